@@ -17,6 +17,8 @@
 #include <iostream>
 #include <limits> // For std::numeric_limits
 
+#include "../../14_Pipeline_Modules/FrameChange.h"
+
 using Microsoft::WRL::ComPtr;
 
 #pragma comment(lib, "mfplat.lib")
@@ -37,6 +39,7 @@ const UINT32 AUDIO_CHANNELS = 2;
 const UINT32 AUDIO_BITS_PER_SAMPLE = 16;
 const UINT32 AUDIO_BLOCK_ALIGNMENT = AUDIO_CHANNELS * (AUDIO_BITS_PER_SAMPLE / 8);
 const UINT32 AUDIO_AVG_BYTES_PER_SECOND = AUDIO_SAMPLE_RATE * AUDIO_BLOCK_ALIGNMENT;
+const LONGLONG MAX_HOLD_TIME = 10'000'000; // Longest one video frame may stand in for unchanged ones
 
 // Global variables
 ComPtr<IMFSinkWriter> pSinkWriter = nullptr;
@@ -74,6 +77,7 @@ HRESULT ConfigureSinkWriter(
 void CaptureFrames();
 void StartRecording();
 HRESULT EnumerateDevices(GUID sourceType, std::vector<DeviceInfo>& devices);
+bool FrameChanged(FrameChangeDetector& detector, ComPtr<IMFSample> pVideoSample);
 void ListDevices(const std::vector<DeviceInfo>& devices);
 ComPtr<IMFMediaSource> SelectDevice(const std::vector<DeviceInfo>& devices);
 void ClearInputBuffer();
@@ -219,11 +223,36 @@ ComPtr<IMFMediaSource> SelectDevice(const std::vector<DeviceInfo>& devices) {
     }
 }
 
-// Capture frames until stopped by Enter key press
+// Compare the luma plane of an NV12 sample with the last kept frame
+bool FrameChanged(FrameChangeDetector& detector, ComPtr<IMFSample> pVideoSample) {
+    ComPtr<IMFMediaBuffer> pBuffer;
+    BYTE* pData = nullptr;
+    DWORD length = 0;
+    if (FAILED(pVideoSample->ConvertToContiguousBuffer(&pBuffer))) return true;
+    if (FAILED(pBuffer->Lock(&pData, NULL, &length))) return true;
+    bool changed = length < FRAME_WIDTH * FRAME_HEIGHT || detector.Changed(pData, FRAME_WIDTH);
+    pBuffer->Unlock();
+    return changed;
+}
+
+// Capture frames until stopped by Enter key press.
+// Unchanged video frames are dropped and their time added to the duration of
+// the frame before them, so static scenes cost the encoder and the file little.
 void CaptureFrames() {
     printf("Capturing frames... Press Enter to stop recording.\n");
     HRESULT hr = S_OK;
     LONGLONG startTime = 0;
+    LONGLONG lastVideoTime = 0;
+
+    FrameChangeDetector changeDetector;
+    changeDetector.Init(FRAME_WIDTH, FRAME_HEIGHT);
+    // Holds one sample from the source reader at a time, so no copy is needed
+    VfrHold<ComPtr<IMFSample>> videoHold(MAX_HOLD_TIME);
+    auto writeVideo = [&](ComPtr<IMFSample>&& pSample, LONGLONG, LONGLONG duration) {
+        pSample->SetSampleDuration(duration);
+        HRESULT writeResult = pSinkWriter->WriteSample(videoStreamIndex, pSample.Get());
+        if (FAILED(writeResult)) PrintErrorMessage("Failed to write video sample.", writeResult);
+    };
 
     auto keyPressThread = std::thread([]() {
         getchar(); // Wait for Enter key press
@@ -257,8 +286,11 @@ void CaptureFrames() {
             LONGLONG llSampleTime = MFGetSystemTime() - startTime;
             pVideoSample->SetSampleTime(llSampleTime);
             pVideoSample->SetSampleDuration(FRAME_DURATION);
-            hr = pSinkWriter->WriteSample(videoStreamIndex, pVideoSample.Get());
-            if (FAILED(hr)) PrintErrorMessage("Failed to write video sample.", hr);
+            lastVideoTime = llSampleTime;
+
+            bool changed = FrameChanged(changeDetector, pVideoSample);
+            if (videoHold.WouldKeep(llSampleTime, changed)) changeDetector.Keep();
+            videoHold.Push(pVideoSample, llSampleTime, changed, writeVideo);
         }
 
         // Capture Audio Sample
@@ -296,7 +328,9 @@ void CaptureFrames() {
     }
 
     if (keyPressThread.joinable()) keyPressThread.join();
+    videoHold.Flush(lastVideoTime + FRAME_DURATION, writeVideo);
     printf("Finished capturing frames.\n");
+    printf("Video frames written: %llu, merged into longer frames: %llu.\n", videoHold.Kept(), videoHold.Merged());
 
     pVideoSourceReader.Reset();
     pAudioSourceReader.Reset();
@@ -17,6 +17,8 @@
 #include <iostream>
 #include <limits> // For std::numeric_limits
 
+#include "../../14_Pipeline_Modules/MotionDetector.h"
+
 using Microsoft::WRL::ComPtr;
 
 #pragma comment(lib, "mfplat.lib")
@@ -37,6 +39,8 @@ const UINT32 AUDIO_CHANNELS = 2;
 const UINT32 AUDIO_BITS_PER_SAMPLE = 16;
 const UINT32 AUDIO_BLOCK_ALIGNMENT = AUDIO_CHANNELS * (AUDIO_BITS_PER_SAMPLE / 8);
 const UINT32 AUDIO_AVG_BYTES_PER_SECOND = AUDIO_SAMPLE_RATE * AUDIO_BLOCK_ALIGNMENT;
+const LONGLONG MOTION_PRE_ROLL = 2 * 10'000'000;                 // Written ahead of each motion event
+const UINT32 MOTION_RELEASE_FRAMES = 3 * FRAME_RATE_NUMERATOR;    // Quiet time before an event ends
 
 // Global variables
 ComPtr<IMFSinkWriter> pSinkWriter = nullptr;
@@ -74,6 +78,8 @@ HRESULT ConfigureSinkWriter(
 void CaptureFrames();
 void StartRecording();
 HRESULT EnumerateDevices(GUID sourceType, std::vector<DeviceInfo>& devices);
+HRESULT CopySample(ComPtr<IMFSample> pSource, ComPtr<IMFSample>& ppCopy);
+MotionResult AnalyzeMotion(MotionDetector& detector, ComPtr<IMFSample> pVideoSample);
 void ListDevices(const std::vector<DeviceInfo>& devices);
 ComPtr<IMFMediaSource> SelectDevice(const std::vector<DeviceInfo>& devices);
 void ClearInputBuffer();
@@ -219,12 +225,84 @@ ComPtr<IMFMediaSource> SelectDevice(const std::vector<DeviceInfo>& devices) {
     }
 }
 
-// Capture frames until stopped by Enter key press
+// Copy a sample into memory we own, so it can be held for pre-roll without
+// keeping the source reader's buffers
+HRESULT CopySample(ComPtr<IMFSample> pSource, ComPtr<IMFSample>& ppCopy) {
+    ComPtr<IMFMediaBuffer> pSourceBuffer;
+    ComPtr<IMFMediaBuffer> pBuffer;
+    DWORD length = 0;
+    HRESULT hr = pSource->ConvertToContiguousBuffer(&pSourceBuffer);
+    if (SUCCEEDED(hr)) hr = pSourceBuffer->GetCurrentLength(&length);
+    if (SUCCEEDED(hr)) hr = MFCreateMemoryBuffer(length, &pBuffer);
+
+    BYTE* pSourceData = nullptr;
+    BYTE* pData = nullptr;
+    if (SUCCEEDED(hr)) hr = pSourceBuffer->Lock(&pSourceData, NULL, NULL);
+    if (SUCCEEDED(hr)) {
+        hr = pBuffer->Lock(&pData, NULL, NULL);
+        if (SUCCEEDED(hr)) {
+            memcpy(pData, pSourceData, length);
+            pBuffer->Unlock();
+        }
+        pSourceBuffer->Unlock();
+    }
+    if (SUCCEEDED(hr)) hr = pBuffer->SetCurrentLength(length);
+
+    LONGLONG sampleTime = 0;
+    LONGLONG sampleDuration = 0;
+    if (SUCCEEDED(hr)) hr = MFCreateSample(&ppCopy);
+    if (SUCCEEDED(hr)) hr = ppCopy->AddBuffer(pBuffer.Get());
+    if (SUCCEEDED(hr) && SUCCEEDED(pSource->GetSampleTime(&sampleTime))) hr = ppCopy->SetSampleTime(sampleTime);
+    if (SUCCEEDED(hr) && SUCCEEDED(pSource->GetSampleDuration(&sampleDuration))) hr = ppCopy->SetSampleDuration(sampleDuration);
+    if (FAILED(hr)) PrintErrorMessage("Failed to copy sample.", hr);
+    return hr;
+}
+
+// Run the motion detector on the luma plane of an NV12 sample
+MotionResult AnalyzeMotion(MotionDetector& detector, ComPtr<IMFSample> pVideoSample) {
+    MotionResult result;
+    result.active = detector.Active();
+    ComPtr<IMFMediaBuffer> pBuffer;
+    BYTE* pData = nullptr;
+    DWORD length = 0;
+    if (FAILED(pVideoSample->ConvertToContiguousBuffer(&pBuffer))) return result;
+    if (FAILED(pBuffer->Lock(&pData, NULL, &length))) return result;
+    if (length >= FRAME_WIDTH * FRAME_HEIGHT) result = detector.Analyze(pData, FRAME_WIDTH);
+    pBuffer->Unlock();
+    return result;
+}
+
+// Capture frames until stopped by Enter key press.
+// Only motion events (plus MOTION_PRE_ROLL before each) reach the sink writer,
+// so the encoder and disk stay idle while nothing is happening.
 void CaptureFrames() {
     printf("Capturing frames... Press Enter to stop recording.\n");
     HRESULT hr = S_OK;
     LONGLONG startTime = 0;
 
+    MotionConfig motionConfig;
+    motionConfig.releaseFrames = MOTION_RELEASE_FRAMES;
+    MotionDetector motionDetector;
+    if (!motionDetector.Init(FRAME_WIDTH, FRAME_HEIGHT, motionConfig)) {
+        printf("Motion detector does not support %ux%u.\n", FRAME_WIDTH, FRAME_HEIGHT);
+        return;
+    }
+    PreRollGate<ComPtr<IMFSample>> videoGate(MOTION_PRE_ROLL);
+    PreRollGate<ComPtr<IMFSample>> audioGate(MOTION_PRE_ROLL);
+    UINT64 framesCaptured = 0;
+    UINT64 framesWritten = 0;
+    UINT32 motionEvents = 0;
+
+    auto writeVideo = [&](ComPtr<IMFSample>&& pSample, LONGLONG) {
+        HRESULT writeResult = pSinkWriter->WriteSample(videoStreamIndex, pSample.Get());
+        if (FAILED(writeResult)) PrintErrorMessage("Failed to write video sample.", writeResult);
+        ++framesWritten;
+    };
+    auto writeAudio = [&](ComPtr<IMFSample>&& pSample, LONGLONG) {
+        HRESULT writeResult = pSinkWriter->WriteSample(audioStreamIndex, pSample.Get());
+        if (FAILED(writeResult)) PrintErrorMessage("Failed to write audio sample.", writeResult);
+    };
+
     auto keyPressThread = std::thread([]() {
         getchar(); // Wait for Enter key press
         isRecording = false;
@@ -257,8 +335,24 @@ void CaptureFrames() {
             LONGLONG llSampleTime = MFGetSystemTime() - startTime;
             pVideoSample->SetSampleTime(llSampleTime);
             pVideoSample->SetSampleDuration(FRAME_DURATION);
-            hr = pSinkWriter->WriteSample(videoStreamIndex, pVideoSample.Get());
-            if (FAILED(hr)) PrintErrorMessage("Failed to write video sample.", hr);
+            ++framesCaptured;
+
+            MotionResult motion = AnalyzeMotion(motionDetector, pVideoSample);
+            if (motion.started) {
+                ++motionEvents;
+                printf("Motion detected at %.1f s, recording.\n", llSampleTime / 10'000'000.0);
+            }
+            if (motion.stopped) {
+                printf("Motion ended at %.1f s, waiting.\n", llSampleTime / 10'000'000.0);
+                // Mark the gap so the writer does not expect samples until the next event
+                pSinkWriter->SendStreamTick(videoStreamIndex, llSampleTime);
+                if (pAudioSourceReader) pSinkWriter->SendStreamTick(audioStreamIndex, llSampleTime);
+            }
+
+            // Held samples must be copies; the source reader recycles its buffers
+            ComPtr<IMFSample> pGateSample = pVideoSample;
+            if (!motion.active && FAILED(CopySample(pVideoSample, pGateSample))) pGateSample.Reset();
+            if (pGateSample) videoGate.Push(pGateSample, llSampleTime, motion.active, writeVideo);
         }
 
         // Capture Audio Sample
@@ -281,8 +375,10 @@ void CaptureFrames() {
             if (pAudioSample) {
                 LONGLONG llAudioSampleTime = MFGetSystemTime() - startTime;
                 pAudioSample->SetSampleTime(llAudioSampleTime);
-                hr = pSinkWriter->WriteSample(audioStreamIndex, pAudioSample.Get());
-                if (FAILED(hr)) PrintErrorMessage("Failed to write audio sample.", hr);
+                const bool active = motionDetector.Active();
+                ComPtr<IMFSample> pGateSample = pAudioSample;
+                if (!active && FAILED(CopySample(pAudioSample, pGateSample))) pGateSample.Reset();
+                if (pGateSample) audioGate.Push(pGateSample, llAudioSampleTime, active, writeAudio);
             }
         }
 
@@ -297,6 +393,7 @@ void CaptureFrames() {
 
     if (keyPressThread.joinable()) keyPressThread.join();
     printf("Finished capturing frames.\n");
+    printf("Motion events: %u, frames written: %llu of %llu captured.\n", motionEvents, framesWritten, framesCaptured);
 
     pVideoSourceReader.Reset();
     pAudioSourceReader.Reset();
@@ -1,4 +1,4 @@
-del VideoCapture.exe output.*
+del VideoCapture.exe output.* output_*
 cl.exe /EHsc /MD /Fe:VideoCapture.exe VideoCapture.cpp /link mfplat.lib mf.lib mfreadwrite.lib mfuuid.lib ole32.lib
 del VideoCapture.obj
 VideoCapture.exe
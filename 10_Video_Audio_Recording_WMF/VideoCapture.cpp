@@ -5,6 +5,8 @@
 #include <mfidl.h>
 #include <mfreadwrite.h>
 #include <mferror.h>
+#include <codecapi.h>
+#include <strmif.h>
 #include <windows.h>
 #include <wrl/client.h>
 #include <comdef.h>
@@ -12,6 +14,8 @@
 #include <thread>
 #include <chrono>
 #include <atomic>
+#include "../14_Pipeline_Modules/SeekIndex.h"
+#include "../14_Pipeline_Modules/Thumbnails.h"
 
 using Microsoft::WRL::ComPtr;
 
@@ -33,6 +37,8 @@ const UINT32 AUDIO_CHANNELS = 2;
 const UINT32 AUDIO_BITS_PER_SAMPLE = 16;
 const UINT32 AUDIO_BLOCK_ALIGNMENT = AUDIO_CHANNELS * (AUDIO_BITS_PER_SAMPLE / 8);
 const UINT32 AUDIO_AVG_BYTES_PER_SECOND = AUDIO_SAMPLE_RATE * AUDIO_BLOCK_ALIGNMENT;
+const UINT32 THUMBNAIL_INTERVAL = FRAME_RATE_NUMERATOR; // One scrubbing thumbnail per second
+const UINT32 KEYFRAME_INTERVAL = 2 * FRAME_RATE_NUMERATOR; // Longest GOP, so a seek decodes at most 2 s
 
 // Global variables
 ComPtr<IMFSinkWriter> pSinkWriter = nullptr;
@@ -43,6 +49,8 @@ ComPtr<IMFMediaSource> pAudioMediaSource = nullptr;
 DWORD videoStreamIndex = 0;
 DWORD audioStreamIndex = 1;
 std::atomic<bool> isRecording(true);
+ThumbnailStage thumbnails; // Sprite sheets and WebVTT/JSON index next to output.mp4
+SeekIndexRecorder seekIndex; // Keyframe index written to output.mp4.seek after Finalize
 
 // Error printing
 void PrintErrorMessage(const char* msg, HRESULT hr) {
@@ -61,6 +69,7 @@ HRESULT ConfigureSinkWriter(
     DWORD& videoStreamIndex, 
     DWORD& audioStreamIndex
 );
+void OfferThumbnail(ComPtr<IMFSample> pVideoSample, LONGLONG sampleTime);
 void CaptureFrames();
 void StartRecording();
 
@@ -135,16 +144,46 @@ HRESULT ConfigureSinkWriter(
         hr = ppSinkWriter->SetInputMediaType(videoStreamIndex, pVideoType.Get(), NULL);
     }
 
+    // Cap the GOP; the encoder's default can leave minutes between keyframes
+    if (SUCCEEDED(hr)) {
+        ComPtr<ICodecAPI> pCodecApi;
+        VARIANT gopSize;
+        VariantInit(&gopSize);
+        gopSize.vt = VT_UI4;
+        gopSize.ulVal = KEYFRAME_INTERVAL;
+        if (FAILED(ppSinkWriter->GetServiceForStream(videoStreamIndex, GUID_NULL, IID_PPV_ARGS(&pCodecApi))) ||
+            FAILED(pCodecApi->SetValue(&CODECAPI_AVEncMPVGOPSize, &gopSize))) {
+            printf("Encoder keeps its own GOP size.\n");
+        }
+    }
+
     if (SUCCEEDED(hr)) hr = ppSinkWriter->BeginWriting();
     if (FAILED(hr)) PrintErrorMessage("Failed to configure sink writer.", hr);
     return hr;
 }
 
+// Hand the frame to the thumbnail stage; it copies 1 in THUMBNAIL_INTERVAL frames and returns at once
+void OfferThumbnail(ComPtr<IMFSample> pVideoSample, LONGLONG sampleTime) {
+    ComPtr<IMFMediaBuffer> pBuffer;
+    BYTE* pData = nullptr;
+    DWORD length = 0;
+    if (FAILED(pVideoSample->ConvertToContiguousBuffer(&pBuffer))) return;
+    if (FAILED(pBuffer->Lock(&pData, NULL, &length))) return;
+    if (length >= Frame420Size(FRAME_WIDTH, FRAME_HEIGHT)) {
+        VideoFrame frame;
+        Describe420Frame(frame, pData, FRAME_WIDTH, FRAME_HEIGHT, PixelFormat::NV12);
+        frame.pts = sampleTime;
+        thumbnails.Offer(frame);
+    }
+    pBuffer->Unlock();
+}
+
 // Capture frames until stopped by Enter key press
 void CaptureFrames() {
     printf("Capturing frames... Press Enter to stop recording.\n");
     HRESULT hr = S_OK;
     LONGLONG startTime = 0;
+    LONGLONG lastVideoTime = 0;
 
     auto keyPressThread = std::thread([]() {
         getchar();
@@ -178,8 +217,11 @@ void CaptureFrames() {
             LONGLONG llSampleTime = MFGetSystemTime() - startTime;
             pVideoSample->SetSampleTime(llSampleTime);
             pVideoSample->SetSampleDuration(FRAME_DURATION);
+            OfferThumbnail(pVideoSample, llSampleTime);
+            lastVideoTime = llSampleTime;
             hr = pSinkWriter->WriteSample(videoStreamIndex, pVideoSample.Get());
             if (FAILED(hr)) PrintErrorMessage("Failed to write video sample.", hr);
+            else seekIndex.AddFrame(llSampleTime);
         }
 
         // Capture Audio Sample
@@ -218,6 +260,9 @@ void CaptureFrames() {
 
     if (keyPressThread.joinable()) keyPressThread.join();
     printf("Finished capturing frames.\n");
+    if (thumbnails.Stop(lastVideoTime + FRAME_DURATION)) {
+        printf("Thumbnails: %llu taken, %llu skipped, %u sprite sheets.\n", thumbnails.Taken(), thumbnails.Skipped(), thumbnails.SheetsWritten());
+    }
 
     pVideoSourceReader.Reset();
     pAudioSourceReader.Reset();
@@ -269,11 +314,16 @@ void StartRecording() {
     }
 
     hr = ConfigureSinkWriter(pSelectedVideoType, pSelectedAudioType, pSinkWriter, videoStreamIndex, audioStreamIndex);
+    ThumbnailConfig thumbnailConfig;
+    thumbnailConfig.frameInterval = THUMBNAIL_INTERVAL;
+    if (!thumbnails.Start("output", FRAME_WIDTH, FRAME_HEIGHT, thumbnailConfig)) printf("Recording without thumbnails.\n");
+    seekIndex.Start();
     CaptureFrames();
 
     if (pSinkWriter) {
         hr = pSinkWriter->Finalize();
         pSinkWriter.Reset();
+        if (SUCCEEDED(hr) && seekIndex.Finish("output.mp4", "output.mp4.seek")) printf("Seek index written to output.mp4.seek.\n");
     }
 }
 
@@ -1,43 +1,16 @@
-#include <windows.h>     // For Windows API
-#include <objbase.h>     // For CoCreateGuid and GUID handling
+#include "../../14_Pipeline_Modules/SessionId.h" // For the per-thread UUID generator
 #include <iostream>      // For standard I/O
 #include <string>        // For string handling
 
+// No COM here: the old CoInitialize/CoCreateGuid/StringFromGUID2/wcstombs round trip
+// per call is replaced by a per-thread generator that formats straight into a buffer.
+// Throws std::runtime_error if the OS cannot seed the generator.
 std::string GenerateGUIDInRegistryFormat() {
-    // Initialize COM library, necessary for using CoCreateGuid on some systems
-    HRESULT hr = CoInitialize(nullptr);
-    if (FAILED(hr)) {
-        throw std::runtime_error("Failed to initialize COM library.");
-    }
-
-    GUID guid;
-    std::string result;
-
-    // Create a new GUID
-    if (CoCreateGuid(&guid) == S_OK) {
-        wchar_t guidString[39]; // GUID length in registry format is 38 characters + null terminator
-
-        // Convert GUID to a wide-character string in registry format
-        if (StringFromGUID2(guid, guidString, 39) > 0) {
-            // Convert the wide string to a narrow string for standard output
-            char narrowString[39];
-            wcstombs(narrowString, guidString, 39);
+    char guidString[UUID_REGISTRY_LENGTH + 1]; // GUID length in registry format is 38 characters + null terminator
 
-            // Store the GUID in registry format
-            result = narrowString;
-        } else {
-            CoUninitialize();
-            throw std::runtime_error("Failed to convert GUID to string format.");
-        }
-    } else {
-        CoUninitialize();
-        throw std::runtime_error("Failed to create GUID.");
-    }
-
-    // Clean up COM library
-    CoUninitialize();
-    
-    return result;
+    // Create a new random (version 4) GUID and store it in registry format
+    FormatRegistry(ThreadIdGenerator().NewV4(), guidString);
+    return std::string(guidString, UUID_REGISTRY_LENGTH);
 }
 
 int main() {
@@ -1,3 +1,3 @@
 del Identifier.exe
-cl /EHsc Identifier.cpp /link ole32.lib
+cl /EHsc Identifier.cpp
 del Identifier.obj
\ No newline at end of file
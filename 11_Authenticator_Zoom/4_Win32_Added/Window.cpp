@@ -1,21 +1,103 @@
 #include <windows.h>
 #include <objbase.h>
+#include <commdlg.h>
 #include <string>
 #include <iostream>
+#include "../../14_Pipeline_Modules/SessionRegistry.h"
+
+// Constants
+const char* REGISTRY_PATH = "sessions"; // sessions.log and sessions.idx in the working directory
+const int64_t FILETIME_UNIX_OFFSET = 116444736000000000LL; // 1601 to 1970 in 100-ns ticks
 
 // Global variables for controls
-HWND hButtonGenerate, hButtonCopy, hText;
+HWND hButtonGenerate, hButtonCopy, hButtonLink, hButtonShow, hText;
+
+// Session registry and the session the buttons act on
+SessionRegistry sessionRegistry;
+Uuid currentSession = {};
+bool haveSession = false;
 
 // Function to generate GUID in registry format
-std::wstring GenerateGUIDInRegistryFormat() {
-    GUID guid;
-    if (CoCreateGuid(&guid) == S_OK) {
-        wchar_t guidString[39];
-        if (StringFromGUID2(guid, guidString, 39) > 0) {
-            return std::wstring(guidString);
-        }
+std::wstring GenerateGUIDInRegistryFormat(Uuid& id) {
+    try {
+        id = ThreadIdGenerator().NewV4();
+    } catch (const std::exception&) {
+        return L"Failed to generate GUID.";
+    }
+    char guidString[UUID_REGISTRY_LENGTH + 1];
+    FormatRegistry(id, guidString);
+    return std::wstring(guidString, guidString + UUID_REGISTRY_LENGTH);
+}
+
+// UTF-16 <-> UTF-8 for the registry, which stores UTF-8
+std::string ToUtf8(const std::wstring& text) {
+    int size = WideCharToMultiByte(CP_UTF8, 0, text.c_str(), static_cast<int>(text.size()), NULL, 0, NULL, NULL);
+    std::string result(size, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, text.c_str(), static_cast<int>(text.size()), &result[0], size, NULL, NULL);
+    return result;
+}
+
+std::wstring FromUtf8(const std::string& text) {
+    int size = MultiByteToWideChar(CP_UTF8, 0, text.c_str(), static_cast<int>(text.size()), NULL, 0);
+    std::wstring result(size, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, text.c_str(), static_cast<int>(text.size()), &result[0], size);
+    return result;
+}
+
+// Registry time (100-ns ticks since 1970) as local "YYYY-MM-DD HH:MM:SS"
+std::wstring FormatLocalTime(int64_t unixTicks) {
+    int64_t fileTicks = unixTicks + FILETIME_UNIX_OFFSET;
+    FILETIME fileTime = { static_cast<DWORD>(fileTicks), static_cast<DWORD>(fileTicks >> 32) };
+    SYSTEMTIME utc, local;
+    wchar_t text[32];
+    if (!FileTimeToSystemTime(&fileTime, &utc) || !SystemTimeToTzSpecificLocalTime(NULL, &utc, &local)) return L"?";
+    swprintf_s(text, L"%04u-%02u-%02u %02u:%02u:%02u", local.wYear, local.wMonth, local.wDay, local.wHour, local.wMinute, local.wSecond);
+    return text;
+}
+
+// Ask for a recording file and link it to the current session, using the file's times as its range
+void LinkRecording(HWND hwnd) {
+    wchar_t path[MAX_PATH] = L"";
+    OPENFILENAME ofn = {};
+    ofn.lStructSize = sizeof(ofn);
+    ofn.hwndOwner = hwnd;
+    ofn.lpstrFilter = L"Recordings\0*.mp4;*.mkv;*.avi;*.wmv;*.raw\0All files\0*.*\0";
+    ofn.lpstrFile = path;
+    ofn.nMaxFile = MAX_PATH;
+    ofn.Flags = OFN_FILEMUSTEXIST | OFN_PATHMUSTEXIST;
+    if (!GetOpenFileName(&ofn)) return;
+
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesEx(path, GetFileExInfoStandard, &attributes)) {
+        MessageBox(hwnd, L"Cannot read the file's times.", L"Error", MB_OK | MB_ICONWARNING);
+        return;
+    }
+    auto toUnixTicks = [](const FILETIME& time) {
+        return ((static_cast<int64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) - FILETIME_UNIX_OFFSET;
+    };
+    int64_t start = toUnixTicks(attributes.ftCreationTime);
+    int64_t end = toUnixTicks(attributes.ftLastWriteTime);
+    if (!sessionRegistry.AddRecording(currentSession, ToUtf8(path), std::string(), start, end > start ? end : start)) {
+        MessageBox(hwnd, L"Failed to write the session registry.", L"Error", MB_OK | MB_ICONWARNING);
     }
-    return L"Failed to generate GUID.";
+}
+
+// List the recordings linked to the current session
+void ShowRecordings(HWND hwnd) {
+    SessionRecord record;
+    if (!sessionRegistry.Lookup(currentSession, record)) {
+        MessageBox(hwnd, L"This session is not in the registry.", L"Error", MB_OK | MB_ICONWARNING);
+        return;
+    }
+    std::wstring text = L"Created " + FormatLocalTime(record.created) + L" on " + FromUtf8(record.label) + L"\n\n";
+    if (record.recordings.empty()) text += L"No recordings linked yet.";
+    for (const RecordingEntry& entry : record.recordings) {
+        text += FromUtf8(entry.path) + L"\n    " + FormatLocalTime(entry.start) + L" to " +
+                (entry.end ? FormatLocalTime(entry.end) : std::wstring(L"(still recording)"));
+        if (!entry.device.empty()) text += L", " + FromUtf8(entry.device);
+        text += L"\n";
+    }
+    MessageBox(hwnd, text.c_str(), L"Session Recordings", MB_OK | MB_ICONINFORMATION);
 }
 
 // Function to copy text to clipboard
@@ -66,13 +148,40 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
                 50, 100, 300, 30,
                 hwnd, NULL, (HINSTANCE) GetWindowLongPtr(hwnd, GWLP_HINSTANCE), NULL
             );
+
+            // Create "Link Recording" button
+            hButtonLink = CreateWindow(
+                L"BUTTON", L"Link Recording",
+                WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON,
+                50, 140, 150, 30,
+                hwnd, (HMENU) 3, (HINSTANCE) GetWindowLongPtr(hwnd, GWLP_HINSTANCE), NULL
+            );
+
+            // Create "Show Recordings" button
+            hButtonShow = CreateWindow(
+                L"BUTTON", L"Show Recordings",
+                WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON,
+                220, 140, 150, 30,
+                hwnd, (HMENU) 4, (HINSTANCE) GetWindowLongPtr(hwnd, GWLP_HINSTANCE), NULL
+            );
+
+            // Open the session registry; a crash last time is recovered here
+            if (!sessionRegistry.Open(REGISTRY_PATH)) {
+                MessageBox(hwnd, L"Failed to open the session registry. Sessions will not be saved.", L"Error", MB_OK | MB_ICONWARNING);
+            }
             break;
         }
 
         case WM_COMMAND: {
             if (LOWORD(wParam) == 1) {  // "CreateSessionID" button click
-                std::wstring guid = GenerateGUIDInRegistryFormat();
+                std::wstring guid = GenerateGUIDInRegistryFormat(currentSession);
                 SetWindowText(hText, guid.c_str());  // Display GUID in the static text control
+
+                // Register the session so recordings can be linked to it
+                char computerName[MAX_COMPUTERNAME_LENGTH + 1];
+                DWORD nameLength = MAX_COMPUTERNAME_LENGTH + 1;
+                if (!GetComputerNameA(computerName, &nameLength)) nameLength = 0;
+                haveSession = sessionRegistry.AddSession(currentSession, UnixTimeTicks(), std::string(computerName, nameLength));
             } else if (LOWORD(wParam) == 2) {  // "Copy UUID" button click
                 wchar_t guidText[39];
                 GetWindowText(hText, guidText, 39);
@@ -83,11 +192,20 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
                 } else {
                     CopyToClipboard(hwnd, guidText);  // Copy text from static control to clipboard
                 }
+            } else if (LOWORD(wParam) == 3 || LOWORD(wParam) == 4) {  // "Link Recording" / "Show Recordings" button click
+                if (!haveSession) {
+                    MessageBox(hwnd, L"No session registered. Please click 'CreateSessionID' first.", L"Error", MB_OK | MB_ICONWARNING);
+                } else if (LOWORD(wParam) == 3) {
+                    LinkRecording(hwnd);
+                } else {
+                    ShowRecordings(hwnd);
+                }
             }
             break;
         }
 
         case WM_DESTROY:
+            sessionRegistry.Close();  // Marks the index clean so the next start does not rebuild it
             PostQuitMessage(0);
             return 0;
 
@@ -116,7 +234,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     HWND hwnd = CreateWindowEx(
         0, CLASS_NAME, L"GUID Generator",
         WS_OVERLAPPEDWINDOW,
-        CW_USEDEFAULT, CW_USEDEFAULT, 400, 200,
+        CW_USEDEFAULT, CW_USEDEFAULT, 420, 240,
         NULL, NULL, hInstance, NULL
     );
 
@@ -1,6 +1,9 @@
 // VideoCapture.cpp
 #define NOMINMAX // Prevents min and max macros from being defined
 
+#ifdef HAVE_SRT
+#include <winsock2.h> // libsrt needs it ahead of windows.h, which would bring in the old winsock.h
+#endif
 #include <mfapi.h>
 #include <mfidl.h>
 #include <mfreadwrite.h>
@@ -17,6 +20,22 @@
 #include <iostream>
 #include <limits> // For std::numeric_limits
 
+#include "../14_Pipeline_Modules/AudioResampler.h"
+#include "../14_Pipeline_Modules/AvSync.h"
+#include "../14_Pipeline_Modules/CropScale.h"
+#include "../14_Pipeline_Modules/FrameQueue.h"
+#include "../14_Pipeline_Modules/KeyframeControl.h"
+#include "../14_Pipeline_Modules/LatencyStamp.h"
+#include "../14_Pipeline_Modules/NamedPipe.h"
+#include "../14_Pipeline_Modules/OutputSupervisor.h"
+#include "../14_Pipeline_Modules/RateController.h"
+#include "../14_Pipeline_Modules/RingBuffer.h"
+#include "../14_Pipeline_Modules/SrtOutput.h"
+#include "../14_Pipeline_Modules/StreamFanout.h"
+#include "../14_Pipeline_Modules/ThreadPolicy.h"
+#include "../14_Pipeline_Modules/TsChunker.h"
+#include "../14_Pipeline_Modules/VideoEncoder.h"
+
 using Microsoft::WRL::ComPtr;
 
 #pragma comment(lib, "mfplat.lib")
@@ -26,17 +45,50 @@ using Microsoft::WRL::ComPtr;
 #pragma comment(lib, "ole32.lib")
 
 // Constants
-const UINT32 FRAME_WIDTH = 640; // Reduced resolution to 640x360 (360p)
-const UINT32 FRAME_HEIGHT = 360;
+const UINT32 FRAME_WIDTH = 1280; // Captured at 720p so a zoomed-in region still has detail
+const UINT32 FRAME_HEIGHT = 720;
+const UINT32 OUTPUT_WIDTH = 640; // Streamed at 640x360 (360p): the region of interest, scaled
+const UINT32 OUTPUT_HEIGHT = 360;
+const LONGLONG ZOOM_DURATION = 7'500'000; // Time a zoom or pan takes to reach its target
 const UINT32 FRAME_RATE_NUMERATOR = 24; // Reduced frame rate to 24 FPS
 const UINT32 FRAME_RATE_DENOMINATOR = 1;
 const UINT64 FRAME_DURATION = 10'000'000 / FRAME_RATE_NUMERATOR;
-const UINT32 VIDEO_BITRATE = 1000000; // Lower video bitrate to 1000 kbps
+const UINT32 VIDEO_BITRATE = 1000000; // Lower video bitrate to 1000 kbps; the top of the rate ladder
 const UINT32 AUDIO_SAMPLE_RATE = 48000;
 const UINT32 AUDIO_CHANNELS = 2;
 const UINT32 AUDIO_BITS_PER_SAMPLE = 16;
 const UINT32 AUDIO_BLOCK_ALIGNMENT = AUDIO_CHANNELS * (AUDIO_BITS_PER_SAMPLE / 8);
 const UINT32 AUDIO_AVG_BYTES_PER_SECOND = AUDIO_SAMPLE_RATE * AUDIO_BLOCK_ALIGNMENT;
+const UINT32 STREAM_AUDIO_SAMPLE_RATE = 44100; // Converted in-process; ffmpeg receives it ready to encode
+const UINT32 STREAM_AUDIO_BYTES_PER_FRAME = AUDIO_CHANNELS * sizeof(int16_t);
+const UINT32 AUDIO_CONVERT_BLOCK = 1024; // Frames per converter call
+const char* AUDIO_PIPE_NAME = "webcam_livestream_audio";
+const char* RATE_LOG_PATH = "stream_rate.log"; // Every rate decision, one line per second
+const size_t STREAM_QUEUE_FRAMES = 12; // Half a second at 24 fps between capture and ffmpeg
+const DropPolicy STREAM_DROP_POLICY = DropPolicy::DropOldest; // Raw frames stand alone: keep the freshest
+const char* DROP_LOG_PATH = "stream_drops.log"; // Every frame the queue dropped, with its time
+const LONGLONG BACKLOG_DURATION = 5 * 10'000'000; // Stream kept while ffmpeg is restarted after a failure
+const size_t BACKLOG_VIDEO_BYTES = 48 * 1024 * 1024; // Memory cap; 5 s of 640x360 NV12 is about 41 MB
+const size_t BACKLOG_AUDIO_BYTES = 2 * 1024 * 1024; // 5 s of stream PCM is under 1 MB
+const size_t AUDIO_BACKLOG_CHUNK = AUDIO_CONVERT_BLOCK * STREAM_AUDIO_BYTES_PER_FRAME; // 23 ms: how closely a restart lines audio up
+const char* OUTPUT_LOG_PATH = "stream_output.log"; // Every encoder and destination failure and restart
+const char* STREAM_PIPE_NAME = "webcam_livestream_ts"; // ffmpeg's encoded output, read back for the destinations
+const size_t STREAM_READ_BYTES = 64 * 1024;
+const double STREAM_GOP_SECONDS = 2.0; // Longest GOP to start with; "gop <seconds>" changes it
+const double KEYFRAME_SPACING_SECONDS = 0.5; // Asked-for keyframes (the "keyframe" command, a destination connecting) at least this far apart
+const bool STREAM_INTRA_REFRESH = false; // A sweep of intra blocks in place of periodic IDRs: even frame sizes, no IDR bursts on the uplink
+const double INTRA_REFRESH_SECONDS = 1.0; // One sweep; a viewer joining mid-stream has a clean picture after it
+const uint32_t INTRA_REFRESH_BUFFER_MS = 200; // VBV with intra refresh, capped at the stream bitrate; nothing to save up for an IDR
+const char* THREAD_POLICY_PATH = "thread_policy.txt"; // This deployment's priorities and CPUs by thread role (see ThreadPolicy.h); without it, the defaults
+const bool STAMP_LATENCY = false; // Measurement mode: capture time drawn into each frame for a local receiver (GlassToGlassBench --receive)
+
+// Rate ladder, highest first: the stream starts at the top and steps down while the uplink backs up
+const std::vector<RateRung> STREAM_LADDER = {
+    { VIDEO_BITRATE, OUTPUT_WIDTH, OUTPUT_HEIGHT, FRAME_RATE_NUMERATOR },
+    { 700000, OUTPUT_WIDTH, OUTPUT_HEIGHT, FRAME_RATE_NUMERATOR },
+    { 450000, 480, 270, FRAME_RATE_NUMERATOR },
+    { 250000, 384, 216, 15 },
+};
 
 // Global variables
 ComPtr<IMFSourceReader> pVideoSourceReader = nullptr;
@@ -47,10 +99,112 @@ DWORD videoStreamIndex = 0;
 DWORD audioStreamIndex = 1;
 std::atomic<bool> isRecording(true);
 
+// Video and audio reach ffmpeg over separate pipes with no timestamps, so both
+// capture threads stamp against one clock and the aligners keep frame and
+// sample counts on that timeline
+MediaClock mediaClock;
+NamedPipeWriter audioPipe;
+SpscRingBuffer audioRing(STREAM_AUDIO_SAMPLE_RATE * STREAM_AUDIO_BYTES_PER_FRAME); // About a second of PCM
+std::atomic<bool> audioCaptureDone(false);
+std::atomic<bool> audioPipeReopen(false); // The pipe writer lets go of ffmpeg so it can be restarted
+
+// The key thread sets zoom targets; the capture loop crops and scales to them
+RoiController roiController;
+Nv12CropScaler cropScaler;
+
+// The capture thread queues scaled frames and never waits on ffmpeg; the video
+// pipe thread writes them and restarts ffmpeg when the controller picks another
+// rung. The controller follows the first destination's output (see streamFanout).
+BoundedFrameQueue frameQueue;
+RateController rateController;
+OutputMeter outputMeter;
+std::atomic<uint32_t> streamRung(0); // Ladder index the capture thread scales to
+FILE* rateLog = nullptr;
+FILE* dropLog = nullptr;
+
+// The encoder ffmpeg can still fail. Everything on its way to ffmpeg passes
+// through a backlog; after a failure the video pipe thread restarts ffmpeg with
+// backoff and the backlogs catch the new one up from where the old one stopped
+ReconnectSupervisor outputSupervisor;
+CatchUpBuffer videoBacklog; // Video pipe thread
+CatchUpBuffer audioBacklog; // Audio pipe thread while it runs, the video pipe thread in between
+uint64_t audioBytesTaken = 0; // Stream PCM taken from audioRing so far; owned with audioBacklog
+std::atomic<bool> audioPipeFailed(false);
+bool streamAudio = false; // Captured audio goes to ffmpeg over audioPipe
+FILE* outputLog = nullptr;
+
+// ffmpeg encodes once and writes MPEG-TS to streamPipe. The stream read thread
+// cuts it at keyframes, and the fan-out sends it to every destination. Each
+// destination has its own thread, queue and reconnect state, so one that is
+// slow or down holds up only itself.
+NamedPipeReader streamPipe;
+TsChunker tsChunker;
+StreamFanout streamFanout;
+std::thread streamReadThread;
+bool lowLatencyStream = false; // An SRT destination: the encoder holds no frames back
+
+// Keyframes: every interval, plus on request from the key thread and when a
+// destination connects. With HAVE_LIBAVCODEC (avcodec.lib, avutil.lib, libx264
+// built in) the video pipe thread encodes in-process and forces each keyframe;
+// ffmpeg then only muxes. Without it ffmpeg's own x264 takes the interval as a
+// fixed GOP at its next start, and requests go unanswered.
+KeyframeController keyframeControl;
+std::atomic<double> streamGopSeconds(STREAM_GOP_SECONDS);
+#ifdef HAVE_LIBAVCODEC
+LibavH264Encoder videoEncoder;
+#endif
+
+// Each thread takes its role's priority, CPUs and name; its CPU time and
+// preemptions are printed when the stream ends
+ThreadPolicyTable threadPolicies;
+ThreadUsageLog threadUsage;
+
 FILE* ffmpegProcess = nullptr;
 const std::string STREAM_KEY = "q0vs-qzck-wdvv-s16x-6m5j";
 const std::string STREAM_URL = "rtmp://a.rtmp.youtube.com/live2";
 
+// Where the stream goes. An rtmp:// target goes through an ffmpeg relay. An
+// srt://host:port?latency=<ms>&oheadbw=<percent> target goes over SRT: through
+// libsrt when built with HAVE_SRT (srt.lib), else through an ffmpeg relay.
+// Anything else is a file. Rate control follows the first one.
+struct StreamDestination {
+    std::string name;
+    std::string target;
+};
+const std::vector<StreamDestination> STREAM_DESTINATIONS = {
+    { "youtube", STREAM_URL + "/" + STREAM_KEY },
+    { "archive", "stream_archive.ts" },
+};
+
+// Sends the stream on through an ffmpeg that only remuxes it (to FLV for RTMP)
+class RelaySink : public StreamSink {
+public:
+    RelaySink(const std::string& relayUrl, const std::string& relayFormat) : url(relayUrl), format(relayFormat) {}
+    ~RelaySink() override { Close(); }
+
+    bool Open() override {
+        Close();
+        const std::string command = "ffmpeg -loglevel error -f mpegts -i - -c copy -f " + format + " \"" + url + "\"";
+        relay = _popen(command.c_str(), "wb");
+        return relay != nullptr;
+    }
+
+    // Fails once the relay has exited (the connection dropped)
+    bool Write(const uint8_t* data, size_t bytes) override {
+        return relay && fwrite(data, 1, bytes, relay) == bytes && fflush(relay) == 0;
+    }
+
+    void Close() override {
+        if (relay) _pclose(relay);
+        relay = nullptr;
+    }
+
+private:
+    std::string url;
+    std::string format;
+    FILE* relay = nullptr;
+};
+
 // Device Info structure for selection
 struct DeviceInfo {
     ComPtr<IMFActivate> device;
@@ -66,14 +220,26 @@ void PrintErrorMessage(const char* msg, HRESULT hr) {
 // Function declarations
 HRESULT InitializeMediaFoundation();
 HRESULT ConfigureConservativeMediaType(ComPtr<IMFSourceReader> pSourceReader, ComPtr<IMFMediaType>& ppSelectedType);
+HRESULT ConfigureAudioMediaType(ComPtr<IMFSourceReader> pAudioSourceReader, ComPtr<IMFMediaType>& ppSelectedAudioType);
+void CaptureAudio();
+bool BufferAudio(std::vector<BYTE>& chunk);
+void WriteAudioPipe();
+void ReadStreamPipe();
+std::unique_ptr<StreamSink> CreateStreamSink(const StreamDestination& destination);
+void WriteVideoPipe(std::thread* audioPipeThread);
 void CaptureFrames();
 void StartRecording();
 HRESULT EnumerateDevices(GUID sourceType, std::vector<DeviceInfo>& devices);
 void ListDevices(const std::vector<DeviceInfo>& devices);
 ComPtr<IMFMediaSource> SelectDevice(const std::vector<DeviceInfo>& devices);
 void ClearInputBuffer();
-void StartFFmpegProcess();
+GopPolicy StreamGopPolicy(const RateRung& rung);
+bool WriteVideoFrame(const BYTE* data, size_t bytes, const RateRung& rung);
+void StartFFmpegProcess(const RateRung& rung);
 void StopFFmpegProcess();
+void StartStreamOutput(const RateRung& rung, std::thread& audioPipeThread, VideoCadenceAligner& videoAligner);
+void StopStreamOutput(std::thread& audioPipeThread);
+void SwitchStreamRung(const RateRung& rung, std::thread& audioPipeThread, VideoCadenceAligner& videoAligner);
 
 // Initialize Media Foundation
 HRESULT InitializeMediaFoundation() {
@@ -98,45 +264,498 @@ HRESULT ConfigureConservativeMediaType(ComPtr<IMFSourceReader> pSourceReader, Co
     return hr;
 }
 
-// Start FFmpeg process
-void StartFFmpegProcess() {
-    std::string command = "ffmpeg -y -f rawvideo -pix_fmt nv12 -s 640x360 -r 24 -i - "
-                          "-f lavfi -i anullsrc=channel_layout=stereo:sample_rate=48000 "
-                          "-c:v libx264 -pix_fmt yuv420p -preset faster -g 48 -b:v 1000k -bufsize 5000k "
-                          "-c:a aac -b:a 128k -ar 44100 -f flv -loglevel debug " + STREAM_URL + "/" + STREAM_KEY;
+// Configure audio media type
+HRESULT ConfigureAudioMediaType(ComPtr<IMFSourceReader> pAudioSourceReader, ComPtr<IMFMediaType>& ppSelectedAudioType) {
+    HRESULT hr = MFCreateMediaType(&ppSelectedAudioType);
+    if (SUCCEEDED(hr)) hr = ppSelectedAudioType->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Audio);
+    if (SUCCEEDED(hr)) hr = ppSelectedAudioType->SetGUID(MF_MT_SUBTYPE, MFAudioFormat_PCM);
+    if (SUCCEEDED(hr)) hr = ppSelectedAudioType->SetUINT32(MF_MT_AUDIO_NUM_CHANNELS, AUDIO_CHANNELS);
+    if (SUCCEEDED(hr)) hr = ppSelectedAudioType->SetUINT32(MF_MT_AUDIO_SAMPLES_PER_SECOND, AUDIO_SAMPLE_RATE);
+    if (SUCCEEDED(hr)) hr = ppSelectedAudioType->SetUINT32(MF_MT_AUDIO_BITS_PER_SAMPLE, AUDIO_BITS_PER_SAMPLE);
+    if (SUCCEEDED(hr)) hr = ppSelectedAudioType->SetUINT32(MF_MT_AUDIO_BLOCK_ALIGNMENT, AUDIO_BLOCK_ALIGNMENT);
+    if (SUCCEEDED(hr)) hr = ppSelectedAudioType->SetUINT32(MF_MT_AUDIO_AVG_BYTES_PER_SECOND, AUDIO_AVG_BYTES_PER_SECOND);
+    if (SUCCEEDED(hr)) hr = pAudioSourceReader->SetCurrentMediaType(MF_SOURCE_READER_FIRST_AUDIO_STREAM, NULL, ppSelectedAudioType.Get());
+    if (FAILED(hr)) PrintErrorMessage("Failed to configure audio media type.", hr);
+    return hr;
+}
+
+// Audio capture thread: convert to the stream format, align to the shared clock, hand off to the ring.
+// Never waits on ffmpeg; if the pipe writer falls behind, the ring drops and counts the overflow.
+void CaptureAudio() {
+    ScopedThreadPolicy threadPolicy(ThreadRole::Audio, threadPolicies, "audio capture", &threadUsage);
+    // The device may not honour the requested type exactly; convert from whatever it delivers
+    UINT32 deviceRate = AUDIO_SAMPLE_RATE, deviceChannels = AUDIO_CHANNELS, deviceBits = AUDIO_BITS_PER_SAMPLE;
+    GUID deviceSubtype = MFAudioFormat_PCM;
+    ComPtr<IMFMediaType> pCurrentType;
+    if (SUCCEEDED(pAudioSourceReader->GetCurrentMediaType(MF_SOURCE_READER_FIRST_AUDIO_STREAM, &pCurrentType))) {
+        pCurrentType->GetUINT32(MF_MT_AUDIO_SAMPLES_PER_SECOND, &deviceRate);
+        pCurrentType->GetUINT32(MF_MT_AUDIO_NUM_CHANNELS, &deviceChannels);
+        pCurrentType->GetUINT32(MF_MT_AUDIO_BITS_PER_SAMPLE, &deviceBits);
+        pCurrentType->GetGUID(MF_MT_SUBTYPE, &deviceSubtype);
+    }
+    const SampleFormat deviceFormat = deviceSubtype == MFAudioFormat_Float ? SampleFormat::F32 : SampleFormat::S16;
+    const UINT32 deviceBytesPerFrame = deviceChannels * (deviceFormat == SampleFormat::F32 ? 4 : 2);
+
+    AudioConverter converter;
+    if (deviceBits != (deviceFormat == SampleFormat::F32 ? 32u : 16u) ||
+        !converter.Init(deviceRate, deviceChannels, deviceFormat, STREAM_AUDIO_SAMPLE_RATE, AUDIO_CHANNELS,
+                        SampleFormat::S16, AUDIO_CONVERT_BLOCK)) {
+        printf("Unsupported audio capture format (%u Hz, %u channels, %u bits).\n", deviceRate, deviceChannels, deviceBits);
+        audioCaptureDone = true;
+        return;
+    }
+    // Resampler output lags its input by the filter's group delay
+    const int64_t resamplerDelay = deviceRate == STREAM_AUDIO_SAMPLE_RATE ? 0 :
+        static_cast<int64_t>(converter.Resampler().Latency() * TICKS_PER_SECOND / deviceRate);
+    printf("Audio: %u Hz x %u -> %u Hz x %u s16 (resampler delay %.2f ms)\n", deviceRate, deviceChannels,
+           STREAM_AUDIO_SAMPLE_RATE, AUDIO_CHANNELS, resamplerDelay / 10000.0);
+
+    std::vector<int16_t> converted(converter.MaxOutputFrames(AUDIO_CONVERT_BLOCK) * AUDIO_CHANNELS);
+    std::vector<int16_t> silence(STREAM_AUDIO_SAMPLE_RATE * AUDIO_CHANNELS, 0);
+    AudioTimelineAligner aligner;
+    aligner.Init(STREAM_AUDIO_SAMPLE_RATE);
+
+    while (isRecording) {
+        ComPtr<IMFSample> pAudioSample;
+        DWORD audioStreamFlags = 0;
+        HRESULT hr = pAudioSourceReader->ReadSample(MF_SOURCE_READER_FIRST_AUDIO_STREAM, 0, NULL, &audioStreamFlags, NULL, &pAudioSample);
+        if (FAILED(hr)) {
+            PrintErrorMessage("Failed to read audio sample.", hr);
+            break;
+        }
+        if (!pAudioSample || !mediaClock.Started()) continue;
+        const int64_t arrival = mediaClock.Now();
+
+        ComPtr<IMFMediaBuffer> pBuffer;
+        pAudioSample->ConvertToContiguousBuffer(&pBuffer);
+        BYTE* pData = nullptr;
+        DWORD maxLength = 0, currentLength = 0;
+        pBuffer->Lock(&pData, &maxLength, &currentLength);
+
+        // The block was captured over the time leading up to its arrival
+        const UINT32 deviceFrames = currentLength / deviceBytesPerFrame;
+        int64_t blockPts = arrival - static_cast<int64_t>(deviceFrames) * TICKS_PER_SECOND / deviceRate - resamplerDelay;
+        for (UINT32 done = 0; done < deviceFrames;) {
+            const UINT32 frames = std::min(deviceFrames - done, AUDIO_CONVERT_BLOCK);
+            const size_t produced = converter.Convert(pData + done * deviceBytesPerFrame, frames, converted.data());
+            const AudioCorrection correction = aligner.Align(blockPts < 0 ? 0 : blockPts, static_cast<uint32_t>(produced));
+            if (correction.silenceFrames) {
+                audioRing.WriteTimeline(silence.data(), correction.silenceFrames * STREAM_AUDIO_BYTES_PER_FRAME);
+            }
+            audioRing.WriteTimeline(converted.data() + correction.dropFrames * AUDIO_CHANNELS,
+                            (produced - correction.dropFrames) * STREAM_AUDIO_BYTES_PER_FRAME);
+            blockPts += static_cast<int64_t>(frames) * TICKS_PER_SECOND / deviceRate;
+            done += frames;
+        }
+        pBuffer->Unlock();
+    }
+
+    printf("Audio sync: %.1f ms silence inserted, %.1f ms dropped, worst offset %.1f ms, ring overflow %llu bytes\n",
+           aligner.SilenceInserted() * 1000.0 / STREAM_AUDIO_SAMPLE_RATE, aligner.FramesDropped() * 1000.0 / STREAM_AUDIO_SAMPLE_RATE,
+           aligner.MaxOffsetTicks() / 10000.0, static_cast<unsigned long long>(audioRing.OverflowBytes()));
+    audioCaptureDone = true;
+}
+
+// Move stream PCM from the ring to the audio backlog; false if the ring was empty
+bool BufferAudio(std::vector<BYTE>& chunk) {
+    const size_t length = audioRing.Read(chunk.data(), chunk.size());
+    if (length == 0) return false;
+    // The capture thread keeps the samples on the shared clock's timeline and the ring pays back
+    // what it overflowed as silence, so the count of bytes taken is the pts
+    const uint64_t frames = audioBytesTaken / STREAM_AUDIO_BYTES_PER_FRAME;
+    audioBacklog.Push(static_cast<int64_t>(frames * TICKS_PER_SECOND / STREAM_AUDIO_SAMPLE_RATE), true, chunk.data(), length);
+    audioBytesTaken += length;
+    return true;
+}
+
+// Pipe writer thread: the only thread that blocks on ffmpeg reading the audio input.
+// Runs until capture ends, ffmpeg goes away, or a restart asks it to let go of this ffmpeg.
+// After a restart it first writes the backlog kept while ffmpeg was down.
+void WriteAudioPipe() {
+    ScopedThreadPolicy threadPolicy(ThreadRole::Io, threadPolicies, "audio pipe", &threadUsage);
+    std::vector<BYTE> chunk(AUDIO_BACKLOG_CHUNK);
+    if (!audioPipe.Connect()) return;
+    while (!audioPipeReopen) {
+        const bool done = audioCaptureDone;
+        if (!BufferAudio(chunk) && audioBacklog.Pending() == 0) {
+            if (done) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            continue;
+        }
+        const BacklogChunk* pending = audioBacklog.Next();
+        if (!pending) continue;
+        if (!audioPipe.Write(pending->data.data(), pending->bytes)) {
+            printf("FFmpeg closed the audio pipe.\n");
+            audioPipeFailed = true;
+            break;
+        }
+        audioBacklog.Sent();
+        audioBacklog.Acknowledged(audioBacklog.SentBytes());
+    }
+    audioPipe.Close();
+}
+
+// Stream read thread: takes ffmpeg's encoded output and hands it to every destination, until ffmpeg exits
+void ReadStreamPipe() {
+    ScopedThreadPolicy threadPolicy(ThreadRole::Io, threadPolicies, "stream read", &threadUsage);
+    std::vector<uint8_t> buffer(STREAM_READ_BYTES);
+    if (!streamPipe.Connect()) return;
+    const TsChunkSink publish = [](const uint8_t* data, size_t bytes, bool keyframe) { streamFanout.Publish(data, bytes, keyframe); };
+    size_t length;
+    while ((length = streamPipe.Read(buffer.data(), buffer.size())) > 0) {
+        tsChunker.Push(buffer.data(), length, publish);
+    }
+}
+
+// The sink for a destination's target
+std::unique_ptr<StreamSink> CreateStreamSink(const StreamDestination& destination) {
+    SrtConfig srt;
+    if (ParseSrtUrl(destination.target, srt)) {
+#ifdef HAVE_SRT
+        return std::unique_ptr<StreamSink>(new SrtSink(srt, outputLog, destination.name));
+#else
+        return std::unique_ptr<StreamSink>(new RelaySink(FfmpegSrtUrl(srt), "mpegts"));
+#endif
+    }
+    if (destination.target.compare(0, 7, "rtmp://") == 0) {
+        return std::unique_ptr<StreamSink>(new RelaySink(destination.target, "flv"));
+    }
+    return std::unique_ptr<StreamSink>(new FileSink(destination.target));
+}
+
+// The keyframe policy in frames at a rung's frame rate
+GopPolicy StreamGopPolicy(const RateRung& rung) {
+    GopPolicy policy;
+    policy.maxFrames = STREAM_INTRA_REFRESH ? 0 : static_cast<uint32_t>(streamGopSeconds * rung.fps + 0.5); // The sweep stands in for the interval
+    policy.minFrames = static_cast<uint32_t>(KEYFRAME_SPACING_SECONDS * rung.fps + 0.5);
+    return policy;
+}
+
+// One frame to ffmpeg's video input: coded here when the encoder is in-process, else raw
+bool WriteVideoFrame(const BYTE* data, size_t bytes, const RateRung& rung) {
+#ifdef HAVE_LIBAVCODEC
+    VideoFrame frame;
+    Describe420Frame(frame, data, rung.width, rung.height, PixelFormat::NV12);
+    const bool idr = keyframeControl.NextFrame() != KeyframeReason::None;
+    bool written = true;
+    const bool encoded = videoEncoder.Encode(frame, idr, [&](const EncodedVideoPacket& packet) {
+        written = written && fwrite(packet.data, 1, packet.size, ffmpegProcess) == packet.size;
+        if (packet.keyframe) keyframeControl.KeyframeSent(); // Answers only requests stamped before NextFrame chose it
+    });
+    return encoded && written && fflush(ffmpegProcess) == 0;
+#else
+    (void)rung;
+    return fwrite(data, 1, bytes, ffmpegProcess) == bytes && fflush(ffmpegProcess) == 0;
+#endif
+}
+
+// Let go of the pipes a failed StartFFmpegProcess created
+void AbandonFFmpegStart() {
+    streamPipe.Close();
+    audioPipe.Close();
+}
+
+// Start FFmpeg process at one rung of the rate ladder
+void StartFFmpegProcess(const RateRung& rung) {
+    if (!streamPipe.Create(STREAM_PIPE_NAME)) return;
+    // Captured audio goes over a named pipe as the second input; without a device, stream silence
+    std::string audioInput = "-f lavfi -i anullsrc=channel_layout=stereo:sample_rate=44100 ";
+    if (pAudioSourceReader && audioPipe.Create(AUDIO_PIPE_NAME)) {
+        audioInput = "-f s16le -ar " + std::to_string(STREAM_AUDIO_SAMPLE_RATE) + " -ac " + std::to_string(AUDIO_CHANNELS) +
+                     " -i " + audioPipe.Path() + " ";
+    }
+    const std::string muxOptions = lowLatencyStream ? "-muxdelay 0 -muxpreload 0 " : "";
+    keyframeControl.SetPolicy(StreamGopPolicy(rung));
+#ifdef HAVE_LIBAVCODEC
+    // Encoded here; ffmpeg muxes the H.264 as it comes, timed by frame count like the raw video was
+    VideoEncoderConfig encoderConfig;
+    encoderConfig.width = rung.width;
+    encoderConfig.height = rung.height;
+    encoderConfig.fps = rung.fps;
+    encoderConfig.bitrate = rung.bitrate;
+    encoderConfig.zeroLatency = lowLatencyStream; // No lookahead or B-frames: each frame goes out as soon as it is encoded
+    if (STREAM_INTRA_REFRESH) {
+        encoderConfig.intraRefreshFrames = static_cast<uint32_t>(INTRA_REFRESH_SECONDS * rung.fps + 0.5);
+        encoderConfig.maxBitrate = rung.bitrate;
+        encoderConfig.bufferMs = INTRA_REFRESH_BUFFER_MS;
+    }
+    if (!videoEncoder.Open(encoderConfig)) {
+        AbandonFFmpegStart();
+        return;
+    }
+    keyframeControl.Restart();
+    const std::string videoInput = "-f h264 -framerate " + std::to_string(rung.fps) + " -analyzeduration 0 -i - ";
+    const std::string videoOutput = "-c:v copy ";
+#else
+    const std::string kbps = std::to_string(rung.bitrate / 1000);
+    // Low latency: no lookahead or B-frames, so each frame is written out as soon as it is encoded
+    const std::string latencyOptions = lowLatencyStream ? "-tune zerolatency " : "";
+    // A fixed GOP; keyframes only on request need the in-process encoder, so "gop 0" gets 10 s here
+    const GopPolicy gop = keyframeControl.Policy();
+    uint32_t gopFrames = gop.maxFrames ? gop.maxFrames : 10 * rung.fps;
+    uint32_t bufferMs = 5000;
+    std::string refreshOptions;
+    if (STREAM_INTRA_REFRESH) {
+        // -g is the sweep's period here
+        gopFrames = static_cast<uint32_t>(INTRA_REFRESH_SECONDS * rung.fps + 0.5);
+        bufferMs = INTRA_REFRESH_BUFFER_MS;
+        refreshOptions = "-intra-refresh 1 -maxrate " + kbps + "k ";
+    }
+    const std::string videoInput = "-f rawvideo -pix_fmt nv12 -s " + std::to_string(rung.width) + "x" + std::to_string(rung.height) +
+                                   " -r " + std::to_string(rung.fps) + " -i - ";
+    const std::string videoOutput = "-c:v libx264 -pix_fmt yuv420p -preset faster " + latencyOptions + refreshOptions +
+                                    "-g " + std::to_string(gopFrames) + " -b:v " + kbps + "k" +
+                                    " -bufsize " + std::to_string(static_cast<uint64_t>(rung.bitrate) * bufferMs / 1000 / 1000) + "k ";
+#endif
+    std::string command = "ffmpeg -y " + videoInput + audioInput + videoOutput +
+                          "-c:a aac -b:a 128k -f mpegts -flush_packets 1 " + muxOptions + "-loglevel debug " + streamPipe.Path();
 
     ffmpegProcess = _popen(command.c_str(), "wb");
     if (!ffmpegProcess) {
         std::cerr << "Failed to start FFmpeg process.\n";
+#ifdef HAVE_LIBAVCODEC
+        videoEncoder.Close();
+#endif
+        AbandonFFmpegStart();
+        return;
     }
+    // Each ffmpeg writes a stream of its own: the destinations start it on a new connection
+    tsChunker.Reset();
+    streamFanout.Restart();
+    streamReadThread = std::thread(ReadStreamPipe);
 }
 
 // Stop FFmpeg process
 void StopFFmpegProcess() {
     if (ffmpegProcess) {
+#ifdef HAVE_LIBAVCODEC
+        // Frames the encoder still holds go out before ffmpeg's input closes
+        videoEncoder.Flush([](const EncodedVideoPacket& packet) { fwrite(packet.data, 1, packet.size, ffmpegProcess); });
+        videoEncoder.Close();
+#endif
         _pclose(ffmpegProcess);
         ffmpegProcess = nullptr;
     }
+    // ffmpeg has exited, so its output has ended; release the reader if ffmpeg never opened it
+    streamPipe.CancelConnect();
+    if (streamReadThread.joinable()) streamReadThread.join();
+    streamPipe.Close();
+}
+
+// Start ffmpeg and feed it from the backlogs. Both streams resume at the later of
+// their first buffered pts, so audio and video stay in sync to within an audio chunk.
+void StartStreamOutput(const RateRung& rung, std::thread& audioPipeThread, VideoCadenceAligner& videoAligner) {
+    int64_t origin = videoBacklog.Empty() ? mediaClock.Now() : videoBacklog.FrontPts();
+    if (streamAudio && !audioBacklog.Empty()) origin = std::max(origin, audioBacklog.FrontPts());
+    videoBacklog.DropBefore(origin);
+    audioBacklog.DropBefore(origin);
+    videoAligner.Restart(rung.fps, 1, origin);
+
+    StartFFmpegProcess(rung);
+    audioPipeReopen = false;
+    audioPipeFailed = false;
+    if (streamAudio && ffmpegProcess && audioPipe.Path().size()) audioPipeThread = std::thread(WriteAudioPipe);
+    outputMeter.Reset(NowTicks());
+    rateController.Resume(NowTicks());
+}
+
+// Let go of ffmpeg: stop the audio pipe writer, then close ffmpeg's input
+void StopStreamOutput(std::thread& audioPipeThread) {
+    if (audioPipeThread.joinable()) {
+        audioPipeReopen = true;
+        audioPipe.CancelConnect();
+        audioPipeThread.join();
+    }
+    StopFFmpegProcess();
+}
+
+// Move the stream to another rung. A running ffmpeg cannot change its encoder's
+// bitrate or its raw input's size, so it is restarted; the stream has a short gap.
+void SwitchStreamRung(const RateRung& rung, std::thread& audioPipeThread, VideoCadenceAligner& videoAligner) {
+    printf("Stream rate: switching to %ux%u at %u fps, %u kbps (restarting ffmpeg).\n", rung.width, rung.height, rung.fps,
+           rung.bitrate / 1000);
+    StopStreamOutput(audioPipeThread);
+
+    // The new ffmpeg's audio and video both start now: drop what was queued for the old one
+    std::vector<BYTE> discard(AUDIO_BACKLOG_CHUNK);
+    while (BufferAudio(discard)) {}
+    audioBacklog.Clear();
+    videoBacklog.Clear();
+    StartStreamOutput(rung, audioPipeThread, videoAligner);
+}
+
+// Video pipe thread: the only thread that blocks on ffmpeg reading the video input.
+// Writes queued frames on ffmpeg's frame-count timeline, steps the rate ladder, and
+// restarts ffmpeg when it goes away.
+void WriteVideoPipe(std::thread* audioPipeThread) {
+    ScopedThreadPolicy threadPolicy(ThreadRole::Encode, threadPolicies, "video pipe", &threadUsage); // Encodes too, in-process
+    VideoCadenceAligner videoAligner;
+    videoAligner.Init(FRAME_RATE_NUMERATOR, FRAME_RATE_DENOMINATOR);
+    std::vector<BYTE> previousFrame;
+    std::vector<BYTE> audioChunk(AUDIO_BACKLOG_CHUNK);
+    QueuedFrame queued;
+    while (frameQueue.Pop(queued)) {
+        // Frames scaled before a rung switch no longer fit ffmpeg's input
+        const RateRung& rung = rateController.Current();
+        if (queued.bytes == Frame420Size(rung.width, rung.height)) {
+            videoBacklog.Push(queued.pts, true, frameQueue.Data(queued), queued.bytes); // Raw frames stand alone
+        }
+        frameQueue.Release(queued);
+        frameQueue.LogDrops(dropLog);
+
+        if (!outputSupervisor.Up()) {
+            // The audio pipe writer is stopped too: keep its stream until ffmpeg is back
+            if (streamAudio) {
+                while (BufferAudio(audioChunk)) {}
+            }
+            if (!outputSupervisor.AttemptDue(NowTicks())) continue;
+            StartStreamOutput(rung, *audioPipeThread, videoAligner);
+            if (!ffmpegProcess) {
+                outputSupervisor.Failed(NowTicks(), "ffmpeg did not start");
+                continue;
+            }
+            outputSupervisor.Connected(NowTicks());
+            previousFrame.clear();
+        }
+
+        // Write what ffmpeg has not had yet; after a restart that is the backlog, as fast as ffmpeg
+        // takes it. ffmpeg times video by frame count, so fill gaps (queue drops included) with
+        // the previous frame and drop frames that arrive ahead of their slot.
+        bool pipeClosed = false;
+        while (const BacklogChunk* frame = videoBacklog.Next()) {
+            const VideoCorrection correction = videoAligner.Align(frame->pts);
+            if (!correction.dropFrame) {
+                const UINT32 repeats = previousFrame.size() == frame->bytes ? correction.repeatPrevious : 0;
+                bool written = true;
+                for (UINT32 i = 0; i < repeats && written; ++i) {
+                    written = WriteVideoFrame(previousFrame.data(), previousFrame.size(), rung);
+                }
+                if (!written || !WriteVideoFrame(frame->data.data(), frame->bytes, rung)) {
+                    pipeClosed = true;
+                    break;
+                }
+                previousFrame.assign(frame->data.begin(), frame->data.end());
+            }
+            videoBacklog.Sent();
+            if (frameQueue.Depth() > 0) break; // Take in the new frame; the rest follows on the next pass
+        }
+        videoBacklog.Acknowledged(videoBacklog.SentBytes());
+        if (pipeClosed || audioPipeFailed) {
+            StopStreamOutput(*audioPipeThread);
+            videoBacklog.Rewind();
+            audioBacklog.Rewind();
+            outputSupervisor.Failed(NowTicks(), pipeClosed ? "video pipe closed" : "audio pipe closed");
+            continue;
+        }
+
+        // Once a second: step the rate ladder on how the first destination keeps up with the stream
+        const int64_t now = NowTicks();
+        if (rateController.Due(now)) {
+            const RateDecision decision = rateController.Update(now, outputMeter.Take(now));
+            if (decision.action != RateAction::Hold) {
+                SwitchStreamRung(rateController.Current(), *audioPipeThread, videoAligner);
+                streamRung = rateController.CurrentIndex();
+                previousFrame.clear();
+                if (!ffmpegProcess) outputSupervisor.Failed(NowTicks(), "ffmpeg did not restart");
+            }
+        }
+    }
+    frameQueue.LogDrops(dropLog);
+    printf("Finished streaming frames (%llu repeated, %llu dropped to hold the frame rate).\n",
+           static_cast<unsigned long long>(videoAligner.Repeated()), static_cast<unsigned long long>(videoAligner.Dropped()));
 }
 
 // Capture frames until stopped by Enter key press
 void CaptureFrames() {
     printf("Capturing frames... Press Enter to stop recording.\n");
+    printf("Type \"zoom <factor> [centerX centerY]\" to zoom, centre from 0 to 1 (zoom 1 shows the whole frame).\n");
+    printf("Type \"keyframe\" for a keyframe now, \"gop <seconds>\" to set the longest GOP (0: keyframes only when asked for).\n");
     HRESULT hr = S_OK;
     LONGLONG startTime = 0;
 
+    roiController.Init(FRAME_WIDTH, FRAME_HEIGHT, OUTPUT_WIDTH, OUTPUT_HEIGHT);
+    cropScaler.Init(FRAME_WIDTH, FRAME_HEIGHT, OUTPUT_WIDTH, OUTPUT_HEIGHT);
+    LoadThreadPolicies(THREAD_POLICY_PATH, threadPolicies);
+
     auto keyPressThread = std::thread([]() {
-        getchar(); // Wait for Enter key press
+        ScopedThreadPolicy threadPolicy(ThreadRole::Telemetry, threadPolicies, "keys", &threadUsage);
+        std::string line;
+        while (std::getline(std::cin, line) && !line.empty()) { // An empty line (Enter) stops
+            double zoom = 1.0, centerX = 0.5, centerY = 0.5, gop = 0.0;
+            if (sscanf(line.c_str(), "zoom %lf %lf %lf", &zoom, &centerX, &centerY) >= 1) {
+                roiController.ZoomTo(zoom, centerX, centerY, ZOOM_DURATION);
+                printf("Zooming to %.1fx at (%.2f, %.2f).\n", zoom, centerX, centerY);
+            } else if (line == "keyframe") {
+                keyframeControl.RequestKeyframe(KeyframeReason::Request);
+#ifndef HAVE_LIBAVCODEC
+                printf("Keyframes on request need the in-process encoder (HAVE_LIBAVCODEC).\n");
+#endif
+            } else if (sscanf(line.c_str(), "gop %lf", &gop) == 1 && gop >= 0) {
+                streamGopSeconds = gop;
+                keyframeControl.SetPolicy(StreamGopPolicy(STREAM_LADDER[streamRung]));
+                printf("Longest GOP %.1f s%s.\n", gop, gop > 0 ? "" : " (keyframes only when asked for)");
+#ifndef HAVE_LIBAVCODEC
+                printf("ffmpeg takes it at its next restart.\n");
+#endif
+            } else {
+                printf("Unknown command: %s\n", line.c_str());
+            }
+        }
         isRecording = false;
     });
 
-    StartFFmpegProcess();  // Start FFmpeg process for streaming
+    rateLog = fopen(RATE_LOG_PATH, "w");
+    dropLog = fopen(DROP_LOG_PATH, "w");
+    outputLog = fopen(OUTPUT_LOG_PATH, "w");
+    FanoutConfig destinationConfig;
+    destinationConfig.backlogTicks = BACKLOG_DURATION;
+    if (!STREAM_INTRA_REFRESH) {
+        destinationConfig.connected = [] { keyframeControl.RequestKeyframe(KeyframeReason::Subscriber); }; // Starts it off on a picture
+    } // With intra refresh a new destination has a clean picture within one sweep, without an IDR burst
+    tsChunker.Init(destinationConfig.maxChunkBytes);
+    lowLatencyStream = false;
+    for (size_t i = 0; i < STREAM_DESTINATIONS.size(); ++i) {
+        const StreamDestination& destination = STREAM_DESTINATIONS[i];
+        if (destination.target.compare(0, 6, "srt://") == 0) lowLatencyStream = true;
+        streamFanout.Add(destination.name, CreateStreamSink(destination), destinationConfig, outputLog,
+                         i == 0 ? &outputMeter : nullptr);
+    }
+    streamFanout.Start();
+    rateController.Init(STREAM_LADDER, NowTicks(), 0, RateControlConfig(), rateLog);
+    streamRung = 0;
+    keyframeControl.Reset(StreamGopPolicy(rateController.Current()));
+    outputMeter.Reset(NowTicks());
+    // The top rung is the largest frame; every slot can hold any rung's frame
+    if (!frameQueue.Init(STREAM_QUEUE_FRAMES, Frame420Size(OUTPUT_WIDTH, OUTPUT_HEIGHT), STREAM_DROP_POLICY)) {
+        printf("Failed to allocate the stream frame queue.\n");
+    } else {
+        StartFFmpegProcess(rateController.Current());  // Start FFmpeg process for streaming
+    }
+    const bool streaming = ffmpegProcess != nullptr;
+    streamAudio = streaming && audioPipe.Path().size();
+    videoBacklog.Init(BACKLOG_DURATION, BACKLOG_VIDEO_BYTES);
+    audioBacklog.Init(BACKLOG_DURATION, BACKLOG_AUDIO_BYTES);
+    audioBytesTaken = 0;
+    audioPipeFailed = false;
+    outputSupervisor.Init(NowTicks(), ReconnectConfig(), outputLog, "encoder");
+    if (streaming) outputSupervisor.Connected(NowTicks());
+
+    std::thread audioCaptureThread, audioPipeThread, videoPipeThread;
+    if (streamAudio) {
+        audioCaptureThread = std::thread(CaptureAudio);
+        audioPipeThread = std::thread(WriteAudioPipe);
+    }
+    if (streaming) videoPipeThread = std::thread(WriteVideoPipe, &audioPipeThread);
 
+    // This loop must come back for each frame before the device overwrites it
+    ScopedThreadPolicy capturePolicy(ThreadRole::Capture, threadPolicies, "capture", &threadUsage);
+    if (!capturePolicy.Refused().empty()) printf("Capture thread policy refused: %s.\n", capturePolicy.Refused().c_str());
     while (isRecording) {
         auto frameStart = std::chrono::steady_clock::now();
 
         if (startTime == 0) {
             startTime = MFGetSystemTime();
+            mediaClock.Start();
         }
 
         // Capture Video Sample
@@ -156,16 +775,30 @@ void CaptureFrames() {
         }
 
         if (pVideoSample) {
+            const int64_t framePts = mediaClock.Now();
             ComPtr<IMFMediaBuffer> pBuffer;
             pVideoSample->ConvertToContiguousBuffer(&pBuffer);
             BYTE* pData = nullptr;
             DWORD maxLength = 0, currentLength = 0;
             pBuffer->Lock(&pData, &maxLength, &currentLength);
 
-            // Write the video data to FFmpeg
-            if (ffmpegProcess) {
-                fwrite(pData, 1, currentLength, ffmpegProcess);
-                fflush(ffmpegProcess);
+            // After a rung switch, scale to the size the new ffmpeg expects
+            const RateRung& rung = STREAM_LADDER[streamRung];
+            if (rung.width != cropScaler.OutputWidth() || rung.height != cropScaler.OutputHeight()) {
+                cropScaler.Init(FRAME_WIDTH, FRAME_HEIGHT, rung.width, rung.height);
+            }
+
+            if (streaming && currentLength >= Frame420Size(FRAME_WIDTH, FRAME_HEIGHT)) {
+                // Only the region of interest goes to the encoder, at the output size. Never waits
+                // on ffmpeg: when the video pipe thread is behind, the queue's drop policy decides.
+                uint8_t* slot = frameQueue.Begin(framePts, true); // Raw frames stand alone
+                if (slot) {
+                    VideoFrame frame;
+                    Describe420Frame(frame, pData, FRAME_WIDTH, FRAME_HEIGHT, PixelFormat::NV12);
+                    cropScaler.Scale(frame, roiController.Current(framePts), slot);
+                    if (STAMP_LATENCY) WriteLatencyStamp(slot, rung.width, rung.height, rung.width, LatencyStampMicros());
+                    frameQueue.Commit(cropScaler.OutputSize());
+                }
             }
 
             pBuffer->Unlock();
@@ -180,10 +813,39 @@ void CaptureFrames() {
         }
     }
 
+    capturePolicy.Finish();
     if (keyPressThread.joinable()) keyPressThread.join();
-    printf("Finished capturing frames.\n");
+    frameQueue.Close();
+    if (videoPipeThread.joinable()) videoPipeThread.join(); // Writes out what is still queued
+    printf("Finished capturing frames (%llu queued; %s queue dropped %llu: %llu evicted, %llu refused, %llu with a reference; high water %zu).\n",
+           static_cast<unsigned long long>(frameQueue.Committed()), DropPolicyName(STREAM_DROP_POLICY),
+           static_cast<unsigned long long>(frameQueue.Dropped()), static_cast<unsigned long long>(frameQueue.Evicted()),
+           static_cast<unsigned long long>(frameQueue.Refused()), static_cast<unsigned long long>(frameQueue.Dependent()),
+           frameQueue.HighWater());
+
+    if (audioCaptureThread.joinable()) audioCaptureThread.join();
+    audioPipe.CancelConnect(); // In case ffmpeg never opened its audio input
+    if (audioPipeThread.joinable()) audioPipeThread.join();
 
     StopFFmpegProcess();  // Stop FFmpeg process after recording
+    streamFanout.Stop(); // The destinations send what they still have queued
+    printf("Stream rate: %u steps down, %u up (%u failed probes); decisions in %s.\n", rateController.Downs(), rateController.Ups(),
+           rateController.FailedProbes(), RATE_LOG_PATH);
+    printf("Stream encoder: %u failures, %u restarts (%u failed attempts), %.1f s down; %llu frames trimmed from the backlog; events in %s.\n",
+           outputSupervisor.Losses(), outputSupervisor.Reconnects(), outputSupervisor.FailedAttempts(),
+           static_cast<double>(outputSupervisor.DownTicks(NowTicks())) / TICKS_PER_SECOND,
+           static_cast<unsigned long long>(videoBacklog.Dropped()), OUTPUT_LOG_PATH);
+#ifdef HAVE_LIBAVCODEC
+    keyframeControl.PrintStats(stdout, "Stream keyframes:");
+#endif
+    printf("Stream destinations:\n");
+    streamFanout.PrintStats(stdout);
+    printf("Threads:\n");
+    threadUsage.Print(stdout);
+    if (rateLog) fclose(rateLog);
+    if (dropLog) fclose(dropLog);
+    if (outputLog) fclose(outputLog);
+    rateLog = dropLog = outputLog = nullptr;
 
     pVideoSourceReader.Reset();
     pAudioSourceReader.Reset();
@@ -281,6 +943,26 @@ void StartRecording() {
     ComPtr<IMFMediaType> pSelectedVideoType;
     hr = ConfigureConservativeMediaType(pVideoSourceReader, pSelectedVideoType);
 
+    // Enumerate and select audio device
+    std::vector<DeviceInfo> audioDevices;
+    hr = EnumerateDevices(MF_DEVSOURCE_ATTRIBUTE_SOURCE_TYPE_AUDCAP_GUID, audioDevices);
+    if (FAILED(hr) || audioDevices.empty()) {
+        printf("No audio capture devices found. Streaming silence.\n");
+    } else {
+        printf("Available Audio Devices:\n");
+        ListDevices(audioDevices);
+        pAudioMediaSource = SelectDevice(audioDevices);
+        if (pAudioMediaSource) {
+            hr = MFCreateSourceReaderFromMediaSource(pAudioMediaSource.Get(), NULL, &pAudioSourceReader);
+            if (FAILED(hr)) {
+                PrintErrorMessage("Failed to create audio source reader.", hr);
+            } else {
+                ComPtr<IMFMediaType> pSelectedAudioType;
+                if (FAILED(ConfigureAudioMediaType(pAudioSourceReader, pSelectedAudioType))) pAudioSourceReader.Reset();
+            }
+        }
+    }
+
     CaptureFrames();
 }
 
@@ -0,0 +1,355 @@
+// AudioEncoder.h
+// In-process audio encoding with control over bitrate and profile, which the
+// sink writer's built-in AAC encoder and the ffmpeg command line do not give
+// the capture path.
+//   AudioEncoder         - interface: fixed-size interleaved s16 frames in, packets out
+//   LibavAacEncoder      - AAC through libavcodec (libfdk_aac when built in,
+//                          else the native encoder); needs HAVE_LIBAVCODEC
+//   AudioEncodeWorker    - pulls PCM from an SpscRingBuffer, cuts it into codec
+//                          frames and encodes them on its own thread
+//   WriteAdtsHeader      - 7-byte ADTS header for raw AAC access units
+// Packet timestamps come from the count of samples submitted, not from a
+// clock, so they are exact: packet n of an LC stream starts at n * 1024 minus
+// the encoder's priming delay.
+#pragma once
+
+#include "MediaTypes.h"
+#include "RingBuffer.h"
+#include "Stats.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef HAVE_LIBAVCODEC
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/error.h>
+}
+#endif
+
+enum class AacProfile {
+    LC,  // AAC-LC: 1024-sample frames, what every player handles
+    HE,  // HE-AAC (SBR): needs libfdk_aac
+    HEv2 // HE-AAC v2 (SBR + parametric stereo): needs libfdk_aac, stereo input
+};
+
+struct AudioEncoderConfig {
+    uint32_t sampleRate = 48000;
+    uint32_t channels = 2;
+    uint32_t bitrate = 128000; // Bits per second
+    AacProfile profile = AacProfile::LC;
+    bool adts = true; // Prefix each packet with an ADTS header (for .aac files and MPEG-TS)
+};
+
+// One encoded access unit. data is only valid during the sink callback.
+struct EncodedAudioPacket {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    int64_t samplePts = 0; // In samples at the input rate; negative for priming output
+    uint32_t frames = 0;   // Samples per channel this packet decodes to
+    int64_t pts = 0;       // samplePts in 100-ns ticks
+};
+
+typedef std::function<void(const EncodedAudioPacket&)> AudioPacketSink;
+
+// Sampling frequency index used by ADTS and AudioSpecificConfig; -1 if not a standard rate
+inline int AacSampleRateIndex(uint32_t rate) {
+    static const uint32_t rates[] = { 96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350 };
+    for (int i = 0; i < 13; ++i) {
+        if (rates[i] == rate) return i;
+    }
+    return -1;
+}
+
+// Write a 7-byte ADTS header (no CRC) for a payload of payloadBytes.
+// HE profiles signal SBR implicitly: the header carries the LC core at half the rate.
+inline bool WriteAdtsHeader(uint8_t* out, AacProfile profile, uint32_t sampleRate, uint32_t channels, size_t payloadBytes) {
+    const uint32_t coreRate = profile == AacProfile::LC ? sampleRate : sampleRate / 2;
+    const uint32_t coreChannels = profile == AacProfile::HEv2 ? 1 : channels;
+    const int rateIndex = AacSampleRateIndex(coreRate);
+    const size_t frameLength = payloadBytes + 7;
+    if (rateIndex < 0 || coreChannels > 7 || frameLength > 0x1FFF) return false;
+    const uint32_t objectType = 2; // AAC LC
+    out[0] = 0xFF;
+    out[1] = 0xF1; // MPEG-4, layer 0, no CRC
+    out[2] = static_cast<uint8_t>(((objectType - 1) << 6) | (rateIndex << 2) | (coreChannels >> 2));
+    out[3] = static_cast<uint8_t>(((coreChannels & 3) << 6) | (frameLength >> 11));
+    out[4] = static_cast<uint8_t>((frameLength >> 3) & 0xFF);
+    out[5] = static_cast<uint8_t>(((frameLength & 7) << 5) | 0x1F); // Buffer fullness 0x7FF: VBR
+    out[6] = 0xFC;
+    return true;
+}
+
+class AudioEncoder {
+public:
+    virtual ~AudioEncoder() = default;
+    virtual bool Open(const AudioEncoderConfig& config) = 0;
+    // Samples per channel in every frame but the last
+    virtual uint32_t FrameSize() const = 0;
+    // Samples the decoder must discard at the start (priming)
+    virtual uint32_t Delay() const = 0;
+    // Encode frames samples (== FrameSize() except at end of stream) starting at sample firstSample
+    virtual bool Encode(const int16_t* pcm, uint32_t frames, int64_t firstSample, const AudioPacketSink& sink) = 0;
+    // Drain delayed output at end of stream
+    virtual bool Flush(const AudioPacketSink& sink) = 0;
+    virtual void Close() = 0;
+    virtual const char* Name() const = 0;
+    // AudioSpecificConfig for containers that carry it out of band (MP4, FLV)
+    virtual const std::vector<uint8_t>& CodecConfig() const = 0;
+};
+
+#ifdef HAVE_LIBAVCODEC
+
+class LibavAacEncoder : public AudioEncoder {
+public:
+    ~LibavAacEncoder() override { Close(); }
+
+    bool Open(const AudioEncoderConfig& encoderConfig) override {
+        Close();
+        config = encoderConfig;
+        // libfdk_aac sounds better at low bitrates and is the only one with HE profiles
+        const AVCodec* codec = avcodec_find_encoder_by_name("libfdk_aac");
+        if (!codec && config.profile == AacProfile::LC) codec = avcodec_find_encoder(AV_CODEC_ID_AAC);
+        if (!codec) {
+            printf("No AAC encoder in this libavcodec supports the requested profile.\n");
+            return false;
+        }
+        context = avcodec_alloc_context3(codec);
+        if (!context) return false;
+
+        // Pick the encoder's input layout: the native encoder takes planar float, fdk takes s16
+        planarFloat = true;
+        for (const AVSampleFormat* format = codec->sample_fmts; format && *format != AV_SAMPLE_FMT_NONE; ++format) {
+            if (*format == AV_SAMPLE_FMT_S16) planarFloat = false;
+        }
+        context->sample_fmt = planarFloat ? AV_SAMPLE_FMT_FLTP : AV_SAMPLE_FMT_S16;
+        context->sample_rate = static_cast<int>(config.sampleRate);
+        context->bit_rate = config.bitrate;
+        context->time_base = AVRational{ 1, static_cast<int>(config.sampleRate) };
+        av_channel_layout_default(&context->ch_layout, static_cast<int>(config.channels));
+        context->profile = config.profile == AacProfile::HEv2 ? ProfileId(29) : config.profile == AacProfile::HE ? ProfileId(5) : ProfileId(2);
+        // Raw access units plus out-of-band config; ADTS is added here, not by the codec
+        context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+        int result = avcodec_open2(context, codec, nullptr);
+        if (result < 0) {
+            PrintAvError("Failed to open AAC encoder", result);
+            Close();
+            return false;
+        }
+        codecConfig.assign(context->extradata, context->extradata + context->extradata_size);
+
+        frame = av_frame_alloc();
+        packet = av_packet_alloc();
+        frame->format = context->sample_fmt;
+        frame->sample_rate = context->sample_rate;
+        frame->nb_samples = context->frame_size;
+        av_channel_layout_copy(&frame->ch_layout, &context->ch_layout);
+        result = av_frame_get_buffer(frame, 0);
+        if (result < 0) {
+            PrintAvError("Failed to allocate AAC input frame", result);
+            Close();
+            return false;
+        }
+        name = std::string(codec->name) + (config.profile == AacProfile::LC ? " (LC)" : config.profile == AacProfile::HE ? " (HE)" : " (HEv2)");
+        return true;
+    }
+
+    uint32_t FrameSize() const override { return context ? static_cast<uint32_t>(context->frame_size) : 0; }
+    uint32_t Delay() const override { return context ? static_cast<uint32_t>(context->initial_padding) : 0; }
+
+    bool Encode(const int16_t* pcm, uint32_t frames, int64_t firstSample, const AudioPacketSink& sink) override {
+        if (!context || frames == 0 || frames > FrameSize()) return false;
+        if (av_frame_make_writable(frame) < 0) return false;
+        frame->nb_samples = static_cast<int>(frames);
+        frame->pts = firstSample;
+        const uint32_t channels = config.channels;
+        if (planarFloat) {
+            for (uint32_t c = 0; c < channels; ++c) {
+                float* plane = reinterpret_cast<float*>(frame->data[c]);
+                for (uint32_t i = 0; i < frames; ++i) plane[i] = pcm[i * channels + c] * (1.0f / 32768.0f);
+            }
+        } else {
+            memcpy(frame->data[0], pcm, frames * channels * sizeof(int16_t));
+        }
+        int result = avcodec_send_frame(context, frame);
+        if (result < 0) {
+            PrintAvError("AAC encode failed", result);
+            return false;
+        }
+        return Drain(sink);
+    }
+
+    bool Flush(const AudioPacketSink& sink) override {
+        if (!context) return false;
+        avcodec_send_frame(context, nullptr);
+        return Drain(sink);
+    }
+
+    void Close() override {
+        if (packet) av_packet_free(&packet);
+        if (frame) av_frame_free(&frame);
+        if (context) avcodec_free_context(&context);
+        codecConfig.clear();
+    }
+
+    const char* Name() const override { return name.c_str(); }
+    const std::vector<uint8_t>& CodecConfig() const override { return codecConfig; }
+
+private:
+    // Profile ids moved from FF_PROFILE_* to AV_PROFILE_* in FFmpeg 6.1; the values did not change
+    static int ProfileId(int audioObjectType) { return audioObjectType - 1; }
+
+    static void PrintAvError(const char* message, int error) {
+        char text[AV_ERROR_MAX_STRING_SIZE] = {};
+        av_strerror(error, text, sizeof(text));
+        printf("%s: %s\n", message, text);
+    }
+
+    bool Drain(const AudioPacketSink& sink) {
+        for (;;) {
+            int result = avcodec_receive_packet(context, packet);
+            if (result == AVERROR(EAGAIN) || result == AVERROR_EOF) return true;
+            if (result < 0) {
+                PrintAvError("AAC encode failed", result);
+                return false;
+            }
+            EncodedAudioPacket out;
+            out.samplePts = packet->pts;
+            out.frames = packet->duration > 0 ? static_cast<uint32_t>(packet->duration) : FrameSize();
+            out.pts = packet->pts * TICKS_PER_SECOND / config.sampleRate;
+            if (config.adts) {
+                adtsPacket.resize(packet->size + 7);
+                WriteAdtsHeader(adtsPacket.data(), config.profile, config.sampleRate, config.channels, packet->size);
+                memcpy(adtsPacket.data() + 7, packet->data, packet->size);
+                out.data = adtsPacket.data();
+                out.size = adtsPacket.size();
+            } else {
+                out.data = packet->data;
+                out.size = packet->size;
+            }
+            sink(out);
+            av_packet_unref(packet);
+        }
+    }
+
+    AudioEncoderConfig config;
+    AVCodecContext* context = nullptr;
+    AVFrame* frame = nullptr;
+    AVPacket* packet = nullptr;
+    bool planarFloat = true;
+    std::vector<uint8_t> codecConfig;
+    std::vector<uint8_t> adtsPacket;
+    std::string name;
+};
+
+#endif // HAVE_LIBAVCODEC
+
+// Encode thread fed from a PCM ring. Each wake-up submits every complete frame
+// waiting in the ring back to back, so the thread wakes once per poll interval
+// rather than once per frame.
+class AudioEncodeWorker {
+public:
+    ~AudioEncodeWorker() { Stop(); }
+
+    // ring carries interleaved s16 at the encoder's rate and channel count
+    bool Start(AudioEncoder& audioEncoder, SpscRingBuffer& pcmRing, uint32_t channelCount, AudioPacketSink packetSink,
+               uint32_t pollIntervalMs = 10) {
+        if (running) return false;
+        encoder = &audioEncoder;
+        ring = &pcmRing;
+        channels = channelCount;
+        sink = std::move(packetSink);
+        pollMs = pollIntervalMs;
+        frameSamples = encoder->FrameSize();
+        if (frameSamples == 0 || channels == 0) return false;
+        frameBuffer.assign(static_cast<size_t>(frameSamples) * channels, 0);
+        nextSample = 0;
+        framesEncoded = 0;
+        packets = 0;
+        bytesOut = 0;
+        failed = false;
+        stopRequested = false;
+        running = true;
+        thread = std::thread(&AudioEncodeWorker::Run, this);
+        return true;
+    }
+
+    // Encode what is left in the ring (a short last frame included), flush, and join
+    void Stop() {
+        if (!running) return;
+        stopRequested = true;
+        thread.join();
+        running = false;
+    }
+
+    bool Failed() const { return failed; }
+    int64_t SamplesEncoded() const { return nextSample; }
+    uint64_t FramesEncoded() const { return framesEncoded; }
+    uint64_t Packets() const { return packets; }
+    uint64_t BytesOut() const { return bytesOut; }
+    const LatencyHistogram& BatchLatency() const { return batchLatency; }
+
+private:
+    void Run() {
+        const size_t frameBytes = frameBuffer.size() * sizeof(int16_t);
+        const AudioPacketSink counted = [this](const EncodedAudioPacket& packet) {
+            ++packets;
+            bytesOut += packet.size;
+            sink(packet);
+        };
+        for (;;) {
+            const bool stopping = stopRequested.load();
+            const int64_t batchStart = NowTicks();
+            uint32_t batch = 0;
+            while (!failed && ring->Readable() >= frameBytes) {
+                ring->Read(frameBuffer.data(), frameBytes);
+                EncodeOne(frameSamples, counted);
+                ++batch;
+            }
+            if (batch) batchLatency.Record(static_cast<uint64_t>((NowTicks() - batchStart) / 10));
+            if (stopping || failed) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(pollMs));
+        }
+        if (!failed) {
+            // Partial last frame, whole samples only
+            const size_t tail = ring->Read(frameBuffer.data(), frameBytes) / (channels * sizeof(int16_t));
+            if (tail) EncodeOne(static_cast<uint32_t>(tail), counted);
+            if (!encoder->Flush(counted)) failed = true;
+        }
+    }
+
+    void EncodeOne(uint32_t samples, const AudioPacketSink& counted) {
+        if (!encoder->Encode(frameBuffer.data(), samples, nextSample, counted)) {
+            failed = true;
+            return;
+        }
+        nextSample += samples;
+        ++framesEncoded;
+    }
+
+    AudioEncoder* encoder = nullptr;
+    SpscRingBuffer* ring = nullptr;
+    AudioPacketSink sink;
+    uint32_t channels = 0;
+    uint32_t frameSamples = 0;
+    uint32_t pollMs = 10;
+    std::vector<int16_t> frameBuffer;
+    std::thread thread;
+    bool running = false;
+    std::atomic<bool> stopRequested{ false };
+    std::atomic<bool> failed{ false };
+    int64_t nextSample = 0;
+    uint64_t framesEncoded = 0;
+    uint64_t packets = 0;
+    uint64_t bytesOut = 0;
+    LatencyHistogram batchLatency;
+};
@@ -0,0 +1,231 @@
+// AudioEncoderBench.cpp
+// Checks and measures the in-process audio encoder path.
+//   1. ADTS headers: fields written by WriteAdtsHeader parse back correctly.
+//   2. Framing: PCM pushed into a ring in 10 ms capture blocks comes out of
+//      AudioEncodeWorker as whole codec frames with contiguous, sample-exact
+//      timestamps, including the short last frame.
+//   3. Throughput (needs libavcodec): AAC encode speed per profile and bitrate,
+//      called directly and through the worker, as multiples of real time.
+// Without libavcodec, 1 and 2 run against a pass-through stand-in encoder.
+// Usage: ./Run.sh AudioEncoderBench [seconds]
+#include "AudioEncoder.h"
+#include "MediaTypes.h"
+#include "RingBuffer.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+// Constants
+const uint32_t SAMPLE_RATE = 48000;
+const uint32_t CHANNELS = 2;
+const uint32_t CAPTURE_BLOCK = 480; // 10 ms, what the capture thread pushes
+const double PI = 3.14159265358979323846;
+
+// Stand-in with the shape of an AAC encoder: 1024-sample frames, one frame of
+// priming delay, output one frame behind input
+class PassthroughEncoder : public AudioEncoder {
+public:
+    bool Open(const AudioEncoderConfig& encoderConfig) override {
+        config = encoderConfig;
+        held.clear();
+        heldFrames = FrameSize(); // The priming frame
+        emitted = -static_cast<int64_t>(Delay());
+        return true;
+    }
+    uint32_t FrameSize() const override { return 1024; }
+    uint32_t Delay() const override { return 1024; }
+    bool Encode(const int16_t* pcm, uint32_t frames, int64_t, const AudioPacketSink& sink) override {
+        Emit(sink);
+        held.assign(reinterpret_cast<const uint8_t*>(pcm), reinterpret_cast<const uint8_t*>(pcm + frames * config.channels));
+        heldFrames = frames;
+        return true;
+    }
+    bool Flush(const AudioPacketSink& sink) override {
+        Emit(sink);
+        return true;
+    }
+    void Close() override {}
+    const char* Name() const override { return "pass-through"; }
+    const std::vector<uint8_t>& CodecConfig() const override { return codecConfig; }
+
+private:
+    void Emit(const AudioPacketSink& sink) {
+        if (heldFrames == 0) return;
+        EncodedAudioPacket packet;
+        packet.data = held.data();
+        packet.size = held.size();
+        packet.samplePts = emitted;
+        packet.frames = heldFrames;
+        packet.pts = emitted * TICKS_PER_SECOND / config.sampleRate;
+        sink(packet);
+        emitted += heldFrames;
+        heldFrames = 0;
+    }
+
+    AudioEncoderConfig config;
+    std::vector<uint8_t> held, codecConfig;
+    uint32_t heldFrames = 0;
+    int64_t emitted = 0;
+};
+
+// Music-like test signal: a few partials with slow amplitude movement
+std::vector<int16_t> MakeSignal(uint32_t rate, double seconds) {
+    const size_t frames = static_cast<size_t>(rate * seconds);
+    std::vector<int16_t> pcm(frames * CHANNELS);
+    for (size_t i = 0; i < frames; ++i) {
+        double t = static_cast<double>(i) / rate;
+        double envelope = 0.5 + 0.4 * sin(2 * PI * 0.3 * t);
+        double left = envelope * (0.3 * sin(2 * PI * 220 * t) + 0.15 * sin(2 * PI * 1320 * t) + 0.05 * sin(2 * PI * 5500 * t));
+        double right = envelope * (0.3 * sin(2 * PI * 330 * t) + 0.1 * sin(2 * PI * 2640 * t));
+        pcm[i * CHANNELS] = static_cast<int16_t>(lrint(left * 32767));
+        pcm[i * CHANNELS + 1] = static_cast<int16_t>(lrint(right * 32767));
+    }
+    return pcm;
+}
+
+bool CheckAdts() {
+    struct Case { AacProfile profile; uint32_t rate, channels; size_t payload; uint32_t coreIndex, coreChannels; };
+    const Case cases[] = { { AacProfile::LC, 48000, 2, 371, 3, 2 }, { AacProfile::LC, 44100, 1, 8184, 4, 1 },
+                           { AacProfile::HE, 48000, 2, 200, 6, 2 }, { AacProfile::HEv2, 44100, 2, 90, 7, 1 } };
+    bool ok = true;
+    for (const Case& c : cases) {
+        uint8_t h[7] = {};
+        bool written = WriteAdtsHeader(h, c.profile, c.rate, c.channels, c.payload);
+        uint32_t syncword = (h[0] << 4) | (h[1] >> 4);
+        uint32_t objectType = (h[2] >> 6) + 1;
+        uint32_t rateIndex = (h[2] >> 2) & 0xF;
+        uint32_t channels = ((h[2] & 1) << 2) | (h[3] >> 6);
+        size_t length = ((h[3] & 3) << 11) | (h[4] << 3) | (h[5] >> 5);
+        bool good = written && syncword == 0xFFF && (h[1] & 1) == 1 && objectType == 2 && rateIndex == c.coreIndex &&
+                    channels == c.coreChannels && length == c.payload + 7;
+        ok = ok && good;
+    }
+    uint8_t h[7];
+    ok = ok && !WriteAdtsHeader(h, AacProfile::LC, 47000, 2, 100) && !WriteAdtsHeader(h, AacProfile::LC, 48000, 2, 8200);
+    printf("ADTS header round trip: %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// Push PCM through a ring in capture-sized blocks while the worker encodes.
+// realTime paces the pushes like a capture device; otherwise push as fast as the ring allows.
+struct WorkerRun {
+    bool contiguous = true;
+    int64_t samplesIn = 0, samplesOut = 0;
+    uint64_t packets = 0, bytes = 0;
+    double seconds = 0;
+    LatencyHistogram batches;
+};
+
+WorkerRun RunWorker(AudioEncoder& encoder, const std::vector<int16_t>& pcm, bool realTime) {
+    WorkerRun run;
+    SpscRingBuffer ring(SAMPLE_RATE * CHANNELS * sizeof(int16_t));
+    int64_t expectedPts = -static_cast<int64_t>(encoder.Delay());
+    AudioEncodeWorker worker;
+    worker.Start(encoder, ring, CHANNELS, [&](const EncodedAudioPacket& packet) {
+        if (packet.samplePts != expectedPts) run.contiguous = false;
+        expectedPts = packet.samplePts + packet.frames;
+        run.samplesOut += packet.frames;
+    });
+
+    const size_t frames = pcm.size() / CHANNELS;
+    const int64_t start = NowTicks();
+    for (size_t f = 0; f < frames;) {
+        const size_t block = frames - f < CAPTURE_BLOCK ? frames - f : CAPTURE_BLOCK;
+        if (!ring.Write(pcm.data() + f * CHANNELS, block * CHANNELS * sizeof(int16_t))) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1)); // Only when not paced
+            continue;
+        }
+        f += block;
+        if (realTime) {
+            std::this_thread::sleep_until(std::chrono::steady_clock::now() + std::chrono::microseconds(block * 1000000 / SAMPLE_RATE));
+        }
+    }
+    worker.Stop();
+    run.seconds = (NowTicks() - start) / static_cast<double>(TICKS_PER_SECOND);
+    run.samplesIn = static_cast<int64_t>(frames);
+    run.packets = worker.Packets();
+    run.bytes = worker.BytesOut();
+    run.batches = worker.BatchLatency();
+    if (worker.Failed()) run.contiguous = false;
+    return run;
+}
+
+void ReportWorker(const char* label, const WorkerRun& run, uint32_t delay) {
+    const double audioSeconds = static_cast<double>(run.samplesIn) / SAMPLE_RATE;
+    printf("  %-22s %6.0fx real time, %llu packets, %.1f kbit/s, timestamps %s, %lld samples out for %lld in (+%u priming)\n",
+           label, audioSeconds / run.seconds, static_cast<unsigned long long>(run.packets),
+           run.bytes * 8.0 / audioSeconds / 1000.0, run.contiguous ? "contiguous" : "BROKEN",
+           static_cast<long long>(run.samplesOut), static_cast<long long>(run.samplesIn), delay);
+}
+
+int main(int argc, char** argv) {
+    const double seconds = argc > 1 ? atof(argv[1]) : 60.0;
+    bool ok = CheckAdts();
+    // Odd length so the last frame is short
+    std::vector<int16_t> pcm = MakeSignal(SAMPLE_RATE, seconds + 0.0123);
+
+    printf("\nWorker framing (%u-frame capture blocks into the ring):\n", CAPTURE_BLOCK);
+    {
+        PassthroughEncoder encoder;
+        AudioEncoderConfig config;
+        encoder.Open(config);
+        WorkerRun run = RunWorker(encoder, pcm, false);
+        ReportWorker(encoder.Name(), run, encoder.Delay());
+        ok = ok && run.contiguous && run.samplesOut == run.samplesIn + encoder.Delay();
+        encoder.Open(config);
+        WorkerRun paced = RunWorker(encoder, std::vector<int16_t>(pcm.begin(), pcm.begin() + SAMPLE_RATE * CHANNELS * 2), true);
+        ReportWorker("pass-through, paced", paced, encoder.Delay());
+        paced.batches.Print("  batch encode time");
+        ok = ok && paced.contiguous;
+    }
+
+#ifdef HAVE_LIBAVCODEC
+    printf("\nAAC encode, %.0f s of 48 kHz stereo:\n", seconds);
+    struct Setting { AacProfile profile; uint32_t bitrate; };
+    const Setting settings[] = { { AacProfile::LC, 96000 }, { AacProfile::LC, 128000 }, { AacProfile::LC, 192000 },
+                                 { AacProfile::HE, 64000 }, { AacProfile::HEv2, 32000 } };
+    for (const Setting& setting : settings) {
+        LibavAacEncoder encoder;
+        AudioEncoderConfig config;
+        config.bitrate = setting.bitrate;
+        config.profile = setting.profile;
+        if (!encoder.Open(config)) {
+            printf("  %s at %u kbit/s: not available\n", setting.profile == AacProfile::LC ? "LC" : "HE", setting.bitrate / 1000);
+            continue;
+        }
+
+        // Direct calls: the codec's own cost
+        const uint32_t frameSize = encoder.FrameSize();
+        const size_t frames = pcm.size() / CHANNELS;
+        uint64_t bytes = 0;
+        int64_t expectedPts = -static_cast<int64_t>(encoder.Delay());
+        bool contiguous = true;
+        const AudioPacketSink sink = [&](const EncodedAudioPacket& packet) {
+            if (packet.samplePts != expectedPts) contiguous = false;
+            expectedPts = packet.samplePts + packet.frames;
+            bytes += packet.size;
+        };
+        const int64_t start = NowTicks();
+        for (size_t f = 0; f < frames; f += frameSize) {
+            const uint32_t n = static_cast<uint32_t>(frames - f < frameSize ? frames - f : frameSize);
+            encoder.Encode(pcm.data() + f * CHANNELS, n, static_cast<int64_t>(f), sink);
+        }
+        encoder.Flush(sink);
+        const double elapsed = (NowTicks() - start) / static_cast<double>(TICKS_PER_SECOND);
+        printf("  %-22s %3u kbit/s target: %6.0fx real time direct, %.1f kbit/s actual, frame %u, delay %u, timestamps %s\n",
+               encoder.Name(), setting.bitrate / 1000, seconds / elapsed, bytes * 8.0 / seconds / 1000.0, frameSize,
+               encoder.Delay(), contiguous ? "contiguous" : "BROKEN");
+
+        // Through the ring and worker thread
+        encoder.Open(config);
+        WorkerRun run = RunWorker(encoder, pcm, false);
+        ReportWorker("  via worker", run, encoder.Delay());
+        ok = ok && run.contiguous;
+    }
+#else
+    printf("\nBuilt without libavcodec (define HAVE_LIBAVCODEC and link libavcodec/libavutil for AAC throughput).\n");
+#endif
+    return ok ? 0 : 1;
+}
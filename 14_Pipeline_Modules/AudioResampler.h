@@ -0,0 +1,417 @@
+// AudioResampler.h
+// In-process audio format conversion for the capture path:
+//   - s16 <-> f32 sample conversion
+//   - channel up/down-mix
+//   - polyphase windowed-sinc resampling for any rational ratio (48k <-> 44.1k
+//     is 147/160)
+// Inner loops are vectorised with AVX2/FMA, SSE2 or NEON (chosen at compile
+// time) with scalar tails. All buffers are allocated in Init, so the streaming
+// calls never allocate.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+enum class SampleFormat {
+    S16,
+    F32
+};
+
+// s16 -> f32 in [-1, 1)
+inline void ConvertS16ToF32(const int16_t* in, float* out, size_t count) {
+    const float scale = 1.0f / 32768.0f;
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256 vscale = _mm256_set1_ps(scale);
+    for (; i + 8 <= count; i += 8) {
+        __m256i wide = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(wide), vscale));
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128 vscale = _mm_set1_ps(scale);
+    for (; i + 8 <= count; i += 8) {
+        __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(packed, packed), 16);
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), vscale));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), vscale));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t packed = vld1q_s16(in + i);
+        vst1q_f32(out + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(packed))), scale));
+        vst1q_f32(out + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(packed))), scale));
+    }
+#endif
+    for (; i < count; ++i) out[i] = in[i] * scale;
+}
+
+// f32 -> s16 with rounding and saturation
+inline void ConvertF32ToS16(const float* in, int16_t* out, size_t count) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256 vscale = _mm256_set1_ps(32768.0f);
+    for (; i + 16 <= count; i += 16) {
+        __m256i a = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(in + i), vscale));
+        __m256i b = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(in + i + 8), vscale));
+        // packs works per 128-bit lane; permute restores sample order
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), packed);
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128 vscale = _mm_set1_ps(32768.0f);
+    for (; i + 8 <= count; i += 8) {
+        __m128i a = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i), vscale));
+        __m128i b = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i + 4), vscale));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(a, b));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for (; i + 8 <= count; i += 8) {
+        int32x4_t a = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(in + i), 32768.0f));
+        int32x4_t b = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(in + i + 4), 32768.0f));
+        vst1q_s16(out + i, vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+    }
+#endif
+    for (; i < count; ++i) {
+        float v = in[i] * 32768.0f;
+        v = v > 32767.0f ? 32767.0f : (v < -32768.0f ? -32768.0f : v);
+        out[i] = static_cast<int16_t>(lrintf(v));
+    }
+}
+
+// Interleaved channel conversion. Mono<->stereo have fast paths; other layouts
+// fold extra input channels onto the outputs round-robin and average them.
+inline void MixChannels(const float* in, uint32_t inChannels, float* out, uint32_t outChannels, size_t frames) {
+    if (inChannels == outChannels) {
+        memcpy(out, in, frames * inChannels * sizeof(float));
+        return;
+    }
+    if (inChannels == 2 && outChannels == 1) {
+        size_t i = 0;
+#if defined(__SSE2__) || defined(_M_X64) || defined(__AVX2__)
+        const __m128 half = _mm_set1_ps(0.5f);
+        for (; i + 4 <= frames; i += 4) {
+            __m128 a = _mm_loadu_ps(in + 2 * i);     // L0 R0 L1 R1
+            __m128 b = _mm_loadu_ps(in + 2 * i + 4); // L2 R2 L3 R3
+            __m128 left = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+            __m128 right = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+            _mm_storeu_ps(out + i, _mm_mul_ps(_mm_add_ps(left, right), half));
+        }
+#elif defined(__ARM_NEON)
+        for (; i + 4 <= frames; i += 4) {
+            float32x4x2_t lr = vld2q_f32(in + 2 * i);
+            vst1q_f32(out + i, vmulq_n_f32(vaddq_f32(lr.val[0], lr.val[1]), 0.5f));
+        }
+#endif
+        for (; i < frames; ++i) out[i] = 0.5f * (in[2 * i] + in[2 * i + 1]);
+        return;
+    }
+    if (inChannels == 1 && outChannels == 2) {
+        size_t i = 0;
+#if defined(__SSE2__) || defined(_M_X64) || defined(__AVX2__)
+        for (; i + 4 <= frames; i += 4) {
+            __m128 mono = _mm_loadu_ps(in + i);
+            _mm_storeu_ps(out + 2 * i, _mm_unpacklo_ps(mono, mono));
+            _mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(mono, mono));
+        }
+#elif defined(__ARM_NEON)
+        for (; i + 4 <= frames; i += 4) {
+            float32x4_t mono = vld1q_f32(in + i);
+            float32x4x2_t lr = { { mono, mono } };
+            vst2q_f32(out + 2 * i, lr);
+        }
+#endif
+        for (; i < frames; ++i) out[2 * i] = out[2 * i + 1] = in[i];
+        return;
+    }
+    for (size_t f = 0; f < frames; ++f) {
+        const float* src = in + f * inChannels;
+        float* dst = out + f * outChannels;
+        for (uint32_t c = 0; c < outChannels; ++c) {
+            if (inChannels < outChannels) {
+                dst[c] = src[c % inChannels];
+            } else {
+                float sum = 0.0f;
+                uint32_t n = 0;
+                for (uint32_t s = c; s < inChannels; s += outChannels, ++n) sum += src[s];
+                dst[c] = sum / n;
+            }
+        }
+    }
+}
+
+// Dot product of two float vectors; taps is a multiple of 8
+inline float DotProduct(const float* a, const float* b, size_t taps) {
+#if defined(__AVX2__) && defined(__FMA__)
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= taps; i += 16) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+    }
+    for (; i < taps; i += 8) acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    __m256 acc = _mm256_add_ps(acc0, acc1);
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+#elif defined(__SSE2__) || defined(_M_X64) || defined(__AVX2__)
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (size_t i = 0; i < taps; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    __m128 sum = _mm_add_ps(acc0, acc1);
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+#elif defined(__ARM_NEON)
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    for (size_t i = 0; i < taps; i += 8) {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    float32x4_t sum = vaddq_f32(acc0, acc1);
+    float32x2_t pair = vadd_f32(vget_low_f32(sum), vget_high_f32(sum));
+    return vget_lane_f32(vpadd_f32(pair, pair), 0);
+#else
+    float sum = 0.0f;
+    for (size_t i = 0; i < taps; ++i) sum += a[i] * b[i];
+    return sum;
+#endif
+}
+
+// Streaming polyphase resampler for interleaved float audio
+class PolyphaseResampler {
+public:
+    static const uint32_t MAX_PHASES = 1024; // Larger ratios use interpolated phases
+
+    // tapsPerPhase trades quality for speed (32 gives ~-90 dB stopband)
+    bool Init(uint32_t inputRate, uint32_t outputRate, uint32_t channelCount, size_t maxBlockFrames,
+              uint32_t tapsPerPhase = 32) {
+        if (inputRate == 0 || outputRate == 0 || channelCount == 0 || maxBlockFrames == 0) return false;
+        uint32_t divisor = Gcd(inputRate, outputRate);
+        upFactor = outputRate / divisor;
+        downFactor = inputRate / divisor;
+        channels = channelCount;
+        maxBlock = maxBlockFrames;
+        taps = (tapsPerPhase + 7) / 8 * 8;
+        interpolated = upFactor > MAX_PHASES;
+        phases = interpolated ? 512 : upFactor;
+
+        // Prototype low-pass at the upsampled rate, cut just below the lower Nyquist
+        const double ratio = upFactor < downFactor ? static_cast<double>(upFactor) / downFactor : 1.0;
+        const double cutoff = 0.475 * ratio; // Cycles per input sample
+        const double beta = 8.6;
+        const size_t length = static_cast<size_t>(taps) * phases;
+        const double center = (length - 1) / 2.0;
+        coefficients.assign((phases + 1) * taps, 0.0f);
+        for (uint32_t p = 0; p <= phases; ++p) {
+            for (uint32_t t = 0; t < taps; ++t) {
+                // Tap t of phase p sits at upsampled position t*phases + p; store reversed
+                double k = static_cast<double>(t) * phases + p;
+                double x = (k - center) / phases; // In input samples
+                double sinc = fabs(x) < 1e-12 ? 1.0 : sin(3.14159265358979323846 * 2.0 * cutoff * x) / (3.14159265358979323846 * 2.0 * cutoff * x);
+                double w = (k - center) / (length / 2.0);
+                double window = fabs(w) >= 1.0 ? 0.0 : BesselI0(beta * sqrt(1.0 - w * w)) / BesselI0(beta);
+                coefficients[static_cast<size_t>(p) * taps + (taps - 1 - t)] = static_cast<float>(2.0 * cutoff * sinc * window);
+            }
+        }
+
+        history.assign(channels, std::vector<float>(taps + maxBlock, 0.0f));
+        Reset();
+        return true;
+    }
+
+    void Reset() {
+        for (std::vector<float>& channel : history) std::fill(channel.begin(), channel.end(), 0.0f);
+        fill = taps - 1;
+        position = taps - 1;
+        phase = 0;
+    }
+
+    // Upper bound on output frames for an input block
+    size_t MaxOutputFrames(size_t inputFrames) const {
+        return static_cast<size_t>((static_cast<uint64_t>(inputFrames) * upFactor + downFactor - 1) / downFactor) + 2;
+    }
+
+    // Resample interleaved input; out must hold MaxOutputFrames(inputFrames) frames
+    size_t Process(const float* in, size_t inputFrames, float* out) {
+        size_t produced = 0;
+        while (inputFrames > 0) {
+            size_t block = inputFrames < maxBlock ? inputFrames : maxBlock;
+            for (uint32_t c = 0; c < channels; ++c) {
+                float* dst = history[c].data() + fill;
+                for (size_t i = 0; i < block; ++i) dst[i] = in[i * channels + c];
+            }
+            fill += block;
+            in += block * channels;
+            inputFrames -= block;
+            produced += Drain(out + produced * channels);
+        }
+        return produced;
+    }
+
+    uint32_t UpFactor() const { return upFactor; }
+    uint32_t DownFactor() const { return downFactor; }
+    uint32_t Taps() const { return taps; }
+    // Group delay in input samples, for aligning timestamps
+    double Latency() const { return (static_cast<double>(taps) * phases - 1) / (2.0 * phases); }
+
+private:
+    static uint32_t Gcd(uint32_t a, uint32_t b) {
+        while (b) {
+            uint32_t t = a % b;
+            a = b;
+            b = t;
+        }
+        return a;
+    }
+
+    static double BesselI0(double x) {
+        double sum = 1.0, term = 1.0;
+        for (int k = 1; k < 50; ++k) {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+            if (term < 1e-12 * sum) break;
+        }
+        return sum;
+    }
+
+    // Produce every output whose filter window is fully inside the history
+    size_t Drain(float* out) {
+        size_t produced = 0;
+        while (position < fill) {
+            for (uint32_t c = 0; c < channels; ++c) {
+                const float* window = history[c].data() + position - (taps - 1);
+                float value;
+                if (!interpolated) {
+                    value = DotProduct(window, coefficients.data() + static_cast<size_t>(phase) * taps, taps);
+                } else {
+                    // Map the exact phase onto the table and blend the two neighbours
+                    double exact = static_cast<double>(phase) * phases / upFactor;
+                    uint32_t p0 = static_cast<uint32_t>(exact);
+                    float frac = static_cast<float>(exact - p0);
+                    float a = DotProduct(window, coefficients.data() + static_cast<size_t>(p0) * taps, taps);
+                    float b = DotProduct(window, coefficients.data() + static_cast<size_t>(p0 + 1) * taps, taps);
+                    value = a + (b - a) * frac;
+                }
+                out[produced * channels + c] = value;
+            }
+            ++produced;
+            phase += downFactor;
+            position += phase / upFactor;
+            phase %= upFactor;
+        }
+
+        // Keep only the samples the next window still needs
+        size_t keepFrom = position - (taps - 1);
+        if (keepFrom > 0) {
+            size_t keep = fill > keepFrom ? fill - keepFrom : 0;
+            for (uint32_t c = 0; c < channels; ++c) {
+                memmove(history[c].data(), history[c].data() + keepFrom, keep * sizeof(float));
+            }
+            fill -= keepFrom;
+            position -= keepFrom;
+        }
+        return produced;
+    }
+
+    uint32_t upFactor = 1;
+    uint32_t downFactor = 1;
+    uint32_t channels = 0;
+    uint32_t taps = 0;
+    uint32_t phases = 0;
+    bool interpolated = false;
+    size_t maxBlock = 0;
+    std::vector<float> coefficients; // (phases + 1) x taps, each phase reversed
+    std::vector<std::vector<float>> history;
+    size_t fill = 0;     // Valid samples in each history buffer
+    size_t position = 0; // Newest input sample under the filter window
+    uint32_t phase = 0;  // Sub-sample position in units of 1/upFactor
+};
+
+// Complete conversion chain: input format -> f32 -> channel mix -> resample -> output format
+class AudioConverter {
+public:
+    bool Init(uint32_t inputRate, uint32_t inputChannels, SampleFormat inputFormat,
+              uint32_t outputRate, uint32_t outputChannels, SampleFormat outputFormat, size_t maxBlockFrames) {
+        inRate = inputRate;
+        outRate = outputRate;
+        inChannels = inputChannels;
+        outChannels = outputChannels;
+        inFormat = inputFormat;
+        outFormat = outputFormat;
+        maxBlock = maxBlockFrames;
+        floatIn.assign(maxBlock * inChannels, 0.0f);
+        mixed.assign(maxBlock * outChannels, 0.0f);
+        if (inRate != outRate) {
+            if (!resampler.Init(inRate, outRate, outChannels, maxBlock)) return false;
+            resampled.assign(resampler.MaxOutputFrames(maxBlock) * outChannels, 0.0f);
+        }
+        return true;
+    }
+
+    size_t MaxOutputFrames(size_t inputFrames) const {
+        return inRate == outRate ? inputFrames : resampler.MaxOutputFrames(inputFrames);
+    }
+
+    // Convert up to maxBlockFrames frames; out must hold MaxOutputFrames(frames)
+    size_t Convert(const void* in, size_t frames, void* out) {
+        if (frames > maxBlock) frames = maxBlock;
+        const float* source;
+        if (inFormat == SampleFormat::S16) {
+            ConvertS16ToF32(static_cast<const int16_t*>(in), floatIn.data(), frames * inChannels);
+            source = floatIn.data();
+        } else {
+            source = static_cast<const float*>(in);
+        }
+        if (inChannels != outChannels) {
+            MixChannels(source, inChannels, mixed.data(), outChannels, frames);
+            source = mixed.data();
+        }
+
+        size_t produced = frames;
+        const float* result = source;
+        if (inRate != outRate) {
+            produced = resampler.Process(source, frames, resampled.data());
+            result = resampled.data();
+        }
+
+        if (outFormat == SampleFormat::S16) {
+            ConvertF32ToS16(result, static_cast<int16_t*>(out), produced * outChannels);
+        } else if (static_cast<const void*>(result) != out) {
+            memcpy(out, result, produced * outChannels * sizeof(float));
+        }
+        return produced;
+    }
+
+    const PolyphaseResampler& Resampler() const { return resampler; }
+
+private:
+    uint32_t inRate = 0;
+    uint32_t outRate = 0;
+    uint32_t inChannels = 0;
+    uint32_t outChannels = 0;
+    SampleFormat inFormat = SampleFormat::S16;
+    SampleFormat outFormat = SampleFormat::S16;
+    size_t maxBlock = 0;
+    PolyphaseResampler resampler;
+    std::vector<float> floatIn;
+    std::vector<float> mixed;
+    std::vector<float> resampled;
+};
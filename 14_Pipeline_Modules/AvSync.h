@@ -0,0 +1,144 @@
+// AvSync.h
+// Keeps two raw streams (NV12 frames on one pipe, PCM on another) in sync when
+// the receiver has no timestamps and simply counts frames and samples.
+// Both capture threads stamp their data from one MediaClock; each aligner then
+// compares "where this data belongs on the shared timeline" with "how much has
+// been written so far" and corrects the stream it owns:
+//   audio: insert silence or drop samples
+//   video: repeat the previous frame or drop frames
+// Small differences inside the tolerance are left alone so jitter does not
+// turn into constant corrections.
+#pragma once
+
+#include "MediaTypes.h"
+
+#include <stdint.h>
+#include <atomic>
+
+// Shared timestamp base for the capture threads (100-ns ticks since Start)
+class MediaClock {
+public:
+    void Start() { startTicks.store(NowTicks(), std::memory_order_release); }
+    bool Started() const { return startTicks.load(std::memory_order_acquire) != 0; }
+    int64_t Now() const { return NowTicks() - startTicks.load(std::memory_order_acquire); }
+    // Convert a NowTicks()-based timestamp taken by a capture thread
+    int64_t FromTicks(int64_t ticks) const { return ticks - startTicks.load(std::memory_order_acquire); }
+
+private:
+    std::atomic<int64_t> startTicks{ 0 };
+};
+
+// Correction for one audio block: insert silence before it, or drop frames from its start
+struct AudioCorrection {
+    uint32_t silenceFrames = 0;
+    uint32_t dropFrames = 0;
+};
+
+class AudioTimelineAligner {
+public:
+    void Init(uint32_t rate, int64_t toleranceTicks = TICKS_PER_SECOND / 50) {
+        sampleRate = rate;
+        tolerance = toleranceTicks;
+        framesWritten = 0;
+        silenceInserted = 0;
+        framesDropped = 0;
+        maxOffset = 0;
+    }
+
+    // blockPts: shared-clock time of the block's first sample
+    AudioCorrection Align(int64_t blockPts, uint32_t frames) {
+        AudioCorrection correction;
+        const int64_t expected = blockPts * sampleRate / TICKS_PER_SECOND;
+        const int64_t offset = expected - framesWritten; // > 0: the stream is behind the clock
+        const int64_t offsetTicks = offset * TICKS_PER_SECOND / sampleRate;
+        const int64_t magnitude = offsetTicks < 0 ? -offsetTicks : offsetTicks;
+        if (magnitude > maxOffset) maxOffset = magnitude;
+
+        if (offsetTicks > tolerance) {
+            // Cap one insertion at a second; a longer gap is a stall, not drift
+            correction.silenceFrames = static_cast<uint32_t>(offset < sampleRate ? offset : sampleRate);
+        } else if (offsetTicks < -tolerance) {
+            correction.dropFrames = static_cast<uint32_t>(-offset < frames ? -offset : frames);
+        }
+        silenceInserted += correction.silenceFrames;
+        framesDropped += correction.dropFrames;
+        framesWritten += correction.silenceFrames + frames - correction.dropFrames;
+        return correction;
+    }
+
+    int64_t FramesWritten() const { return framesWritten; }
+    uint64_t SilenceInserted() const { return silenceInserted; }
+    uint64_t FramesDropped() const { return framesDropped; }
+    int64_t MaxOffsetTicks() const { return maxOffset; }
+
+private:
+    uint32_t sampleRate = 48000;
+    int64_t tolerance = TICKS_PER_SECOND / 50;
+    int64_t framesWritten = 0;
+    uint64_t silenceInserted = 0;
+    uint64_t framesDropped = 0;
+    int64_t maxOffset = 0;
+};
+
+// Correction for one video frame: repeat the previously written frame first, or drop this one
+struct VideoCorrection {
+    uint32_t repeatPrevious = 0;
+    bool dropFrame = false;
+};
+
+class VideoCadenceAligner {
+public:
+    void Init(uint32_t fpsNumerator, uint32_t fpsDenominator, int64_t toleranceTicks = TICKS_PER_SECOND / 100) {
+        fpsNum = fpsNumerator;
+        fpsDen = fpsDenominator;
+        tolerance = toleranceTicks;
+        framesWritten = 0;
+        repeated = 0;
+        dropped = 0;
+        origin = 0;
+    }
+
+    // The receiver restarted (possibly at a new rate): its first frame belongs at originPts
+    void Restart(uint32_t fpsNumerator, uint32_t fpsDenominator, int64_t originPts) {
+        fpsNum = fpsNumerator;
+        fpsDen = fpsDenominator;
+        framesWritten = 0;
+        origin = originPts;
+    }
+
+    // framePts: shared-clock capture time. A gap is filled with the previous
+    // frame, as a player would hold it, so this frame still lands in its own slot.
+    VideoCorrection Align(int64_t framePts) {
+        VideoCorrection correction;
+        const int64_t frameTicks = TICKS_PER_SECOND * fpsDen / fpsNum;
+        const int64_t nextSlotPts = origin + framesWritten * TICKS_PER_SECOND * fpsDen / fpsNum;
+        const int64_t offset = framePts - nextSlotPts; // > 0: the stream is behind the clock
+        const int64_t limit = frameTicks / 2 + tolerance;
+        if (offset < -limit) {
+            correction.dropFrame = true;
+            ++dropped;
+            return correction;
+        }
+        if (offset > limit && framesWritten > 0) {
+            const int64_t behind = (offset + frameTicks / 2) / frameTicks;
+            const int64_t cap = fpsNum / fpsDen; // At most a second of repeats for one frame
+            correction.repeatPrevious = static_cast<uint32_t>(behind < cap ? behind : cap);
+        }
+        repeated += correction.repeatPrevious;
+        framesWritten += correction.repeatPrevious + 1;
+        return correction;
+    }
+
+    int64_t FramesWritten() const { return framesWritten; }
+    uint64_t Repeated() const { return repeated; }
+    uint64_t Dropped() const { return dropped; }
+
+private:
+    uint32_t fpsNum = 24;
+    uint32_t fpsDen = 1;
+    int64_t tolerance = TICKS_PER_SECOND / 100;
+    int64_t framesWritten = 0;
+    int64_t origin = 0;
+    uint64_t repeated = 0;
+    uint64_t dropped = 0;
+};
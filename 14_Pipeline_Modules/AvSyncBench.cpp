@@ -0,0 +1,293 @@
+// AvSyncBench.cpp
+// A/V sync over two FIFOs, laid out the way the livestream feeds ffmpeg:
+// NV12 frames on one pipe, s16 stereo PCM on another, and a receiver that only
+// counts frames and samples (rawvideo at -r 24, s16le at -ar 48000).
+// A synthetic camera flashes and a synthetic microphone beeps at the same
+// instant every two seconds. The camera loses the odd frame and runs slightly
+// slow, the microphone clock runs fast, and both are jittered. For each event
+// the receiver's view of the flash and the beep is compared with when they
+// really happened; the difference is the A/V offset a viewer would see.
+// Simulated time runs faster than real time; the clocks are all simulated, so
+// the result does not depend on the speed-up.
+// Usage: ./Run.sh AvSyncBench [seconds] [mic-drift-ppm] [speed-up]
+#include "AvSync.h"
+#include "MediaTypes.h"
+#include "NamedPipe.h"
+#include "RingBuffer.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Constants
+const uint32_t FRAME_WIDTH = 32; // Sync does not depend on frame size; keep the pipe traffic small
+const uint32_t FRAME_HEIGHT = 18;
+const uint32_t FRAME_BYTES = FRAME_WIDTH * FRAME_HEIGHT * 3 / 2;
+const uint32_t FPS = 24;
+const uint32_t SAMPLE_RATE = 48000;
+const uint32_t CHANNELS = 2;
+const uint32_t BLOCK_FRAMES = 480;         // 10 ms, what the capture device delivers
+const double EVENT_PERIOD = 2.0;           // Seconds between flash/beep events
+const double FLASH_LENGTH = 3.0 / FPS;     // Long enough to survive a dropped frame
+const double BEEP_LENGTH = 0.1;
+const double CAMERA_DRIFT_PPM = -200.0;
+const uint32_t CAMERA_LOSS_ONE_IN = 500;   // Frames the camera never delivers
+const double CAMERA_JITTER = 0.004;        // Seconds, +/-
+const double MIC_JITTER = 0.002;
+const uint32_t SILENCE_BEFORE_EVENT = SAMPLE_RATE / 2; // Receiver needs this much quiet before a beep
+
+struct RunResult {
+    std::vector<double> videoTrue, videoSeen, audioTrue, audioSeen;
+    uint64_t repeated = 0, dropped = 0, silence = 0, samplesDropped = 0;
+    size_t ringHighWater = 0;
+    uint64_t ringOverflow = 0;
+    double wallSeconds = 0;
+};
+
+// Small deterministic generator for jitter and frame loss
+struct Lcg {
+    uint64_t state;
+    explicit Lcg(uint64_t seed) : state(seed) {}
+    double Uniform() { // [-1, 1)
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return static_cast<double>(state >> 11) / static_cast<double>(1ULL << 52) - 1.0;
+    }
+};
+
+bool InFlash(double t) { return fmod(t, EVENT_PERIOD) < FLASH_LENGTH; }
+bool InBeep(double t) { return fmod(t, EVENT_PERIOD) < BEEP_LENGTH; }
+
+// Sleep until simulated time t, given the run's real start and speed-up
+void PaceTo(std::chrono::steady_clock::time_point start, double t, double speed) {
+    std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                              std::chrono::duration<double>(t / speed)));
+}
+
+void VideoProducer(NamedPipeWriter& pipe, bool align, double seconds, double speed,
+                   std::chrono::steady_clock::time_point start, RunResult& result) {
+    VideoCadenceAligner aligner;
+    aligner.Init(FPS, 1);
+    Lcg random(1);
+    std::vector<uint8_t> frame(FRAME_BYTES), previous(FRAME_BYTES);
+    const double period = (1.0 / FPS) / (1.0 + CAMERA_DRIFT_PPM * 1e-6);
+    bool previousFlash = false;
+    if (!pipe.Connect()) return;
+
+    for (uint64_t n = 0;; ++n) {
+        const double t = n * period; // When the camera really exposed the frame
+        if (t >= seconds) break;
+        const double jitter = CAMERA_JITTER * random.Uniform();
+        if (n % CAMERA_LOSS_ONE_IN == CAMERA_LOSS_ONE_IN - 1) continue;
+        PaceTo(start, t, speed);
+
+        const bool flash = InFlash(t);
+        memset(frame.data(), flash ? 235 : 16, FRAME_WIDTH * FRAME_HEIGHT);
+        memset(frame.data() + FRAME_WIDTH * FRAME_HEIGHT, 128, FRAME_BYTES - FRAME_WIDTH * FRAME_HEIGHT);
+
+        // Capture timestamp from the shared clock, as the capture loop would take it
+        const int64_t pts = static_cast<int64_t>((t + jitter) * TICKS_PER_SECOND);
+        VideoCorrection correction;
+        if (align) correction = aligner.Align(pts < 0 ? 0 : pts);
+        if (correction.dropFrame) continue;
+        for (uint32_t r = 0; r < correction.repeatPrevious; ++r) {
+            if (!pipe.Write(previous.data(), previous.size())) return;
+        }
+        if (flash && !previousFlash) result.videoTrue.push_back(t);
+        if (!pipe.Write(frame.data(), frame.size())) return;
+        previous.swap(frame);
+        previousFlash = flash;
+    }
+    result.repeated = aligner.Repeated();
+    result.dropped = aligner.Dropped();
+    pipe.Close();
+}
+
+void AudioProducer(SpscRingBuffer& ring, bool align, double seconds, double speed, double driftPpm,
+                   std::chrono::steady_clock::time_point start, RunResult& result) {
+    AudioTimelineAligner aligner;
+    aligner.Init(SAMPLE_RATE);
+    Lcg random(2);
+    const double actualRate = SAMPLE_RATE * (1.0 + driftPpm * 1e-6);
+    std::vector<int16_t> block(BLOCK_FRAMES * CHANNELS);
+    std::vector<bool> beep(BLOCK_FRAMES);
+    std::vector<int16_t> silence(SAMPLE_RATE * CHANNELS, 0);
+    uint64_t quietRun = SILENCE_BEFORE_EVENT;
+
+    for (uint64_t first = 0;; first += BLOCK_FRAMES) {
+        const double t = first / actualRate; // When the block's first sample was really taken
+        if (t >= seconds) break;
+        const double delivered = (first + BLOCK_FRAMES) / actualRate;
+        PaceTo(start, delivered, speed);
+
+        for (uint32_t i = 0; i < BLOCK_FRAMES; ++i) {
+            const double sampleTime = (first + i) / actualRate;
+            beep[i] = InBeep(sampleTime);
+            // 1 kHz square wave: every beep sample is clearly non-zero
+            const int16_t v = beep[i] ? (((first + i) / (SAMPLE_RATE / 2000)) & 1 ? 16384 : -16384) : 0;
+            block[i * CHANNELS] = block[i * CHANNELS + 1] = v;
+        }
+
+        // The capture thread stamps the block on arrival and backs off its duration
+        const double stamp = delivered - BLOCK_FRAMES / static_cast<double>(SAMPLE_RATE) + MIC_JITTER * random.Uniform();
+        AudioCorrection correction;
+        if (align) correction = aligner.Align(static_cast<int64_t>((stamp < 0 ? 0 : stamp) * TICKS_PER_SECOND), BLOCK_FRAMES);
+
+        // Record where the receiver should find each beep onset, mirroring its detector
+        quietRun += correction.silenceFrames;
+        for (uint32_t i = correction.dropFrames; i < BLOCK_FRAMES; ++i) {
+            if (beep[i] && quietRun >= SILENCE_BEFORE_EVENT) result.audioTrue.push_back((first + i) / actualRate);
+            quietRun = beep[i] ? 0 : quietRun + 1;
+        }
+
+        // Never block here: if the writer is behind, the ring counts the overflow
+        if (correction.silenceFrames) ring.Write(silence.data(), correction.silenceFrames * CHANNELS * sizeof(int16_t));
+        ring.Write(block.data() + correction.dropFrames * CHANNELS,
+                   (BLOCK_FRAMES - correction.dropFrames) * CHANNELS * sizeof(int16_t));
+    }
+    result.silence = aligner.SilenceInserted();
+    result.samplesDropped = aligner.FramesDropped();
+}
+
+// Drains the ring into the audio pipe so the capture thread never waits on the reader
+void AudioWriter(SpscRingBuffer& ring, NamedPipeWriter& pipe, std::atomic<bool>& producerDone) {
+    std::vector<uint8_t> chunk(64 * 1024);
+    if (!pipe.Connect()) return;
+    for (;;) {
+        const bool done = producerDone.load();
+        size_t length = ring.Read(chunk.data(), chunk.size());
+        if (length == 0) {
+            if (done) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        if (!pipe.Write(chunk.data(), length)) break;
+    }
+    pipe.Close();
+}
+
+// Receiver: frame index / FPS is the only notion of time it has
+void VideoReceiver(const std::string& path, std::vector<double>& seen) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    std::vector<uint8_t> frame(FRAME_BYTES);
+    bool lastFlash = false;
+    for (uint64_t index = 0;; ++index) {
+        size_t filled = 0;
+        while (filled < frame.size()) {
+            ssize_t n = read(fd, frame.data() + filled, frame.size() - filled);
+            if (n <= 0) break;
+            filled += static_cast<size_t>(n);
+        }
+        if (filled < frame.size()) break;
+        const bool flash = frame[0] > 128;
+        if (flash && !lastFlash) seen.push_back(static_cast<double>(index) / FPS);
+        lastFlash = flash;
+    }
+    close(fd);
+}
+
+// Receiver: sample index / rate is the only notion of time it has
+void AudioReceiver(const std::string& path, std::vector<double>& seen) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    std::vector<int16_t> buffer(16 * 1024 * CHANNELS);
+    uint64_t sampleIndex = 0, quietRun = SILENCE_BEFORE_EVENT;
+    size_t carry = 0; // Bytes of a partial frame left from the last read
+    for (;;) {
+        ssize_t n = read(fd, reinterpret_cast<uint8_t*>(buffer.data()) + carry, buffer.size() * sizeof(int16_t) - carry);
+        if (n <= 0) break;
+        const size_t bytes = carry + static_cast<size_t>(n);
+        const size_t frames = bytes / (CHANNELS * sizeof(int16_t));
+        for (size_t i = 0; i < frames; ++i, ++sampleIndex) {
+            const bool loud = abs(buffer[i * CHANNELS]) > 1000;
+            if (loud && quietRun >= SILENCE_BEFORE_EVENT) seen.push_back(static_cast<double>(sampleIndex) / SAMPLE_RATE);
+            quietRun = loud ? 0 : quietRun + 1;
+        }
+        carry = bytes - frames * CHANNELS * sizeof(int16_t);
+        memmove(buffer.data(), reinterpret_cast<uint8_t*>(buffer.data()) + frames * CHANNELS * sizeof(int16_t), carry);
+    }
+    close(fd);
+}
+
+RunResult Run(bool align, double seconds, double driftPpm, double speed) {
+    RunResult result;
+    NamedPipeWriter videoPipe, audioPipe;
+    const std::string suffix = std::to_string(getpid());
+    if (!videoPipe.Create("avsync_video_" + suffix) || !audioPipe.Create("avsync_audio_" + suffix)) return result;
+    // Half a second of wall-clock buffering; at a speed-up that is speed/2 seconds of PCM
+    SpscRingBuffer ring(static_cast<size_t>(SAMPLE_RATE * CHANNELS * sizeof(int16_t) * speed / 2));
+    std::atomic<bool> producerDone(false);
+
+    const auto start = std::chrono::steady_clock::now();
+    std::thread videoReceiver(VideoReceiver, videoPipe.Path(), std::ref(result.videoSeen));
+    std::thread audioReceiver(AudioReceiver, audioPipe.Path(), std::ref(result.audioSeen));
+    std::thread audioWriter(AudioWriter, std::ref(ring), std::ref(audioPipe), std::ref(producerDone));
+    std::thread audioProducer([&]() {
+        AudioProducer(ring, align, seconds, speed, driftPpm, start, result);
+        producerDone = true;
+    });
+    VideoProducer(videoPipe, align, seconds, speed, start, result);
+    videoPipe.Close();
+
+    audioProducer.join();
+    audioWriter.join();
+    videoReceiver.join();
+    audioReceiver.join();
+    result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.ringHighWater = ring.HighWater();
+    result.ringOverflow = ring.OverflowBytes();
+    return result;
+}
+
+void Report(const char* label, const RunResult& r, double seconds, double speed) {
+    size_t events = std::min(std::min(r.videoTrue.size(), r.videoSeen.size()), std::min(r.audioTrue.size(), r.audioSeen.size()));
+    printf("%s (%.0f s simulated in %.1f s):\n", label, seconds, r.wallSeconds);
+    if (events == 0) {
+        printf("  no events matched\n");
+        return;
+    }
+    // Positive offset: the beep is heard after the flash is seen
+    double sum = 0, worst = 0;
+    std::vector<double> offsets(events);
+    for (size_t k = 0; k < events; ++k) {
+        offsets[k] = ((r.audioSeen[k] - r.audioTrue[k]) - (r.videoSeen[k] - r.videoTrue[k])) * 1000.0;
+        sum += offsets[k];
+        if (fabs(offsets[k]) > fabs(worst)) worst = offsets[k];
+    }
+    printf("  events: %zu (video %zu/%zu, audio %zu/%zu seen/sent)\n", events, r.videoSeen.size(), r.videoTrue.size(),
+           r.audioSeen.size(), r.audioTrue.size());
+    printf("  offset ms: first %+.1f, mean %+.1f, worst %+.1f, last %+.1f\n", offsets.front(), sum / events, worst,
+           offsets.back());
+    printf("  offset over time:");
+    for (int q = 1; q <= 5; ++q) printf(" %+.0f", offsets[events * q / 5 - 1]);
+    printf(" ms\n");
+    printf("  video: %llu repeated, %llu dropped; audio: %.1f ms silence inserted, %.1f ms dropped\n",
+           static_cast<unsigned long long>(r.repeated), static_cast<unsigned long long>(r.dropped),
+           r.silence * 1000.0 / SAMPLE_RATE, r.samplesDropped * 1000.0 / SAMPLE_RATE);
+    // The ring fills at speed-up times the real rate, so scale back to wall-clock delay
+    printf("  audio ring: high water %.2f ms of wall-clock delay, overflow %llu bytes\n",
+           r.ringHighWater * 1000.0 / (SAMPLE_RATE * CHANNELS * sizeof(int16_t)) / speed,
+           static_cast<unsigned long long>(r.ringOverflow));
+}
+
+int main(int argc, char** argv) {
+    const double seconds = argc > 1 ? atof(argv[1]) : 1800.0;
+    const double driftPpm = argc > 2 ? atof(argv[2]) : 500.0;
+    const double speed = argc > 3 ? atof(argv[3]) : 200.0;
+    printf("Camera %+.0f ppm, loses 1 frame in %u; microphone %+.0f ppm; %.0fx real time\n\n", CAMERA_DRIFT_PPM,
+           CAMERA_LOSS_ONE_IN, driftPpm, speed);
+
+    Report("Counting frames and samples as they arrive", Run(false, seconds, driftPpm, speed), seconds, speed);
+    printf("\n");
+    Report("Aligned to the shared clock", Run(true, seconds, driftPpm, speed), seconds, speed);
+    return 0;
+}
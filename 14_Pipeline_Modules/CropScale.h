@@ -0,0 +1,234 @@
+// CropScale.h
+// Digital pan and zoom ahead of the encoder: only the region of interest is
+// scaled to the output size, so no bits are spent on the rest of the frame.
+// RoiController owns the rectangle. Any thread can set a new target (a
+// rectangle or a zoom factor around a point); the capture thread asks for
+// the rectangle at each frame's timestamp and gets a smooth move toward the
+// target: the centre eases in and out, and the size changes geometrically so
+// the zoom rate looks constant. Rectangles are kept at the output aspect
+// ratio, inside the frame and no smaller than 1/maxZoom of it.
+// Nv12CropScaler does the bilinear crop and scale for NV12: one BlendRows
+// call per output row for the vertical taps, then ScaleRowBilinear with
+// per-column offset and weight tables for the horizontal ones.
+#pragma once
+
+#include "MediaTypes.h"
+#include "PixelKernels.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+// In source pixels; fractional so animation is smooth
+struct RoiRect {
+    double x = 0, y = 0, width = 0, height = 0;
+
+    bool operator==(const RoiRect& other) const {
+        return x == other.x && y == other.y && width == other.width && height == other.height;
+    }
+    bool operator!=(const RoiRect& other) const { return !(*this == other); }
+};
+
+class RoiController {
+public:
+    void Init(uint32_t sourceWidth, uint32_t sourceHeight, uint32_t outputWidth, uint32_t outputHeight, double maxZoomFactor = 8.0) {
+        std::lock_guard<std::mutex> guard(lock);
+        frameWidth = sourceWidth;
+        frameHeight = sourceHeight;
+        aspect = static_cast<double>(outputWidth) / outputHeight;
+        maxZoom = maxZoomFactor;
+        RoiRect all;
+        all.width = frameWidth;
+        all.height = frameHeight;
+        shown = from = to = Fit(all);
+        pending = false;
+        duration = 0;
+    }
+
+    // Move to rect over durationTicks, starting at the next frame
+    void SetTarget(const RoiRect& rect, int64_t durationTicks) {
+        std::lock_guard<std::mutex> guard(lock);
+        pendingTarget = Fit(rect);
+        pendingDuration = durationTicks;
+        pending = true;
+    }
+
+    // zoom 1 = the whole frame; centre in 0..1 of the frame
+    void ZoomTo(double zoom, double centerX, double centerY, int64_t durationTicks) {
+        RoiRect rect;
+        rect.width = frameWidth / std::max(zoom, 1.0);
+        rect.height = rect.width / aspect;
+        rect.x = centerX * frameWidth - rect.width / 2;
+        rect.y = centerY * frameHeight - rect.height / 2;
+        SetTarget(rect, durationTicks);
+    }
+
+    // The rectangle for a frame at pts; call with increasing pts from one thread
+    RoiRect Current(int64_t pts) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (pending) {
+            from = shown;
+            to = pendingTarget;
+            start = pts;
+            duration = pendingDuration;
+            pending = false;
+        }
+        double t = duration > 0 ? static_cast<double>(pts - start) / duration : 1.0;
+        t = std::min(std::max(t, 0.0), 1.0);
+        const double s = t * t * (3 - 2 * t);
+        const double width = from.width * pow(to.width / from.width, s);
+        const double centerX = from.x + from.width / 2 + (to.x + to.width / 2 - from.x - from.width / 2) * s;
+        const double centerY = from.y + from.height / 2 + (to.y + to.height / 2 - from.y - from.height / 2) * s;
+        RoiRect rect;
+        rect.width = width;
+        rect.height = width / aspect;
+        rect.x = centerX - rect.width / 2;
+        rect.y = centerY - rect.height / 2;
+        shown = Fit(rect);
+        return shown;
+    }
+
+    bool Animating(int64_t pts) const {
+        std::lock_guard<std::mutex> guard(lock);
+        return pending || pts < start + duration;
+    }
+
+    // Output aspect, at most the frame, at least 1/maxZoom of it, inside the frame
+    RoiRect Fit(RoiRect rect) const {
+        const double centerX = rect.x + rect.width / 2, centerY = rect.y + rect.height / 2;
+        if (rect.width / rect.height > aspect) rect.height = rect.width / aspect;
+        else rect.width = rect.height * aspect;
+        const double minWidth = frameWidth / maxZoom;
+        if (rect.width < minWidth) {
+            rect.width = minWidth;
+            rect.height = minWidth / aspect;
+        }
+        if (rect.width > frameWidth) {
+            rect.width = frameWidth;
+            rect.height = rect.width / aspect;
+        }
+        if (rect.height > frameHeight) {
+            rect.height = frameHeight;
+            rect.width = rect.height * aspect;
+        }
+        rect.x = std::min(std::max(centerX - rect.width / 2, 0.0), frameWidth - rect.width);
+        rect.y = std::min(std::max(centerY - rect.height / 2, 0.0), frameHeight - rect.height);
+        return rect;
+    }
+
+private:
+    mutable std::mutex lock;
+    uint32_t frameWidth = 0, frameHeight = 0;
+    double aspect = 16.0 / 9.0;
+    double maxZoom = 8.0;
+    RoiRect shown, from, to, pendingTarget;
+    bool pending = false;
+    int64_t pendingDuration = 0;
+    int64_t start = 0, duration = 0;
+};
+
+class Nv12CropScaler {
+public:
+    bool Init(uint32_t sourceWidth, uint32_t sourceHeight, uint32_t outputWidth, uint32_t outputHeight) {
+        if (sourceWidth < 4 || sourceHeight < 4 || outputWidth < 2 || outputHeight < 2 || (outputWidth | outputHeight) & 1) return false;
+        srcWidth = sourceWidth;
+        srcHeight = sourceHeight;
+        outWidth = outputWidth;
+        outHeight = outputHeight;
+        luma.Resize(outWidth, outHeight, srcWidth);
+        chroma.Resize(outWidth / 2, outHeight / 2, srcWidth);
+        tablesFor = RoiRect();
+        return true;
+    }
+
+    uint32_t OutputWidth() const { return outWidth; }
+    uint32_t OutputHeight() const { return outHeight; }
+    size_t OutputSize() const { return Frame420Size(outWidth, outHeight); }
+
+    // Crop roi out of an NV12 frame and scale it into out (contiguous NV12, OutputSize() bytes)
+    void Scale(const VideoFrame& frame, const RoiRect& roi, uint8_t* out) {
+        Scale(frame.planes[0], frame.strides[0], frame.planes[1], frame.strides[1], roi,
+              out, outWidth, out + static_cast<size_t>(outWidth) * outHeight, outWidth);
+    }
+
+    void Scale(const uint8_t* y, size_t yStride, const uint8_t* uv, size_t uvStride, const RoiRect& roi,
+               uint8_t* outY, size_t outYStride, uint8_t* outUV, size_t outUVStride) {
+        if (roi != tablesFor) {
+            // Chroma samples sit on the even luma pixels, so the chroma ROI is half the luma one
+            luma.Build(roi.x, roi.y, roi.width, roi.height, srcWidth, srcHeight, 1);
+            chroma.Build(roi.x / 2, roi.y / 2, roi.width / 2, roi.height / 2, srcWidth / 2, srcHeight / 2, 2);
+            tablesFor = roi;
+        }
+        luma.Run(y, yStride, outY, outYStride);
+        chroma.Run(uv, uvStride, outUV, outUVStride);
+    }
+
+private:
+    // Tap tables and row buffer for one plane
+    struct PlaneScaler {
+        uint32_t outColumns = 0, outRows = 0, channels = 1;
+        std::vector<int32_t> columnOffsets, columnWeights; // Relative to spanStart, in bytes
+        std::vector<uint32_t> rowIndex, rowWeights;
+        size_t spanStart = 0, spanBytes = 0;
+        std::vector<uint8_t> row;
+
+        void Resize(uint32_t columns, uint32_t rows, uint32_t sourceRowBytes) {
+            outColumns = columns;
+            outRows = rows;
+            columnOffsets.assign(columns, 0);
+            columnWeights.assign(columns, 0);
+            rowIndex.assign(rows, 0);
+            rowWeights.assign(rows, 0);
+            row.assign(sourceRowBytes + 8, 0); // Gathers read a few bytes past the span
+        }
+
+        // Source position of each output pixel centre, split into a tap and a 0..256 weight.
+        // The last tap is pulled in by one so the second tap stays inside the plane.
+        static void Taps(double start, double span, uint32_t outCount, uint32_t limit, uint32_t* index, uint32_t* weight) {
+            const double step = span / outCount;
+            for (uint32_t i = 0; i < outCount; ++i) {
+                double position = start + (i + 0.5) * step - 0.5;
+                position = std::min(std::max(position, 0.0), static_cast<double>(limit - 1));
+                uint32_t tap = static_cast<uint32_t>(position);
+                uint32_t w = static_cast<uint32_t>(lrint((position - tap) * 256));
+                if (tap >= limit - 1) {
+                    tap = limit - 2;
+                    w = 256;
+                }
+                index[i] = tap;
+                weight[i] = w;
+            }
+        }
+
+        void Build(double x, double y, double width, double height, uint32_t planeWidth, uint32_t planeHeight, uint32_t planeChannels) {
+            channels = planeChannels;
+            std::vector<uint32_t> taps(outColumns), weights(outColumns);
+            Taps(x, width, outColumns, planeWidth, taps.data(), weights.data());
+            Taps(y, height, outRows, planeHeight, rowIndex.data(), rowWeights.data());
+            spanStart = static_cast<size_t>(taps[0]) * channels;
+            spanBytes = (static_cast<size_t>(taps[outColumns - 1]) + 2) * channels - spanStart;
+            for (uint32_t i = 0; i < outColumns; ++i) {
+                columnOffsets[i] = static_cast<int32_t>(taps[i] * channels - spanStart);
+                columnWeights[i] = static_cast<int32_t>(weights[i]);
+            }
+        }
+
+        void Run(const uint8_t* plane, size_t stride, uint8_t* out, size_t outStride) {
+            for (uint32_t r = 0; r < outRows; ++r) {
+                const uint8_t* top = plane + rowIndex[r] * stride + spanStart;
+                if (rowWeights[r] == 0) memcpy(row.data(), top, spanBytes);
+                else BlendRows(top, top + stride, rowWeights[r], row.data(), spanBytes);
+                ScaleRowBilinear(row.data(), columnOffsets.data(), columnWeights.data(), channels, out + r * outStride, outColumns);
+            }
+        }
+    };
+
+    uint32_t srcWidth = 0, srcHeight = 0;
+    uint32_t outWidth = 0, outHeight = 0;
+    PlaneScaler luma, chroma;
+    RoiRect tablesFor;
+};
@@ -0,0 +1,151 @@
+// CropScaleBench.cpp
+// Per-frame cost of the NV12 crop/zoom stage at 1080p input, SIMD as built
+// against a scalar reference with the same arithmetic (outputs must match
+// exactly), for a few fixed regions and for an animated zoom. Also checks
+// that an animated move stays smooth, in frame and at the output aspect.
+// Usage: ./Run.sh CropScaleBench [frames]
+#include "CropScale.h"
+#include "MediaTypes.h"
+#include "Stats.h"
+#include "SyntheticMedia.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+// Constants
+const uint32_t SOURCE_WIDTH = 1920;
+const uint32_t SOURCE_HEIGHT = 1080;
+const uint32_t FPS = 30;
+const uint32_t SOURCE_FRAMES = 8; // Distinct input frames cycled through, so caches see new data
+
+#if defined(__GNUC__) && !defined(__clang__)
+#define SCALAR_ONLY __attribute__((optimize("no-tree-vectorize")))
+#else
+#define SCALAR_ONLY
+#endif
+
+// Same tap placement and two-step rounding as Nv12CropScaler, one pixel at a time
+SCALAR_ONLY void ScalarScalePlane(const uint8_t* plane, size_t stride, uint32_t planeWidth, uint32_t planeHeight, uint32_t channels,
+                                  double x, double y, double width, double height, uint32_t outWidth, uint32_t outHeight, uint8_t* out) {
+    std::vector<uint32_t> colTap(outWidth), colWeight(outWidth), rowTap(outHeight), rowWeight(outHeight);
+    auto taps = [](double start, double span, uint32_t count, uint32_t limit, uint32_t* index, uint32_t* weight) {
+        for (uint32_t i = 0; i < count; ++i) {
+            double position = start + (i + 0.5) * (span / count) - 0.5;
+            position = position < 0 ? 0 : position > limit - 1 ? limit - 1 : position;
+            uint32_t tap = static_cast<uint32_t>(position);
+            uint32_t w = static_cast<uint32_t>(lrint((position - tap) * 256));
+            if (tap >= limit - 1) {
+                tap = limit - 2;
+                w = 256;
+            }
+            index[i] = tap;
+            weight[i] = w;
+        }
+    };
+    taps(x, width, outWidth, planeWidth, colTap.data(), colWeight.data());
+    taps(y, height, outHeight, planeHeight, rowTap.data(), rowWeight.data());
+    for (uint32_t r = 0; r < outHeight; ++r) {
+        const uint8_t* top = plane + rowTap[r] * stride;
+        const uint8_t* bottom = top + stride;
+        const uint32_t wb = rowWeight[r], wa = 256 - wb;
+        for (uint32_t c = 0; c < outWidth; ++c) {
+            for (uint32_t k = 0; k < channels; ++k) {
+                const size_t left = colTap[c] * channels + k, right = left + channels;
+                const uint32_t l = (top[left] * wa + bottom[left] * wb + 128) >> 8;
+                const uint32_t rr = (top[right] * wa + bottom[right] * wb + 128) >> 8;
+                const uint32_t h = colWeight[c];
+                out[(static_cast<size_t>(r) * outWidth + c) * channels + k] = static_cast<uint8_t>((l * (256 - h) + rr * h + 128) >> 8);
+            }
+        }
+    }
+}
+
+void ScalarCropScale(const uint8_t* frame, const RoiRect& roi, uint32_t outWidth, uint32_t outHeight, uint8_t* out) {
+    ScalarScalePlane(frame, SOURCE_WIDTH, SOURCE_WIDTH, SOURCE_HEIGHT, 1, roi.x, roi.y, roi.width, roi.height, outWidth, outHeight, out);
+    ScalarScalePlane(frame + SOURCE_WIDTH * SOURCE_HEIGHT, SOURCE_WIDTH, SOURCE_WIDTH / 2, SOURCE_HEIGHT / 2, 2,
+                     roi.x / 2, roi.y / 2, roi.width / 2, roi.height / 2, outWidth / 2, outHeight / 2,
+                     out + static_cast<size_t>(outWidth) * outHeight);
+}
+
+struct CaseResult {
+    LatencyHistogram simd, scalar;
+    bool identical = true;
+};
+
+// zoom 0 = animate from the whole frame to 4x and back every two seconds
+CaseResult RunCase(const std::vector<std::vector<uint8_t>>& frames, uint32_t outWidth, uint32_t outHeight, double zoom, uint32_t count) {
+    CaseResult result;
+    Nv12CropScaler scaler;
+    scaler.Init(SOURCE_WIDTH, SOURCE_HEIGHT, outWidth, outHeight);
+    RoiController controller;
+    controller.Init(SOURCE_WIDTH, SOURCE_HEIGHT, outWidth, outHeight);
+    if (zoom > 0) controller.ZoomTo(zoom, 0.4, 0.45, 0);
+    std::vector<uint8_t> out(scaler.OutputSize()), reference(scaler.OutputSize());
+    VideoFrame frame;
+    for (uint32_t i = 0; i < count; ++i) {
+        const int64_t pts = static_cast<int64_t>(i) * TICKS_PER_SECOND / FPS;
+        if (zoom == 0 && i % (2 * FPS) == 0) controller.ZoomTo((i / (2 * FPS)) % 2 ? 1.0 : 4.0, 0.65, 0.4, 2 * TICKS_PER_SECOND);
+        const RoiRect roi = controller.Current(pts);
+        const std::vector<uint8_t>& data = frames[i % frames.size()];
+        Describe420Frame(frame, data.data(), SOURCE_WIDTH, SOURCE_HEIGHT, PixelFormat::NV12);
+
+        int64_t start = NowTicks();
+        scaler.Scale(frame, roi, out.data());
+        result.simd.Record(static_cast<uint64_t>(NowTicks() - start) / 10);
+
+        start = NowTicks();
+        ScalarCropScale(data.data(), roi, outWidth, outHeight, reference.data());
+        result.scalar.Record(static_cast<uint64_t>(NowTicks() - start) / 10);
+        if (out != reference) result.identical = false;
+    }
+    return result;
+}
+
+// An animated move should change the rectangle a little each frame and never leave the frame
+bool CheckAnimation() {
+    RoiController controller;
+    controller.Init(SOURCE_WIDTH, SOURCE_HEIGHT, 1280, 720);
+    controller.ZoomTo(6.0, 0.9, 0.1, TICKS_PER_SECOND); // Corner target: has to be pulled inside
+    RoiRect previous = controller.Current(0);
+    double largestStep = 0, worstAspect = 0;
+    bool inside = true;
+    for (uint32_t i = 1; i <= FPS + 5; ++i) {
+        RoiRect rect = controller.Current(static_cast<int64_t>(i) * TICKS_PER_SECOND / FPS);
+        largestStep = std::max(largestStep, fabs(rect.x - previous.x) + fabs(rect.width - previous.width));
+        worstAspect = std::max(worstAspect, fabs(rect.width / rect.height - 16.0 / 9.0));
+        inside = inside && rect.x >= 0 && rect.y >= 0 && rect.x + rect.width <= SOURCE_WIDTH + 1e-6 && rect.y + rect.height <= SOURCE_HEIGHT + 1e-6;
+        previous = rect;
+    }
+    const bool settled = fabs(previous.width - SOURCE_WIDTH / 6.0) < 1e-6 && !controller.Animating(static_cast<int64_t>(FPS + 5) * TICKS_PER_SECOND / FPS);
+    printf("Animated 1x -> 6x zoom into a corner over 1 s: largest per-frame move %.1f px, aspect error %.1e, %s, %s\n\n",
+           largestStep, worstAspect, inside ? "inside the frame" : "LEFT THE FRAME", settled ? "settled on target" : "DID NOT SETTLE");
+    return inside && settled && worstAspect < 1e-9 && largestStep < SOURCE_WIDTH / 10.0;
+}
+
+int main(int argc, char** argv) {
+    const uint32_t count = argc > 1 ? static_cast<uint32_t>(atoi(argv[1])) : 300;
+    bool ok = CheckAnimation();
+
+    std::vector<std::vector<uint8_t>> frames(SOURCE_FRAMES, std::vector<uint8_t>(Frame420Size(SOURCE_WIDTH, SOURCE_HEIGHT)));
+    for (uint32_t i = 0; i < SOURCE_FRAMES; ++i) FillTestPattern(frames[i].data(), SOURCE_WIDTH, SOURCE_HEIGHT, PixelFormat::NV12, i);
+
+    struct Output { uint32_t width, height; };
+    const Output outputs[] = { { 1280, 720 }, { 640, 360 } };
+    struct Zoom { const char* name; double zoom; };
+    const Zoom zooms[] = { { "whole frame", 1.0 }, { "2x zoom", 2.0 }, { "4x zoom", 4.0 }, { "animated 1x-4x", 0.0 } };
+    printf("NV12 %ux%u in, %u frames per case (us per frame, SIMD vs scalar)\n", SOURCE_WIDTH, SOURCE_HEIGHT, count);
+    for (const Output& output : outputs) {
+        const double pixelShare = 100.0 * output.width * output.height / (SOURCE_WIDTH * SOURCE_HEIGHT);
+        printf("%ux%u out (%.0f%% of the input pixels reach the encoder):\n", output.width, output.height, pixelShare);
+        for (const Zoom& zoom : zooms) {
+            CaseResult result = RunCase(frames, output.width, output.height, zoom.zoom, count);
+            printf("  %-15s mean %6.0f, p99 %6.0f | scalar mean %6.0f (%.1fx) | %.1f%% of a frame at %u fps | %s\n", zoom.name,
+                   result.simd.Mean(), static_cast<double>(result.simd.Percentile(99)), result.scalar.Mean(), result.scalar.Mean() / result.simd.Mean(),
+                   result.simd.Mean() * FPS / 1e4, FPS, result.identical ? "matches scalar" : "DIFFERS FROM SCALAR");
+            ok = ok && result.identical;
+        }
+    }
+    return ok ? 0 : 1;
+}
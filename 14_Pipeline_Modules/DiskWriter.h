@@ -0,0 +1,373 @@
+// DiskWriter.h
+// Write-behind output file for recordings. The capture thread copies data into
+// large aligned chunks; a dedicated I/O thread preallocates file extents ahead
+// of the write position, writes whole chunks and calls fdatasync on its own
+// schedule. Filesystem stalls are absorbed by the chunk pool instead of
+// reaching the capture loop, and are reported as stall events.
+#pragma once
+
+#include "MediaTypes.h"
+#include "Stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Artificial slowdown used to stand in for a slow disk or network share
+struct WriteThrottle {
+    uint32_t stallEveryMs = 0;          // Period of injected stalls (0 = none)
+    uint32_t stallMs = 0;               // Length of each injected stall
+    uint64_t bytesPerSecond = 0;        // Sustained bandwidth cap (0 = none)
+
+    // Sleep as a throttled device would for a write of length bytes
+    void Apply(size_t length, int64_t startTicks) const {
+        if (bytesPerSecond) {
+            std::this_thread::sleep_for(std::chrono::microseconds(length * 1000000ULL / bytesPerSecond));
+        }
+        if (stallEveryMs && stallMs) {
+            int64_t elapsedMs = (NowTicks() - startTicks) / 10000;
+            int64_t period = elapsedMs / stallEveryMs;
+            if (period != lastStallPeriod && period > 0) {
+                lastStallPeriod = period;
+                std::this_thread::sleep_for(std::chrono::milliseconds(stallMs));
+            }
+        }
+    }
+
+    mutable int64_t lastStallPeriod = 0;
+};
+
+struct DiskWriterOptions {
+    size_t chunkBytes = 4 << 20;              // Size of each write issued by the I/O thread
+    size_t chunkCount = 16;                   // Chunks buffered between capture and disk
+    uint64_t preallocateBytes = 256ULL << 20; // Extent reserved ahead of the write position
+    uint32_t syncIntervalMs = 1000;           // fdatasync period (0 = only on close)
+    uint32_t stallThresholdMs = 50;           // Writes slower than this are logged as stalls
+    WriteThrottle throttle;                   // For benchmarking only
+};
+
+class DiskWriter {
+public:
+    static const size_t ALIGNMENT = 4096;
+
+    DiskWriter() = default;
+    DiskWriter(const DiskWriter&) = delete;
+    DiskWriter& operator=(const DiskWriter&) = delete;
+    ~DiskWriter() { Close(); }
+
+    bool Open(const std::string& filePath, const DiskWriterOptions& writerOptions = DiskWriterOptions()) {
+        Close();
+        options = writerOptions;
+        options.chunkBytes = (options.chunkBytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        if (options.chunkCount < 2) options.chunkCount = 2;
+        path = filePath;
+
+        if (!OpenFile()) {
+            printf("Failed to open %s for writing.\n", path.c_str());
+            return false;
+        }
+
+        for (size_t i = 0; i < options.chunkCount; ++i) {
+            Chunk chunk;
+            chunk.data = static_cast<uint8_t*>(AllocateAligned(options.chunkBytes));
+            chunk.used = 0;
+            if (!chunk.data) {
+                printf("Failed to allocate write-behind buffers.\n");
+                Close();
+                return false;
+            }
+            freeChunks.push_back(chunk);
+            allChunks.push_back(chunk.data);
+        }
+
+        current = TakeFreeChunk();
+        logicalSize = 0;
+        preallocatedTo = 0;
+        failed = false;
+        stopping = false;
+        stallEvents = 0;
+        producerStalls = 0;
+        writeLatency.Reset();
+        syncLatency.Reset();
+        blockedLatency.Reset();
+        startTicks = NowTicks();
+        ioThread = std::thread(&DiskWriter::IoLoop, this);
+        return true;
+    }
+
+    // Append data; only blocks if every chunk is waiting on the disk
+    bool Write(const void* data, size_t length) {
+        if (!IsOpen() || failed) return false;
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        while (length > 0) {
+            size_t space = options.chunkBytes - current.used;
+            size_t take = length < space ? length : space;
+            memcpy(current.data + current.used, bytes, take);
+            current.used += take;
+            bytes += take;
+            length -= take;
+            if (current.used == options.chunkBytes) {
+                SubmitCurrent();
+                current = TakeFreeChunk();
+            }
+        }
+        return !failed;
+    }
+
+    // Flush buffered data, sync, trim the preallocated tail and close
+    void Close() {
+        if (ioThread.joinable()) {
+            if (current.data && current.used > 0) SubmitCurrent();
+            else if (current.data) ReturnChunk(current);
+            current = Chunk();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            pendingReady.notify_all();
+            ioThread.join();
+
+            int64_t syncStart = NowTicks();
+            SyncFile();
+            syncLatency.Record(static_cast<uint64_t>((NowTicks() - syncStart) / 10));
+            TruncateFile(logicalSize);
+        }
+        CloseFile();
+        for (uint8_t* chunk : allChunks) FreeAligned(chunk);
+        allChunks.clear();
+        freeChunks.clear();
+        pendingChunks.clear();
+        current = Chunk();
+    }
+
+    void PrintReport() const {
+        printf("DiskWriter %s: %.1f MB written, %llu disk stall events, %llu producer stalls.\n", path.c_str(),
+               logicalSize / 1e6, static_cast<unsigned long long>(stallEvents),
+               static_cast<unsigned long long>(producerStalls));
+        writeLatency.Print("  chunk write latency");
+        syncLatency.Print("  fdatasync latency");
+        if (blockedLatency.Count()) blockedLatency.Print("  producer blocked");
+    }
+
+    bool IsOpen() const { return ioThread.joinable(); }
+    bool Failed() const { return failed; }
+    uint64_t BytesWritten() const { return logicalSize; }
+    uint64_t StallEvents() const { return stallEvents; }
+    uint64_t ProducerStalls() const { return producerStalls; }
+    const LatencyHistogram& WriteLatency() const { return writeLatency; }
+    const LatencyHistogram& SyncLatency() const { return syncLatency; }
+
+private:
+    struct Chunk {
+        uint8_t* data = nullptr;
+        size_t used = 0;
+    };
+
+    void SubmitCurrent() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pendingChunks.push_back(current);
+        }
+        pendingReady.notify_one();
+    }
+
+    Chunk TakeFreeChunk() {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (freeChunks.empty()) {
+            // The disk fell behind by the whole buffer; this is the stall we are trying to hide
+            ++producerStalls;
+            int64_t blockedStart = NowTicks();
+            // The I/O thread hands every chunk back, even after a failed write
+            chunkFreed.wait(lock, [this] { return !freeChunks.empty(); });
+            blockedLatency.Record(static_cast<uint64_t>((NowTicks() - blockedStart) / 10));
+        }
+        Chunk chunk = freeChunks.front();
+        freeChunks.pop_front();
+        chunk.used = 0;
+        return chunk;
+    }
+
+    void ReturnChunk(Chunk chunk) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            freeChunks.push_back(chunk);
+        }
+        chunkFreed.notify_one();
+    }
+
+    void IoLoop() {
+        int64_t lastSync = NowTicks();
+        uint64_t fileOffset = 0;
+        for (;;) {
+            Chunk chunk;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                pendingReady.wait_for(lock, std::chrono::milliseconds(options.syncIntervalMs ? options.syncIntervalMs : 1000),
+                                      [this] { return !pendingChunks.empty() || stopping; });
+                if (pendingChunks.empty() && stopping) break;
+                if (!pendingChunks.empty()) {
+                    chunk = pendingChunks.front();
+                    pendingChunks.pop_front();
+                }
+            }
+
+            if (chunk.data) {
+                if (!failed) {
+                    EnsurePreallocated(fileOffset + chunk.used);
+                    int64_t writeStart = NowTicks();
+                    options.throttle.Apply(chunk.used, startTicks);
+                    if (!WriteAt(chunk.data, chunk.used, fileOffset)) {
+                        printf("DiskWriter: write to %s failed at offset %llu.\n", path.c_str(),
+                               static_cast<unsigned long long>(fileOffset));
+                        failed = true;
+                    }
+                    RecordWrite(writeStart);
+                    fileOffset += chunk.used;
+                    logicalSize = fileOffset;
+                }
+                ReturnChunk(chunk);
+            }
+
+            if (!failed && options.syncIntervalMs && NowTicks() - lastSync >= options.syncIntervalMs * 10000LL) {
+                int64_t syncStart = NowTicks();
+                SyncFile();
+                syncLatency.Record(static_cast<uint64_t>((NowTicks() - syncStart) / 10));
+                lastSync = NowTicks();
+            }
+        }
+        chunkFreed.notify_all();
+    }
+
+    void RecordWrite(int64_t writeStart) {
+        uint64_t micros = static_cast<uint64_t>((NowTicks() - writeStart) / 10);
+        writeLatency.Record(micros);
+        if (micros >= options.stallThresholdMs * 1000ULL) {
+            ++stallEvents;
+            printf("[DiskWriter] stall: %.1f ms write at t=%.3f s\n", micros / 1000.0,
+                   (NowTicks() - startTicks) / static_cast<double>(TICKS_PER_SECOND));
+        }
+    }
+
+    // Reserve extents well ahead of the write position so the filesystem never
+    // allocates on the hot path
+    void EnsurePreallocated(uint64_t end) {
+        if (options.preallocateBytes == 0 || end <= preallocatedTo) return;
+        uint64_t target = preallocatedTo;
+        while (target < end) target += options.preallocateBytes;
+        if (Preallocate(preallocatedTo, target - preallocatedTo)) preallocatedTo = target;
+        else options.preallocateBytes = 0; // Not supported here; stop trying
+    }
+
+#ifdef _WIN32
+    bool OpenFile() {
+        file = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        return file != INVALID_HANDLE_VALUE;
+    }
+    bool Preallocate(uint64_t offset, uint64_t length) {
+        FILE_ALLOCATION_INFO info;
+        info.AllocationSize.QuadPart = static_cast<LONGLONG>(offset + length);
+        return SetFileInformationByHandle(file, FileAllocationInfo, &info, sizeof(info)) != 0;
+    }
+    bool WriteAt(const uint8_t* data, size_t length, uint64_t offset) {
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD written = 0;
+        return WriteFile(file, data, static_cast<DWORD>(length), &written, &overlapped) && written == length;
+    }
+    void SyncFile() { if (file != INVALID_HANDLE_VALUE) FlushFileBuffers(file); }
+    void TruncateFile(uint64_t size) {
+        LARGE_INTEGER position;
+        position.QuadPart = static_cast<LONGLONG>(size);
+        if (SetFilePointerEx(file, position, NULL, FILE_BEGIN)) SetEndOfFile(file);
+    }
+    void CloseFile() {
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+    }
+    static void* AllocateAligned(size_t size) { return _aligned_malloc(size, ALIGNMENT); }
+    static void FreeAligned(void* p) { _aligned_free(p); }
+
+    HANDLE file = INVALID_HANDLE_VALUE;
+#else
+    bool OpenFile() {
+        fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        return fd >= 0;
+    }
+    bool Preallocate(uint64_t offset, uint64_t length) {
+#ifdef __linux__
+        // KEEP_SIZE reserves blocks without moving EOF, so readers never see zero tails
+        if (fallocate(fd, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(offset), static_cast<off_t>(length)) == 0) return true;
+#endif
+        return posix_fallocate(fd, static_cast<off_t>(offset), static_cast<off_t>(length)) == 0;
+    }
+    bool WriteAt(const uint8_t* data, size_t length, uint64_t offset) {
+        while (length > 0) {
+            ssize_t written = pwrite(fd, data, length, static_cast<off_t>(offset));
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            data += written;
+            length -= static_cast<size_t>(written);
+            offset += static_cast<uint64_t>(written);
+        }
+        return true;
+    }
+    void SyncFile() { if (fd >= 0) fdatasync(fd); }
+    void TruncateFile(uint64_t size) {
+        if (fd >= 0 && ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            printf("DiskWriter: failed to trim %s.\n", path.c_str());
+        }
+    }
+    void CloseFile() {
+        if (fd >= 0) close(fd);
+        fd = -1;
+    }
+    static void* AllocateAligned(size_t size) {
+        void* p = nullptr;
+        return posix_memalign(&p, ALIGNMENT, size) == 0 ? p : nullptr;
+    }
+    static void FreeAligned(void* p) { free(p); }
+
+    int fd = -1;
+#endif
+
+    DiskWriterOptions options;
+    std::string path;
+    std::thread ioThread;
+    std::mutex mutex;
+    std::condition_variable pendingReady;
+    std::condition_variable chunkFreed;
+    std::deque<Chunk> freeChunks;
+    std::deque<Chunk> pendingChunks;
+    std::vector<uint8_t*> allChunks;
+    Chunk current;
+    bool stopping = false;
+    std::atomic<bool> failed{ false };
+    std::atomic<uint64_t> logicalSize{ 0 };
+    uint64_t preallocatedTo = 0;
+    int64_t startTicks = 0;
+    std::atomic<uint64_t> stallEvents{ 0 };
+    uint64_t producerStalls = 0;
+    LatencyHistogram writeLatency;
+    LatencyHistogram syncLatency;
+    LatencyHistogram blockedLatency;
+};
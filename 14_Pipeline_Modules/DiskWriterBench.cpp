@@ -0,0 +1,118 @@
+// DiskWriterBench.cpp
+// Simulates a capture loop writing frames to disk while the device stalls
+// periodically (injected delay), and compares the default buffered path
+// (fwrite + periodic flush on the capture thread) with the write-behind DiskWriter.
+//
+// Usage: DiskWriterBench [output-dir] [seconds] [stall-every-ms] [stall-ms]
+#include "DiskWriter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+// Constants
+const uint32_t FRAME_WIDTH = 1280;
+const uint32_t FRAME_HEIGHT = 720;
+const uint32_t FRAME_RATE_NUMERATOR = 30;
+const int64_t FRAME_INTERVAL = TICKS_PER_SECOND / FRAME_RATE_NUMERATOR;
+
+struct CaptureResult {
+    LatencyHistogram blocked; // Time the capture thread spent inside the write path
+    uint64_t lateFrames = 0;  // Frames whose write overran the frame interval
+    uint64_t frames = 0;
+};
+
+// Run a paced capture loop for the given duration, calling writeFrame per frame
+template <typename WriteFn>
+CaptureResult RunCaptureLoop(double seconds, const std::vector<uint8_t>& frame, WriteFn writeFrame) {
+    CaptureResult result;
+    const int64_t start = NowTicks();
+    int64_t nextFrame = start;
+    while (NowTicks() - start < static_cast<int64_t>(seconds * TICKS_PER_SECOND)) {
+        int64_t writeStart = NowTicks();
+        writeFrame(frame.data(), frame.size());
+        int64_t spent = NowTicks() - writeStart;
+        result.blocked.Record(static_cast<uint64_t>(spent / 10));
+        if (spent > FRAME_INTERVAL) ++result.lateFrames;
+        ++result.frames;
+
+        nextFrame += FRAME_INTERVAL;
+        int64_t wait = nextFrame - NowTicks();
+        if (wait > 0) std::this_thread::sleep_for(std::chrono::microseconds(wait / 10));
+        else nextFrame = NowTicks(); // Fell behind; a real camera would have dropped frames here
+    }
+    return result;
+}
+
+void PrintResult(const char* label, const CaptureResult& result) {
+    printf("%s: %llu frames, %llu late (%.2f%%)\n", label, static_cast<unsigned long long>(result.frames),
+           static_cast<unsigned long long>(result.lateFrames),
+           result.frames ? 100.0 * result.lateFrames / result.frames : 0.0);
+    result.blocked.Print("  capture thread in write");
+}
+
+int main(int argc, char* argv[]) {
+    std::string directory = argc > 1 ? argv[1] : "/tmp";
+    double seconds = argc > 2 ? atof(argv[2]) : 6.0;
+    WriteThrottle throttle;
+    throttle.stallEveryMs = argc > 3 ? static_cast<uint32_t>(atoi(argv[3])) : 1000;
+    throttle.stallMs = argc > 4 ? static_cast<uint32_t>(atoi(argv[4])) : 250;
+
+    std::vector<uint8_t> frame(Frame420Size(FRAME_WIDTH, FRAME_HEIGHT));
+    for (size_t i = 0; i < frame.size(); ++i) frame[i] = static_cast<uint8_t>(i * 31);
+    printf("Writing %ux%u NV12 at %u fps (%.1f MB/s) for %.0f s; device stalls %u ms every %u ms.\n\n",
+           FRAME_WIDTH, FRAME_HEIGHT, FRAME_RATE_NUMERATOR, frame.size() * FRAME_RATE_NUMERATOR / 1e6, seconds,
+           throttle.stallMs, throttle.stallEveryMs);
+
+    // Baseline: buffered stdio on the capture thread, flushed and synced once per second
+    {
+        std::string path = directory + "/diskwriter_buffered.bin";
+        FILE* out = fopen(path.c_str(), "wb");
+        if (!out) {
+            printf("Failed to create %s.\n", path.c_str());
+            return 1;
+        }
+        WriteThrottle device = throttle;
+        const int64_t start = NowTicks();
+        int64_t lastSync = start;
+        CaptureResult result = RunCaptureLoop(seconds, frame, [&](const uint8_t* data, size_t length) {
+            device.Apply(length, start);
+            fwrite(data, 1, length, out);
+            if (NowTicks() - lastSync >= TICKS_PER_SECOND) {
+                fflush(out);
+#ifndef _WIN32
+                fdatasync(fileno(out));
+#endif
+                lastSync = NowTicks();
+            }
+        });
+        fclose(out);
+        remove(path.c_str());
+        PrintResult("Buffered fwrite", result);
+    }
+    printf("\n");
+
+    // Write-behind: the same stalls land on the I/O thread
+    {
+        std::string path = directory + "/diskwriter_writebehind.bin";
+        DiskWriterOptions options;
+        options.throttle = throttle;
+        options.chunkBytes = 8 << 20;
+        options.chunkCount = 16;
+        DiskWriter writer;
+        if (!writer.Open(path, options)) return 1;
+        CaptureResult result = RunCaptureLoop(seconds, frame, [&](const uint8_t* data, size_t length) {
+            writer.Write(data, length);
+        });
+        writer.Close();
+        PrintResult("Write-behind DiskWriter", result);
+        writer.PrintReport();
+        remove(path.c_str());
+    }
+    return 0;
+}
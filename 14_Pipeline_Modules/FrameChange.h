@@ -0,0 +1,146 @@
+// FrameChange.h
+// Variable frame rate for mostly static scenes (a desk, a slide, a screen).
+// FrameChangeDetector compares a cheap sample of each frame, every rowStep-th
+// pair of luma rows averaged 2x2 to soften sensor noise, against the last frame
+// that was kept. Comparing against the last kept frame, not the previous one,
+// means a slow fade still adds up to a change. The frame counts as changed when
+// any tile of the sample differs by more than tileThreshold per pixel.
+// VfrHold drops unchanged frames and folds their time into the duration of the
+// frame before them, so the output plays back at the right speed with fewer
+// frames. maxHoldTicks caps how long one frame can stand in for the others,
+// which bounds seek distance and how stale a joining viewer's picture can be.
+#pragma once
+
+#include "PixelKernels.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+struct FrameChangeConfig {
+    uint32_t rowStep = 2;        // Sample one pair of rows in every rowStep pairs
+    uint32_t tileRows = 4;       // Sampled rows per tile; tiles are 8 sampled pixels wide
+    uint32_t tileThreshold = 2;  // Mean absolute difference per sampled pixel
+};
+
+class FrameChangeDetector {
+public:
+    bool Init(uint32_t frameWidth, uint32_t frameHeight, const FrameChangeConfig& changeConfig = FrameChangeConfig()) {
+        config = changeConfig;
+        if (config.rowStep == 0 || config.tileRows == 0) return false;
+        width = frameWidth;
+        sampleWidth = frameWidth / 2;
+        sampleRows = frameHeight / (2 * config.rowStep);
+        groups = sampleWidth / 8;
+        if (groups == 0 || sampleRows == 0) return false;
+        sample.assign(static_cast<size_t>(sampleWidth) * sampleRows, 0);
+        reference.assign(sample.size(), 0);
+        tileSums.assign(groups, 0);
+        haveReference = false;
+        lastPeak = 0;
+        return true;
+    }
+
+    // y: the frame's luma plane. True when the frame differs from the last kept one;
+    // the caller says whether it kept this frame anyway (for example at max hold).
+    bool Changed(const uint8_t* y, size_t stride) {
+        for (uint32_t row = 0; row < sampleRows; ++row) {
+            Downsample2x2(y + static_cast<size_t>(row) * 2 * config.rowStep * stride, stride, width, 2,
+                          sample.data() + static_cast<size_t>(row) * sampleWidth, sampleWidth);
+        }
+        if (!haveReference) {
+            lastPeak = 0;
+            return true;
+        }
+        // Tiles are compared as 8-pixel groups over tileRows rows; compare sums to
+        // threshold * pixels to avoid a divide per tile
+        uint32_t peak = 0;
+        for (uint32_t top = 0; top < sampleRows; top += config.tileRows) {
+            const uint32_t rows = std::min(config.tileRows, sampleRows - top);
+            std::fill(tileSums.begin(), tileSums.end(), 0);
+            for (uint32_t row = top; row < top + rows; ++row) {
+                const size_t offset = static_cast<size_t>(row) * sampleWidth;
+                AccumulateSad8(sample.data() + offset, reference.data() + offset, groups, tileSums.data());
+            }
+            for (uint32_t sum : tileSums) peak = std::max(peak, sum * 16 / (8 * rows));
+        }
+        lastPeak = peak;
+        return peak > config.tileThreshold * 16;
+    }
+
+    // The frame just analysed becomes the reference
+    void Keep() {
+        sample.swap(reference);
+        haveReference = true;
+    }
+
+    // Largest tile mean difference of the last call (x16 for one decimal of resolution)
+    uint32_t LastPeak() const { return lastPeak; }
+
+private:
+    FrameChangeConfig config;
+    uint32_t width = 0;
+    uint32_t sampleWidth = 0;
+    uint32_t sampleRows = 0;
+    uint32_t groups = 0;
+    std::vector<uint8_t> sample, reference;
+    std::vector<uint32_t> tileSums;
+    bool haveReference = false;
+    uint32_t lastPeak = 0;
+};
+
+// Holds the last kept frame until the next one arrives, so its duration can
+// cover the frames dropped after it. T is whatever the writer takes.
+template <typename T>
+class VfrHold {
+public:
+    explicit VfrHold(int64_t maxHoldTicks = 0) : maxHold(maxHoldTicks) {}
+
+    void SetMaxHold(int64_t maxHoldTicks) { maxHold = maxHoldTicks; }
+
+    // True if a frame at pts would be kept: changed, first, or the held frame has
+    // reached maxHold (0 = no limit)
+    bool WouldKeep(int64_t pts, bool changed) const {
+        return changed || !holding || (maxHold > 0 && pts - heldPts >= maxHold);
+    }
+
+    // emit(T&&, pts, duration) is called for the previously held frame when this one is kept.
+    // Returns true if the frame was kept.
+    template <typename Emit>
+    bool Push(T item, int64_t pts, bool changed, Emit emit) {
+        if (!WouldKeep(pts, changed)) {
+            ++merged;
+            return false;
+        }
+        if (holding) emit(std::move(held), heldPts, pts - heldPts);
+        held = std::move(item);
+        heldPts = pts;
+        holding = true;
+        ++kept;
+        return true;
+    }
+
+    // Write the held frame at the end of the recording; endPts is where the last
+    // captured frame would have ended
+    template <typename Emit>
+    void Flush(int64_t endPts, Emit emit) {
+        if (!holding) return;
+        emit(std::move(held), heldPts, std::max<int64_t>(endPts - heldPts, 1));
+        held = T();
+        holding = false;
+    }
+
+    uint64_t Kept() const { return kept; }
+    uint64_t Merged() const { return merged; }
+
+private:
+    int64_t maxHold;
+    T held = T();
+    int64_t heldPts = 0;
+    bool holding = false;
+    uint64_t kept = 0;
+    uint64_t merged = 0;
+};
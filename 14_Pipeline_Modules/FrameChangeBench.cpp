@@ -0,0 +1,263 @@
+// FrameChangeBench.cpp
+// Static-frame dropping with variable frame rate output, on synthetic scenes
+// with sensor noise and known content changes:
+//   slides     - a presentation: slide changes every 15 s, cursor bursts
+//   desk       - a webcam on a desk: slow daylight fade, someone reaching in
+//   full motion - a moving pattern; nothing should be dropped
+// For each scene and max hold time it reports frames kept, the longest gap,
+// whether the VFR timeline still adds up, whether any real change was dropped
+// and what the detector costs. With libjpeg, every frame (CFR) and only the
+// kept frames (VFR) are also encoded as a stand-in intra encoder to measure
+// encoder CPU and output size saved.
+// Usage: ./Run.sh FrameChangeBench [seconds]
+#include "FrameChange.h"
+#include "MediaTypes.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#ifdef HAVE_LIBJPEG
+#include <jpeglib.h>
+#endif
+
+// Constants
+const uint32_t FRAME_WIDTH = 640;
+const uint32_t FRAME_HEIGHT = 480;
+const uint32_t FPS = 30;
+const int64_t FRAME_TICKS = TICKS_PER_SECOND / FPS;
+const uint32_t MAX_LATE_FRAMES = 3; // A faint, thin change may take a few frames to add up past the threshold
+
+enum class Scene { Slides, Desk, FullMotion };
+
+// Renders one scene; tracks what the frame shows apart from noise so dropped
+// frames can be checked against the frame that stands in for them
+class SceneRenderer {
+public:
+    SceneRenderer(Scene sceneKind, uint32_t seconds) : scene(sceneKind), totalSeconds(seconds),
+        luma(FRAME_WIDTH * FRAME_HEIGHT), noise(FRAME_WIDTH * FRAME_HEIGHT + 4096) {
+        uint32_t state = 2463534242u;
+        for (int8_t& n : noise) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            n = static_cast<int8_t>(static_cast<int>(state % 7) - 3); // +/- 3 steps
+        }
+    }
+
+    const uint8_t* Render(uint64_t index) {
+        const double t = static_cast<double>(index) / FPS;
+        version = 0;
+        level = 0;
+        if (scene == Scene::Slides) {
+            const uint32_t slide = static_cast<uint32_t>(t / 15);
+            version = slide * 1000;
+            for (uint32_t y = 0; y < FRAME_HEIGHT; ++y) {
+                for (uint32_t x = 0; x < FRAME_WIDTH; ++x) {
+                    // Title bar, text lines that move with the slide number
+                    uint8_t v = 235;
+                    if (y < 60) v = 60;
+                    else if ((y - 60) % 36 < 14 && x > 40 && x < 40 + ((y / 36 * 97 + slide * 131) % 520)) v = 40;
+                    luma[y * FRAME_WIDTH + x] = v;
+                }
+            }
+            // Cursor moves for one second in every ten
+            const double burst = t - 10.0 * static_cast<uint32_t>(t / 10);
+            const uint32_t step = burst < 1.0 ? static_cast<uint32_t>(burst * FPS) : FPS;
+            const uint32_t cx = 100 + step * 12, cy = 300 - step * 5;
+            version += step + 1;
+            for (uint32_t y = cy; y < cy + 16; ++y) memset(&luma[y * FRAME_WIDTH + cx], 0, 10);
+        } else if (scene == Scene::Desk) {
+            // Daylight fades by 40 steps over the run; the ideal is that no held frame
+            // is more than a few steps off the frames it replaces
+            level = static_cast<int>(40.0 * t / totalSeconds);
+            for (uint32_t y = 0; y < FRAME_HEIGHT; ++y) {
+                for (uint32_t x = 0; x < FRAME_WIDTH; ++x) {
+                    uint32_t v = y > 300 ? 90 + (x / 64 % 2) * 15 : 150 + ((x * 3 + y) / 50 % 3) * 10;
+                    luma[y * FRAME_WIDTH + x] = static_cast<uint8_t>(v - level);
+                }
+            }
+            // An arm reaches in for 4 s every 20 s
+            const double cycle = t - 20.0 * static_cast<uint32_t>(t / 20);
+            if (cycle >= 12 && cycle < 16) {
+                const uint64_t frameInCycle = static_cast<uint64_t>((cycle - 12) * FPS);
+                version = static_cast<uint32_t>(t / 20) * 1000 + 1 + frameInCycle;
+                const uint32_t reach = static_cast<uint32_t>(frameInCycle * 300 / (4 * FPS));
+                for (uint32_t y = 320; y < 380; ++y) memset(&luma[y * FRAME_WIDTH], 60, 40 + reach);
+            }
+        } else {
+            version = static_cast<uint32_t>(index);
+            for (uint32_t y = 0; y < FRAME_HEIGHT; ++y) {
+                for (uint32_t x = 0; x < FRAME_WIDTH; ++x) luma[y * FRAME_WIDTH + x] = static_cast<uint8_t>(((x + index * 3) ^ y) & 0xFF);
+            }
+        }
+        // Fresh sensor noise every frame
+        const int8_t* n = noise.data() + (index * 1543) % 4096;
+        for (size_t i = 0; i < luma.size(); ++i) {
+            int v = luma[i] + n[i];
+            luma[i] = static_cast<uint8_t>(v < 0 ? 0 : v > 255 ? 255 : v);
+        }
+        return luma.data();
+    }
+
+    uint32_t Version() const { return version; }
+    int Level() const { return level; }
+
+private:
+    Scene scene;
+    uint32_t totalSeconds;
+    std::vector<uint8_t> luma;
+    std::vector<int8_t> noise;
+    uint32_t version = 0;
+    int level = 0;
+};
+
+#ifdef HAVE_LIBJPEG
+// Stand-in encoder: each frame as a greyscale JPEG
+class JpegEncoder {
+public:
+    JpegEncoder() {
+        compress.err = jpeg_std_error(&errors);
+        jpeg_create_compress(&compress);
+    }
+    ~JpegEncoder() {
+        jpeg_destroy_compress(&compress);
+        free(buffer);
+    }
+    size_t Encode(const uint8_t* y) {
+        unsigned long size = 0;
+        jpeg_mem_dest(&compress, &buffer, &size);
+        compress.image_width = FRAME_WIDTH;
+        compress.image_height = FRAME_HEIGHT;
+        compress.input_components = 1;
+        compress.in_color_space = JCS_GRAYSCALE;
+        jpeg_set_defaults(&compress);
+        jpeg_set_quality(&compress, 80, TRUE);
+        jpeg_start_compress(&compress, TRUE);
+        while (compress.next_scanline < compress.image_height) {
+            JSAMPROW row = const_cast<uint8_t*>(y + compress.next_scanline * FRAME_WIDTH);
+            jpeg_write_scanlines(&compress, &row, 1);
+        }
+        jpeg_finish_compress(&compress);
+        return size;
+    }
+
+private:
+    jpeg_compress_struct compress;
+    jpeg_error_mgr errors;
+    unsigned char* buffer = nullptr;
+};
+#endif
+
+struct VfrRun {
+    uint64_t frames = 0, kept = 0;
+    int64_t longestHold = 0;
+    bool timelineOk = true;
+    uint64_t staleFrames = 0;  // Dropped frames whose content really differed from the held one
+    uint32_t longestStale = 0; // Most such frames in a row: how late a small change can show up
+    int worstLevelDrift = 0;   // Largest brightness gap between a dropped frame and its stand-in
+    double detectorSeconds = 0;
+    double encodeSeconds = 0, cfrEncodeSeconds = 0;
+    uint64_t bytes = 0, cfrBytes = 0;
+};
+
+VfrRun Run(Scene scene, uint32_t seconds, int64_t maxHold, bool encode) {
+    VfrRun run;
+    SceneRenderer renderer(scene, seconds);
+    FrameChangeDetector detector;
+    detector.Init(FRAME_WIDTH, FRAME_HEIGHT);
+    VfrHold<uint64_t> hold(maxHold);
+    int64_t expectedPts = 0;
+    uint32_t heldVersion = 0;
+    int heldLevel = 0;
+    uint32_t staleRun = 0;
+    const auto emit = [&](uint64_t, int64_t pts, int64_t duration) {
+        if (pts != expectedPts || duration <= 0) run.timelineOk = false;
+        expectedPts = pts + duration;
+        if (duration > run.longestHold) run.longestHold = duration;
+    };
+#ifdef HAVE_LIBJPEG
+    JpegEncoder encoder;
+#endif
+
+    const uint64_t total = static_cast<uint64_t>(seconds) * FPS;
+    for (uint64_t i = 0; i < total; ++i) {
+        const uint8_t* y = renderer.Render(i);
+        const int64_t pts = static_cast<int64_t>(i) * FRAME_TICKS;
+        const int64_t start = NowTicks();
+        const bool changed = detector.Changed(y, FRAME_WIDTH);
+        const bool keep = hold.WouldKeep(pts, changed);
+        if (keep) detector.Keep();
+        run.detectorSeconds += (NowTicks() - start) / static_cast<double>(TICKS_PER_SECOND);
+        hold.Push(i, pts, changed, emit);
+        ++run.frames;
+
+        if (keep) {
+            heldVersion = renderer.Version();
+            heldLevel = renderer.Level();
+            staleRun = 0;
+        } else {
+            if (renderer.Version() != heldVersion) {
+                ++run.staleFrames;
+                if (++staleRun > run.longestStale) run.longestStale = staleRun;
+            }
+            int drift = renderer.Level() - heldLevel;
+            drift = drift < 0 ? -drift : drift;
+            if (drift > run.worstLevelDrift) run.worstLevelDrift = drift;
+        }
+#ifdef HAVE_LIBJPEG
+        if (encode) {
+            int64_t encodeStart = NowTicks();
+            const size_t size = encoder.Encode(y);
+            const double elapsed = (NowTicks() - encodeStart) / static_cast<double>(TICKS_PER_SECOND);
+            run.cfrEncodeSeconds += elapsed;
+            run.cfrBytes += size;
+            if (keep) {
+                run.encodeSeconds += elapsed;
+                run.bytes += size;
+            }
+        }
+#else
+        (void)encode;
+#endif
+    }
+    hold.Flush(static_cast<int64_t>(total) * FRAME_TICKS, emit);
+    run.kept = hold.Kept();
+    if (expectedPts != static_cast<int64_t>(total) * FRAME_TICKS || hold.Kept() + hold.Merged() != total) run.timelineOk = false;
+    return run;
+}
+
+int main(int argc, char** argv) {
+    const uint32_t seconds = argc > 1 ? static_cast<uint32_t>(atoi(argv[1])) : 60;
+    struct Case { const char* name; Scene scene; };
+    const Case scenes[] = { { "slides", Scene::Slides }, { "desk", Scene::Desk }, { "full motion", Scene::FullMotion } };
+    const int64_t holds[] = { TICKS_PER_SECOND / 2, 2 * TICKS_PER_SECOND };
+    bool ok = true;
+    printf("%ux%u at %u fps, %u s per scene, sensor noise +/-3\n\n", FRAME_WIDTH, FRAME_HEIGHT, FPS, seconds);
+    for (const Case& c : scenes) {
+        for (size_t h = 0; h < sizeof(holds) / sizeof(holds[0]); ++h) {
+            VfrRun run = Run(c.scene, seconds, holds[h], h == 0);
+            const double keptPercent = 100.0 * run.kept / run.frames;
+            printf("%-11s max hold %.1f s: kept %llu of %llu frames (%.1f%%, avg %.1f fps), longest frame %.2f s, timeline %s\n",
+                   c.name, static_cast<double>(holds[h]) / TICKS_PER_SECOND, static_cast<unsigned long long>(run.kept),
+                   static_cast<unsigned long long>(run.frames), keptPercent, run.kept / static_cast<double>(seconds),
+                   static_cast<double>(run.longestHold) / TICKS_PER_SECOND, run.timelineOk ? "ok" : "BROKEN");
+            printf("%-11s   dropped frames with real changes: %llu (at most %u in a row), worst fade drift %d steps, detector %.1f us/frame\n",
+                   "", static_cast<unsigned long long>(run.staleFrames), run.longestStale, run.worstLevelDrift,
+                   run.detectorSeconds / run.frames * 1e6);
+#ifdef HAVE_LIBJPEG
+            if (h == 0) {
+                printf("%-11s   JPEG encode: CFR %.2f s CPU, %.1f MB; VFR %.2f s CPU, %.1f MB (%.0f%% of the CPU, %.0f%% of the bytes)\n", "",
+                       run.cfrEncodeSeconds, run.cfrBytes / 1e6, run.encodeSeconds, run.bytes / 1e6,
+                       100.0 * run.encodeSeconds / run.cfrEncodeSeconds, 100.0 * run.bytes / run.cfrBytes);
+            }
+#endif
+            ok = ok && run.timelineOk && run.longestStale <= MAX_LATE_FRAMES && run.longestHold <= holds[h] + FRAME_TICKS;
+        }
+    }
+#ifndef HAVE_LIBJPEG
+    printf("\nBuilt without libjpeg (define HAVE_LIBJPEG and link -ljpeg for encoder CPU and size).\n");
+#endif
+    return ok ? 0 : 1;
+}
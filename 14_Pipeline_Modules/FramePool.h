@@ -0,0 +1,85 @@
+// FramePool.h
+// Fixed set of page-aligned frame buffers that are handed out and returned by
+// index. Slots are sized to a multiple of 4 KiB so they can be used for O_DIRECT
+// I/O and registered with the kernel once.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <mutex>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+class FramePool {
+public:
+    static const size_t ALIGNMENT = 4096;
+
+    FramePool() = default;
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+    ~FramePool() { Free(); }
+
+    bool Allocate(size_t slotCount, size_t frameBytes) {
+        Free();
+        slotBytes = (frameBytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+#ifdef _WIN32
+        memory = static_cast<uint8_t*>(_aligned_malloc(slotBytes * slotCount, ALIGNMENT));
+#else
+        void* p = nullptr;
+        memory = posix_memalign(&p, ALIGNMENT, slotBytes * slotCount) == 0 ? static_cast<uint8_t*>(p) : nullptr;
+#endif
+        if (!memory) return false;
+        // Touch every page now so the first frames do not pay for page faults
+        memset(memory, 0, slotBytes * slotCount);
+        count = slotCount;
+        freeSlots.clear();
+        for (size_t i = slotCount; i-- > 0;) freeSlots.push_back(static_cast<int>(i));
+        return true;
+    }
+
+    void Free() {
+#ifdef _WIN32
+        _aligned_free(memory);
+#else
+        free(memory);
+#endif
+        memory = nullptr;
+        count = 0;
+        freeSlots.clear();
+    }
+
+    // Take a free slot; returns -1 if all slots are in flight
+    int Acquire() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (freeSlots.empty()) return -1;
+        int slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+
+    void Release(int slot) {
+        std::lock_guard<std::mutex> lock(mutex);
+        freeSlots.push_back(slot);
+    }
+
+    size_t Available() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return freeSlots.size();
+    }
+
+    uint8_t* Slot(int slot) const { return memory + static_cast<size_t>(slot) * slotBytes; }
+    size_t SlotBytes() const { return slotBytes; }
+    size_t SlotCount() const { return count; }
+
+private:
+    uint8_t* memory = nullptr;
+    size_t slotBytes = 0;
+    size_t count = 0;
+    std::mutex mutex;
+    std::vector<int> freeSlots;
+};
@@ -0,0 +1,318 @@
+// FrameQueue.h
+// Bounded hand-off between a capture thread and an output thread that can
+// stall (ffmpeg's stdin, a socket). The capture thread fills preallocated
+// slots and never waits for the output; when every slot is queued the drop
+// policy decides which frame goes:
+//   DropOldest     evict the oldest queued frame: the least stale frames go
+//                  out once the output recovers
+//   DropNewest     refuse the incoming frame: what is queued goes out in order
+//   KeepKeyframes  for encoded frames: evict the oldest delta frame along with
+//                  the deltas queued after it up to the next keyframe, and
+//                  refuse incoming deltas until a keyframe arrives, so the
+//                  output never gets a frame whose reference was dropped.
+//                  A keyframe is evicted only when nothing else is queued.
+//                  Frames tagged with a temporal layer (see Begin) go top
+//                  layer first. A frame at layer L > 0 references only the
+//                  latest frame below L, so dropping it costs just the
+//                  frames above L up to the next one at L or below. A slow
+//                  output then gets half or a quarter of the frame rate
+//                  instead of losing the rest of the GOP.
+// DropOldest and DropNewest ignore references; they suit raw frames, where
+// every frame stands alone.
+// Each drop is counted, by layer too, and kept as an event (when, the frame's pts and layer, why) in a
+// fixed ring that the output thread writes out with LogDrops, so logging never
+// runs on the capture thread.
+#pragma once
+
+#include "FramePool.h"
+#include "MediaTypes.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+enum class DropPolicy { DropOldest, DropNewest, KeepKeyframes };
+
+inline const char* DropPolicyName(DropPolicy policy) {
+    switch (policy) {
+    case DropPolicy::DropOldest: return "drop-oldest";
+    case DropPolicy::DropNewest: return "drop-newest";
+    default: return "keep-keyframes";
+    }
+}
+
+enum class DropReason {
+    Evicted,   // Queued frame pushed out by a newer one
+    Refused,   // Incoming frame turned away, the queue being full
+    Dependent  // Its reference frame was dropped
+};
+
+struct QueuedFrame {
+    int slot = -1;
+    int64_t pts = 0;
+    size_t bytes = 0;
+    bool keyframe = false;
+    uint32_t layer = 0; // Temporal layer; keyframes and untagged streams are layer 0
+};
+
+struct DropEvent {
+    int64_t ticks;     // When it was dropped (NowTicks)
+    int64_t pts;
+    DropReason reason;
+    bool keyframe;
+    uint32_t layer;
+    uint32_t depth;    // Frames queued at the time
+};
+
+class BoundedFrameQueue {
+public:
+    static const size_t EVENT_CAPACITY = 1024; // Drop events kept between LogDrops calls
+    static const uint32_t MAX_LAYERS = 4;      // Drops at higher layers count as the top one
+
+    // capacity frames can wait; two more slots are the one being filled and the one being written
+    bool Init(size_t capacity, size_t frameBytes, DropPolicy dropPolicy) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (capacity == 0 || !pool.Allocate(capacity + 2, frameBytes)) return false;
+        maxQueued = capacity;
+        policy = dropPolicy;
+        queue.clear();
+        events.assign(EVENT_CAPACITY, DropEvent());
+        eventCount = eventsLost = 0;
+        pending = QueuedFrame();
+        brokenLayer = INTACT;
+        closed = false;
+        committed = evicted = refused = dependent = 0;
+        for (uint64_t& count : droppedAtLayer) count = 0;
+        highWater = 0;
+        startTicks = NowTicks();
+        return true;
+    }
+
+    // Producer: a slot for the next frame, or nullptr if the policy drops it. Never waits.
+    // layer: the frame's temporal layer, for a layered stream under KeepKeyframes
+    uint8_t* Begin(int64_t pts, bool keyframe, uint32_t layer = 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (policy == DropPolicy::KeepKeyframes) {
+            if (!keyframe && layer >= brokenLayer) {
+                Record(pts, DropReason::Dependent, false, layer);
+                return nullptr;
+            }
+            brokenLayer = INTACT;
+        }
+        if (queue.size() >= maxQueued) {
+            if (policy == DropPolicy::DropNewest) {
+                Record(pts, DropReason::Refused, keyframe, layer);
+                return nullptr;
+            }
+            if (policy == DropPolicy::DropOldest) {
+                Evict(0, DropReason::Evicted);
+            } else {
+                const uint32_t top = TopLayer();
+                if (!keyframe && layer > top) {
+                    // Nothing queued is as expendable as this frame: it goes, and the frames above it that follow
+                    Record(pts, DropReason::Refused, false, layer);
+                    brokenLayer = layer + 1;
+                    return nullptr;
+                }
+                const uint32_t broken = top > 0 ? EvictOldestAt(top) : EvictOldestDelta();
+                if (!keyframe && layer >= broken) {
+                    // Nothing after the evicted frames to depend on: this frame and those after it go too
+                    Record(pts, DropReason::Dependent, false, layer);
+                    brokenLayer = broken;
+                    return nullptr;
+                }
+            }
+        }
+        pending.slot = pool.Acquire();
+        pending.pts = pts;
+        pending.keyframe = keyframe;
+        pending.layer = keyframe ? 0 : layer;
+        return pool.Slot(pending.slot);
+    }
+
+    // Producer: a frame the caller could not queue at all (e.g. larger than a slot).
+    // Under KeepKeyframes the frames that reference it are dropped as in Begin.
+    void Refuse(int64_t pts, bool keyframe, uint32_t layer = 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Record(pts, DropReason::Refused, keyframe, layer);
+        if (policy == DropPolicy::KeepKeyframes) {
+            const uint32_t broken = keyframe || layer == 0 ? 0 : layer + 1;
+            brokenLayer = std::min(brokenLayer, broken);
+        }
+    }
+
+    // Producer: queue the frame filled since Begin
+    void Commit(size_t bytes) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.bytes = bytes;
+            queue.push_back(pending);
+            pending = QueuedFrame();
+            ++committed;
+            if (queue.size() > highWater) highWater = queue.size();
+        }
+        ready.notify_one();
+    }
+
+    // Consumer: wait for the next frame; false once closed and drained
+    bool Pop(QueuedFrame& frame) {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [this] { return closed || !queue.empty(); });
+        if (queue.empty()) return false;
+        frame = queue.front();
+        queue.pop_front();
+        return true;
+    }
+
+    const uint8_t* Data(const QueuedFrame& frame) const { return pool.Slot(frame.slot); }
+
+    // Consumer: the frame has been written
+    void Release(const QueuedFrame& frame) { pool.Release(frame.slot); }
+
+    // Producer is done; Pop drains what is queued, then returns false
+    void Close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        ready.notify_all();
+    }
+
+    // Write out the drop events since the last call, one line each, tagged with label
+    void LogDrops(FILE* log, const char* label = "drop") {
+        std::vector<DropEvent> batch;
+        uint64_t lost = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (eventCount == 0 && eventsLost == 0) return;
+            batch.assign(events.begin(), events.begin() + eventCount);
+            lost = eventsLost;
+            eventCount = eventsLost = 0;
+        }
+        if (!log) return;
+        for (const DropEvent& e : batch) {
+            char kind[32];
+            if (e.keyframe) snprintf(kind, sizeof(kind), "keyframe");
+            else if (e.layer) snprintf(kind, sizeof(kind), "layer %u frame", e.layer);
+            else snprintf(kind, sizeof(kind), "frame");
+            fprintf(log, "[%s %8.3fs] pts %8.3fs %s %s (%s, %u queued)\n", label, static_cast<double>(e.ticks - startTicks) / TICKS_PER_SECOND,
+                    static_cast<double>(e.pts) / TICKS_PER_SECOND, kind,
+                    e.reason == DropReason::Evicted ? "evicted" : e.reason == DropReason::Refused ? "refused" : "dropped with its reference",
+                    DropPolicyName(policy), e.depth);
+        }
+        if (lost) fprintf(log, "[%s] %llu more drops not logged\n", label, static_cast<unsigned long long>(lost));
+        fflush(log);
+    }
+
+    // Counters are updated under the lock by both threads, so reading them takes it too
+    size_t Depth() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return queue.size();
+    }
+
+    DropPolicy Policy() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return policy;
+    }
+    uint64_t Committed() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return committed;
+    }
+    uint64_t Evicted() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return evicted;
+    }
+    uint64_t Refused() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return refused;
+    }
+    uint64_t Dependent() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return dependent;
+    }
+    uint64_t Dropped() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return evicted + refused + dependent;
+    }
+    uint64_t DroppedAtLayer(uint32_t layer) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return layer < MAX_LAYERS ? droppedAtLayer[layer] : 0;
+    }
+    size_t HighWater() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return highWater;
+    }
+
+private:
+    static const uint32_t INTACT = 0xFFFFFFFF; // brokenLayer: no frame's reference is missing
+
+    // Called with the lock held
+    void Record(int64_t pts, DropReason reason, bool keyframe, uint32_t layer) {
+        if (reason == DropReason::Evicted) ++evicted;
+        else if (reason == DropReason::Refused) ++refused;
+        else ++dependent;
+        ++droppedAtLayer[layer < MAX_LAYERS ? layer : MAX_LAYERS - 1];
+        if (eventCount < events.size()) {
+            events[eventCount++] = DropEvent{ NowTicks(), pts, reason, keyframe, layer, static_cast<uint32_t>(queue.size()) };
+        } else {
+            ++eventsLost;
+        }
+    }
+
+    void Evict(size_t index, DropReason reason) {
+        const QueuedFrame frame = queue[index];
+        Record(frame.pts, reason, frame.keyframe, frame.layer);
+        queue.erase(queue.begin() + index);
+        pool.Release(frame.slot);
+    }
+
+    uint32_t TopLayer() const {
+        uint32_t top = 0;
+        for (const QueuedFrame& frame : queue) top = std::max(top, frame.layer);
+        return top;
+    }
+
+    // Evict the oldest frame at layer, the highest queued (above 0), so nothing queued references it.
+    // Returns the lowest layer left without a reference: layer + 1 if it was the newest frame, else INTACT.
+    uint32_t EvictOldestAt(uint32_t layer) {
+        size_t index = 0;
+        while (queue[index].layer != layer) ++index;
+        Evict(index, DropReason::Evicted);
+        return index < queue.size() ? INTACT : layer + 1;
+    }
+
+    // Evict the oldest delta and the frames after it up to the next keyframe; if there is no
+    // delta, the oldest keyframe. Returns INTACT if a keyframe is still queued after what went, else 0.
+    uint32_t EvictOldestDelta() {
+        size_t index = 0;
+        while (index < queue.size() && queue[index].keyframe) ++index;
+        if (index == queue.size()) {
+            Evict(0, DropReason::Evicted);
+            return queue.empty() ? 0 : INTACT;
+        }
+        Evict(index, DropReason::Evicted);
+        while (index < queue.size() && !queue[index].keyframe) Evict(index, DropReason::Dependent);
+        return index < queue.size() ? INTACT : 0;
+    }
+
+    FramePool pool;
+    mutable std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<QueuedFrame> queue;
+    size_t maxQueued = 0;
+    DropPolicy policy = DropPolicy::DropOldest;
+    QueuedFrame pending;
+    uint32_t brokenLayer = INTACT; // Incoming frames at this layer and above lost their reference; a keyframe or a lower frame ends it
+    bool closed = false;
+    std::vector<DropEvent> events;
+    size_t eventCount = 0;
+    uint64_t eventsLost = 0;
+    uint64_t committed = 0, evicted = 0, refused = 0, dependent = 0;
+    uint64_t droppedAtLayer[MAX_LAYERS] = {};
+    size_t highWater = 0;
+    int64_t startTicks = 0;
+};
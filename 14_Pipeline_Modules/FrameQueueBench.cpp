@@ -0,0 +1,167 @@
+// FrameQueueBench.cpp
+// BoundedFrameQueue between a 30 fps producer and an artificially slow
+// consumer, for each drop policy, against the old inline write where the
+// capture thread waits for the output itself. The stream is encoded-like: a
+// keyframe every second, deltas in between, each frame tagged with its index
+// so the consumer can tell whether it still has every reference it needs.
+// The consumer's write time follows a script: fast, then slower than the
+// frame rate (a backlog builds), then a one-second stall, then fast again.
+// Reported per policy: how long the producer spent handing off a frame, what
+// was dropped and why, deliveries whose reference had been dropped, and the
+// capture-to-write latency.
+// Usage: ./Run.sh FrameQueueBench [queue-frames]
+#include "FrameQueue.h"
+#include "MediaTypes.h"
+#include "Stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// Constants
+const uint32_t FPS = 30;
+const uint32_t GOP = 30;                  // Keyframe every second
+const size_t FRAME_BYTES = 64 * 1024;
+const double SECONDS = 6.0;
+const size_t DEFAULT_QUEUE_FRAMES = 12;   // 0.4 s at 30 fps
+const char* LOG_PATH = "/tmp/FrameQueueBench.log";
+
+struct FrameTag {
+    uint64_t index;
+    uint32_t keyframe;
+};
+
+struct RunResult {
+    LatencyHistogram handOff;  // Producer, us
+    LatencyHistogram latency;  // Capture to written, ms
+    uint64_t delivered = 0, undecodable = 0, lost = 0;
+    uint64_t evicted = 0, refused = 0, dependent = 0;
+    size_t highWater = 0;
+};
+
+// Time one write takes at t seconds into the run
+std::chrono::milliseconds WriteCost(double t) {
+    if (t >= 3.0 && t < 3.1) return std::chrono::milliseconds(1000); // One write stalls for a second
+    if (t >= 1.5 && t < 3.0) return std::chrono::milliseconds(50);   // Slower than the 33 ms frame interval
+    return std::chrono::milliseconds(8);
+}
+
+// Consumer side bookkeeping: a delta is decodable only if every frame since its keyframe arrived
+struct Decoder {
+    bool chainIntact = false;
+    uint64_t lastIndex = 0;
+
+    bool Accept(const FrameTag& tag) {
+        chainIntact = tag.keyframe ? true : chainIntact && tag.index == lastIndex + 1;
+        lastIndex = tag.index;
+        return chainIntact;
+    }
+};
+
+// pts counts from start, as capture timestamps count from the media clock's start
+void Consume(const FrameTag& tag, int64_t pts, int64_t start, Decoder& decoder, RunResult& result) {
+    std::this_thread::sleep_for(WriteCost(static_cast<double>(NowTicks() - start) / TICKS_PER_SECOND));
+    ++result.delivered;
+    if (!decoder.Accept(tag)) ++result.undecodable;
+    result.latency.Record(static_cast<uint64_t>((NowTicks() - start - pts) / 10000));
+}
+
+RunResult RunQueued(DropPolicy policy, size_t queueFrames, FILE* log) {
+    RunResult result;
+    BoundedFrameQueue queue;
+    if (!queue.Init(queueFrames, FRAME_BYTES, policy)) return result;
+    const int64_t start = NowTicks();
+    if (log) fprintf(log, "--- %s, %zu frames queued at most\n", DropPolicyName(policy), queueFrames);
+
+    std::thread consumer([&] {
+        Decoder decoder;
+        QueuedFrame frame;
+        while (queue.Pop(frame)) {
+            FrameTag tag;
+            memcpy(&tag, queue.Data(frame), sizeof(tag));
+            Consume(tag, frame.pts, start, decoder, result);
+            queue.Release(frame);
+            queue.LogDrops(log);
+        }
+        queue.LogDrops(log);
+    });
+
+    const uint64_t frames = static_cast<uint64_t>(SECONDS * FPS);
+    for (uint64_t n = 0; n < frames; ++n) {
+        const int64_t due = start + static_cast<int64_t>(n) * TICKS_PER_SECOND / FPS;
+        const int64_t now = NowTicks();
+        if (due > now) std::this_thread::sleep_for(std::chrono::nanoseconds((due - now) * 100));
+        const int64_t pts = NowTicks() - start;
+        const FrameTag tag = { n, n % GOP == 0 ? 1u : 0u };
+        uint8_t* slot = queue.Begin(pts, tag.keyframe != 0);
+        if (slot) {
+            memset(slot + sizeof(tag), static_cast<int>(n), FRAME_BYTES - sizeof(tag)); // Stands in for the scale into the slot
+            memcpy(slot, &tag, sizeof(tag));
+            queue.Commit(FRAME_BYTES);
+        }
+        result.handOff.Record(static_cast<uint64_t>((NowTicks() - start - pts) / 10));
+    }
+    queue.Close();
+    consumer.join();
+    result.evicted = queue.Evicted();
+    result.refused = queue.Refused();
+    result.dependent = queue.Dependent();
+    result.highWater = queue.HighWater();
+    return result;
+}
+
+// The old loop: the capture thread writes each frame itself; frames due while it waits are lost
+RunResult RunInline() {
+    RunResult result;
+    Decoder decoder;
+    const int64_t start = NowTicks();
+    const uint64_t frames = static_cast<uint64_t>(SECONDS * FPS);
+    for (uint64_t n = 0; n < frames; ++n) {
+        const int64_t due = start + static_cast<int64_t>(n) * TICKS_PER_SECOND / FPS;
+        const int64_t now = NowTicks();
+        if (now - due > TICKS_PER_SECOND / FPS) {
+            ++result.lost; // The device queue overflowed while the loop was writing
+            continue;
+        }
+        if (due > now) std::this_thread::sleep_for(std::chrono::nanoseconds((due - now) * 100));
+        const int64_t pts = NowTicks() - start;
+        const FrameTag tag = { n, n % GOP == 0 ? 1u : 0u };
+        Consume(tag, pts, start, decoder, result);
+        result.handOff.Record(static_cast<uint64_t>((NowTicks() - start - pts) / 10));
+    }
+    return result;
+}
+
+void Report(const char* name, const RunResult& r) {
+    printf("%-15s %7.0f %9.0f %9llu %5llu %5llu %5llu %5llu %9llu %6.0f %6.0f %6.0f %5zu\n", name,
+           static_cast<double>(r.handOff.Percentile(99)), static_cast<double>(r.handOff.Percentile(100)),
+           static_cast<unsigned long long>(r.delivered), static_cast<unsigned long long>(r.lost),
+           static_cast<unsigned long long>(r.evicted), static_cast<unsigned long long>(r.refused),
+           static_cast<unsigned long long>(r.dependent), static_cast<unsigned long long>(r.undecodable),
+           static_cast<double>(r.latency.Percentile(50)), static_cast<double>(r.latency.Percentile(99)),
+           static_cast<double>(r.latency.Percentile(100)), r.highWater);
+}
+
+int main(int argc, char** argv) {
+    const size_t queueFrames = argc > 1 ? static_cast<size_t>(std::max(1, atoi(argv[1]))) : DEFAULT_QUEUE_FRAMES;
+    printf("%u fps for %.0f s, keyframe every %u frames; consumer: 8 ms/frame, 50 ms from 1.5 s, a 1 s stall at 3 s, 8 ms from 3.1 s\n",
+           FPS, SECONDS, GOP);
+    printf("Queue: %zu frames of %zu KiB\n\n", queueFrames, FRAME_BYTES / 1024);
+    printf("%-15s %17s %9s %5s %17s %9s %20s %5s\n", "", "hand-off us", "written", "lost", "dropped", "broken", "latency ms", "queue");
+    printf("%-15s %7s %9s %9s %5s %5s %5s %5s %9s %6s %6s %6s %5s\n", "", "p99", "max", "", "", "evict", "refuse", "deps", "refs", "p50",
+           "p99", "max", "high");
+
+    FILE* log = fopen(LOG_PATH, "w");
+    Report("inline write", RunInline());
+    Report("drop-oldest", RunQueued(DropPolicy::DropOldest, queueFrames, log));
+    Report("drop-newest", RunQueued(DropPolicy::DropNewest, queueFrames, log));
+    Report("keep-keyframes", RunQueued(DropPolicy::KeepKeyframes, queueFrames, log));
+    if (log) fclose(log);
+    printf("\nlost: frames the capture loop missed while blocked; broken refs: written after one of their references was dropped\n");
+    printf("Every drop, with its time: %s\n", LOG_PATH);
+    return 0;
+}
@@ -0,0 +1,355 @@
+// GlassToGlassBench.cpp
+// Glass-to-glass latency of stream pipelines on one Linux machine. Frames are
+// stamped with their capture time (LatencyStamp.h), and a local receiver reads
+// the stamps back after decoding.
+//   1. Stamps: the stamp reads back at every rate ladder size, through noise
+//      and blur. A damaged bar is refused rather than misread.
+//   2. Pipelines: synthetic 640x360 frames at 30 fps, stamped as they are
+//      "captured", go through each configuration to a receiver that decodes
+//      them.
+//      With ffmpeg on the PATH, the livestream's x264 settings run in both
+//      stream modes, written as MPEG-TS into a FIFO and decoded by a second
+//      ffmpeg.
+//      With libjpeg, an in-process stand-in runs: frame queue, encoder thread,
+//      decoder thread. Its encoder can be made slower than real time, to show
+//      what the queue depth and drop policy cost.
+//      Samples from the first second (decoder start-up) are not counted.
+//   3. --receive: decode a stream from a stamping sender on this machine (e.g.
+//      an SRT or UDP URL) with ffmpeg, and report its latency every 10 s.
+// Usage: ./Run.sh GlassToGlassBench [seconds]
+//        ./Run.sh GlassToGlassBench --receive <input> <width> <height>
+#include "FrameQueue.h"
+#include "LatencyStamp.h"
+#include "MediaTypes.h"
+#include "Stats.h"
+#include "SyntheticMedia.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef HAVE_LIBJPEG
+#include <jpeglib.h>
+#endif
+
+// Constants
+const uint32_t WIDTH = 640;
+const uint32_t HEIGHT = 360;
+const uint32_t FPS = 30;
+const char* FIFO_PATH = "/tmp/GlassToGlassBench.ts";
+const char* DECODER_OPTIONS = "-fflags nobuffer -flags low_delay -probesize 32 -analyzeduration 0"; // A viewer tuned for latency
+
+struct FfmpegConfig {
+    const char* name;
+    const char* encoder;
+};
+
+// The livestream's encoder and muxer settings (13_youtube_livestream, top rung)
+const FfmpegConfig FFMPEG_CONFIGS[] = {
+    { "x264 faster (RTMP mode)", "-c:v libx264 -pix_fmt yuv420p -preset faster -g 60 -b:v 1000k -bufsize 5000k "
+                                 "-f mpegts -flush_packets 1" },
+    { "x264 faster zerolatency (SRT mode)", "-c:v libx264 -pix_fmt yuv420p -preset faster -tune zerolatency -g 60 -b:v 1000k "
+                                            "-bufsize 5000k -f mpegts -flush_packets 1 -muxdelay 0 -muxpreload 0" },
+    { "x264 ultrafast zerolatency", "-c:v libx264 -pix_fmt yuv420p -preset ultrafast -tune zerolatency -g 60 -b:v 1000k "
+                                    "-bufsize 5000k -f mpegts -flush_packets 1 -muxdelay 0 -muxpreload 0" },
+};
+
+int failures = 0;
+
+void Check(bool ok, const char* what) {
+    printf("  %-52s %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok) ++failures;
+}
+
+void CheckStamps() {
+    printf("Stamps:\n");
+    const uint32_t sizes[][2] = { { 640, 360 }, { 480, 270 }, { 384, 216 }, { 1280, 720 } };
+    std::mt19937 random(3);
+    std::uniform_int_distribution<int> noise(-24, 24);
+    char what[96];
+    for (const auto& size : sizes) {
+        const uint32_t w = size[0], h = size[1];
+        std::vector<uint8_t> frame(Frame420Size(w, h));
+        FillTestPattern(frame.data(), w, h, PixelFormat::NV12, 7);
+        const uint64_t stamp = 0xABCDE12345ULL;
+        uint64_t read = 0;
+        const bool written = WriteLatencyStamp(frame.data(), w, h, w, stamp);
+        snprintf(what, sizeof(what), "%ux%u clean", w, h);
+        Check(written && ReadLatencyStamp(frame.data(), w, h, w, read) && read == stamp, what);
+
+        // What a low-bitrate encode does to the bars: noise, then softened edges
+        std::vector<uint8_t> rough(frame.begin(), frame.begin() + static_cast<size_t>(w) * h);
+        for (uint8_t& p : rough) p = static_cast<uint8_t>(std::min(255, std::max(0, p + noise(random))));
+        std::vector<uint8_t> blurred(rough);
+        for (uint32_t y = 1; y + 1 < h; ++y) {
+            for (uint32_t x = 1; x + 1 < w; ++x) {
+                uint32_t sum = 0;
+                for (int dy = -1; dy <= 1; ++dy) {
+                    for (int dx = -1; dx <= 1; ++dx) sum += rough[(y + dy) * w + x + dx];
+                }
+                blurred[y * w + x] = static_cast<uint8_t>(sum / 9);
+            }
+        }
+        read = 0;
+        snprintf(what, sizeof(what), "%ux%u through noise and blur", w, h);
+        Check(ReadLatencyStamp(blurred.data(), w, h, w, read) && read == stamp, what);
+    }
+
+    // One time bar inverted: the CRC catches it
+    std::vector<uint8_t> frame(Frame420Size(WIDTH, HEIGHT));
+    WriteLatencyStamp(frame.data(), WIDTH, HEIGHT, WIDTH, 0x1234567ULL);
+    const uint32_t cell = LatencyStampCell(WIDTH, HEIGHT);
+    for (uint32_t y = 0; y < 2 * cell; ++y) {
+        uint8_t* bar = frame.data() + y * WIDTH + 20 * cell;
+        memset(bar, bar[0] == LATENCY_STAMP_WHITE ? LATENCY_STAMP_BLACK : LATENCY_STAMP_WHITE, cell);
+    }
+    uint64_t read = 0;
+    Check(!ReadLatencyStamp(frame.data(), WIDTH, HEIGHT, WIDTH, read), "a flipped bar is refused");
+    FillTestPattern(frame.data(), WIDTH, HEIGHT, PixelFormat::NV12, 1);
+    Check(!ReadLatencyStamp(frame.data(), WIDTH, HEIGHT, WIDTH, read), "an unstamped frame is refused");
+    Check(!WriteLatencyStamp(frame.data(), 160, 90, 160, 1), "160x90 is too small to stamp");
+}
+
+void PrintHeader() {
+    printf("%-38s %7s %7s %7s %8s %8s %8s %8s\n", "", "sent", "read", "bad", "p50 ms", "p90 ms", "p99 ms", "max ms");
+}
+
+void Report(const char* name, uint64_t sent, const GlassToGlassMeter& meter) {
+    const LatencyHistogram& l = meter.Latency();
+    printf("%-38s %7llu %7llu %7llu %8.1f %8.1f %8.1f %8.1f\n", name, static_cast<unsigned long long>(sent),
+           static_cast<unsigned long long>(l.Count()), static_cast<unsigned long long>(meter.Unreadable()), l.Percentile(50) / 1000.0,
+           l.Percentile(90) / 1000.0, l.Percentile(99) / 1000.0, l.Max() / 1000.0);
+}
+
+// Synthetic capture at FPS: frame n is stamped when its capture time comes, then handed to deliver
+template <typename Deliver>
+uint64_t Capture(double seconds, Deliver deliver) {
+    std::vector<uint8_t> frame(Frame420Size(WIDTH, HEIGHT));
+    const auto start = std::chrono::steady_clock::now();
+    uint64_t n = 0;
+    for (; n < seconds * FPS; ++n) {
+        FillTestPattern(frame.data(), WIDTH, HEIGHT, PixelFormat::NV12, n);
+        std::this_thread::sleep_until(start + std::chrono::microseconds(static_cast<int64_t>(n * 1000000 / FPS)));
+        WriteLatencyStamp(frame.data(), WIDTH, HEIGHT, WIDTH, LatencyStampMicros());
+        if (!deliver(frame)) break;
+    }
+    return n;
+}
+
+// Count from the second second: the decoder's start-up is not the pipeline's latency
+void Receive(GlassToGlassMeter& meter, const uint8_t* luma, uint64_t& received) {
+    meter.Frame(luma, WIDTH, HEIGHT, WIDTH);
+    if (++received == FPS) meter.Reset();
+}
+
+bool HaveFfmpeg() {
+    return system("ffmpeg -version > /dev/null 2>&1") == 0;
+}
+
+// Encoder ffmpeg into a FIFO, decoder ffmpeg out of it, raw luma back to this process
+void RunFfmpeg(const FfmpegConfig& config, double seconds) {
+    unlink(FIFO_PATH);
+    if (mkfifo(FIFO_PATH, 0600) != 0) return;
+    const std::string decode = std::string("ffmpeg -loglevel error ") + DECODER_OPTIONS + " -f mpegts -i " + FIFO_PATH +
+                               " -f rawvideo -pix_fmt gray -";
+    const std::string encode = "ffmpeg -loglevel error -y -f rawvideo -pix_fmt nv12 -s " + std::to_string(WIDTH) + "x" +
+                               std::to_string(HEIGHT) + " -r " + std::to_string(FPS) + " -i - " + config.encoder + " " + FIFO_PATH;
+    FILE* decoder = popen(decode.c_str(), "r");
+    FILE* encoder = popen(encode.c_str(), "w");
+    if (!decoder || !encoder) {
+        printf("Cannot start ffmpeg.\n");
+        return;
+    }
+    GlassToGlassMeter meter;
+    std::thread receiver([&] {
+        std::vector<uint8_t> luma(static_cast<size_t>(WIDTH) * HEIGHT);
+        uint64_t received = 0;
+        while (fread(luma.data(), 1, luma.size(), decoder) == luma.size()) Receive(meter, luma.data(), received);
+    });
+    const uint64_t sent = Capture(seconds, [&](const std::vector<uint8_t>& frame) {
+        return fwrite(frame.data(), 1, frame.size(), encoder) == frame.size() && fflush(encoder) == 0;
+    });
+    pclose(encoder); // The encoder flushes and closes the FIFO; the decoder reaches its end
+    receiver.join();
+    pclose(decoder);
+    unlink(FIFO_PATH);
+    Report(config.name, sent, meter);
+}
+
+#ifdef HAVE_LIBJPEG
+
+struct JpegConfig {
+    const char* name;
+    int quality;
+    int extraEncodeMs; // Makes the encoder slower than real time
+    size_t queueFrames;
+    DropPolicy policy;
+};
+
+const JpegConfig JPEG_CONFIGS[] = {
+    { "jpeg q85, queue 12", 85, 0, 12, DropPolicy::DropOldest },
+    { "jpeg q20, queue 12", 20, 0, 12, DropPolicy::DropOldest },
+    { "slow encoder, queue 12, drop oldest", 85, 40, 12, DropPolicy::DropOldest },
+    { "slow encoder, queue 12, drop newest", 85, 40, 12, DropPolicy::DropNewest },
+    { "slow encoder, queue 2, drop oldest", 85, 40, 2, DropPolicy::DropOldest },
+};
+
+std::vector<uint8_t> EncodeLuma(const uint8_t* luma, int quality) {
+    jpeg_compress_struct compress;
+    jpeg_error_mgr errors;
+    compress.err = jpeg_std_error(&errors);
+    jpeg_create_compress(&compress);
+    unsigned char* buffer = nullptr;
+    unsigned long size = 0;
+    jpeg_mem_dest(&compress, &buffer, &size);
+    compress.image_width = WIDTH;
+    compress.image_height = HEIGHT;
+    compress.input_components = 1;
+    compress.in_color_space = JCS_GRAYSCALE;
+    jpeg_set_defaults(&compress);
+    jpeg_set_quality(&compress, quality, TRUE);
+    jpeg_start_compress(&compress, TRUE);
+    while (compress.next_scanline < compress.image_height) {
+        JSAMPROW row = const_cast<uint8_t*>(luma + compress.next_scanline * WIDTH);
+        jpeg_write_scanlines(&compress, &row, 1);
+    }
+    jpeg_finish_compress(&compress);
+    std::vector<uint8_t> encoded(buffer, buffer + size);
+    jpeg_destroy_compress(&compress);
+    free(buffer);
+    return encoded;
+}
+
+bool DecodeLuma(const std::vector<uint8_t>& encoded, std::vector<uint8_t>& luma) {
+    jpeg_decompress_struct decompress;
+    jpeg_error_mgr errors;
+    decompress.err = jpeg_std_error(&errors);
+    jpeg_create_decompress(&decompress);
+    jpeg_mem_src(&decompress, const_cast<uint8_t*>(encoded.data()), static_cast<unsigned long>(encoded.size()));
+    if (jpeg_read_header(&decompress, TRUE) != JPEG_HEADER_OK) {
+        jpeg_destroy_decompress(&decompress);
+        return false;
+    }
+    decompress.out_color_space = JCS_GRAYSCALE;
+    jpeg_start_decompress(&decompress);
+    luma.resize(static_cast<size_t>(WIDTH) * HEIGHT);
+    while (decompress.output_scanline < decompress.output_height && decompress.output_scanline < HEIGHT) {
+        JSAMPROW row = luma.data() + static_cast<size_t>(decompress.output_scanline) * WIDTH;
+        jpeg_read_scanlines(&decompress, &row, 1);
+    }
+    jpeg_finish_decompress(&decompress);
+    jpeg_destroy_decompress(&decompress);
+    return true;
+}
+
+// Capture into a BoundedFrameQueue as the livestream does; an encoder thread
+// hands JPEGs over to a decoder thread, which reads the stamps
+void RunJpeg(const JpegConfig& config, double seconds) {
+    BoundedFrameQueue queue;
+    if (!queue.Init(config.queueFrames, Frame420Size(WIDTH, HEIGHT), config.policy)) return;
+    std::mutex lock;
+    std::condition_variable ready;
+    std::deque<std::vector<uint8_t>> transport;
+    bool encoderDone = false;
+
+    std::thread encoder([&] {
+        QueuedFrame frame;
+        while (queue.Pop(frame)) {
+            std::vector<uint8_t> encoded = EncodeLuma(queue.Data(frame), config.quality);
+            queue.Release(frame);
+            if (config.extraEncodeMs) std::this_thread::sleep_for(std::chrono::milliseconds(config.extraEncodeMs));
+            std::lock_guard<std::mutex> hold(lock);
+            transport.push_back(std::move(encoded));
+            ready.notify_one();
+        }
+        std::lock_guard<std::mutex> hold(lock);
+        encoderDone = true;
+        ready.notify_one();
+    });
+    GlassToGlassMeter meter;
+    std::thread decoder([&] {
+        std::vector<uint8_t> luma;
+        uint64_t received = 0;
+        for (;;) {
+            std::vector<uint8_t> encoded;
+            {
+                std::unique_lock<std::mutex> hold(lock);
+                ready.wait(hold, [&] { return !transport.empty() || encoderDone; });
+                if (transport.empty()) return;
+                encoded = std::move(transport.front());
+                transport.pop_front();
+            }
+            if (DecodeLuma(encoded, luma)) Receive(meter, luma.data(), received);
+        }
+    });
+
+    const uint64_t sent = Capture(seconds, [&](const std::vector<uint8_t>& frame) {
+        uint8_t* slot = queue.Begin(static_cast<int64_t>(LatencyStampMicros()) * 10, true);
+        if (slot) {
+            memcpy(slot, frame.data(), frame.size());
+            queue.Commit(frame.size());
+        }
+        return true;
+    });
+    queue.Close();
+    encoder.join();
+    decoder.join();
+    Report(config.name, sent, meter);
+}
+
+#endif // HAVE_LIBJPEG
+
+// Report the latency of a stamped stream from elsewhere on this machine, every 10 s until it ends
+int ReceiveOnly(const char* input, uint32_t width, uint32_t height) {
+    const std::string decode = std::string("ffmpeg -loglevel error ") + DECODER_OPTIONS + " -i \"" + input +
+                               "\" -f rawvideo -pix_fmt gray -s " + std::to_string(width) + "x" + std::to_string(height) + " -";
+    FILE* decoder = popen(decode.c_str(), "r");
+    if (!decoder) return 1;
+    GlassToGlassMeter meter;
+    std::vector<uint8_t> luma(static_cast<size_t>(width) * height);
+    auto windowStart = std::chrono::steady_clock::now();
+    PrintHeader();
+    while (fread(luma.data(), 1, luma.size(), decoder) == luma.size()) {
+        meter.Frame(luma.data(), width, height, width);
+        if (std::chrono::steady_clock::now() - windowStart >= std::chrono::seconds(10)) {
+            Report(input, meter.Frames(), meter);
+            meter.Reset();
+            windowStart = std::chrono::steady_clock::now();
+        }
+    }
+    Report(input, meter.Frames(), meter);
+    pclose(decoder);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc == 5 && strcmp(argv[1], "--receive") == 0) return ReceiveOnly(argv[2], atoi(argv[3]), atoi(argv[4]));
+    const double seconds = argc > 1 ? atof(argv[1]) : 8.0;
+
+    CheckStamps();
+    printf("\nPipelines: %ux%u at %u fps for %.0f s; read: frames whose stamp was read after the first second, bad: unreadable\n",
+           WIDTH, HEIGHT, FPS, seconds);
+    PrintHeader();
+    if (HaveFfmpeg()) {
+        for (const FfmpegConfig& config : FFMPEG_CONFIGS) RunFfmpeg(config, seconds);
+    } else {
+        printf("(ffmpeg is not on the PATH: the x264 pipelines are skipped)\n");
+    }
+#ifdef HAVE_LIBJPEG
+    for (const JpegConfig& config : JPEG_CONFIGS) RunJpeg(config, seconds);
+#else
+    printf("(built without libjpeg: define HAVE_LIBJPEG and link -ljpeg for the in-process pipelines)\n");
+#endif
+    return failures ? 1 : 0;
+}
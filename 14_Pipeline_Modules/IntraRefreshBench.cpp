@@ -0,0 +1,178 @@
+// IntraRefreshBench.cpp
+// Frame sizes and uplink queueing with periodic IDRs and with intra refresh
+// (VideoEncoder.h). 20 s of 640x360 video at 30 fps and 1 Mbps are encoded in
+// each mode, with IDRs placed by a KeyframeController. The frame sizes then go
+// through an uplink with 50% headroom (1.5 Mbps): each frame joins the send
+// queue at its capture time, and the queue drains at the link rate, as the
+// socket's send buffer would.
+// Reported per mode: frame size mean, standard deviation and largest; the send
+// queue's peak depth; and how long each frame waits to leave (p50/p99/max).
+//   With libavcodec: libx264 through LibavH264Encoder on the moving test
+//   pattern, with the livestream's settings (VBV 5 s without a peak rate) and
+//   with a tight VBV, each with and without intra refresh. Also checks that
+//   an IDR can still be forced in intra refresh mode.
+//   Without it: a size model (an IDR 10x a P frame, +-15% noise on every
+//   frame) shows the queueing alone; those rows are marked "model".
+// Usage: ./Run.sh IntraRefreshBench
+#include "KeyframeControl.h"
+#include "MediaTypes.h"
+#include "Stats.h"
+#include "SyntheticMedia.h"
+#include "VideoEncoder.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+// Constants
+const uint32_t WIDTH = 640;
+const uint32_t HEIGHT = 360;
+const uint32_t FPS = 30;
+const uint32_t BITRATE = 1000000;
+const double LINK_BITRATE = 1.5 * BITRATE;
+const uint32_t SECONDS = 20;
+const uint32_t GOP_FRAMES = 2 * FPS;
+const uint32_t REFRESH_FRAMES = FPS;
+
+int failures = 0;
+
+void Check(bool ok, const char* what) {
+    printf("  %-56s %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok) ++failures;
+}
+
+// Frame sizes through the uplink: frame n is queued at n / FPS
+void Report(const char* name, const std::vector<size_t>& sizes) {
+    double sum = 0, squares = 0;
+    size_t largest = 0;
+    for (size_t size : sizes) {
+        sum += size;
+        squares += static_cast<double>(size) * size;
+        largest = std::max(largest, size);
+    }
+    const double mean = sizes.empty() ? 0 : sum / sizes.size();
+    const double deviation = sizes.empty() ? 0 : sqrt(std::max(0.0, squares / sizes.size() - mean * mean));
+
+    const double linkBytesPerSecond = LINK_BITRATE / 8;
+    LatencyHistogram wait;
+    double queued = 0, peak = 0;
+    for (size_t n = 0; n < sizes.size(); ++n) {
+        if (n > 0) queued = std::max(0.0, queued - linkBytesPerSecond / FPS);
+        queued += sizes[n];
+        peak = std::max(peak, queued);
+        wait.Record(static_cast<uint64_t>(queued / linkBytesPerSecond * 1e6)); // Until its last byte has left
+    }
+    printf("%-44s %7.1f %7.1f %7.1f %9.1f %11.1f %7.0f %7.0f %7.0f\n", name, mean / 1000, deviation / 1000, largest / 1000.0,
+           mean > 0 ? largest / mean : 0.0, peak / 1000, wait.Percentile(50) / 1000.0, wait.Percentile(99) / 1000.0, wait.Max() / 1000.0);
+}
+
+void PrintHeader() {
+    printf("%-44s %7s %7s %7s %9s %11s %7s %7s %7s\n", "", "mean KB", "sd KB", "max KB", "max/mean", "queue KB", "p50 ms", "p99 ms",
+           "max ms");
+}
+
+// The same stream as a size model: what matters to the uplink is how the bytes are spread
+std::vector<size_t> ModelSizes(bool intraRefresh) {
+    std::mt19937 random(5);
+    std::uniform_real_distribution<double> noise(0.85, 1.15);
+    const double mean = BITRATE / 8.0 / FPS;
+    const double delta = mean * GOP_FRAMES / (GOP_FRAMES - 1 + 10); // An IDR costs 10 P frames
+    KeyframeController keyframes;
+    keyframes.Reset({ intraRefresh ? 0 : GOP_FRAMES, 0 });
+    std::vector<size_t> sizes;
+    for (uint32_t n = 0; n < SECONDS * FPS; ++n) {
+        const bool idr = keyframes.NextFrame() != KeyframeReason::None;
+        const double size = intraRefresh ? (idr ? 10 * delta : mean) : (idr ? 10 * delta : delta);
+        sizes.push_back(static_cast<size_t>(size * noise(random)));
+    }
+    return sizes;
+}
+
+#ifdef HAVE_LIBAVCODEC
+
+struct EncodeMode {
+    const char* name;
+    uint32_t bufferMs;
+    uint32_t maxBitrate;
+    uint32_t intraRefreshFrames;
+};
+
+const EncodeMode MODES[] = {
+    { "periodic IDR 2 s, VBV 5 s (as streamed)", 5000, 0, 0 },
+    { "periodic IDR 2 s, VBV 200 ms capped", 200, BITRATE, 0 },
+    { "intra refresh 1 s, VBV 5 s", 5000, 0, REFRESH_FRAMES },
+    { "intra refresh 1 s, VBV 200 ms capped", 200, BITRATE, REFRESH_FRAMES },
+};
+
+// Encode the test pattern; forced lists extra frames to force to IDRs. Sizes by frame, and the frames that carry an IDR slice.
+bool Encode(const EncodeMode& mode, const std::vector<uint32_t>& forced, std::vector<size_t>& sizes, std::vector<uint32_t>& idrs) {
+    LibavH264Encoder encoder;
+    VideoEncoderConfig config;
+    config.width = WIDTH;
+    config.height = HEIGHT;
+    config.fps = FPS;
+    config.bitrate = BITRATE;
+    config.bufferMs = mode.bufferMs;
+    config.maxBitrate = mode.maxBitrate;
+    config.intraRefreshFrames = mode.intraRefreshFrames;
+    if (!encoder.Open(config)) return false;
+    KeyframeController keyframes;
+    keyframes.Reset({ mode.intraRefreshFrames ? 0 : GOP_FRAMES, 0 }); // The sweep stands in for periodic IDRs
+    const int64_t frameTicks = TICKS_PER_SECOND / FPS;
+    sizes.assign(SECONDS * FPS, 0);
+    idrs.clear();
+    auto sink = [&](const EncodedVideoPacket& packet) {
+        const size_t n = static_cast<size_t>(packet.pts / frameTicks);
+        if (n < sizes.size()) sizes[n] = packet.size;
+        for (int type : H264NalTypes(packet.data, packet.size)) {
+            if (type == 5) {
+                idrs.push_back(static_cast<uint32_t>(n));
+                break;
+            }
+        }
+    };
+    std::vector<uint8_t> pixels(Frame420Size(WIDTH, HEIGHT));
+    for (uint32_t n = 0; n < SECONDS * FPS; ++n) {
+        for (uint32_t f : forced) {
+            if (f == n) keyframes.RequestKeyframe(KeyframeReason::Request);
+        }
+        FillTestPattern(pixels.data(), WIDTH, HEIGHT, PixelFormat::NV12, n);
+        VideoFrame frame;
+        Describe420Frame(frame, pixels.data(), WIDTH, HEIGHT, PixelFormat::NV12);
+        frame.pts = n * frameTicks;
+        if (!encoder.Encode(frame, keyframes.NextFrame() != KeyframeReason::None, sink)) return false;
+    }
+    return encoder.Flush(sink);
+}
+
+#endif // HAVE_LIBAVCODEC
+
+int main() {
+    printf("%u s at %ux%u, %u fps, %u kbps; uplink %.0f kbps\n", SECONDS, WIDTH, HEIGHT, FPS, BITRATE / 1000, LINK_BITRATE / 1000);
+    PrintHeader();
+#ifdef HAVE_LIBAVCODEC
+    std::vector<size_t> sizes;
+    std::vector<uint32_t> idrs;
+    for (const EncodeMode& mode : MODES) {
+        if (!Encode(mode, {}, sizes, idrs)) {
+            printf("%-44s encode failed\n", mode.name);
+            ++failures;
+            continue;
+        }
+        Report(mode.name, sizes);
+    }
+    Report("periodic IDR 2 s (model)", ModelSizes(false));
+    Report("intra refresh 1 s (model)", ModelSizes(true));
+
+    printf("\nIntra refresh:\n");
+    const bool encoded = Encode(MODES[3], { 100, 450 }, sizes, idrs);
+    Check(encoded && idrs == std::vector<uint32_t>({ 0, 100, 450 }), "IDRs only at the start and where forced (100, 450)");
+#else
+    Report("periodic IDR 2 s (model)", ModelSizes(false));
+    Report("intra refresh 1 s (model)", ModelSizes(true));
+    printf("\nBuilt without libavcodec (define HAVE_LIBAVCODEC and link libavcodec/libavutil to encode with libx264).\n");
+#endif
+    return failures ? 1 : 0;
+}
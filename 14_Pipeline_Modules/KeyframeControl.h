@@ -0,0 +1,184 @@
+// KeyframeControl.h
+// Keyframes on demand. With the GOP length fixed in the encoder's command line,
+// a viewer who joins mid-GOP waits up to a whole GOP for a picture, and nothing
+// can put a keyframe where a segment is to be cut. Here the encoder asks, frame
+// by frame, whether to code an IDR:
+//   GopPolicy           - the longest gap between keyframes (0: only when one is
+//                         asked for), and the shortest gap before an asked-for
+//                         one, so a burst of requests costs one keyframe
+//   KeyframeReason      - who asked: a new stream, the interval, the control
+//                         API, a segment cut or a new subscriber
+//   KeyframeController  - RequestKeyframe and SetPolicy from any thread; the
+//                         encoder thread calls NextFrame once per frame and
+//                         forces an IDR when it returns a reason, then calls
+//                         KeyframeSent once that IDR is out, so requests stamped
+//                         at or before its capture that arrived while it was
+//                         being coded count as answered by it. Later requests
+//                         wait for the next keyframe, since this one comes before
+//                         them in the stream. A new policy applies from the next
+//                         frame, without an encoder restart.
+// The encoder's own keyframe placement (keyint, scene cuts) should be off, so
+// that every keyframe in the stream is one of these.
+#pragma once
+
+#include "MediaTypes.h"
+#include "Stats.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+struct GopPolicy {
+    uint32_t maxFrames = 60; // Longest GOP; 0: keyframes only when asked for
+    uint32_t minFrames = 0;  // Asked-for keyframes at least this far apart; requests in between wait and merge
+};
+
+enum class KeyframeReason : uint32_t {
+    None,       // Not a keyframe
+    Start,      // First frame of a stream
+    Interval,   // GopPolicy::maxFrames reached
+    Request,    // The control API
+    Segment,    // A segment cut
+    Subscriber, // A destination or viewer connected
+    Count
+};
+
+inline const char* KeyframeReasonName(KeyframeReason reason) {
+    switch (reason) {
+    case KeyframeReason::Start: return "start";
+    case KeyframeReason::Interval: return "interval";
+    case KeyframeReason::Request: return "request";
+    case KeyframeReason::Segment: return "segment";
+    case KeyframeReason::Subscriber: return "subscriber";
+    default: return "none";
+    }
+}
+
+class KeyframeController {
+public:
+    // A new stream: its first frame is a keyframe. Counters start over.
+    void Reset(const GopPolicy& gopPolicy) {
+        SetPolicy(gopPolicy);
+        Restart();
+        {
+            std::lock_guard<std::mutex> hold(lock);
+            pending = 0;
+            firstRequest = lastRequest = 0;
+            inFlight = false;
+            keyframeAt = 0;
+        }
+        requests = 0;
+        frames = 0;
+        for (uint64_t& count : keyframes) count = 0;
+        requestWait.Reset();
+    }
+
+    // The encoder was reopened: its next frame is a keyframe; counters and pending requests carry on
+    void Restart() { restart = true; }
+
+    // Any thread; used from the next frame on
+    void SetPolicy(const GopPolicy& gopPolicy) {
+        std::lock_guard<std::mutex> hold(lock);
+        policy = gopPolicy;
+    }
+
+    GopPolicy Policy() const {
+        std::lock_guard<std::mutex> hold(lock);
+        return policy;
+    }
+
+    // Any thread: make a coming frame a keyframe, the next one the policy's minFrames allows
+    void RequestKeyframe(KeyframeReason reason, int64_t now = NowTicks()) {
+        if (reason == KeyframeReason::None || reason >= KeyframeReason::Count) return;
+        std::lock_guard<std::mutex> hold(lock);
+        if (!pending) firstRequest = lastRequest = now;
+        lastRequest = std::max(lastRequest, now);
+        pending |= 1u << static_cast<uint32_t>(reason);
+        ++requests;
+    }
+
+    // Encoder thread, once per frame before it is encoded (now: its capture time): why it must be an IDR, or None
+    KeyframeReason NextFrame(int64_t now = NowTicks()) {
+        // Requests and this decision are serialized, so a request is either served here or left whole
+        std::lock_guard<std::mutex> hold(lock);
+        const GopPolicy current = policy;
+        ++frames;
+        KeyframeReason reason = KeyframeReason::None;
+        const uint32_t asked = pending;
+        if (restart) {
+            reason = KeyframeReason::Start;
+        } else if (asked && sinceKeyframe >= current.minFrames) {
+            uint32_t first = 1;
+            while (!(asked & (1u << first))) ++first;
+            reason = static_cast<KeyframeReason>(first);
+        } else if (current.maxFrames && sinceKeyframe >= current.maxFrames) {
+            reason = KeyframeReason::Interval;
+        }
+        if (reason == KeyframeReason::None) {
+            ++sinceKeyframe;
+            return reason;
+        }
+        // Every keyframe serves whatever was asked for up to now
+        restart = false;
+        sinceKeyframe = 1;
+        if (asked) requestWait.Record(static_cast<uint64_t>(std::max<int64_t>(now - firstRequest, 0) / 10));
+        pending = 0;
+        firstRequest = lastRequest = 0;
+        inFlight = true;
+        keyframeAt = now;
+        ++keyframes[static_cast<uint32_t>(reason)];
+        return reason;
+    }
+
+    // Encoder thread, once the keyframe NextFrame asked for has been output. Requests that arrived
+    // while it was coded but are stamped at or before its capture are answered by it; a request
+    // stamped later must be followed by a keyframe, so then all pending requests wait for the next one
+    void KeyframeSent(int64_t now = NowTicks()) {
+        std::lock_guard<std::mutex> hold(lock);
+        if (!inFlight) return;
+        inFlight = false;
+        if (!pending || lastRequest > keyframeAt) return;
+        requestWait.Record(static_cast<uint64_t>(std::max<int64_t>(now - firstRequest, 0) / 10));
+        pending = 0;
+        firstRequest = lastRequest = 0;
+    }
+
+    // Counters; read them from the encoder thread or after it has stopped
+    uint64_t Frames() const { return frames; }
+    uint64_t Keyframes(KeyframeReason reason) const { return keyframes[static_cast<uint32_t>(reason)]; }
+    uint64_t Keyframes() const {
+        uint64_t total = 0;
+        for (uint32_t i = 1; i < static_cast<uint32_t>(KeyframeReason::Count); ++i) total += keyframes[i];
+        return total;
+    }
+    uint64_t Requests() const { return requests; }
+    const LatencyHistogram& RequestWait() const { return requestWait; } // First request to the keyframe, us
+
+    void PrintStats(FILE* out, const char* label) const {
+        fprintf(out, "%s %llu keyframes in %llu frames (", label, static_cast<unsigned long long>(Keyframes()),
+                static_cast<unsigned long long>(frames));
+        for (uint32_t i = 1; i < static_cast<uint32_t>(KeyframeReason::Count); ++i) {
+            fprintf(out, "%s%s %llu", i > 1 ? ", " : "", KeyframeReasonName(static_cast<KeyframeReason>(i)),
+                    static_cast<unsigned long long>(keyframes[i]));
+        }
+        fprintf(out, "); %llu requests, answered in p50 %.0f ms, max %.0f ms\n", static_cast<unsigned long long>(requests.load()),
+                requestWait.Percentile(50) / 1000.0, requestWait.Max() / 1000.0);
+    }
+
+private:
+    mutable std::mutex lock;
+    GopPolicy policy;
+    uint32_t pending = 0;      // One bit per KeyframeReason; under lock
+    int64_t firstRequest = 0;  // Oldest unanswered request, ticks; under lock
+    int64_t lastRequest = 0;   // Newest unanswered request, ticks; under lock
+    bool inFlight = false;     // NextFrame chose a keyframe that KeyframeSent has not reported yet; under lock
+    int64_t keyframeAt = 0;    // Capture time NextFrame was given for that keyframe; under lock
+    std::atomic<uint64_t> requests{ 0 };
+    bool restart = true;
+    uint32_t sinceKeyframe = 0; // Frames since the last keyframe, counting it
+    uint64_t frames = 0;
+    uint64_t keyframes[static_cast<uint32_t>(KeyframeReason::Count)] = {};
+    LatencyHistogram requestWait;
+};
@@ -0,0 +1,366 @@
+// KeyframeControlBench.cpp
+// Keyframes on demand (KeyframeControl.h):
+//   1. The controller, frame by frame: the first frame and the interval, a
+//      request answered on the next frame, a burst of requests merged into one
+//      keyframe under minFrames, a policy change applied at once, keyframes only
+//      on request, a restart, requests made while a keyframe is being coded,
+//      and requests from several threads.
+//   2. Join latency. An encoder stand-in (SyntheticTsStream at 30 fps, keyframes
+//      40 KB and other frames 5 KB, placed by the controller) feeds a local TCP
+//      server. Viewers connect at random times, about 2.5 a second, plus a burst
+//      of 10 at once halfway. Each viewer times how long it waits for its first
+//      keyframe, which is the first picture it can show. With "IDR on join" the
+//      server asks for a keyframe as each viewer connects.
+//      Reported per policy: the join waits, keyframes a minute and the bitrate
+//      they cost.
+//   3. With libavcodec: libx264 through LibavH264Encoder codes exactly the
+//      forced frames as IDRs, each with SPS and PPS in front.
+// Usage: ./Run.sh KeyframeControlBench [seconds per policy]
+#include "KeyframeControl.h"
+#include "MediaTypes.h"
+#include "Stats.h"
+#include "SyntheticMedia.h"
+#include "VideoEncoder.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Constants
+const uint32_t FPS = 30;
+const size_t KEYFRAME_BYTES = 40000;
+const size_t DELTA_BYTES = 5000;
+const double JOINS_PER_SECOND = 2.5;
+const int BURST_VIEWERS = 10;
+
+struct JoinPolicy {
+    const char* name;
+    GopPolicy gop;
+    bool idrOnJoin;
+};
+
+const JoinPolicy POLICIES[] = {
+    { "fixed GOP 5 s", { 5 * FPS, 0 }, false },
+    { "fixed GOP 2 s", { 2 * FPS, 0 }, false },
+    { "GOP 5 s + IDR on join", { 5 * FPS, FPS / 2 }, true },
+    { "GOP 5 s + IDR on join, 1 s apart", { 5 * FPS, FPS }, true },
+};
+
+int failures = 0;
+
+void Check(bool ok, const char* what) {
+    printf("  %-56s %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok) ++failures;
+}
+
+// Frames from..to-1 through the controller; before(frame) runs ahead of each. Returns the keyframes.
+std::vector<uint32_t> RunFrames(KeyframeController& controller, uint32_t from, uint32_t to,
+                                const std::function<void(uint32_t)>& before = nullptr) {
+    std::vector<uint32_t> keys;
+    for (uint32_t frame = from; frame < to; ++frame) {
+        if (before) before(frame);
+        if (controller.NextFrame() != KeyframeReason::None) keys.push_back(frame);
+    }
+    return keys;
+}
+
+void CheckController() {
+    printf("Controller:\n");
+    KeyframeController controller;
+    controller.Reset({ 60, 0 });
+    Check(RunFrames(controller, 0, 180) == std::vector<uint32_t>({ 0, 60, 120 }) && controller.Keyframes(KeyframeReason::Start) == 1 &&
+              controller.Keyframes(KeyframeReason::Interval) == 2,
+          "first frame, then every 60");
+
+    controller.Reset({ 60, 0 });
+    std::vector<uint32_t> keys = RunFrames(controller, 0, 100, [&](uint32_t frame) {
+        if (frame == 10) controller.RequestKeyframe(KeyframeReason::Request);
+    });
+    Check(keys == std::vector<uint32_t>({ 0, 10, 70 }), "a request is the next frame; the interval restarts there");
+
+    controller.Reset({ 60, 15 });
+    keys = RunFrames(controller, 0, 60, [&](uint32_t frame) {
+        if (frame == 3) controller.RequestKeyframe(KeyframeReason::Subscriber);
+        if (frame == 5) controller.RequestKeyframe(KeyframeReason::Segment);
+        if (frame == 8) controller.RequestKeyframe(KeyframeReason::Request);
+    });
+    Check(keys == std::vector<uint32_t>({ 0, 15 }) && controller.Requests() == 3 && controller.Keyframes(KeyframeReason::Request) == 1 &&
+              controller.Keyframes(KeyframeReason::Subscriber) == 0,
+          "three requests inside minFrames: one keyframe at 15");
+
+    controller.Reset({ 150, 0 });
+    keys = RunFrames(controller, 0, 80, [&](uint32_t frame) {
+        if (frame == 30) controller.SetPolicy({ 24, 0 });
+    });
+    Check(keys == std::vector<uint32_t>({ 0, 30, 54, 78 }), "GOP 150 -> 24 at frame 30 applies there");
+
+    controller.Reset({ 0, 0 });
+    keys = RunFrames(controller, 0, 1000, [&](uint32_t frame) {
+        if (frame == 500) controller.RequestKeyframe(KeyframeReason::Request);
+    });
+    Check(keys == std::vector<uint32_t>({ 0, 500 }), "maxFrames 0: keyframes only on request");
+
+    controller.Reset({ 60, 0 });
+    RunFrames(controller, 0, 20);
+    controller.Restart();
+    Check(RunFrames(controller, 20, 21) == std::vector<uint32_t>({ 20 }) && controller.Keyframes(KeyframeReason::Start) == 2,
+          "an encoder restart starts on a keyframe");
+
+    // A request seen while a keyframe is coded is answered when it goes out if it is stamped at or
+    // before that frame's capture, and timed from its own request
+    controller.Reset({ 0, 0 });
+    controller.NextFrame(0);
+    controller.KeyframeSent(10);
+    controller.RequestKeyframe(KeyframeReason::Request, 1000);
+    const bool asked = controller.NextFrame(1100) == KeyframeReason::Request;
+    controller.RequestKeyframe(KeyframeReason::Subscriber, 1050);
+    controller.KeyframeSent(1300);
+    const bool answered = controller.NextFrame(1400) == KeyframeReason::None;
+    controller.RequestKeyframe(KeyframeReason::Request, 3000);
+    controller.KeyframeSent(3100); // No keyframe in flight: the request stays
+    const bool later = controller.NextFrame(3500) == KeyframeReason::Request;
+    Check(asked && answered && later && controller.RequestWait().Count() == 3 && controller.RequestWait().Max() == 50,
+          "requests during an IDR's encode: answered, timed alone");
+
+    // A request after the keyframe's capture, before its packet leaves, needs a keyframe after it
+    controller.Reset({ 0, 0 });
+    controller.NextFrame(0);
+    controller.KeyframeSent(10);
+    controller.RequestKeyframe(KeyframeReason::Request, 2000);
+    controller.NextFrame(2100);
+    controller.RequestKeyframe(KeyframeReason::Segment, 2200);
+    controller.KeyframeSent(2300);
+    Check(controller.NextFrame(2400) == KeyframeReason::Segment, "request after the IDR's capture: a keyframe of its own");
+
+    // Each requester waits for a keyframe after its request before making the next
+    controller.Reset({ 0, 0 });
+    std::atomic<uint64_t> served(0);
+    std::atomic<int> requestersLeft(4);
+    std::atomic<bool> stuck(false);
+    std::vector<std::thread> requesters;
+    for (int t = 0; t < 4; ++t) {
+        requesters.emplace_back([&] {
+            for (int i = 0; i < 200 && !stuck; ++i) {
+                const uint64_t seen = served;
+                controller.RequestKeyframe(KeyframeReason::Request);
+                const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+                while (served == seen) {
+                    if (std::chrono::steady_clock::now() > deadline) stuck = true;
+                    if (stuck) break;
+                    std::this_thread::yield();
+                }
+            }
+            --requestersLeft;
+        });
+    }
+    while (requestersLeft > 0) {
+        if (controller.NextFrame() != KeyframeReason::None) ++served;
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    for (std::thread& requester : requesters) requester.join();
+    Check(!stuck && controller.Requests() == 800 && controller.Keyframes() < 800, "800 requests from 4 threads, all answered, merged");
+}
+
+struct JoinResult {
+    LatencyHistogram wait; // Connect to first keyframe, us
+    uint32_t joins = 0;
+    uint32_t failed = 0;
+    uint64_t keyframes = 0;
+    uint64_t bytes = 0;
+    double seconds = 0;
+};
+
+// A viewer: connect, then read TS packets until one starts a keyframe
+bool JoinOnce(int port, uint64_t& waitMicros) {
+    const int64_t startNs = SyntheticSteadyNs();
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    timeval timeout = { 15, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    bool joined = false;
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) {
+        uint8_t packet[188];
+        while (recv(fd, packet, sizeof(packet), MSG_WAITALL) == static_cast<ssize_t>(sizeof(packet))) {
+            SyntheticTsStamp stamp;
+            if (ReadSyntheticTsStamp(packet, stamp) && stamp.keyframe) {
+                waitMicros = static_cast<uint64_t>((SyntheticSteadyNs() - startNs) / 1000);
+                joined = true;
+                break;
+            }
+        }
+    }
+    close(fd);
+    return joined;
+}
+
+JoinResult RunPolicy(const JoinPolicy& policy, double seconds) {
+    JoinResult result;
+    const int listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 64) != 0 ||
+        getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+        printf("Cannot listen on localhost.\n");
+        return result;
+    }
+    const int port = ntohs(address.sin_port);
+
+    KeyframeController keyframes;
+    keyframes.Reset(policy.gop);
+    std::mutex viewersLock;
+    std::vector<int> viewers;
+    std::atomic<bool> running(true);
+
+    // The server: a new viewer gets the stream from the next frame on
+    std::thread acceptor([&] {
+        for (;;) {
+            const int viewer = accept(listener, nullptr, nullptr);
+            if (viewer < 0) return; // Listener shut down
+            {
+                std::lock_guard<std::mutex> hold(viewersLock);
+                viewers.push_back(viewer);
+            }
+            if (policy.idrOnJoin) keyframes.RequestKeyframe(KeyframeReason::Subscriber);
+        }
+    });
+
+    const auto start = std::chrono::steady_clock::now();
+    std::thread encoder([&] {
+        SyntheticTsStream stream(FPS, KEYFRAME_BYTES, DELTA_BYTES);
+        std::vector<uint8_t> ts;
+        for (uint32_t n = 0; running; ++n) {
+            std::this_thread::sleep_until(start + std::chrono::microseconds(static_cast<int64_t>(n) * 1000000 / FPS));
+            ts.clear();
+            const bool idr = keyframes.NextFrame() != KeyframeReason::None;
+            stream.Frame(n, idr, ts);
+            result.bytes += ts.size();
+            std::lock_guard<std::mutex> hold(viewersLock);
+            for (size_t i = 0; i < viewers.size();) {
+                if (send(viewers[i], ts.data(), ts.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(ts.size())) {
+                    ++i;
+                } else {
+                    close(viewers[i]); // The viewer has its keyframe and left
+                    viewers.erase(viewers.begin() + i);
+                }
+            }
+            if (idr) keyframes.KeyframeSent(); // Only viewers who asked before its capture count as served
+        }
+    });
+
+    std::mutex resultLock;
+    std::vector<std::thread> joiners;
+    auto join = [&] {
+        joiners.emplace_back([&] {
+            uint64_t wait = 0;
+            const bool joined = JoinOnce(port, wait);
+            std::lock_guard<std::mutex> hold(resultLock);
+            ++result.joins;
+            if (joined) result.wait.Record(wait);
+            else ++result.failed;
+        });
+    };
+    std::mt19937 random(11);
+    std::exponential_distribution<double> gap(JOINS_PER_SECOND);
+    bool burst = false;
+    for (double at = gap(random); at < seconds; at += gap(random)) {
+        if (!burst && at >= seconds / 2) {
+            std::this_thread::sleep_until(start + std::chrono::microseconds(static_cast<int64_t>(seconds / 2 * 1e6)));
+            for (int i = 0; i < BURST_VIEWERS; ++i) join();
+            burst = true;
+        }
+        std::this_thread::sleep_until(start + std::chrono::microseconds(static_cast<int64_t>(at * 1e6)));
+        join();
+    }
+    for (std::thread& joiner : joiners) joiner.join(); // The stream runs on until every viewer has its keyframe
+    running = false;
+    encoder.join();
+    shutdown(listener, SHUT_RDWR);
+    acceptor.join();
+    close(listener);
+    for (int viewer : viewers) close(viewer);
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.keyframes = keyframes.Keyframes();
+    return result;
+}
+
+#ifdef HAVE_LIBAVCODEC
+
+void CheckLibx264() {
+    printf("\nlibx264:\n");
+    LibavH264Encoder encoder;
+    VideoEncoderConfig config;
+    if (!encoder.Open(config)) {
+        Check(false, "open libx264");
+        return;
+    }
+    const std::vector<uint32_t> forced = { 0, 17, 40, 41, 89 };
+    std::vector<uint8_t> pixels(Frame420Size(config.width, config.height));
+    std::vector<uint32_t> keys;
+    bool headers = true;
+    auto sink = [&](const EncodedVideoPacket& packet) {
+        if (!packet.keyframe) return;
+        keys.push_back(static_cast<uint32_t>(packet.pts / (TICKS_PER_SECOND / config.fps)));
+        const std::vector<int> types = H264NalTypes(packet.data, packet.size);
+        bool sps = false, pps = false, idr = false;
+        for (int type : types) {
+            sps = sps || type == 7;
+            pps = pps || (type == 8 && sps);
+            idr = idr || (type == 5 && pps);
+        }
+        headers = headers && idr;
+    };
+    for (uint32_t n = 0; n < 120; ++n) {
+        FillTestPattern(pixels.data(), config.width, config.height, PixelFormat::NV12, n);
+        VideoFrame frame;
+        Describe420Frame(frame, pixels.data(), config.width, config.height, PixelFormat::NV12);
+        frame.pts = static_cast<int64_t>(n) * (TICKS_PER_SECOND / config.fps);
+        bool idr = false;
+        for (uint32_t f : forced) idr = idr || f == n;
+        encoder.Encode(frame, idr, sink);
+    }
+    encoder.Flush(sink);
+    Check(keys == forced, "keyframes exactly at the forced frames");
+    Check(headers, "each one SPS, PPS, IDR");
+}
+
+#endif // HAVE_LIBAVCODEC
+
+int main(int argc, char** argv) {
+    const double seconds = argc > 1 ? atof(argv[1]) : 15.0;
+    CheckController();
+
+    printf("\nJoin latency: %u fps, keyframes %zu KB, other frames %zu KB; viewers join %.1f a second for %.0f s, plus %d at once halfway\n",
+           FPS, KEYFRAME_BYTES / 1000, DELTA_BYTES / 1000, JOINS_PER_SECOND, seconds, BURST_VIEWERS);
+    printf("%-34s %6s %8s %8s %8s %14s %8s\n", "", "joins", "p50 ms", "p90 ms", "max ms", "keyframes/min", "kbps");
+    for (const JoinPolicy& policy : POLICIES) {
+        const JoinResult r = RunPolicy(policy, seconds);
+        printf("%-34s %6u %8.0f %8.0f %8.0f %14.1f %8.0f%s\n", policy.name, r.joins, r.wait.Percentile(50) / 1000.0,
+               r.wait.Percentile(90) / 1000.0, r.wait.Max() / 1000.0, r.seconds > 0 ? r.keyframes * 60 / r.seconds : 0.0,
+               r.seconds > 0 ? r.bytes * 8 / r.seconds / 1000 : 0.0, r.failed ? "  (some viewers never got a keyframe)" : "");
+        if (r.failed) ++failures;
+    }
+
+#ifdef HAVE_LIBAVCODEC
+    CheckLibx264();
+#else
+    printf("\nBuilt without libavcodec (define HAVE_LIBAVCODEC and link libavcodec/libavutil for the libx264 checks).\n");
+#endif
+    return failures ? 1 : 0;
+}
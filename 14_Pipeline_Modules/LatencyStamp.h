@@ -0,0 +1,143 @@
+// LatencyStamp.h
+// Glass-to-glass latency. The capture side draws the capture time into each
+// frame's luma plane as a row of black and white bars. A receiver on the same
+// machine decodes the stream, reads the bars back and compares the time with
+// its own clock. The figure therefore covers everything in between: queues,
+// encoder, muxer, transport and decoder.
+//   WriteLatencyStamp  - 40 bits of microseconds on the steady clock, after a
+//                        sync pattern and before a CRC-8, in the top rows
+//   ReadLatencyStamp   - reads them back; false if the bars are missing or damaged
+//   GlassToGlassMeter  - the receiving side: latency distribution per frame
+// The bars are sized from the frame width: 56 cells across, each twice as tall
+// as it is wide. That keeps them readable through lossy coding at low bitrates.
+// The receiver must read the frame at the size it was stamped at.
+#pragma once
+
+#include "Stats.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+const uint32_t LATENCY_STAMP_CELLS = 56; // Two black margin cells each side, 4 sync, 40 time, 8 CRC
+const uint32_t LATENCY_STAMP_BITS = 40;
+const uint64_t LATENCY_STAMP_MASK = (1ULL << LATENCY_STAMP_BITS) - 1; // Wraps after 12.7 days
+const uint8_t LATENCY_STAMP_BLACK = 16;
+const uint8_t LATENCY_STAMP_WHITE = 235;
+const uint8_t LATENCY_STAMP_SYNC[4] = { 1, 0, 1, 1 };
+
+// Now on the clock the stamps use: steady, so shared by every process on the machine
+inline uint64_t LatencyStampMicros() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count()) & LATENCY_STAMP_MASK;
+}
+
+// Microseconds from a stamp to now, across the wrap
+inline uint64_t LatencyStampAge(uint64_t stamp, uint64_t now) {
+    return (now - stamp) & LATENCY_STAMP_MASK;
+}
+
+inline uint8_t LatencyStampCrc(uint64_t micros) {
+    uint8_t crc = 0;
+    for (int byte = 4; byte >= 0; --byte) {
+        crc ^= static_cast<uint8_t>(micros >> (8 * byte));
+        for (int bit = 0; bit < 8; ++bit) crc = static_cast<uint8_t>(crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1);
+    }
+    return crc;
+}
+
+// Width of one cell in pixels; 0 if the frame is too small to carry a stamp
+inline uint32_t LatencyStampCell(uint32_t width, uint32_t height) {
+    const uint32_t cell = width / LATENCY_STAMP_CELLS;
+    return cell >= 4 && 2 * cell <= height ? cell : 0;
+}
+
+// Draw micros (LatencyStampMicros) over the top rows; false if the frame is too small
+inline bool WriteLatencyStamp(uint8_t* luma, uint32_t width, uint32_t height, size_t stride, uint64_t micros) {
+    const uint32_t cell = LatencyStampCell(width, height);
+    if (!cell) return false;
+    micros &= LATENCY_STAMP_MASK;
+    const uint8_t crc = LatencyStampCrc(micros);
+    uint8_t bits[LATENCY_STAMP_CELLS] = {}; // Margins stay black
+    for (int i = 0; i < 4; ++i) bits[2 + i] = LATENCY_STAMP_SYNC[i];
+    for (uint32_t i = 0; i < LATENCY_STAMP_BITS; ++i) bits[6 + i] = static_cast<uint8_t>((micros >> (LATENCY_STAMP_BITS - 1 - i)) & 1);
+    for (int i = 0; i < 8; ++i) bits[46 + i] = static_cast<uint8_t>((crc >> (7 - i)) & 1);
+    for (uint32_t y = 0; y < 2 * cell; ++y) {
+        uint8_t* row = luma + y * stride;
+        for (uint32_t c = 0; c < LATENCY_STAMP_CELLS; ++c) {
+            memset(row + c * cell, bits[c] ? LATENCY_STAMP_WHITE : LATENCY_STAMP_BLACK, cell);
+        }
+        memset(row + LATENCY_STAMP_CELLS * cell, LATENCY_STAMP_BLACK, width - LATENCY_STAMP_CELLS * cell);
+    }
+    return true;
+}
+
+// Read a stamp back from a decoded frame. Each cell is the mean of its inner
+// half, so ringing and blur at the bar edges do not count.
+inline bool ReadLatencyStamp(const uint8_t* luma, uint32_t width, uint32_t height, size_t stride, uint64_t& micros) {
+    const uint32_t cell = LatencyStampCell(width, height);
+    if (!cell) return false;
+    const uint32_t threshold = (LATENCY_STAMP_BLACK + LATENCY_STAMP_WHITE) / 2;
+    uint8_t bits[LATENCY_STAMP_CELLS];
+    for (uint32_t c = 0; c < LATENCY_STAMP_CELLS; ++c) {
+        uint32_t sum = 0, count = 0;
+        for (uint32_t y = cell / 2; y < 2 * cell - cell / 2; ++y) {
+            const uint8_t* row = luma + y * stride + c * cell;
+            for (uint32_t x = cell / 4; x < cell - cell / 4; ++x) {
+                sum += row[x];
+                ++count;
+            }
+        }
+        bits[c] = sum > threshold * count ? 1 : 0;
+    }
+    if (bits[0] || bits[1] || bits[54] || bits[55]) return false;
+    for (int i = 0; i < 4; ++i) {
+        if (bits[2 + i] != LATENCY_STAMP_SYNC[i]) return false;
+    }
+    uint64_t value = 0;
+    for (uint32_t i = 0; i < LATENCY_STAMP_BITS; ++i) value = (value << 1) | bits[6 + i];
+    uint8_t crc = 0;
+    for (int i = 0; i < 8; ++i) crc = static_cast<uint8_t>((crc << 1) | bits[46 + i]);
+    if (crc != LatencyStampCrc(value)) return false;
+    micros = value;
+    return true;
+}
+
+class GlassToGlassMeter {
+public:
+    // Start over, e.g. once the decoder has settled
+    void Reset() {
+        latency.Reset();
+        frames = unreadable = repeats = 0;
+    }
+
+    // A decoded frame's luma, seen now
+    void Frame(const uint8_t* luma, uint32_t width, uint32_t height, size_t stride) {
+        const uint64_t now = LatencyStampMicros();
+        ++frames;
+        uint64_t stamp = 0;
+        if (!ReadLatencyStamp(luma, width, height, stride, stamp)) {
+            ++unreadable;
+            return;
+        }
+        if (haveLast && stamp == lastStamp) {
+            ++repeats; // A duplicated frame (the encoder filling its cadence) is not a new sample
+            return;
+        }
+        haveLast = true;
+        lastStamp = stamp;
+        latency.Record(LatencyStampAge(stamp, now));
+    }
+
+    const LatencyHistogram& Latency() const { return latency; }
+    uint64_t Frames() const { return frames; }
+    uint64_t Unreadable() const { return unreadable; }
+    uint64_t Repeats() const { return repeats; }
+
+private:
+    LatencyHistogram latency;
+    uint64_t frames = 0, unreadable = 0, repeats = 0;
+    uint64_t lastStamp = 0;
+    bool haveLast = false;
+};
@@ -0,0 +1,79 @@
+// MediaTypes.h
+// Shared frame/sample descriptions for the portable pipeline modules.
+// Timestamps use the same 100-ns units as Media Foundation (see FRAME_DURATION
+// in the recorders) so values can be handed to IMFSample::SetSampleTime as-is.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <chrono>
+
+const int64_t TICKS_PER_SECOND = 10'000'000;
+
+// Monotonic clock in 100-ns ticks
+inline int64_t NowTicks() {
+    using namespace std::chrono;
+    return duration_cast<duration<int64_t, std::ratio<1, TICKS_PER_SECOND>>>(
+        steady_clock::now().time_since_epoch()).count();
+}
+
+// Wall-clock time as 100-ns ticks since the Unix epoch
+inline int64_t UnixTimeTicks() {
+    using namespace std::chrono;
+    return duration_cast<duration<int64_t, std::ratio<1, TICKS_PER_SECOND>>>(system_clock::now().time_since_epoch()).count();
+}
+
+enum class PixelFormat {
+    NV12, // Y plane followed by interleaved UV plane (what the recorders request)
+    I420  // Y, U, V planes (what Y4M "C420" files contain)
+};
+
+// A video frame described by pointers; the memory belongs to whoever produced it
+struct VideoFrame {
+    const uint8_t* planes[3] = { nullptr, nullptr, nullptr };
+    uint32_t strides[3] = { 0, 0, 0 };
+    uint32_t width = 0;
+    uint32_t height = 0;
+    PixelFormat format = PixelFormat::NV12;
+    int64_t pts = 0;      // 100-ns ticks
+    int64_t duration = 0; // 100-ns ticks
+    uint64_t index = 0;   // Frame number within the source
+};
+
+// A block of interleaved PCM described by pointer
+struct AudioBlock {
+    const uint8_t* data = nullptr;
+    uint32_t frames = 0; // Sample frames (one sample per channel)
+    uint32_t channels = 0;
+    uint32_t sampleRate = 0;
+    uint32_t bitsPerSample = 0;
+    int64_t pts = 0; // 100-ns ticks
+};
+
+// Bytes in a tightly packed 4:2:0 frame (NV12 and I420 have the same size)
+inline size_t Frame420Size(uint32_t width, uint32_t height) {
+    return static_cast<size_t>(width) * height + 2 * (static_cast<size_t>((width + 1) / 2) * ((height + 1) / 2));
+}
+
+// Fill plane pointers for a tightly packed 4:2:0 buffer
+inline void Describe420Frame(VideoFrame& frame, const uint8_t* data, uint32_t width, uint32_t height, PixelFormat format) {
+    const size_t lumaSize = static_cast<size_t>(width) * height;
+    const uint32_t chromaWidth = (width + 1) / 2;
+    const uint32_t chromaHeight = (height + 1) / 2;
+    frame.width = width;
+    frame.height = height;
+    frame.format = format;
+    frame.planes[0] = data;
+    frame.strides[0] = width;
+    if (format == PixelFormat::NV12) {
+        frame.planes[1] = data + lumaSize;
+        frame.strides[1] = chromaWidth * 2;
+        frame.planes[2] = nullptr;
+        frame.strides[2] = 0;
+    } else {
+        frame.planes[1] = data + lumaSize;
+        frame.strides[1] = chromaWidth;
+        frame.planes[2] = data + lumaSize + static_cast<size_t>(chromaWidth) * chromaHeight;
+        frame.strides[2] = chromaWidth;
+    }
+}
@@ -0,0 +1,305 @@
+// MotionBench.cpp
+// Motion gating for 24/7 recording: how many frames the encoder and writer
+// would skip, how fast events are detected, and what the detector costs.
+// Without a clip, a synthetic lobby is generated: a static room with sensor
+// noise, slow daylight drift, a flickering TV in one corner and a person who
+// walks through at known times (the ground truth). It is run with the TV
+// masked and unmasked to show what masks are for.
+// With a clip, the detector runs over it and reports the events it finds.
+// Usage: ./Run.sh MotionBench [clip.y4m | clip.nv12 WIDTHxHEIGHT FPS] [--mask col,row,cols,rows]
+#include "MotionDetector.h"
+#include "PixelKernels.h"
+#include "ReplaySource.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// Constants
+const uint32_t FRAME_WIDTH = 640;
+const uint32_t FRAME_HEIGHT = 480;
+const uint32_t FPS = 30;
+const uint32_t SCENE_SECONDS = 300;
+const int64_t PRE_ROLL_TICKS = 2 * TICKS_PER_SECOND;
+const uint32_t NOISE_AMPLITUDE = 4; // +/- luma steps of sensor noise
+
+// Ground-truth events in the synthetic scene, in seconds
+struct SceneEvent { double start, end; };
+const SceneEvent SCENE_EVENTS[] = { { 20, 28 }, { 61, 66 }, { 118, 133 }, { 170, 174 }, { 222, 236 }, { 270, 277 } };
+
+// Scalar references, kept out of the auto-vectoriser so the comparison is fair
+#if defined(__GNUC__) && !defined(__clang__)
+#define SCALAR_ONLY __attribute__((optimize("no-tree-vectorize")))
+#else
+#define SCALAR_ONLY
+#endif
+
+SCALAR_ONLY void ScalarDownsample2x2(const uint8_t* src, size_t srcStride, uint32_t width, uint32_t height, uint8_t* dst, size_t dstStride) {
+    for (uint32_t y = 0; y < height / 2; ++y) {
+        const uint8_t* row0 = src + 2 * y * srcStride;
+        const uint8_t* row1 = row0 + srcStride;
+        for (uint32_t x = 0; x < width / 2; ++x) {
+            uint32_t left = (row0[2 * x] + row1[2 * x] + 1) >> 1, right = (row0[2 * x + 1] + row1[2 * x + 1] + 1) >> 1;
+            dst[y * dstStride + x] = static_cast<uint8_t>((left + right + 1) >> 1);
+        }
+    }
+}
+
+SCALAR_ONLY void ScalarAccumulateSad8(const uint8_t* a, const uint8_t* b, size_t groups, uint32_t* sums) {
+    for (size_t g = 0; g < groups; ++g) {
+        for (int k = 0; k < 8; ++k) {
+            int d = a[g * 8 + k] - b[g * 8 + k];
+            sums[g] += d < 0 ? -d : d;
+        }
+    }
+}
+
+// Generates the synthetic lobby one NV12 frame at a time
+class LobbyScene {
+public:
+    LobbyScene() : frame(Frame420Size(FRAME_WIDTH, FRAME_HEIGHT)), background(FRAME_WIDTH * FRAME_HEIGHT),
+                   noise(FRAME_WIDTH * FRAME_HEIGHT * 4) {
+        for (uint32_t y = 0; y < FRAME_HEIGHT; ++y) {
+            for (uint32_t x = 0; x < FRAME_WIDTH; ++x) {
+                // Walls, a floor line and some texture
+                uint32_t v = y < FRAME_HEIGHT * 2 / 3 ? 120 + (x / 40 % 2) * 10 : 80 + ((x + y) / 16 % 2) * 20;
+                background[y * FRAME_WIDTH + x] = static_cast<uint8_t>(v);
+            }
+        }
+        uint32_t state = 12345;
+        for (int8_t& n : noise) {
+            state = state * 1664525u + 1013904223u;
+            n = static_cast<int8_t>(static_cast<int>((state >> 24) % (2 * NOISE_AMPLITUDE + 1)) - static_cast<int>(NOISE_AMPLITUDE));
+        }
+        memset(frame.data() + FRAME_WIDTH * FRAME_HEIGHT, 128, frame.size() - FRAME_WIDTH * FRAME_HEIGHT);
+    }
+
+    static bool PersonVisible(double t) {
+        for (const SceneEvent& e : SCENE_EVENTS) {
+            if (t >= e.start && t < e.end) return true;
+        }
+        return false;
+    }
+
+    const uint8_t* Render(uint64_t index) {
+        const double t = static_cast<double>(index) / FPS;
+        const int daylight = static_cast<int>(6.0 * (t / SCENE_SECONDS)); // Slow drift over the whole run
+        const int8_t* n = noise.data() + (index * 7919 % 3) * FRAME_WIDTH * FRAME_HEIGHT;
+        uint8_t* y = frame.data();
+        for (size_t i = 0; i < background.size(); ++i) {
+            int v = background[i] + daylight + n[i];
+            y[i] = static_cast<uint8_t>(v < 0 ? 0 : v > 255 ? 255 : v);
+        }
+        // TV in the top-right corner: the picture changes every frame
+        const uint8_t tv = static_cast<uint8_t>(40 + (static_cast<uint32_t>(index * 2654435761u) >> 24) % 160);
+        for (uint32_t r = 40; r < 130; ++r) memset(y + r * FRAME_WIDTH + 480, tv, 120);
+        // Person walking left to right across the room
+        for (const SceneEvent& e : SCENE_EVENTS) {
+            if (t < e.start || t >= e.end) continue;
+            const uint32_t x = static_cast<uint32_t>((t - e.start) / (e.end - e.start) * (FRAME_WIDTH - 60));
+            for (uint32_t r = 200; r < 440; ++r) memset(y + r * FRAME_WIDTH + x, 30, 60);
+        }
+        return frame.data();
+    }
+
+private:
+    std::vector<uint8_t> frame;
+    std::vector<uint8_t> background;
+    std::vector<int8_t> noise;
+};
+
+struct GateStats {
+    uint64_t frames = 0, written = 0, events = 0, falseEvents = 0;
+    std::vector<double> latencies; // Seconds from movement to trigger, per detected ground-truth event
+    uint32_t missed = 0;
+    uint32_t startsCovered = 0;    // Ground-truth starts that made it into the file thanks to pre-roll
+    double detectorSeconds = 0;
+};
+
+// Runs the detector and gate over a frame source; truth may be null for real clips
+template <typename Source>
+GateStats RunGate(Source next, uint32_t width, uint32_t height, uint32_t fps, const MotionConfig& config, bool synthetic) {
+    GateStats stats;
+    MotionDetector detector;
+    if (!detector.Init(width, height, config)) {
+        printf("Detector rejected %ux%u with this grid.\n", width, height);
+        return stats;
+    }
+    PreRollGate<uint64_t> gate(PRE_ROLL_TICKS);
+    std::vector<uint8_t> eventDetected(sizeof(SCENE_EVENTS) / sizeof(SCENE_EVENTS[0]), 0);
+    std::vector<uint8_t> startWritten(eventDetected.size(), 0);
+
+    const uint8_t* y = nullptr;
+    int64_t pts = 0;
+    while (next(y, pts)) {
+        const int64_t start = NowTicks();
+        MotionResult result = detector.Analyze(y, width);
+        stats.detectorSeconds += (NowTicks() - start) / static_cast<double>(TICKS_PER_SECOND);
+        const uint64_t index = stats.frames++;
+        const double t = static_cast<double>(pts) / TICKS_PER_SECOND;
+
+        if (result.started) {
+            ++stats.events;
+            bool matched = false;
+            if (synthetic) {
+                for (size_t e = 0; e < eventDetected.size(); ++e) {
+                    if (t >= SCENE_EVENTS[e].start && t < SCENE_EVENTS[e].end + 0.5 && !eventDetected[e]) {
+                        eventDetected[e] = 1;
+                        stats.latencies.push_back(t - SCENE_EVENTS[e].start);
+                        matched = true;
+                    }
+                }
+                if (!matched) ++stats.falseEvents;
+            } else {
+                printf("  event at %8.2f s (%u cells, peak diff %.1f)\n", t, result.activeCells, result.peakCell / 16.0);
+            }
+        }
+        // Gate frame indices the way a recorder gates samples
+        gate.Push(index, pts, result.active, [&](uint64_t written, int64_t writtenPts) {
+            ++stats.written;
+            if (!synthetic) return;
+            const double wt = static_cast<double>(writtenPts) / TICKS_PER_SECOND;
+            for (size_t e = 0; e < startWritten.size(); ++e) {
+                if (wt >= SCENE_EVENTS[e].start && wt < SCENE_EVENTS[e].start + 1.0 / fps) startWritten[e] = 1;
+            }
+            (void)written;
+        });
+    }
+    for (size_t e = 0; e < eventDetected.size(); ++e) {
+        if (synthetic && !eventDetected[e]) ++stats.missed;
+        stats.startsCovered += startWritten[e];
+    }
+    return stats;
+}
+
+void Report(const char* label, const GateStats& s, uint32_t fps, size_t frameBytes, bool synthetic) {
+    const double skipped = s.frames ? 100.0 * (s.frames - s.written) / s.frames : 0;
+    printf("%s:\n", label);
+    printf("  frames: %llu, written %llu, skipped %.1f%% (%.0f MB of raw frames never reach the encoder or disk)\n",
+           static_cast<unsigned long long>(s.frames), static_cast<unsigned long long>(s.written), skipped,
+           (s.frames - s.written) * static_cast<double>(frameBytes) / 1e6);
+    if (synthetic) {
+        double sum = 0, worst = 0;
+        for (double l : s.latencies) {
+            sum += l;
+            if (l > worst) worst = l;
+        }
+        printf("  events: %llu triggered, %zu of %zu real detected, %u missed, %llu false\n",
+               static_cast<unsigned long long>(s.events), s.latencies.size(), sizeof(SCENE_EVENTS) / sizeof(SCENE_EVENTS[0]),
+               s.missed, static_cast<unsigned long long>(s.falseEvents));
+        if (!s.latencies.empty()) {
+            printf("  detection latency: mean %.0f ms, worst %.0f ms; %u of %zu event starts in the file via %.0f s pre-roll\n",
+                   sum / s.latencies.size() * 1000, worst * 1000, s.startsCovered, sizeof(SCENE_EVENTS) / sizeof(SCENE_EVENTS[0]),
+                   static_cast<double>(PRE_ROLL_TICKS) / TICKS_PER_SECOND);
+        }
+    }
+    const double perFrame = s.frames ? s.detectorSeconds / s.frames * 1e6 : 0;
+    printf("  detector: %.1f us/frame, %.2f%% of one core at %u fps\n", perFrame, perFrame * fps / 1e4, fps);
+}
+
+// Kernel timing on one frame size: SIMD as built vs. scalar reference
+void KernelBench(uint32_t width, uint32_t height) {
+    std::vector<uint8_t> a(width * height), b(width * height), small(width * height / 4), small2(width * height / 4);
+    for (size_t i = 0; i < a.size(); ++i) {
+        a[i] = static_cast<uint8_t>(i * 31);
+        b[i] = static_cast<uint8_t>(i * 17);
+    }
+    const int repeats = 2000;
+    std::vector<uint32_t> sums(width / 16, 0);
+    struct Kernel { const char* name; int which; };
+    const Kernel kernels[] = { { "downsample 2x2 SIMD", 0 }, { "downsample 2x2 scalar", 1 }, { "SAD 8-groups SIMD", 2 }, { "SAD 8-groups scalar", 3 } };
+    printf("Kernels on %ux%u luma:\n", width, height);
+    for (const Kernel& k : kernels) {
+        const int64_t start = NowTicks();
+        for (int r = 0; r < repeats; ++r) {
+            switch (k.which) {
+                case 0: Downsample2x2(a.data(), width, width, height, small.data(), width / 2); break;
+                case 1: ScalarDownsample2x2(a.data(), width, width, height, small.data(), width / 2); break;
+                case 2:
+                    for (uint32_t row = 0; row < height / 2; ++row) {
+                        AccumulateSad8(small.data() + row * width / 2, small2.data() + row * width / 2, width / 16, sums.data());
+                    }
+                    break;
+                default:
+                    for (uint32_t row = 0; row < height / 2; ++row) {
+                        ScalarAccumulateSad8(small.data() + row * width / 2, small2.data() + row * width / 2, width / 16, sums.data());
+                    }
+                    break;
+            }
+        }
+        const double us = (NowTicks() - start) / 10.0 / repeats;
+        printf("  %-24s %7.1f us\n", k.name, us);
+    }
+    // Cross-check the SIMD kernels against the references
+    std::vector<uint8_t> check(small.size());
+    Downsample2x2(a.data(), width, width, height, small.data(), width / 2);
+    ScalarDownsample2x2(a.data(), width, width, height, check.data(), width / 2);
+    std::vector<uint32_t> s1(width / 16, 0), s2(width / 16, 0);
+    AccumulateSad8(a.data(), b.data(), width / 16, s1.data());
+    ScalarAccumulateSad8(a.data(), b.data(), width / 16, s2.data());
+    const bool same = small == check && s1 == s2 && SumAbsDiff(a.data(), b.data(), a.size()) ==
+                                                         [&]() { uint64_t t = 0; for (size_t i = 0; i < a.size(); ++i) t += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i]; return t; }();
+    printf("  SIMD matches scalar: %s\n\n", same ? "yes" : "NO");
+}
+
+int main(int argc, char** argv) {
+    MotionConfig config;
+    std::string clip;
+    uint32_t clipWidth = 0, clipHeight = 0, clipFps = 0;
+    int maskArgs[4] = { -1, -1, -1, -1 };
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--mask") == 0 && i + 1 < argc) {
+            sscanf(argv[++i], "%d,%d,%d,%d", &maskArgs[0], &maskArgs[1], &maskArgs[2], &maskArgs[3]);
+        } else if (clip.empty()) {
+            clip = argv[i];
+        } else if (!clipWidth) {
+            sscanf(argv[i], "%ux%u", &clipWidth, &clipHeight);
+        } else {
+            clipFps = static_cast<uint32_t>(atoi(argv[i]));
+        }
+    }
+    if (maskArgs[3] > 0) config.mask = MotionDetector::MaskOut(config, maskArgs[0], maskArgs[1], maskArgs[2], maskArgs[3]);
+
+    if (!clip.empty()) {
+        VideoReplaySource source;
+        bool opened = clipWidth ? source.OpenNV12(clip, clipWidth, clipHeight, clipFps ? clipFps : 30) : source.OpenY4M(clip);
+        if (!opened) return 1;
+        const uint32_t fps = static_cast<uint32_t>(TICKS_PER_SECOND / source.FrameDuration());
+        // Small clips need less downsampling to keep 8 pixels per grid column
+        while (config.downsampleShift > 0 && (source.Width() >> config.downsampleShift) / 8 < config.gridColumns) --config.downsampleShift;
+        printf("%s: %zu frames, %ux%u, %u fps\n", clip.c_str(), source.FrameCount(), source.Width(), source.Height(), fps);
+        GateStats stats = RunGate([&](const uint8_t*& y, int64_t& pts) {
+            VideoFrame frame;
+            if (!source.ReadFrame(frame)) return false;
+            y = frame.planes[0];
+            pts = frame.pts;
+            return true;
+        }, source.Width(), source.Height(), fps, config, false);
+        Report("Clip", stats, fps, Frame420Size(source.Width(), source.Height()), false);
+        return 0;
+    }
+
+    KernelBench(FRAME_WIDTH, FRAME_HEIGHT);
+    printf("Synthetic lobby: %ux%u, %u fps, %u s, person present %.0f%% of the time\n\n", FRAME_WIDTH, FRAME_HEIGHT, FPS,
+           SCENE_SECONDS, [] { double s = 0; for (const SceneEvent& e : SCENE_EVENTS) s += e.end - e.start; return s; }() * 100 / SCENE_SECONDS);
+    for (int masked = 1; masked >= 0; --masked) {
+        MotionConfig runConfig = config;
+        // The TV covers x 480-600, y 40-130: cells 12-14 of 16 across, 0-2 of 9 down
+        if (masked) runConfig.mask = MotionDetector::MaskOut(runConfig, 12, 0, 3, 3);
+        LobbyScene scene;
+        uint64_t index = 0;
+        const uint64_t total = static_cast<uint64_t>(SCENE_SECONDS) * FPS;
+        GateStats stats = RunGate([&](const uint8_t*& y, int64_t& pts) {
+            if (index >= total) return false;
+            y = scene.Render(index);
+            pts = static_cast<int64_t>(index) * TICKS_PER_SECOND / FPS;
+            ++index;
+            return true;
+        }, FRAME_WIDTH, FRAME_HEIGHT, FPS, runConfig, true);
+        Report(masked ? "TV masked" : "No mask", stats, FPS, Frame420Size(FRAME_WIDTH, FRAME_HEIGHT), true);
+        printf("\n");
+    }
+    return 0;
+}
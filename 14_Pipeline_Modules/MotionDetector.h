@@ -0,0 +1,213 @@
+// MotionDetector.h
+// Decides whether a camera is looking at anything worth recording.
+// The Y plane of each frame is downsampled (which also averages away sensor
+// noise) and compared with the previous frame's over a grid of cells. A cell is
+// active when its mean absolute difference passes cellThreshold; a frame has
+// motion when enough unmasked cells are active. Recording starts after
+// triggerFrames motion frames in a row and stops after releaseFrames quiet
+// ones, so a pause in movement does not split an event into many clips.
+// PreRollGate holds the last few seconds while idle so a clip starts before
+// the movement that triggered it.
+#pragma once
+
+#include "PixelKernels.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+#include <deque>
+#include <utility>
+#include <vector>
+
+struct MotionConfig {
+    uint32_t downsampleShift = 2;  // Each halving is one 2x2 average: 2 -> 1/4 size per axis
+    uint32_t gridColumns = 16;
+    uint32_t gridRows = 9;
+    uint32_t cellThreshold = 3;    // Mean absolute luma difference per downsampled pixel
+    uint32_t minActiveCells = 2;
+    uint32_t triggerFrames = 2;    // Consecutive motion frames to start an event
+    uint32_t releaseFrames = 48;   // Consecutive quiet frames to end it
+    std::vector<uint8_t> mask;     // gridColumns * gridRows, 0 = ignore the cell; empty = use all
+};
+
+struct MotionResult {
+    bool active = false;      // Inside an event (after hysteresis)
+    bool started = false;     // This frame started an event
+    bool stopped = false;     // This frame ended one
+    uint32_t activeCells = 0; // Unmasked cells over threshold in this frame
+    uint32_t peakCell = 0;    // Highest cell mean difference (x16 for one decimal of resolution)
+};
+
+class MotionDetector {
+public:
+    bool Init(uint32_t frameWidth, uint32_t frameHeight, const MotionConfig& motionConfig) {
+        config = motionConfig;
+        width = frameWidth;
+        height = frameHeight;
+        smallWidth = width >> config.downsampleShift;
+        smallHeight = height >> config.downsampleShift;
+        groups = smallWidth / 8;
+        if (groups < config.gridColumns || smallHeight < config.gridRows || config.gridColumns == 0 || config.gridRows == 0) return false;
+        if (!config.mask.empty() && config.mask.size() != static_cast<size_t>(config.gridColumns) * config.gridRows) return false;
+
+        // Intermediate planes for shifts > 1, then current and previous at the final size
+        scratch.clear();
+        uint32_t w = width, h = height;
+        for (uint32_t s = 1; s < config.downsampleShift; ++s) {
+            w /= 2;
+            h /= 2;
+            scratch.emplace_back(static_cast<size_t>(w) * h);
+        }
+        current.assign(static_cast<size_t>(smallWidth) * smallHeight, 0);
+        previous.assign(current.size(), 0);
+        groupSums.assign(groups, 0);
+
+        // Each 8-pixel group belongs to the cell holding its centre
+        groupCell.resize(groups);
+        for (uint32_t g = 0; g < groups; ++g) {
+            groupCell[g] = (g * 8 + 4) * config.gridColumns / (groups * 8);
+        }
+        cellPixels.assign(static_cast<size_t>(config.gridColumns) * config.gridRows, 0);
+        for (uint32_t row = 0; row < config.gridRows; ++row) {
+            const uint32_t rows = RowEnd(row) - RowStart(row);
+            for (uint32_t g = 0; g < groups; ++g) cellPixels[row * config.gridColumns + groupCell[g]] += 8 * rows;
+        }
+        cellSums.assign(cellPixels.size(), 0);
+        havePrevious = false;
+        active = false;
+        motionRun = 0;
+        quietRun = 0;
+        return true;
+    }
+
+    // y: the frame's luma plane (the first plane of NV12 or I420)
+    MotionResult Analyze(const uint8_t* y, size_t stride) {
+        Downsample(y, stride);
+        MotionResult result;
+        if (havePrevious) {
+            CompareCells();
+            for (size_t cell = 0; cell < cellSums.size(); ++cell) {
+                if (!config.mask.empty() && !config.mask[cell]) continue;
+                // Compare sum > threshold * pixels to avoid a divide per cell
+                if (cellSums[cell] > static_cast<uint64_t>(config.cellThreshold) * cellPixels[cell]) ++result.activeCells;
+                const uint32_t mean16 = static_cast<uint32_t>(cellSums[cell] * 16 / cellPixels[cell]);
+                if (mean16 > result.peakCell) result.peakCell = mean16;
+            }
+        }
+        current.swap(previous);
+        havePrevious = true;
+
+        const bool motion = result.activeCells >= config.minActiveCells;
+        motionRun = motion ? motionRun + 1 : 0;
+        quietRun = motion ? 0 : quietRun + 1;
+        if (!active && motionRun >= config.triggerFrames) {
+            active = true;
+            result.started = true;
+        } else if (active && quietRun >= config.releaseFrames) {
+            active = false;
+            result.stopped = true;
+        }
+        result.active = active;
+        return result;
+    }
+
+    bool Active() const { return active; }
+    uint32_t Columns() const { return config.gridColumns; }
+    uint32_t Rows() const { return config.gridRows; }
+
+    // Build a mask that ignores a rectangle of cells (a TV, a window, a clock)
+    static std::vector<uint8_t> MaskOut(const MotionConfig& config, uint32_t column, uint32_t row, uint32_t columns, uint32_t rows,
+                                        std::vector<uint8_t> mask = std::vector<uint8_t>()) {
+        if (mask.empty()) mask.assign(static_cast<size_t>(config.gridColumns) * config.gridRows, 1);
+        for (uint32_t r = row; r < row + rows && r < config.gridRows; ++r) {
+            for (uint32_t c = column; c < column + columns && c < config.gridColumns; ++c) mask[r * config.gridColumns + c] = 0;
+        }
+        return mask;
+    }
+
+private:
+    uint32_t RowStart(uint32_t row) const { return row * smallHeight / config.gridRows; }
+    uint32_t RowEnd(uint32_t row) const { return (row + 1) * smallHeight / config.gridRows; }
+
+    void Downsample(const uint8_t* y, size_t stride) {
+        if (config.downsampleShift == 0) {
+            for (uint32_t r = 0; r < height; ++r) memcpy(current.data() + static_cast<size_t>(r) * width, y + r * stride, width);
+            return;
+        }
+        const uint8_t* source = y;
+        size_t sourceStride = stride;
+        uint32_t w = width, h = height;
+        for (uint32_t s = 0; s < config.downsampleShift; ++s) {
+            const bool last = s + 1 == config.downsampleShift;
+            uint8_t* target = last ? current.data() : scratch[s].data();
+            const size_t targetStride = last ? smallWidth : w / 2;
+            Downsample2x2(source, sourceStride, w, h, target, targetStride);
+            source = target;
+            sourceStride = targetStride;
+            w /= 2;
+            h /= 2;
+        }
+    }
+
+    void CompareCells() {
+        for (uint32_t row = 0; row < config.gridRows; ++row) {
+            std::fill(groupSums.begin(), groupSums.end(), 0);
+            for (uint32_t line = RowStart(row); line < RowEnd(row); ++line) {
+                const size_t offset = static_cast<size_t>(line) * smallWidth;
+                AccumulateSad8(current.data() + offset, previous.data() + offset, groups, groupSums.data());
+            }
+            uint64_t* cells = cellSums.data() + row * config.gridColumns;
+            std::fill(cells, cells + config.gridColumns, 0);
+            for (uint32_t g = 0; g < groups; ++g) cells[groupCell[g]] += groupSums[g];
+        }
+    }
+
+    MotionConfig config;
+    uint32_t width = 0, height = 0;
+    uint32_t smallWidth = 0, smallHeight = 0;
+    uint32_t groups = 0;
+    std::vector<std::vector<uint8_t>> scratch;
+    std::vector<uint8_t> current, previous;
+    std::vector<uint32_t> groupSums;
+    std::vector<uint32_t> groupCell;
+    std::vector<uint32_t> cellPixels;
+    std::vector<uint64_t> cellSums;
+    bool havePrevious = false;
+    bool active = false;
+    uint32_t motionRun = 0;
+    uint32_t quietRun = 0;
+};
+
+// Passes items straight through while recording; while idle, keeps the last
+// preRollTicks of them so the start of an event can be written retroactively.
+// T is whatever the writer takes (a sample handle, a pool slot, a copy).
+template <typename T>
+class PreRollGate {
+public:
+    explicit PreRollGate(int64_t preRollTicks = 0) : preRoll(preRollTicks) {}
+
+    void SetPreRoll(int64_t preRollTicks) { preRoll = preRollTicks; }
+
+    // emit(T&&, pts) is called for everything that should be written now, oldest first
+    template <typename Emit>
+    void Push(T item, int64_t pts, bool recording, Emit emit) {
+        if (recording) {
+            while (!held.empty()) {
+                emit(std::move(held.front().first), held.front().second);
+                held.pop_front();
+            }
+            emit(std::move(item), pts);
+            return;
+        }
+        held.emplace_back(std::move(item), pts);
+        while (!held.empty() && held.front().second < pts - preRoll) held.pop_front();
+    }
+
+    size_t Held() const { return held.size(); }
+    void Clear() { held.clear(); }
+
+private:
+    int64_t preRoll;
+    std::deque<std::pair<T, int64_t>> held;
+};
@@ -0,0 +1,243 @@
+// NamedPipe.h
+// Named pipes between this process and a child (ffmpeg), alongside the stdin
+// pipe that carries video:
+//   NamedPipeWriter  - the child opens it as an extra input
+//   NamedPipeReader  - the child opens it as an output
+//   Windows: \\.\pipe\<name>      Linux: a FIFO at /tmp/<name>
+#pragma once
+
+#include <stdio.h>
+#include <atomic>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+class NamedPipeWriter {
+public:
+    NamedPipeWriter() = default;
+    NamedPipeWriter(const NamedPipeWriter&) = delete;
+    NamedPipeWriter& operator=(const NamedPipeWriter&) = delete;
+    ~NamedPipeWriter() { Close(); }
+
+    // Create the pipe; pass Path() to the reader before calling Connect
+    bool Create(const std::string& name) {
+        Close();
+#ifdef _WIN32
+        path = "\\\\.\\pipe\\" + name;
+        pipe = CreateNamedPipeA(path.c_str(), PIPE_ACCESS_OUTBOUND, PIPE_TYPE_BYTE | PIPE_WAIT, 1,
+                                1 << 20, 0, 0, NULL);
+        if (pipe == INVALID_HANDLE_VALUE) {
+            printf("Failed to create named pipe %s.\n", path.c_str());
+            return false;
+        }
+#else
+        path = "/tmp/" + name;
+        unlink(path.c_str());
+        if (mkfifo(path.c_str(), 0600) != 0) {
+            printf("Failed to create FIFO %s.\n", path.c_str());
+            return false;
+        }
+        // A reader that exits must surface as a write error, not kill the process
+        signal(SIGPIPE, SIG_IGN);
+#endif
+        return true;
+    }
+
+    // Block until the reader opens the pipe
+    bool Connect() {
+#ifdef _WIN32
+        if (pipe == INVALID_HANDLE_VALUE) return false;
+        if (!ConnectNamedPipe(pipe, NULL) && GetLastError() != ERROR_PIPE_CONNECTED) {
+            printf("No reader connected to %s.\n", path.c_str());
+            return false;
+        }
+#else
+        if (path.empty()) return false;
+        do {
+            fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+        } while (fd < 0 && errno == EINTR);
+        if (fd < 0) {
+            printf("No reader connected to %s.\n", path.c_str());
+            return false;
+        }
+#endif
+        connected = true;
+        return true;
+    }
+
+    // Release a Connect that is still waiting (the reader never started); call from another thread
+    void CancelConnect() {
+        if (connected || path.empty()) return;
+#ifdef _WIN32
+        HANDLE client = CreateFileA(path.c_str(), GENERIC_READ, 0, NULL, OPEN_EXISTING, 0, NULL);
+        if (client != INVALID_HANDLE_VALUE) CloseHandle(client);
+#else
+        int client = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (client >= 0) close(client);
+#endif
+    }
+
+    // Write everything or fail (reader gone)
+    bool Write(const void* data, size_t length) {
+        if (!connected) return false;
+        const char* bytes = static_cast<const char*>(data);
+        while (length > 0) {
+#ifdef _WIN32
+            DWORD written = 0;
+            if (!WriteFile(pipe, bytes, static_cast<DWORD>(length), &written, NULL)) return false;
+#else
+            ssize_t written = write(fd, bytes, length);
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) return false;
+#endif
+            bytes += written;
+            length -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+
+    void Close() {
+#ifdef _WIN32
+        if (pipe != INVALID_HANDLE_VALUE) {
+            if (connected) FlushFileBuffers(pipe);
+            DisconnectNamedPipe(pipe);
+            CloseHandle(pipe);
+        }
+        pipe = INVALID_HANDLE_VALUE;
+#else
+        if (fd >= 0) close(fd);
+        fd = -1;
+        if (!path.empty()) unlink(path.c_str());
+#endif
+        connected = false;
+        path.clear();
+    }
+
+    const std::string& Path() const { return path; }
+    bool IsConnected() const { return connected; }
+
+private:
+    std::string path;
+    std::atomic<bool> connected{ false };
+#ifdef _WIN32
+    HANDLE pipe = INVALID_HANDLE_VALUE;
+#else
+    int fd = -1;
+#endif
+};
+
+class NamedPipeReader {
+public:
+    NamedPipeReader() = default;
+    NamedPipeReader(const NamedPipeReader&) = delete;
+    NamedPipeReader& operator=(const NamedPipeReader&) = delete;
+    ~NamedPipeReader() { Close(); }
+
+    // Create the pipe; pass Path() to the writer before calling Connect
+    bool Create(const std::string& name) {
+        Close();
+#ifdef _WIN32
+        path = "\\\\.\\pipe\\" + name;
+        pipe = CreateNamedPipeA(path.c_str(), PIPE_ACCESS_INBOUND, PIPE_TYPE_BYTE | PIPE_WAIT, 1,
+                                0, 1 << 20, 0, NULL);
+        if (pipe == INVALID_HANDLE_VALUE) {
+            printf("Failed to create named pipe %s.\n", path.c_str());
+            return false;
+        }
+#else
+        path = "/tmp/" + name;
+        unlink(path.c_str());
+        if (mkfifo(path.c_str(), 0600) != 0) {
+            printf("Failed to create FIFO %s.\n", path.c_str());
+            return false;
+        }
+#endif
+        return true;
+    }
+
+    // Block until the writer opens the pipe
+    bool Connect() {
+#ifdef _WIN32
+        if (pipe == INVALID_HANDLE_VALUE) return false;
+        if (!ConnectNamedPipe(pipe, NULL) && GetLastError() != ERROR_PIPE_CONNECTED) {
+            printf("No writer connected to %s.\n", path.c_str());
+            return false;
+        }
+#else
+        if (path.empty()) return false;
+        do {
+            fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        } while (fd < 0 && errno == EINTR);
+        if (fd < 0) {
+            printf("No writer connected to %s.\n", path.c_str());
+            return false;
+        }
+#endif
+        connected = true;
+        return true;
+    }
+
+    // Release a Connect that is still waiting (the writer never started); call from another thread
+    void CancelConnect() {
+        if (connected || path.empty()) return;
+#ifdef _WIN32
+        HANDLE client = CreateFileA(path.c_str(), GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+        if (client != INVALID_HANDLE_VALUE) CloseHandle(client);
+#else
+        int client = open(path.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+        if (client >= 0) close(client);
+#endif
+    }
+
+    // Up to maxLength bytes as soon as some are there; 0 once the writer has closed its end
+    size_t Read(void* data, size_t maxLength) {
+        if (!connected) return 0;
+#ifdef _WIN32
+        DWORD read = 0;
+        if (!ReadFile(pipe, data, static_cast<DWORD>(maxLength), &read, NULL)) return 0; // ERROR_BROKEN_PIPE: writer gone
+        return read;
+#else
+        ssize_t read;
+        do {
+            read = ::read(fd, data, maxLength);
+        } while (read < 0 && errno == EINTR);
+        return read > 0 ? static_cast<size_t>(read) : 0;
+#endif
+    }
+
+    void Close() {
+#ifdef _WIN32
+        if (pipe != INVALID_HANDLE_VALUE) {
+            DisconnectNamedPipe(pipe);
+            CloseHandle(pipe);
+        }
+        pipe = INVALID_HANDLE_VALUE;
+#else
+        if (fd >= 0) close(fd);
+        fd = -1;
+        if (!path.empty()) unlink(path.c_str());
+#endif
+        connected = false;
+        path.clear();
+    }
+
+    const std::string& Path() const { return path; }
+    bool IsConnected() const { return connected; }
+
+private:
+    std::string path;
+    std::atomic<bool> connected{ false };
+#ifdef _WIN32
+    HANDLE pipe = INVALID_HANDLE_VALUE;
+#else
+    int fd = -1;
+#endif
+};
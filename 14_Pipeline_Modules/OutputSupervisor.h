@@ -0,0 +1,287 @@
+// OutputSupervisor.h
+// Keeps a live output going across failures of whatever sits behind it: an
+// ffmpeg child that exits when the network drops, an ingest server that
+// restarts.
+//   ReconnectSupervisor  - tracks whether the output is up and decides when to
+//                          try again. The wait doubles after each failed
+//                          attempt, up to maxWaitTicks. It resets to the first
+//                          wait once a connection has stayed up for stableTicks.
+//                          Every loss, failed attempt and reconnection is logged.
+//   CatchUpBuffer        - every chunk on its way to the output passes through
+//                          it. A chunk stays until the far end has it and a
+//                          later keyframe makes it unnecessary. After a failure,
+//                          Rewind restarts the output at the last keyframe that
+//                          may not have arrived, and everything captured during
+//                          the outage follows as fast as the new output takes it.
+//                          The buffer holds at most maxTicks of media and
+//                          maxBytes of memory. Past either cap, whole GOPs go
+//                          from the front, so the buffer always starts on a
+//                          keyframe. A delta frame with no keyframe to start
+//                          from is refused. An empty keyframe chunk marks a
+//                          restart of the stream; trimming never loses one
+//                          that has not been sent.
+// Neither is thread-safe. The output thread owns both; it may hand a buffer to
+// another thread that it starts and later joins.
+#pragma once
+
+#include "MediaTypes.h"
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct ReconnectConfig {
+    int64_t firstWaitTicks = TICKS_PER_SECOND / 2;
+    int64_t maxWaitTicks = 30 * TICKS_PER_SECOND;
+    int64_t stableTicks = 10 * TICKS_PER_SECOND; // Up this long and the next loss starts over at firstWaitTicks
+};
+
+class ReconnectSupervisor {
+public:
+    // Starts down with an attempt due at once; log receives one line per event (nullptr for none), tagged with name
+    void Init(int64_t now, const ReconnectConfig& settings = ReconnectConfig(), FILE* logFile = stdout, const char* logName = "output") {
+        config = settings;
+        log = logFile;
+        name = logName;
+        startTicks = downSince = nextAttempt = now;
+        wait = config.firstWaitTicks;
+        up = everUp = false;
+        losses = reconnects = failedAttempts = outageAttempts = 0;
+        downTicks = longestOutage = 0;
+    }
+
+    bool Up() const { return up; }
+    bool AttemptDue(int64_t now) const { return !up && now >= nextAttempt; }
+
+    // The output started (or the connection opened)
+    void Connected(int64_t now) {
+        if (everUp) {
+            const int64_t outage = now - downSince;
+            downTicks += outage;
+            longestOutage = std::max(longestOutage, outage);
+            ++reconnects;
+            Log(now, "reconnected after %.1fs down (%u failed attempts)\n", Seconds(outage), outageAttempts);
+        } else {
+            Log(now, "connected\n");
+        }
+        up = everUp = true;
+        upSince = now;
+        outageAttempts = 0;
+    }
+
+    // An attempt failed, or the running output was lost; why goes to the log
+    void Failed(int64_t now, const char* why) {
+        if (up) {
+            if (now - upSince >= config.stableTicks) wait = config.firstWaitTicks;
+            up = false;
+            downSince = now;
+            ++losses;
+            Log(now, "lost (%s) after %.1fs up; retry in %.1fs\n", why, Seconds(now - upSince), Seconds(wait));
+        } else {
+            ++failedAttempts;
+            ++outageAttempts;
+            Log(now, "attempt failed (%s); retry in %.1fs\n", why, Seconds(wait));
+        }
+        nextAttempt = now + wait;
+        wait = std::min(wait * 2, config.maxWaitTicks);
+    }
+
+    uint32_t Losses() const { return losses; }
+    uint32_t Reconnects() const { return reconnects; }
+    uint32_t FailedAttempts() const { return failedAttempts; }
+    int64_t LongestOutage() const { return longestOutage; }
+    // Time spent down after the first connection, the current outage included
+    int64_t DownTicks(int64_t now) const { return downTicks + (everUp && !up ? now - downSince : 0); }
+
+private:
+    static double Seconds(int64_t ticks) { return static_cast<double>(ticks) / TICKS_PER_SECOND; }
+
+    void Log(int64_t now, const char* format, ...) const {
+        if (!log) return;
+        fprintf(log, "[%s %7.1fs] ", name.c_str(), Seconds(now - startTicks));
+        va_list args;
+        va_start(args, format);
+        vfprintf(log, format, args);
+        va_end(args);
+        fflush(log);
+    }
+
+    ReconnectConfig config;
+    FILE* log = nullptr;
+    std::string name;
+    bool up = false;
+    bool everUp = false;
+    int64_t startTicks = 0;
+    int64_t upSince = 0;
+    int64_t downSince = 0;
+    int64_t nextAttempt = 0;
+    int64_t wait = 0;
+    uint32_t losses = 0, reconnects = 0, failedAttempts = 0, outageAttempts = 0;
+    int64_t downTicks = 0;
+    int64_t longestOutage = 0;
+};
+
+struct BacklogChunk {
+    int64_t pts = 0;
+    bool keyframe = false;
+    size_t bytes = 0;
+    uint64_t sentEnd = 0; // Output bytes up to this chunk's end on the current connection, once sent
+    std::vector<uint8_t> data;
+};
+
+class CatchUpBuffer {
+public:
+    static const size_t SPARE_BUFFERS = 8; // Released chunk buffers kept for reuse
+
+    void Init(int64_t maxBacklogTicks, size_t maxBacklogBytes) {
+        maxTicks = maxBacklogTicks;
+        maxBytes = maxBacklogBytes;
+        Clear();
+        dropped = droppedBytes = refused = replayed = 0;
+        highWater = 0;
+    }
+
+    // Append a chunk; false if it was refused (a delta with no keyframe to start from).
+    // Trims whole GOPs from the front to stay within both caps.
+    bool Push(int64_t pts, bool keyframe, const void* data, size_t length) {
+        if (keyframe) {
+            awaitingKeyframe = false;
+        } else if (awaitingKeyframe || chunks.empty()) {
+            awaitingKeyframe = true;
+            ++refused;
+            return false;
+        }
+        if (keyframe && restartOwed && length) chunks.push_back(RestartMarker(pts)); // Trimmed along with its GOP
+        restartOwed = false;
+        BacklogChunk chunk;
+        if (!spare.empty()) {
+            chunk.data = std::move(spare.back());
+            spare.pop_back();
+        }
+        chunk.data.resize(length);
+        memcpy(chunk.data.data(), data, length);
+        chunk.pts = pts;
+        chunk.keyframe = keyframe;
+        chunk.bytes = length;
+        chunks.push_back(std::move(chunk));
+        bytes += length;
+        while (!chunks.empty() && (bytes > maxBytes || chunks.back().pts - chunks.front().pts > maxTicks)) {
+            DropFront();
+        }
+        highWater = std::max(highWater, bytes);
+        return !chunks.empty();
+    }
+
+    // The next chunk to send on the current connection, or nullptr when caught up
+    const BacklogChunk* Next() const { return sent < chunks.size() ? &chunks[sent] : nullptr; }
+
+    // The chunk from Next has been handed to the output
+    void Sent() {
+        BacklogChunk& chunk = chunks[sent++];
+        sentBytes += chunk.bytes;
+        chunk.sentEnd = sentBytes;
+        if (sent <= replayUntil) ++replayed;
+    }
+
+    // The far end has the first ackedBytes sent on this connection. For an output
+    // that cannot tell, pass SentBytes(): written counts as delivered.
+    void Acknowledged(uint64_t ackedBytes) {
+        size_t release = 0;
+        for (size_t i = 1; i <= sent && i < chunks.size() && chunks[i - 1].sentEnd <= ackedBytes; ++i) {
+            if (chunks[i].keyframe) release = i;
+        }
+        for (size_t i = 0; i < release; ++i) Recycle();
+    }
+
+    // The connection failed: the next one starts from the front, which is a keyframe
+    void Rewind() {
+        replayUntil = std::max(replayUntil, sent);
+        sent = 0;
+        sentBytes = 0;
+    }
+
+    // Before a new connection: drop what precedes pts, up to the next keyframe
+    // (e.g. to start where another stream's backlog starts)
+    void DropBefore(int64_t pts) {
+        while (!chunks.empty() && chunks.front().pts < pts) DropFront();
+    }
+
+    void Clear() {
+        while (!chunks.empty()) Recycle();
+        awaitingKeyframe = false;
+        restartOwed = false;
+        sent = replayUntil = 0;
+        sentBytes = 0;
+    }
+
+    bool Empty() const { return chunks.empty(); }
+    int64_t FrontPts() const { return chunks.empty() ? 0 : chunks.front().pts; }
+    size_t Pending() const { return chunks.size() - sent; }
+    // Media time from the next chunk to send to the newest
+    int64_t PendingTicks() const { return sent < chunks.size() ? chunks.back().pts - chunks[sent].pts : 0; }
+    uint64_t SentBytes() const { return sentBytes; }
+    size_t Bytes() const { return bytes; }
+    size_t HighWater() const { return highWater; }
+    uint64_t Dropped() const { return dropped; }
+    uint64_t DroppedBytes() const { return droppedBytes; }
+    uint64_t Refused() const { return refused; }
+    uint64_t Replayed() const { return replayed; }
+
+private:
+    void Recycle() {
+        BacklogChunk& chunk = chunks.front();
+        bytes -= chunk.bytes;
+        if (spare.size() < SPARE_BUFFERS) spare.push_back(std::move(chunk.data));
+        chunks.pop_front();
+        if (sent) --sent;
+        if (replayUntil) --replayUntil;
+    }
+
+    static BacklogChunk RestartMarker(int64_t pts) {
+        BacklogChunk marker;
+        marker.pts = pts;
+        marker.keyframe = true;
+        return marker;
+    }
+
+    // Drop the front GOP: the front chunk and the deltas that follow it. A restart
+    // marker goes with the GOP after it, and if it was not sent yet it moves to the
+    // new front (or the next keyframe pushed), so the output still starts a new stream.
+    void DropFront() {
+        bool restart = false;
+        bool more;
+        do {
+            const bool marker = chunks.front().bytes == 0;
+            if (marker) {
+                restart = restart || sent == 0;
+            } else {
+                ++dropped;
+                droppedBytes += chunks.front().bytes;
+            }
+            Recycle();
+            more = !chunks.empty() && (marker || !chunks.front().keyframe);
+        } while (more);
+        if (chunks.empty()) awaitingKeyframe = true; // The newest chunk went with its GOP
+        if (restart && chunks.empty()) restartOwed = true;
+        else if (restart && chunks.front().bytes) chunks.push_front(RestartMarker(chunks.front().pts));
+    }
+
+    std::deque<BacklogChunk> chunks;
+    std::vector<std::vector<uint8_t>> spare;
+    int64_t maxTicks = 0;
+    size_t maxBytes = 0;
+    size_t bytes = 0;
+    size_t highWater = 0;
+    size_t sent = 0;        // Chunks from the front sent on the current connection
+    size_t replayUntil = 0; // Chunks from the front sent before the last Rewind
+    uint64_t sentBytes = 0;
+    bool awaitingKeyframe = false;
+    bool restartOwed = false; // An unsent restart marker was trimmed with nothing after it
+    uint64_t dropped = 0, droppedBytes = 0, refused = 0, replayed = 0;
+};
@@ -0,0 +1,357 @@
+// OutputSupervisorBench.cpp
+// ReconnectSupervisor and CatchUpBuffer against a stand-in ingest server that
+// is killed and restarted. The server is this program run with --server, a
+// separate process, so the kill behaves like a real server dying: SIGKILL,
+// connection reset, and the port refuses connections until the restart. It
+// logs every frame it receives to a file.
+// A 30 fps producer makes encoded-like frames (keyframe every second, deltas
+// in between) and queues them with BoundedFrameQueue. The output thread sends
+// them over TCP with the supervisor deciding when to reconnect.
+// The script runs twice:
+//   no backlog  frames are dropped while the output is down, and the new
+//               connection waits for the next keyframe
+//   catch-up    frames are buffered while down, up to the backlog cap, and
+//               the buffer is flushed once reconnected
+// Afterwards the server's log is checked for frames that never arrived, the
+// longest gap, and frames delivered after a reference was lost.
+// Usage: ./Run.sh OutputSupervisorBench [backlog-seconds]
+#include "FrameQueue.h"
+#include "MediaTypes.h"
+#include "OutputSupervisor.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Constants
+const uint32_t FPS = 30;
+const uint32_t GOP = 30;
+const size_t KEYFRAME_BYTES = 40000;
+const size_t DELTA_BYTES = 8000;
+const double SECONDS = 14.0;
+const double DEFAULT_BACKLOG_SECONDS = 3.0;
+const size_t BACKLOG_MAX_BYTES = 8 * 1024 * 1024;
+const size_t QUEUE_FRAMES = 30;
+const uint32_t WIRE_MAGIC = 0x4f555431; // "OUT1"
+const char* LOG_PATH = "/tmp/OutputSupervisorBench.log";
+const char* RECEIVED_PATH = "/tmp/OutputSupervisorBench.received";
+
+// Server down from start to end, in seconds
+struct Outage {
+    double start;
+    double end;
+};
+const Outage OUTAGES[] = { { 2.0, 4.0 }, { 7.0, 11.5 } };
+
+struct WireHeader {
+    uint32_t magic;
+    uint32_t index;
+    uint32_t keyframe;
+    uint32_t payload;
+};
+
+struct CatchUp {
+    double at;           // Seconds into the run
+    double backlog;      // Seconds of media waiting when the connection opened
+    double flushMs;      // Until the output caught up with the producer
+};
+
+struct RunResult {
+    uint64_t produced = 0;
+    uint64_t received = 0, unique = 0, duplicates = 0;
+    uint64_t missing = 0, longestGap = 0, broken = 0;
+    uint32_t losses = 0, reconnects = 0, failedAttempts = 0;
+    uint64_t replayed = 0, trimmed = 0;
+    size_t highWater = 0;
+    std::vector<CatchUp> catchUps;
+};
+
+int port = 0;
+char selfPath[4096];
+
+// --server: accept one connection at a time and log each complete frame as "pid connection index keyframe"
+int RunServer(int serverPort, const char* path) {
+    const int out = open(path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    const int listener = socket(AF_INET, SOCK_STREAM, 0);
+    const int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(serverPort));
+    if (out < 0 || listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listener, 1) != 0) {
+        return 1;
+    }
+    std::vector<uint8_t> payload(KEYFRAME_BYTES);
+    for (uint32_t connection = 1;; ++connection) {
+        const int fd = accept(listener, NULL, NULL);
+        if (fd < 0) continue;
+        for (;;) {
+            WireHeader header;
+            if (recv(fd, &header, sizeof(header), MSG_WAITALL) != static_cast<ssize_t>(sizeof(header)) || header.magic != WIRE_MAGIC ||
+                header.payload > payload.size() ||
+                recv(fd, payload.data(), header.payload, MSG_WAITALL) != static_cast<ssize_t>(header.payload)) {
+                break;
+            }
+            dprintf(out, "%d %u %u %u\n", static_cast<int>(getpid()), connection, header.index, header.keyframe);
+        }
+        close(fd);
+    }
+}
+
+pid_t StartServer() {
+    char portText[16];
+    snprintf(portText, sizeof(portText), "%d", port);
+    const pid_t pid = fork();
+    if (pid == 0) {
+        execl(selfPath, selfPath, "--server", portText, RECEIVED_PATH, static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    return pid;
+}
+
+void KillServer(pid_t pid) {
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+}
+
+// A free loopback port for the server to take over
+int PickPort() {
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length);
+    close(fd);
+    return ntohs(address.sin_port);
+}
+
+int Connect() {
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    const int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool SendAll(int fd, const uint8_t* data, size_t length) {
+    while (length > 0) {
+        const ssize_t n = send(fd, data, length, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        data += n;
+        length -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Read the server's log: what arrived, what never did, and what arrived without its references
+void Analyse(RunResult& result) {
+    FILE* in = fopen(RECEIVED_PATH, "r");
+    if (!in) return;
+    std::set<uint32_t> seen;
+    std::map<std::pair<int, uint32_t>, uint32_t> lastIndex; // Per connection: index of the last decodable frame
+    int pid = 0;
+    unsigned connection = 0, index = 0, keyframe = 0;
+    while (fscanf(in, "%d %u %u %u", &pid, &connection, &index, &keyframe) == 4) {
+        ++result.received;
+        if (!seen.insert(index).second) ++result.duplicates;
+        const std::pair<int, uint32_t> key(pid, connection);
+        const auto last = lastIndex.find(key);
+        if (keyframe || (last != lastIndex.end() && last->second + 1 == index)) {
+            lastIndex[key] = index;
+        } else {
+            ++result.broken;
+            lastIndex.erase(key);
+        }
+    }
+    fclose(in);
+    result.unique = seen.size();
+    uint64_t gap = 0;
+    for (uint32_t n = 0; n < result.produced; ++n) {
+        if (seen.count(n)) {
+            gap = 0;
+        } else {
+            ++result.missing;
+            result.longestGap = std::max(result.longestGap, ++gap);
+        }
+    }
+}
+
+RunResult Run(bool catchUp, double backlogSeconds, FILE* log) {
+    RunResult result;
+    fclose(fopen(RECEIVED_PATH, "w"));
+    pid_t server = StartServer();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    BoundedFrameQueue queue;
+    CatchUpBuffer backlog;
+    ReconnectSupervisor supervisor;
+    ReconnectConfig config;
+    config.firstWaitTicks = TICKS_PER_SECOND / 4;
+    config.maxWaitTicks = TICKS_PER_SECOND;
+    config.stableTicks = 2 * TICKS_PER_SECOND;
+    if (!queue.Init(QUEUE_FRAMES, sizeof(WireHeader) + KEYFRAME_BYTES, DropPolicy::KeepKeyframes)) return result;
+    backlog.Init(static_cast<int64_t>(backlogSeconds * TICKS_PER_SECOND), BACKLOG_MAX_BYTES);
+    if (log) fprintf(log, "--- %s\n", catchUp ? "catch-up" : "no backlog");
+    const int64_t start = NowTicks();
+    supervisor.Init(start, config, log);
+
+    std::thread writer([&] {
+        int fd = -1;
+        bool catchingUp = false;
+        CatchUp pending = {};
+        int64_t connectedAt = 0;
+        QueuedFrame frame;
+        while (queue.Pop(frame)) {
+            int64_t now = NowTicks();
+            if (supervisor.AttemptDue(now)) {
+                fd = Connect();
+                if (fd >= 0) {
+                    supervisor.Connected(now);
+                    connectedAt = now;
+                    pending.at = static_cast<double>(now - start) / TICKS_PER_SECOND;
+                    pending.backlog = static_cast<double>(backlog.PendingTicks()) / TICKS_PER_SECOND;
+                    catchingUp = catchUp && supervisor.Reconnects() > 0;
+                } else {
+                    supervisor.Failed(now, "connection refused");
+                }
+            }
+            if (catchUp || supervisor.Up()) backlog.Push(frame.pts, frame.keyframe, queue.Data(frame), frame.bytes);
+            queue.Release(frame);
+            if (!supervisor.Up()) continue;
+
+            // Flush between frames: stop when the producer has queued another, which joins the backlog first
+            while (const BacklogChunk* chunk = backlog.Next()) {
+                if (!SendAll(fd, chunk->data.data(), chunk->bytes)) {
+                    supervisor.Failed(NowTicks(), strerror(errno));
+                    close(fd);
+                    fd = -1;
+                    backlog.Rewind();
+                    if (!catchUp) backlog.Clear();
+                    catchingUp = false;
+                    break;
+                }
+                backlog.Sent();
+                if (queue.Depth() > 0) break;
+            }
+            if (fd < 0) continue;
+            // Acknowledged: everything sent but what the kernel still holds unacknowledged
+            int queued = 0;
+            ioctl(fd, TIOCOUTQ, &queued);
+            backlog.Acknowledged(backlog.SentBytes() - static_cast<uint64_t>(std::max(queued, 0)));
+            if (catchingUp && backlog.Pending() == 0) {
+                now = NowTicks();
+                pending.flushMs = static_cast<double>(now - connectedAt) / 10000;
+                result.catchUps.push_back(pending);
+                catchingUp = false;
+            }
+        }
+        if (fd >= 0) close(fd);
+    });
+
+    // Producer and the server's script, both on the frame clock
+    const uint64_t frames = static_cast<uint64_t>(SECONDS * FPS);
+    size_t outage = 0;
+    bool serverUp = true;
+    std::vector<uint8_t> filler(KEYFRAME_BYTES);
+    for (uint64_t n = 0; n < frames; ++n) {
+        const int64_t due = start + static_cast<int64_t>(n) * TICKS_PER_SECOND / FPS;
+        const int64_t now = NowTicks();
+        if (due > now) std::this_thread::sleep_for(std::chrono::nanoseconds((due - now) * 100));
+        const double t = static_cast<double>(NowTicks() - start) / TICKS_PER_SECOND;
+        if (outage < sizeof(OUTAGES) / sizeof(OUTAGES[0])) {
+            if (serverUp && t >= OUTAGES[outage].start) {
+                KillServer(server);
+                serverUp = false;
+            } else if (!serverUp && t >= OUTAGES[outage].end) {
+                server = StartServer();
+                serverUp = true;
+                ++outage;
+            }
+        }
+
+        WireHeader header = { WIRE_MAGIC, static_cast<uint32_t>(n), n % GOP == 0 ? 1u : 0u, 0 };
+        header.payload = static_cast<uint32_t>(header.keyframe ? KEYFRAME_BYTES : DELTA_BYTES);
+        uint8_t* slot = queue.Begin(NowTicks() - start, header.keyframe != 0);
+        if (slot) {
+            memcpy(slot, &header, sizeof(header));
+            memset(slot + sizeof(header), static_cast<int>(n), header.payload);
+            queue.Commit(sizeof(header) + header.payload);
+        }
+        ++result.produced;
+    }
+    queue.Close();
+    writer.join();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200)); // Let the server log the last frames
+    if (serverUp) KillServer(server);
+
+    result.losses = supervisor.Losses();
+    result.reconnects = supervisor.Reconnects();
+    result.failedAttempts = supervisor.FailedAttempts();
+    result.replayed = backlog.Replayed();
+    result.trimmed = backlog.Dropped();
+    result.highWater = backlog.HighWater();
+    Analyse(result);
+    return result;
+}
+
+void Report(const char* name, const RunResult& r) {
+    printf("%-12s %8llu %8llu %8llu %8llu %9.2f %7llu %9llu %6u %5u %5u %8.1f\n", name, static_cast<unsigned long long>(r.produced),
+           static_cast<unsigned long long>(r.unique), static_cast<unsigned long long>(r.missing),
+           static_cast<unsigned long long>(r.duplicates), static_cast<double>(r.longestGap) / FPS,
+           static_cast<unsigned long long>(r.broken), static_cast<unsigned long long>(r.trimmed), r.losses, r.reconnects,
+           r.failedAttempts, r.highWater / 1048576.0);
+    for (const CatchUp& c : r.catchUps) {
+        printf("%-12s   reconnected at %5.2fs: %.2f s of backlog sent in %.0f ms\n", "", c.at, c.backlog, c.flushMs);
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc == 4 && strcmp(argv[1], "--server") == 0) return RunServer(atoi(argv[2]), argv[3]);
+    const double backlogSeconds = argc > 1 ? std::max(0.1, atof(argv[1])) : DEFAULT_BACKLOG_SECONDS;
+    const ssize_t length = readlink("/proc/self/exe", selfPath, sizeof(selfPath) - 1);
+    if (length <= 0) return 1;
+    selfPath[length] = 0;
+    port = PickPort();
+
+    printf("%u fps for %.0f s, keyframe every %u frames (%zu / %zu bytes); server killed", FPS, SECONDS, GOP, KEYFRAME_BYTES, DELTA_BYTES);
+    for (const Outage& o : OUTAGES) printf(" %.1f-%.1fs", o.start, o.end);
+    printf("\nBacklog: %.1f s, %zu MiB at most; reconnect waits 0.25 s doubling to 1 s\n\n", backlogSeconds, BACKLOG_MAX_BYTES >> 20);
+    printf("%-12s %8s %8s %8s %8s %9s %7s %9s %6s %5s %5s %8s\n", "", "frames", "arrived", "missing", "twice", "gap s", "broken",
+           "trimmed", "losses", "recon", "fails", "peak MiB");
+
+    FILE* log = fopen(LOG_PATH, "w");
+    Report("no backlog", Run(false, backlogSeconds, log));
+    Report("catch-up", Run(true, backlogSeconds, log));
+    if (log) fclose(log);
+    printf("\nmissing: never arrived; twice: resent from the last keyframe after a reset; broken: arrived after a reference was lost\n");
+    printf("Every loss and reconnection: %s\n", LOG_PATH);
+    return 0;
+}
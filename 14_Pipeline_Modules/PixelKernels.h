@@ -0,0 +1,408 @@
+// PixelKernels.h
+// 8-bit plane kernels shared by the video modules. Each has a SIMD
+// body (AVX2, SSE2 or NEON, chosen at compile time; ScaleRowBilinear needs
+// AVX2 gathers) and a scalar tail, so any width works; no alignment is required.
+// The SAD, halving and UV split/merge bodies are step functions that handle a
+// fixed number of bytes. The kernels here loop over them for any size, and
+// ProfileKernels.h unrolls them for fixed frame sizes.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Steps. KERNEL_VECTOR is the bytes one SAD, halving or UV split/merge step
+// covers (output bytes for halving, pairs for split/merge); HALVE_UV_PAIRS is
+// the UV pairs one Downsample2x2Uv step writes.
+#if defined(__AVX2__)
+#define PIXEL_KERNEL_STEPS
+const uint32_t KERNEL_VECTOR = 32;
+const uint32_t HALVE_UV_PAIRS = 16;
+typedef __m256i SadLanes; // One running SAD per 8-byte group of a step
+
+inline SadLanes SadLanesZero() { return _mm256_setzero_si256(); }
+
+inline SadLanes SadLanesAdd(SadLanes sum, const uint8_t* a, const uint8_t* b) {
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b));
+    return _mm256_add_epi64(sum, _mm256_sad_epu8(va, vb));
+}
+
+inline uint64_t SadLanesTotal(SadLanes sum) {
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    return static_cast<uint64_t>(_mm_cvtsi128_si64(half)) + static_cast<uint64_t>(_mm_cvtsi128_si64(_mm_unpackhi_epi64(half, half)));
+}
+
+// Write the KERNEL_VECTOR / 8 group sums (each must fit 32 bits)
+inline void SadLanesStore(SadLanes sum, uint32_t* sums) {
+    __m256i low = _mm256_permutevar8x32_epi32(sum, _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums), _mm256_castsi256_si128(low));
+}
+
+// KERNEL_VECTOR output bytes from 2 * KERNEL_VECTOR bytes of two rows
+inline void HalveStep(const uint8_t* row0, const uint8_t* row1, uint8_t* out) {
+    const __m256i lowBytes = _mm256_set1_epi16(0x00FF);
+    __m256i v0 = _mm256_avg_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row0)),
+                                 _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row1)));
+    __m256i v1 = _mm256_avg_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row0 + 32)),
+                                 _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row1 + 32)));
+    __m256i h0 = _mm256_avg_epu16(_mm256_and_si256(v0, lowBytes), _mm256_srli_epi16(v0, 8));
+    __m256i h1 = _mm256_avg_epu16(_mm256_and_si256(v1, lowBytes), _mm256_srli_epi16(v1, 8));
+    // packus works per 128-bit lane; put the quadwords back in order
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(h0, h1), 0xD8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), packed);
+}
+
+// HALVE_UV_PAIRS output pairs from two interleaved UV rows
+inline void HalveUvStep(const uint8_t* row0, const uint8_t* row1, uint8_t* out) {
+    const __m256i lowPair = _mm256_set1_epi32(0xFFFF);
+    __m256i v0 = _mm256_avg_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row0)),
+                                 _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row1)));
+    __m256i v1 = _mm256_avg_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row0 + 32)),
+                                 _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row1 + 32)));
+    // Each 32-bit lane holds two UV pairs; average them into the low 16 bits
+    __m256i h0 = _mm256_and_si256(_mm256_avg_epu8(v0, _mm256_srli_epi32(v0, 16)), lowPair);
+    __m256i h1 = _mm256_and_si256(_mm256_avg_epu8(v1, _mm256_srli_epi32(v1, 16)), lowPair);
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(h0, h1), 0xD8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), packed);
+}
+
+// KERNEL_VECTOR UV pairs into separate U and V bytes
+inline void SplitUvStep(const uint8_t* uv, uint8_t* u, uint8_t* v) {
+    const __m256i lowBytes = _mm256_set1_epi16(0x00FF);
+    __m256i p0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(uv));
+    __m256i p1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(uv + 32));
+    __m256i us = _mm256_packus_epi16(_mm256_and_si256(p0, lowBytes), _mm256_and_si256(p1, lowBytes));
+    __m256i vs = _mm256_packus_epi16(_mm256_srli_epi16(p0, 8), _mm256_srli_epi16(p1, 8));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(u), _mm256_permute4x64_epi64(us, 0xD8));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(v), _mm256_permute4x64_epi64(vs, 0xD8));
+}
+
+// KERNEL_VECTOR U and V bytes into UV pairs
+inline void MergeUvStep(const uint8_t* u, const uint8_t* v, uint8_t* uv) {
+    __m256i vu = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(u));
+    __m256i vv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v));
+    // unpack works per 128-bit lane: low holds pairs 0-7 and 16-23, high 8-15 and 24-31
+    __m256i low = _mm256_unpacklo_epi8(vu, vv), high = _mm256_unpackhi_epi8(vu, vv);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(uv), _mm256_permute2x128_si256(low, high, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(uv + 32), _mm256_permute2x128_si256(low, high, 0x31));
+}
+#elif defined(__SSE2__) || defined(_M_X64)
+#define PIXEL_KERNEL_STEPS
+const uint32_t KERNEL_VECTOR = 16;
+const uint32_t HALVE_UV_PAIRS = 8;
+typedef __m128i SadLanes;
+
+inline SadLanes SadLanesZero() { return _mm_setzero_si128(); }
+
+inline SadLanes SadLanesAdd(SadLanes sum, const uint8_t* a, const uint8_t* b) {
+    __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+    __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+    return _mm_add_epi64(sum, _mm_sad_epu8(va, vb));
+}
+
+inline uint64_t SadLanesTotal(SadLanes sum) {
+    return static_cast<uint64_t>(_mm_cvtsi128_si64(sum)) + static_cast<uint64_t>(_mm_cvtsi128_si64(_mm_unpackhi_epi64(sum, sum)));
+}
+
+inline void SadLanesStore(SadLanes sum, uint32_t* sums) {
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(sums), _mm_shuffle_epi32(sum, _MM_SHUFFLE(3, 3, 2, 0)));
+}
+
+inline void HalveStep(const uint8_t* row0, const uint8_t* row1, uint8_t* out) {
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    __m128i v0 = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row0)),
+                              _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1)));
+    __m128i v1 = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 16)),
+                              _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 16)));
+    __m128i h0 = _mm_avg_epu16(_mm_and_si128(v0, lowBytes), _mm_srli_epi16(v0, 8));
+    __m128i h1 = _mm_avg_epu16(_mm_and_si128(v1, lowBytes), _mm_srli_epi16(v1, 8));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(h0, h1));
+}
+
+inline void HalveUvStep(const uint8_t* row0, const uint8_t* row1, uint8_t* out) {
+    // SSE2 has no unsigned 32-to-16 pack: bias into signed range, pack, unbias
+    const __m128i lowPair = _mm_set1_epi32(0xFFFF), bias32 = _mm_set1_epi32(0x8000), bias16 = _mm_set1_epi16(-0x8000);
+    __m128i v0 = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row0)),
+                              _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1)));
+    __m128i v1 = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 16)),
+                              _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 16)));
+    __m128i h0 = _mm_sub_epi32(_mm_and_si128(_mm_avg_epu8(v0, _mm_srli_epi32(v0, 16)), lowPair), bias32);
+    __m128i h1 = _mm_sub_epi32(_mm_and_si128(_mm_avg_epu8(v1, _mm_srli_epi32(v1, 16)), lowPair), bias32);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_add_epi16(_mm_packs_epi32(h0, h1), bias16));
+}
+
+inline void SplitUvStep(const uint8_t* uv, uint8_t* u, uint8_t* v) {
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    __m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(uv));
+    __m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(uv + 16));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(u), _mm_packus_epi16(_mm_and_si128(p0, lowBytes), _mm_and_si128(p1, lowBytes)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(v), _mm_packus_epi16(_mm_srli_epi16(p0, 8), _mm_srli_epi16(p1, 8)));
+}
+
+inline void MergeUvStep(const uint8_t* u, const uint8_t* v, uint8_t* uv) {
+    __m128i vu = _mm_loadu_si128(reinterpret_cast<const __m128i*>(u));
+    __m128i vv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(v));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(uv), _mm_unpacklo_epi8(vu, vv));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(uv + 16), _mm_unpackhi_epi8(vu, vv));
+}
+#elif defined(__ARM_NEON)
+#define PIXEL_KERNEL_STEPS
+const uint32_t KERNEL_VECTOR = 16;
+const uint32_t HALVE_UV_PAIRS = 16;
+typedef uint64x2_t SadLanes;
+
+inline SadLanes SadLanesZero() { return vdupq_n_u64(0); }
+
+inline SadLanes SadLanesAdd(SadLanes sum, const uint8_t* a, const uint8_t* b) {
+    return vpadalq_u32(sum, vpaddlq_u16(vpaddlq_u8(vabdq_u8(vld1q_u8(a), vld1q_u8(b)))));
+}
+
+inline uint64_t SadLanesTotal(SadLanes sum) { return vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1); }
+
+inline void SadLanesStore(SadLanes sum, uint32_t* sums) { vst1_u32(sums, vmovn_u64(sum)); }
+
+inline void HalveStep(const uint8_t* row0, const uint8_t* row1, uint8_t* out) {
+    uint8x16x2_t r0 = vld2q_u8(row0); // Even and odd columns
+    uint8x16x2_t r1 = vld2q_u8(row1);
+    vst1q_u8(out, vrhaddq_u8(vrhaddq_u8(r0.val[0], r1.val[0]), vrhaddq_u8(r0.val[1], r1.val[1])));
+}
+
+inline void HalveUvStep(const uint8_t* row0, const uint8_t* row1, uint8_t* out) {
+    uint8x16x4_t r0 = vld4q_u8(row0); // U even, V even, U odd, V odd
+    uint8x16x4_t r1 = vld4q_u8(row1);
+    uint8x16x2_t uv;
+    uv.val[0] = vrhaddq_u8(vrhaddq_u8(r0.val[0], r1.val[0]), vrhaddq_u8(r0.val[2], r1.val[2]));
+    uv.val[1] = vrhaddq_u8(vrhaddq_u8(r0.val[1], r1.val[1]), vrhaddq_u8(r0.val[3], r1.val[3]));
+    vst2q_u8(out, uv);
+}
+
+inline void SplitUvStep(const uint8_t* uv, uint8_t* u, uint8_t* v) {
+    uint8x16x2_t pairs = vld2q_u8(uv);
+    vst1q_u8(u, pairs.val[0]);
+    vst1q_u8(v, pairs.val[1]);
+}
+
+inline void MergeUvStep(const uint8_t* u, const uint8_t* v, uint8_t* uv) {
+    uint8x16x2_t pairs;
+    pairs.val[0] = vld1q_u8(u);
+    pairs.val[1] = vld1q_u8(v);
+    vst2q_u8(uv, pairs);
+}
+#endif
+
+// Sum of absolute differences over count bytes
+inline uint64_t SumAbsDiff(const uint8_t* a, const uint8_t* b, size_t count) {
+    uint64_t total = 0;
+    size_t i = 0;
+#ifdef PIXEL_KERNEL_STEPS
+    SadLanes sum = SadLanesZero();
+    for (; i + KERNEL_VECTOR <= count; i += KERNEL_VECTOR) sum = SadLanesAdd(sum, a + i, b + i);
+    total = SadLanesTotal(sum);
+#endif
+    for (; i < count; ++i) total += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+    return total;
+}
+
+// Add the SAD of each 8-byte group of a and b to sums[g], for groups * 8 bytes.
+// Lets a caller total a block grid one row at a time without a per-block call.
+inline void AccumulateSad8(const uint8_t* a, const uint8_t* b, size_t groups, uint32_t* sums) {
+    size_t g = 0;
+#if defined(__AVX2__)
+    for (; g + 4 <= groups; g += 4) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + g * 8));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + g * 8));
+        __m256i sad = _mm256_sad_epu8(va, vb); // One 16-bit total in each 64-bit lane
+        sums[g] += static_cast<uint32_t>(_mm256_extract_epi16(sad, 0));
+        sums[g + 1] += static_cast<uint32_t>(_mm256_extract_epi16(sad, 4));
+        sums[g + 2] += static_cast<uint32_t>(_mm256_extract_epi16(sad, 8));
+        sums[g + 3] += static_cast<uint32_t>(_mm256_extract_epi16(sad, 12));
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    for (; g + 2 <= groups; g += 2) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + g * 8));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + g * 8));
+        __m128i sad = _mm_sad_epu8(va, vb);
+        sums[g] += static_cast<uint32_t>(_mm_extract_epi16(sad, 0));
+        sums[g + 1] += static_cast<uint32_t>(_mm_extract_epi16(sad, 4));
+    }
+#elif defined(__ARM_NEON)
+    for (; g + 2 <= groups; g += 2) {
+        uint8x16_t diff = vabdq_u8(vld1q_u8(a + g * 8), vld1q_u8(b + g * 8));
+        uint64x2_t pair = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(diff)));
+        sums[g] += static_cast<uint32_t>(vgetq_lane_u64(pair, 0));
+        sums[g + 1] += static_cast<uint32_t>(vgetq_lane_u64(pair, 1));
+    }
+#endif
+    for (; g < groups; ++g) {
+        uint32_t sad = 0;
+        for (int k = 0; k < 8; ++k) {
+            const uint8_t x = a[g * 8 + k], y = b[g * 8 + k];
+            sad += x > y ? x - y : y - x;
+        }
+        sums[g] += sad;
+    }
+}
+
+// Halve a plane in both directions by averaging 2x2 blocks (rounded).
+// Writes (width / 2) x (height / 2); an odd last row or column is ignored.
+inline void Downsample2x2(const uint8_t* src, size_t srcStride, uint32_t width, uint32_t height,
+                          uint8_t* dst, size_t dstStride) {
+    const uint32_t outWidth = width / 2;
+    for (uint32_t y = 0; y < height / 2; ++y) {
+        const uint8_t* row0 = src + (2 * y) * srcStride;
+        const uint8_t* row1 = row0 + srcStride;
+        uint8_t* out = dst + y * dstStride;
+        uint32_t x = 0;
+#ifdef PIXEL_KERNEL_STEPS
+        for (; x + KERNEL_VECTOR <= outWidth; x += KERNEL_VECTOR) HalveStep(row0 + 2 * x, row1 + 2 * x, out + x);
+#endif
+        // Same rounding as the SIMD path: average the rows, then the columns
+        for (; x < outWidth; ++x) {
+            const uint32_t left = (row0[2 * x] + row1[2 * x] + 1) >> 1;
+            const uint32_t right = (row0[2 * x + 1] + row1[2 * x + 1] + 1) >> 1;
+            out[x] = static_cast<uint8_t>((left + right + 1) >> 1);
+        }
+    }
+}
+
+// Downsample2x2 for an interleaved UV plane: pairs is the number of UV pairs
+// per row; U is averaged with U and V with V. Writes (pairs / 2) pairs per row.
+inline void Downsample2x2Uv(const uint8_t* src, size_t srcStride, uint32_t pairs, uint32_t height,
+                            uint8_t* dst, size_t dstStride) {
+    const uint32_t outPairs = pairs / 2;
+    for (uint32_t y = 0; y < height / 2; ++y) {
+        const uint8_t* row0 = src + (2 * y) * srcStride;
+        const uint8_t* row1 = row0 + srcStride;
+        uint8_t* out = dst + y * dstStride;
+        uint32_t x = 0;
+#ifdef PIXEL_KERNEL_STEPS
+        for (; x + HALVE_UV_PAIRS <= outPairs; x += HALVE_UV_PAIRS) HalveUvStep(row0 + 4 * x, row1 + 4 * x, out + 2 * x);
+#endif
+        for (; x < outPairs; ++x) {
+            for (uint32_t c = 0; c < 2; ++c) {
+                const uint32_t left = (row0[4 * x + c] + row1[4 * x + c] + 1) >> 1;
+                const uint32_t right = (row0[4 * x + 2 + c] + row1[4 * x + 2 + c] + 1) >> 1;
+                out[2 * x + c] = static_cast<uint8_t>((left + right + 1) >> 1);
+            }
+        }
+    }
+}
+
+// Split an interleaved UV row into U and V rows (NV12 chroma to I420)
+inline void SplitUv(const uint8_t* uv, uint8_t* u, uint8_t* v, size_t pairs) {
+    size_t x = 0;
+#ifdef PIXEL_KERNEL_STEPS
+    for (; x + KERNEL_VECTOR <= pairs; x += KERNEL_VECTOR) SplitUvStep(uv + 2 * x, u + x, v + x);
+#endif
+    for (; x < pairs; ++x) {
+        u[x] = uv[2 * x];
+        v[x] = uv[2 * x + 1];
+    }
+}
+
+// Interleave U and V rows into a UV row (I420 chroma to NV12)
+inline void MergeUv(const uint8_t* u, const uint8_t* v, uint8_t* uv, size_t pairs) {
+    size_t x = 0;
+#ifdef PIXEL_KERNEL_STEPS
+    for (; x + KERNEL_VECTOR <= pairs; x += KERNEL_VECTOR) MergeUvStep(u + x, v + x, uv + 2 * x);
+#endif
+    for (; x < pairs; ++x) {
+        uv[2 * x] = u[x];
+        uv[2 * x + 1] = v[x];
+    }
+}
+
+// out = (a * (256 - weightB) + b * weightB + 128) >> 8 for count bytes, weightB in 0..256.
+// The vertical half of a bilinear scale.
+inline void BlendRows(const uint8_t* a, const uint8_t* b, uint32_t weightB, uint8_t* out, size_t count) {
+    const uint32_t weightA = 256 - weightB;
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i wa = _mm256_set1_epi16(static_cast<short>(weightA)), wb = _mm256_set1_epi16(static_cast<short>(weightB));
+    const __m256i round = _mm256_set1_epi16(128), zero = _mm256_setzero_si256();
+    for (; i + 32 <= count; i += 32) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        // Products fit in 16 bits unsigned: 255 * 256 + 128 < 65536
+        __m256i lo = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(va, zero), wa),
+                                                       _mm256_mullo_epi16(_mm256_unpacklo_epi8(vb, zero), wb)), round);
+        __m256i hi = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(va, zero), wa),
+                                                       _mm256_mullo_epi16(_mm256_unpackhi_epi8(vb, zero), wb)), round);
+        // unpack and pack both work per 128-bit lane, so the order comes back as it was
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_packus_epi16(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8)));
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128i wa = _mm_set1_epi16(static_cast<short>(weightA)), wb = _mm_set1_epi16(static_cast<short>(weightB));
+    const __m128i round = _mm_set1_epi16(128), zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va, zero), wa),
+                                                 _mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), wb)), round);
+        __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va, zero), wa),
+                                                 _mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), wb)), round);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+    }
+#elif defined(__ARM_NEON)
+    const uint8x8_t wa = vdup_n_u8(static_cast<uint8_t>(weightA > 255 ? 255 : weightA));
+    const uint8x8_t wb = vdup_n_u8(static_cast<uint8_t>(weightB > 255 ? 255 : weightB));
+    // 256 does not fit a u8 lane; whole-row weights are handled by the scalar loop
+    if (weightA <= 255 && weightB <= 255) {
+        for (; i + 16 <= count; i += 16) {
+            uint8x16_t va = vld1q_u8(a + i), vb = vld1q_u8(b + i);
+            uint16x8_t lo = vmlal_u8(vmull_u8(vget_low_u8(va), wa), vget_low_u8(vb), wb);
+            uint16x8_t hi = vmlal_u8(vmull_u8(vget_high_u8(va), wa), vget_high_u8(vb), wb);
+            vst1q_u8(out + i, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));
+        }
+    }
+#endif
+    for (; i < count; ++i) out[i] = static_cast<uint8_t>((a[i] * weightA + b[i] * weightB + 128) >> 8);
+}
+
+// Horizontal half of a bilinear scale for one row. For each output x, blends
+// the two source pixels at offsets[x] and offsets[x] + channels with
+// weights[x] (0..256 toward the second). channels is 1 for luma and 2 for
+// interleaved UV, where both components are produced. src is read up to 3
+// bytes past the last offset + channels, so callers pad their row buffer.
+inline void ScaleRowBilinear(const uint8_t* src, const int32_t* offsets, const int32_t* weights, uint32_t channels,
+                             uint8_t* out, size_t count) {
+    size_t x = 0;
+#if defined(__AVX2__)
+    // One 32-bit gather per output pixel fetches both taps (and both UV pairs)
+    const __m256i byteMask = _mm256_set1_epi32(0xFF), full = _mm256_set1_epi32(256), round = _mm256_set1_epi32(128);
+    for (; x + 8 <= count; x += 8) {
+        __m256i offset = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(offsets + x));
+        __m256i wb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + x));
+        __m256i wa = _mm256_sub_epi32(full, wb);
+        __m256i taps = _mm256_i32gather_epi32(reinterpret_cast<const int*>(src), offset, 1);
+        if (channels == 1) {
+            __m256i p0 = _mm256_and_si256(taps, byteMask), p1 = _mm256_and_si256(_mm256_srli_epi32(taps, 8), byteMask);
+            __m256i v = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(p0, wa), _mm256_mullo_epi32(p1, wb)), round), 8);
+            __m256i words = _mm256_permute4x64_epi64(_mm256_packus_epi32(v, v), 0x08);
+            __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(words), _mm256_castsi256_si128(words));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out + x), bytes);
+        } else {
+            __m256i u0 = _mm256_and_si256(taps, byteMask), v0 = _mm256_and_si256(_mm256_srli_epi32(taps, 8), byteMask);
+            __m256i u1 = _mm256_and_si256(_mm256_srli_epi32(taps, 16), byteMask), v1 = _mm256_srli_epi32(taps, 24);
+            __m256i u = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(u0, wa), _mm256_mullo_epi32(u1, wb)), round), 8);
+            __m256i v = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(v0, wa), _mm256_mullo_epi32(v1, wb)), round), 8);
+            __m256i pairs = _mm256_or_si256(u, _mm256_slli_epi32(v, 8)); // One UV pair in the low 16 bits of each lane
+            __m256i words = _mm256_permute4x64_epi64(_mm256_packus_epi32(pairs, pairs), 0x08);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * x), _mm256_castsi256_si128(words));
+        }
+    }
+#endif
+    for (; x < count; ++x) {
+        const uint8_t* p = src + offsets[x];
+        const uint32_t wb = static_cast<uint32_t>(weights[x]), wa = 256 - wb;
+        for (uint32_t c = 0; c < channels; ++c) out[x * channels + c] = static_cast<uint8_t>((p[c] * wa + p[c + channels] * wb + 128) >> 8);
+    }
+}
@@ -0,0 +1,253 @@
+// ProfileKernels.h
+// Whole-frame kernels for packed 4:2:0 frames (stride == width, as
+// Describe420Frame lays them out):
+//   Convert     NV12 to I420 or I420 to NV12
+//   Halve       half width and height, same format, 2x2 box filter
+//   LumaSad     sum of absolute luma differences
+//   BlockSad8x8 luma SAD of every 8x8 block, row by row
+//
+// ProfileKernels<Width, Height, Format> compiles them for one frame size. Each
+// row is a whole number of PixelKernels.h steps, so the column loops are
+// expanded at compile time with no tail, strides are constants, and the row
+// loops have constant trip counts. BlockSad8x8 keeps each block's sum in a
+// register for its 8 rows instead of adding to memory row by row.
+//
+// FrameKernels picks the compiled profile for a frame size at runtime. The
+// recorders' profiles (640x480, 640x360, 1280x720, NV12 and I420) are
+// instantiated here; any other size gets the generic kernels, which take the
+// size at runtime and finish each row with a scalar tail. Both give the same
+// bytes.
+#pragma once
+
+#include "MediaTypes.h"
+#include "PixelKernels.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// KERNEL_FLATTEN inlines every call in a profile kernel, the unrolled steps' lambdas included
+#if defined(_MSC_VER)
+#define KERNEL_INLINE __forceinline
+#define KERNEL_FLATTEN
+#else
+#define KERNEL_INLINE inline __attribute__((always_inline))
+#define KERNEL_FLATTEN __attribute__((flatten))
+#endif
+
+// Generic kernels: any even size, row loops with runtime bounds and scalar tails
+
+inline void GenericConvert(const uint8_t* src, uint8_t* dst, uint32_t width, uint32_t height, PixelFormat from) {
+    const size_t lumaSize = static_cast<size_t>(width) * height;
+    const size_t chromaWidth = width / 2, chromaHeight = height / 2;
+    memcpy(dst, src, lumaSize);
+    if (from == PixelFormat::NV12) {
+        uint8_t* u = dst + lumaSize;
+        uint8_t* v = u + chromaWidth * chromaHeight;
+        for (size_t row = 0; row < chromaHeight; ++row) {
+            SplitUv(src + lumaSize + row * width, u + row * chromaWidth, v + row * chromaWidth, chromaWidth);
+        }
+    } else {
+        const uint8_t* u = src + lumaSize;
+        const uint8_t* v = u + chromaWidth * chromaHeight;
+        for (size_t row = 0; row < chromaHeight; ++row) {
+            MergeUv(u + row * chromaWidth, v + row * chromaWidth, dst + lumaSize + row * width, chromaWidth);
+        }
+    }
+}
+
+inline void GenericHalve(const uint8_t* src, uint8_t* dst, uint32_t width, uint32_t height, PixelFormat format) {
+    const size_t lumaSize = static_cast<size_t>(width) * height, outLumaSize = static_cast<size_t>(width / 2) * (height / 2);
+    Downsample2x2(src, width, width, height, dst, width / 2);
+    if (format == PixelFormat::NV12) {
+        Downsample2x2Uv(src + lumaSize, width, width / 2, height / 2, dst + outLumaSize, width / 2);
+    } else {
+        const size_t chromaSize = lumaSize / 4, outChromaSize = outLumaSize / 4;
+        Downsample2x2(src + lumaSize, width / 2, width / 2, height / 2, dst + outLumaSize, width / 4);
+        Downsample2x2(src + lumaSize + chromaSize, width / 2, width / 2, height / 2, dst + outLumaSize + outChromaSize, width / 4);
+    }
+}
+
+inline uint64_t GenericLumaSad(const uint8_t* a, const uint8_t* b, uint32_t width, uint32_t height) {
+    return SumAbsDiff(a, b, static_cast<size_t>(width) * height);
+}
+
+// sums holds (width / 8) * (height / 8) blocks; a partial last block row or column is ignored
+inline void GenericBlockSad8x8(const uint8_t* a, const uint8_t* b, uint32_t width, uint32_t height, uint32_t* sums) {
+    const uint32_t columns = width / 8;
+    memset(sums, 0, sizeof(uint32_t) * columns * (height / 8));
+    for (uint32_t row = 0; row < height / 8 * 8; ++row) {
+        const size_t offset = static_cast<size_t>(row) * width;
+        AccumulateSad8(a + offset, b + offset, columns, sums + (row / 8) * columns);
+    }
+}
+
+#ifdef PIXEL_KERNEL_STEPS
+// Calls step(0) .. step(Count - 1), expanded at compile time
+template <uint32_t Count>
+struct Unrolled {
+    template <typename Step>
+    static KERNEL_INLINE void Run(const Step& step) {
+        Unrolled<Count - 1>::Run(step);
+        step(Count - 1);
+    }
+};
+
+template <>
+struct Unrolled<0> {
+    template <typename Step>
+    static KERNEL_INLINE void Run(const Step&) {}
+};
+
+template <uint32_t Width, uint32_t Height, PixelFormat Format>
+struct ProfileKernels {
+    // Chroma halving of I420 writes Width / 4 bytes per row in whole steps; the rest follows
+    static_assert(Width % (4 * KERNEL_VECTOR) == 0 && (Width / 4) % HALVE_UV_PAIRS == 0, "Width must be a whole number of steps");
+    static_assert(Height % 8 == 0, "Height must be a multiple of 8");
+
+    static const size_t LUMA_SIZE = static_cast<size_t>(Width) * Height;
+    static const size_t CHROMA_SIZE = LUMA_SIZE / 4;
+    static const size_t OUT_LUMA_SIZE = LUMA_SIZE / 4;
+
+    KERNEL_FLATTEN static void Convert(const uint8_t* src, uint8_t* dst) {
+        memcpy(dst, src, LUMA_SIZE);
+        for (uint32_t row = 0; row < Height / 2; ++row) {
+            const size_t packed = LUMA_SIZE + static_cast<size_t>(row) * Width;
+            const size_t planar = LUMA_SIZE + static_cast<size_t>(row) * (Width / 2);
+            if (Format == PixelFormat::NV12) {
+                const uint8_t* uv = src + packed;
+                uint8_t* u = dst + planar;
+                uint8_t* v = u + CHROMA_SIZE;
+                Unrolled<Width / 2 / KERNEL_VECTOR>::Run(
+                    [=](uint32_t i) { SplitUvStep(uv + 2 * KERNEL_VECTOR * i, u + KERNEL_VECTOR * i, v + KERNEL_VECTOR * i); });
+            } else {
+                const uint8_t* u = src + planar;
+                const uint8_t* v = u + CHROMA_SIZE;
+                // Unrolled, the interleaving stores ran about 1.3x slower than this loop
+                MergeUv(u, v, dst + packed, Width / 2);
+            }
+        }
+    }
+
+    KERNEL_FLATTEN static void Halve(const uint8_t* src, uint8_t* dst) {
+        HalvePlane<Width, Height>(src, dst);
+        if (Format == PixelFormat::NV12) {
+            for (uint32_t row = 0; row < Height / 4; ++row) {
+                const uint8_t* row0 = src + LUMA_SIZE + static_cast<size_t>(2 * row) * Width;
+                const uint8_t* row1 = row0 + Width;
+                uint8_t* out = dst + OUT_LUMA_SIZE + static_cast<size_t>(row) * (Width / 2);
+                Unrolled<Width / 4 / HALVE_UV_PAIRS>::Run([=](uint32_t i) {
+                    HalveUvStep(row0 + 4 * HALVE_UV_PAIRS * i, row1 + 4 * HALVE_UV_PAIRS * i, out + 2 * HALVE_UV_PAIRS * i);
+                });
+            }
+        } else {
+            HalvePlane<Width / 2, Height / 2>(src + LUMA_SIZE, dst + OUT_LUMA_SIZE);
+            HalvePlane<Width / 2, Height / 2>(src + LUMA_SIZE + CHROMA_SIZE, dst + OUT_LUMA_SIZE + OUT_LUMA_SIZE / 4);
+        }
+    }
+
+    KERNEL_FLATTEN static uint64_t LumaSad(const uint8_t* a, const uint8_t* b) {
+        SadLanes sum = SadLanesZero();
+        for (uint32_t row = 0; row < Height; ++row) {
+            const uint8_t* rowA = a + static_cast<size_t>(row) * Width;
+            const uint8_t* rowB = b + static_cast<size_t>(row) * Width;
+            Unrolled<Width / KERNEL_VECTOR>::Run([&](uint32_t i) { sum = SadLanesAdd(sum, rowA + KERNEL_VECTOR * i, rowB + KERNEL_VECTOR * i); });
+        }
+        return SadLanesTotal(sum);
+    }
+
+    KERNEL_FLATTEN static void BlockSad8x8(const uint8_t* a, const uint8_t* b, uint32_t* sums) {
+        for (uint32_t blockRow = 0; blockRow < Height / 8; ++blockRow) {
+            const uint8_t* rowA = a + static_cast<size_t>(blockRow) * 8 * Width;
+            const uint8_t* rowB = b + static_cast<size_t>(blockRow) * 8 * Width;
+            uint32_t* out = sums + blockRow * (Width / 8);
+            Unrolled<Width / KERNEL_VECTOR>::Run([=](uint32_t i) {
+                SadLanes sum = SadLanesZero();
+                Unrolled<8>::Run([&](uint32_t y) { sum = SadLanesAdd(sum, rowA + y * Width + KERNEL_VECTOR * i, rowB + y * Width + KERNEL_VECTOR * i); });
+                SadLanesStore(sum, out + KERNEL_VECTOR / 8 * i);
+            });
+        }
+    }
+
+private:
+    template <uint32_t PlaneWidth, uint32_t PlaneHeight>
+    KERNEL_FLATTEN static void HalvePlane(const uint8_t* src, uint8_t* dst) {
+        for (uint32_t row = 0; row < PlaneHeight / 2; ++row) {
+            const uint8_t* row0 = src + static_cast<size_t>(2 * row) * PlaneWidth;
+            const uint8_t* row1 = row0 + PlaneWidth;
+            uint8_t* out = dst + static_cast<size_t>(row) * (PlaneWidth / 2);
+            Unrolled<PlaneWidth / 2 / KERNEL_VECTOR>::Run(
+                [=](uint32_t i) { HalveStep(row0 + 2 * KERNEL_VECTOR * i, row1 + 2 * KERNEL_VECTOR * i, out + KERNEL_VECTOR * i); });
+        }
+    }
+};
+#endif
+
+// The kernels for one frame size and format, compiled for it when it is a known profile
+class FrameKernels {
+public:
+    FrameKernels() = default;
+
+    FrameKernels(uint32_t frameWidth, uint32_t frameHeight, PixelFormat frameFormat) {
+        width = frameWidth;
+        height = frameHeight;
+        format = frameFormat;
+#ifdef PIXEL_KERNEL_STEPS
+        specialized = Pick<640, 480>() || Pick<640, 360>() || Pick<1280, 720>();
+#endif
+    }
+
+    // dst receives the frame in the other 4:2:0 layout
+    void Convert(const uint8_t* src, uint8_t* dst) const {
+        if (convert) convert(src, dst);
+        else GenericConvert(src, dst, width, height, format);
+    }
+
+    // dst receives (width / 2) x (height / 2) in the same format
+    void Halve(const uint8_t* src, uint8_t* dst) const {
+        if (halve) halve(src, dst);
+        else GenericHalve(src, dst, width, height, format);
+    }
+
+    uint64_t LumaSad(const uint8_t* a, const uint8_t* b) const {
+        return lumaSad ? lumaSad(a, b) : GenericLumaSad(a, b, width, height);
+    }
+
+    // sums holds (width / 8) * (height / 8) values
+    void BlockSad8x8(const uint8_t* a, const uint8_t* b, uint32_t* sums) const {
+        if (blockSad) blockSad(a, b, sums);
+        else GenericBlockSad8x8(a, b, width, height, sums);
+    }
+
+    bool Specialized() const { return specialized; }
+    uint32_t Width() const { return width; }
+    uint32_t Height() const { return height; }
+
+private:
+#ifdef PIXEL_KERNEL_STEPS
+    template <uint32_t W, uint32_t H>
+    bool Pick() {
+        if (width != W || height != H) return false;
+        if (format == PixelFormat::NV12) Use<ProfileKernels<W, H, PixelFormat::NV12>>();
+        else Use<ProfileKernels<W, H, PixelFormat::I420>>();
+        return true;
+    }
+
+    template <typename Profile>
+    void Use() {
+        convert = &Profile::Convert;
+        halve = &Profile::Halve;
+        lumaSad = &Profile::LumaSad;
+        blockSad = &Profile::BlockSad8x8;
+    }
+#endif
+
+    uint32_t width = 0;
+    uint32_t height = 0;
+    PixelFormat format = PixelFormat::NV12;
+    bool specialized = false;
+    void (*convert)(const uint8_t*, uint8_t*) = nullptr;
+    void (*halve)(const uint8_t*, uint8_t*) = nullptr;
+    uint64_t (*lumaSad)(const uint8_t*, const uint8_t*) = nullptr;
+    void (*blockSad)(const uint8_t*, const uint8_t*, uint32_t*) = nullptr;
+};
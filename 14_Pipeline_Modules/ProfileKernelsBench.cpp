@@ -0,0 +1,132 @@
+// ProfileKernelsBench.cpp
+// Per-frame cost of the ProfileKernels.h kernels compiled for the recorders'
+// profiles (640x480, 640x360, 1280x720) against the generic kernels, which
+// get the size at runtime. Covers NV12 <-> I420 conversion, halving in both
+// formats, luma SAD and the 8x8 block SAD grid. Each result must match the
+// generic kernel byte for byte. Also checks that FrameKernels uses the
+// compiled profile for those sizes and the generic kernels for any other.
+// The time is the median of several batches, with the frames in cache.
+// Usage: ./Run.sh ProfileKernelsBench [batches]
+#include "ProfileKernels.h"
+#include "MediaTypes.h"
+#include "SyntheticMedia.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+// Constants
+const double BATCH_PIXELS = 3e8; // Pixels processed per timed batch
+
+// Keeps the generic kernels from seeing the frame size as a constant
+volatile uint32_t runtimeSize[2];
+
+uint32_t batches = 9;
+bool allMatch = true;
+
+// Median per-frame time of body() in microseconds
+template <typename Body>
+double TimeUs(uint32_t width, uint32_t height, const Body& body) {
+    const uint32_t reps = std::max<uint32_t>(20, static_cast<uint32_t>(BATCH_PIXELS / (static_cast<double>(width) * height)));
+    std::vector<double> times;
+    body();
+    for (uint32_t b = 0; b < batches; ++b) {
+        const int64_t start = NowTicks();
+        for (uint32_t i = 0; i < reps; ++i) body();
+        times.push_back((NowTicks() - start) / 10.0 / reps);
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+void Report(const char* kernel, double genericUs, double profileUs, bool match) {
+    allMatch = allMatch && match;
+    printf("  %-22s %9.1f %9.1f %7.2fx  %s\n", kernel, genericUs, profileUs, genericUs / profileUs, match ? "matches" : "MISMATCH");
+}
+
+template <uint32_t W, uint32_t H>
+void RunProfile() {
+    runtimeSize[0] = W;
+    runtimeSize[1] = H;
+    const uint32_t width = runtimeSize[0], height = runtimeSize[1];
+    const size_t frameSize = Frame420Size(W, H);
+    std::vector<uint8_t> nv12a(frameSize), nv12b(frameSize), i420a(frameSize);
+    FillTestPattern(nv12a.data(), W, H, PixelFormat::NV12, 3);
+    FillTestPattern(nv12b.data(), W, H, PixelFormat::NV12, 40);
+    FillTestPattern(i420a.data(), W, H, PixelFormat::I420, 3);
+    // Vary the chroma so a swapped U and V or a misplaced pair shows
+    for (size_t i = static_cast<size_t>(W) * H; i < frameSize; ++i) {
+        nv12a[i] = static_cast<uint8_t>(i * 7 + (i >> 9));
+        i420a[i] = static_cast<uint8_t>(i * 13 + (i >> 8));
+    }
+    // Both versions write to the same buffer, so its placement cannot favour either
+    std::vector<uint8_t> out(frameSize), generic;
+    const FrameKernels nv12(W, H, PixelFormat::NV12), i420(W, H, PixelFormat::I420);
+    printf("%ux%u%s\n", W, H, nv12.Specialized() && i420.Specialized() ? "" : " (NOT SPECIALIZED)");
+    allMatch = allMatch && nv12.Specialized() && i420.Specialized();
+
+    double g = TimeUs(W, H, [&] { GenericConvert(nv12a.data(), out.data(), width, height, PixelFormat::NV12); });
+    generic = out;
+    double p = TimeUs(W, H, [&] { nv12.Convert(nv12a.data(), out.data()); });
+    Report("NV12 to I420", g, p, generic == out);
+
+    g = TimeUs(W, H, [&] { GenericConvert(i420a.data(), out.data(), width, height, PixelFormat::I420); });
+    generic = out;
+    p = TimeUs(W, H, [&] { i420.Convert(i420a.data(), out.data()); });
+    Report("I420 to NV12", g, p, generic == out);
+
+    g = TimeUs(W, H, [&] { GenericHalve(nv12a.data(), out.data(), width, height, PixelFormat::NV12); });
+    generic = out;
+    p = TimeUs(W, H, [&] { nv12.Halve(nv12a.data(), out.data()); });
+    Report("halve NV12", g, p, generic == out);
+
+    g = TimeUs(W, H, [&] { GenericHalve(i420a.data(), out.data(), width, height, PixelFormat::I420); });
+    generic = out;
+    p = TimeUs(W, H, [&] { i420.Halve(i420a.data(), out.data()); });
+    Report("halve I420", g, p, generic == out);
+
+    uint64_t genericSad = 0, profileSad = 0;
+    g = TimeUs(W, H, [&] { genericSad += GenericLumaSad(nv12a.data(), nv12b.data(), width, height); });
+    p = TimeUs(W, H, [&] { profileSad += nv12.LumaSad(nv12a.data(), nv12b.data()); });
+    Report("luma SAD", g, p, genericSad == profileSad && genericSad > 0);
+
+    std::vector<uint32_t> genericBlocks(W / 8 * (H / 8)), profileBlocks(genericBlocks.size());
+    g = TimeUs(W, H, [&] { GenericBlockSad8x8(nv12a.data(), nv12b.data(), width, height, genericBlocks.data()); });
+    p = TimeUs(W, H, [&] { nv12.BlockSad8x8(nv12a.data(), nv12b.data(), profileBlocks.data()); });
+    Report("8x8 block SAD", g, p, genericBlocks == profileBlocks);
+}
+
+// Sizes without a profile must take the generic path and still be right
+bool CheckFallback() {
+    const uint32_t width = 800, height = 600;
+    const FrameKernels kernels(width, height, PixelFormat::NV12);
+    std::vector<uint8_t> a(Frame420Size(width, height)), b(a.size()), out(a.size()), back(a.size());
+    FillTestPattern(a.data(), width, height, PixelFormat::NV12, 1);
+    FillTestPattern(b.data(), width, height, PixelFormat::NV12, 9);
+    kernels.Convert(a.data(), out.data());
+    FrameKernels(width, height, PixelFormat::I420).Convert(out.data(), back.data());
+    const bool ok = !kernels.Specialized() && back == a && kernels.LumaSad(a.data(), b.data()) == SumAbsDiff(a.data(), b.data(), width * height);
+    printf("Fallback for %ux%u: generic kernels, NV12 -> I420 -> NV12 round trip: %s\n", width, height, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) batches = std::max(1, atoi(argv[1]));
+#if defined(__AVX2__)
+    printf("Steps: AVX2, %u bytes\n", KERNEL_VECTOR);
+#elif defined(PIXEL_KERNEL_STEPS)
+    printf("Steps: SSE2/NEON, %u bytes\n", KERNEL_VECTOR);
+#else
+    printf("No SIMD steps in this build: every size uses the generic kernels\n");
+#endif
+#ifdef PIXEL_KERNEL_STEPS
+    printf("Per frame, us: %-14s %9s %9s %8s\n", "", "generic", "profile", "speedup");
+    RunProfile<640, 480>();
+    RunProfile<640, 360>();
+    RunProfile<1280, 720>();
+#endif
+    const bool fallback = CheckFallback();
+    return allMatch && fallback ? 0 : 1;
+}
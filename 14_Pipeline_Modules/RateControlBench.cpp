@@ -0,0 +1,315 @@
+// RateControlBench.cpp
+// RateController against a local sink whose bandwidth follows a script, the
+// way the livestream's uplink degrades and recovers. The sender produces an
+// encoded-size stream at the current rung (keyframes every 2 s at 4x a delta
+// frame) and writes it with blocking sends over loopback TCP with small
+// socket buffers. A frame still waiting for its slot to pass is skipped, as
+// the capture loop's cadence aligner would. The sink reads no faster than the
+// script allows and times each frame from its slot to its last byte arriving.
+// The meter gets all three signals: time blocked in send, the send queue
+// (SIOCOUTQ) and acknowledged bytes (sent minus still queued).
+// The same script runs twice: fixed at the top rung, then adaptive.
+// Simulated time runs faster than real time; the sink and sender both pace on
+// the simulated clock.
+// Usage: ./Run.sh RateControlBench [speed-up] [script, e.g. 0:2000,15:600,35:300]
+#include "MediaTypes.h"
+#include "RateController.h"
+#include "Stats.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Constants
+const int SEND_BUFFER = 16 * 1024;    // The kernel doubles these; roughly a second of queue at the low rungs
+const int RECEIVE_BUFFER = 8 * 1024;
+const double DEFAULT_SPEED = 5.0;
+const char* DEFAULT_SCRIPT = "0:2000,15:600,35:300,50:1500,70:2500";
+const double SCRIPT_TAIL = 15.0;      // Seconds run after the last script step
+const uint32_t KEYFRAME_WEIGHT = 4;   // Keyframe size in delta frames
+const uint32_t FRAME_MAGIC = 0x46524d31; // "FRM1"
+const char* LOG_PATH = "/tmp/RateControlBench.log";
+
+// The livestream's ladder (13_youtube_livestream)
+const std::vector<RateRung> LADDER = {
+    { 1000000, 640, 360, 24 },
+    { 700000, 640, 360, 24 },
+    { 450000, 480, 270, 24 },
+    { 250000, 384, 216, 15 },
+};
+
+struct FrameHeader {
+    uint32_t magic;
+    uint32_t bytes; // Whole frame, header included
+    int64_t slot;   // Simulated ticks
+};
+
+struct ScriptStep {
+    double start;    // Seconds
+    double kbps;
+};
+
+struct RunResult {
+    uint64_t framesSent = 0, framesSkipped = 0, framesReceived = 0;
+    uint64_t bytesReceived = 0;
+    uint32_t congestedWindows = 0, windows = 0;
+    uint32_t downs = 0, ups = 0, failedProbes = 0;
+    LatencyHistogram latency; // Slot to last byte, ms
+    std::vector<uint64_t> receivedPerSecond;
+    std::vector<uint32_t> rungPerSecond;
+    std::vector<uint64_t> worstLatencyPerSecond; // ms, by arrival second
+};
+
+double speed = DEFAULT_SPEED;
+std::vector<ScriptStep> script;
+std::chrono::steady_clock::time_point runStart;
+
+// Simulated 100-ns ticks since the run started
+int64_t SimNow() {
+    const auto real = std::chrono::steady_clock::now() - runStart;
+    return static_cast<int64_t>(std::chrono::duration<double>(real).count() * speed * TICKS_PER_SECOND);
+}
+
+void SleepUntilSim(int64_t ticks) {
+    std::this_thread::sleep_until(runStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                 std::chrono::duration<double>(ticks / (speed * TICKS_PER_SECOND))));
+}
+
+double KbpsAt(double seconds) {
+    double kbps = script.front().kbps;
+    for (const ScriptStep& step : script) {
+        if (seconds >= step.start) kbps = step.kbps;
+    }
+    return kbps;
+}
+
+bool ParseScript(const char* text) {
+    script.clear();
+    std::string spec(text);
+    size_t begin = 0;
+    while (begin < spec.size()) {
+        size_t end = spec.find(',', begin);
+        if (end == std::string::npos) end = spec.size();
+        ScriptStep step;
+        if (sscanf(spec.substr(begin, end - begin).c_str(), "%lf:%lf", &step.start, &step.kbps) != 2 || step.kbps <= 0 ||
+            (!script.empty() && step.start <= script.back().start)) {
+            return false;
+        }
+        script.push_back(step);
+        begin = end + 1;
+    }
+    return !script.empty() && script.front().start == 0;
+}
+
+// Reads no faster than the script allows and times every frame from its slot to its last byte
+void Sink(int fd, RunResult& result) {
+    std::vector<uint8_t> buffer(64 * 1024);
+    FrameHeader header;
+    size_t headerHave = 0;
+    uint64_t frameLeft = 0;
+    double tokens = 0;
+    int64_t last = SimNow();
+    for (;;) {
+        const int64_t now = SimNow();
+        const double rate = KbpsAt(static_cast<double>(now) / TICKS_PER_SECOND) * 1000 / 8; // Bytes per second
+        tokens = std::min(tokens + rate * (now - last) / TICKS_PER_SECOND, rate * 0.02); // 20 ms of burst at most
+        last = now;
+        if (tokens < 1) {
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+            continue;
+        }
+        pollfd ready = { fd, POLLIN, 0 };
+        if (poll(&ready, 1, 5) <= 0) continue;
+        const ssize_t n = recv(fd, buffer.data(), std::min(buffer.size(), static_cast<size_t>(tokens)), MSG_DONTWAIT);
+        if (n == 0) break;
+        if (n < 0) continue;
+        tokens -= n;
+        const int64_t arrival = SimNow();
+        const size_t second = static_cast<size_t>(arrival / TICKS_PER_SECOND);
+        if (result.receivedPerSecond.size() <= second) {
+            result.receivedPerSecond.resize(second + 1, 0);
+            result.worstLatencyPerSecond.resize(second + 1, 0);
+        }
+        result.receivedPerSecond[second] += n;
+        result.bytesReceived += n;
+
+        for (ssize_t at = 0; at < n;) {
+            if (frameLeft == 0) {
+                const size_t take = std::min<size_t>(sizeof(header) - headerHave, n - at);
+                memcpy(reinterpret_cast<uint8_t*>(&header) + headerHave, buffer.data() + at, take);
+                headerHave += take;
+                at += take;
+                if (headerHave < sizeof(header)) break;
+                if (header.magic != FRAME_MAGIC) {
+                    printf("Sink lost frame sync.\n");
+                    return;
+                }
+                headerHave = 0;
+                frameLeft = header.bytes - sizeof(header);
+            } else {
+                const size_t take = static_cast<size_t>(std::min<uint64_t>(frameLeft, n - at));
+                frameLeft -= take;
+                at += take;
+            }
+            if (frameLeft == 0 && headerHave == 0) {
+                const uint64_t ms = static_cast<uint64_t>(std::max<int64_t>(arrival - header.slot, 0) / 10000);
+                result.latency.Record(ms);
+                result.worstLatencyPerSecond[second] = std::max(result.worstLatencyPerSecond[second], ms);
+                ++result.framesReceived;
+            }
+        }
+    }
+}
+
+bool Connect(int& sender, int& receiver) {
+    const int listener = socket(AF_INET, SOCK_STREAM, 0);
+    sender = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    const int one = 1;
+    // Buffer sizes before connecting, so the window and autotuning follow them
+    setsockopt(listener, SOL_SOCKET, SO_RCVBUF, &RECEIVE_BUFFER, sizeof(RECEIVE_BUFFER));
+    setsockopt(sender, SOL_SOCKET, SO_SNDBUF, &SEND_BUFFER, sizeof(SEND_BUFFER));
+    setsockopt(sender, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (listener < 0 || sender < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listener, 1) != 0 || getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length) != 0 ||
+        connect(sender, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        printf("Cannot set up the loopback sink.\n");
+        return false;
+    }
+    receiver = accept(listener, NULL, NULL);
+    close(listener);
+    return receiver >= 0;
+}
+
+RunResult Run(bool adaptive, FILE* log) {
+    RunResult result;
+    int sender = -1, receiver = -1;
+    if (!Connect(sender, receiver)) return result;
+    const double seconds = script.back().start + SCRIPT_TAIL;
+    runStart = std::chrono::steady_clock::now();
+    std::thread sink(Sink, receiver, std::ref(result));
+
+    // A one-rung ladder never switches but still classifies every window
+    const std::vector<RateRung> ladder = adaptive ? LADDER : std::vector<RateRung>(1, LADDER[0]);
+    RateController controller;
+    OutputMeter meter;
+    controller.Init(ladder, 0, 0, RateControlConfig(), log);
+    meter.Reset(0);
+
+    std::vector<uint8_t> frame(1 << 20, 0);
+    uint64_t sentTotal = 0;
+    uint32_t gopIndex = 0;
+    int64_t slot = 0;
+    while (slot < static_cast<int64_t>(seconds * TICKS_PER_SECOND)) {
+        const RateRung& rung = controller.Current();
+        const int64_t frameTicks = TICKS_PER_SECOND / rung.fps;
+        const uint32_t gop = 2 * rung.fps;
+        const uint64_t delta = static_cast<uint64_t>(rung.bitrate) / 8 / rung.fps * gop / (gop + KEYFRAME_WEIGHT - 1);
+        const uint32_t bytes = static_cast<uint32_t>(std::max<uint64_t>(gopIndex == 0 ? delta * KEYFRAME_WEIGHT : delta, sizeof(FrameHeader)));
+        gopIndex = (gopIndex + 1) % gop;
+        meter.Offered(bytes);
+
+        if (SimNow() - slot > frameTicks) {
+            ++result.framesSkipped; // Still behind from an earlier send; the cadence aligner drops this frame
+        } else {
+            SleepUntilSim(slot);
+            const FrameHeader header = { FRAME_MAGIC, bytes, slot };
+            memcpy(frame.data(), &header, sizeof(header));
+            const int64_t start = NowTicks();
+            for (uint32_t done = 0; done < bytes;) {
+                const ssize_t n = send(sender, frame.data() + done, bytes - done, MSG_NOSIGNAL);
+                if (n <= 0) break;
+                done += static_cast<uint32_t>(n);
+            }
+            meter.Written(bytes, static_cast<int64_t>((NowTicks() - start) * speed));
+            sentTotal += bytes;
+            ++result.framesSent;
+            int queued = 0;
+            ioctl(sender, TIOCOUTQ, &queued); // Unsent plus unacknowledged
+            meter.Acknowledged(sentTotal - queued);
+            meter.QueueDelay(static_cast<int64_t>(static_cast<double>(queued) * 8 * TICKS_PER_SECOND / rung.bitrate));
+        }
+        slot += frameTicks;
+
+        const int64_t now = SimNow();
+        if (controller.Due(now)) {
+            const RateDecision decision = controller.Update(now, meter.Take(now));
+            ++result.windows;
+            if (decision.congested) ++result.congestedWindows;
+            if (decision.action != RateAction::Hold) gopIndex = 0; // The reconfigured encoder starts on a keyframe
+        }
+        const size_t second = static_cast<size_t>(slot / TICKS_PER_SECOND);
+        if (result.rungPerSecond.size() <= second) result.rungPerSecond.resize(second + 1, controller.CurrentIndex());
+    }
+    shutdown(sender, SHUT_WR);
+    sink.join();
+    close(sender);
+    close(receiver);
+    result.downs = controller.Downs();
+    result.ups = controller.Ups();
+    result.failedProbes = controller.FailedProbes();
+    return result;
+}
+
+void Report(const char* name, const RunResult& r) {
+    const double seconds = script.back().start + SCRIPT_TAIL;
+    double capacity = 0;
+    for (double t = 0; t < seconds; t += 0.1) capacity += KbpsAt(t) * 0.1;
+    printf("%-9s frames sent %llu, skipped %llu (sender behind); delivered %.0f kbps of %.0f available\n", name,
+           static_cast<unsigned long long>(r.framesSent), static_cast<unsigned long long>(r.framesSkipped),
+           r.bytesReceived * 8 / 1000.0 / seconds, capacity / seconds);
+    printf("          slot to sink latency ms: p50 %.0f, p95 %.0f, p99 %.0f, max %.0f\n", static_cast<double>(r.latency.Percentile(50)),
+           static_cast<double>(r.latency.Percentile(95)), static_cast<double>(r.latency.Percentile(99)),
+           static_cast<double>(r.latency.Percentile(100)));
+    printf("          congested windows %u of %u; switches down %u, up %u (%u failed probes)\n", r.congestedWindows, r.windows, r.downs, r.ups,
+           r.failedProbes);
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) speed = std::max(0.5, atof(argv[1]));
+    if (!ParseScript(argc > 2 ? argv[2] : DEFAULT_SCRIPT)) {
+        printf("Script is start:kbps steps, the first at 0 and in order, e.g. %s\n", DEFAULT_SCRIPT);
+        return 1;
+    }
+    printf("Uplink script:");
+    for (const ScriptStep& step : script) printf(" %.0fs %.0f kbps;", step.start, step.kbps);
+    printf(" %.0f s at %.1fx speed\n", script.back().start + SCRIPT_TAIL, speed);
+
+    const RunResult fixed = Run(false, nullptr);
+    FILE* log = fopen(LOG_PATH, "w");
+    const RunResult adaptive = Run(true, log);
+    if (log) fclose(log);
+
+    printf("\nAdaptive, per 5 s:  uplink   rung                 received  worst latency\n");
+    for (size_t s = 0; s < adaptive.rungPerSecond.size(); s += 5) {
+        const RateRung& rung = LADDER[adaptive.rungPerSecond[s]];
+        uint64_t bytes = 0, worst = 0;
+        for (size_t i = s; i < s + 5 && i < adaptive.receivedPerSecond.size(); ++i) {
+            bytes += adaptive.receivedPerSecond[i];
+            worst = std::max(worst, adaptive.worstLatencyPerSecond[i]);
+        }
+        printf("  %4zus %12.0fk   %ux%u@%u %4uk %8.0fk %10llu ms\n", s, KbpsAt(static_cast<double>(s)), rung.width, rung.height, rung.fps,
+               rung.bitrate / 1000, bytes * 8 / 1000.0 / 5, static_cast<unsigned long long>(worst));
+    }
+    printf("\n");
+    Report("Fixed", fixed);
+    Report("Adaptive", adaptive);
+    printf("Every decision: %s\n", LOG_PATH);
+    return 0;
+}
@@ -0,0 +1,251 @@
+// RateController.h
+// Congestion-aware bitrate control for a live output whose sink can stall
+// (ffmpeg's stdin, a socket to the ingest server).
+//   OutputMeter     - the output path reports what it offered, what it wrote,
+//                     how long its writes blocked, how deep its send queue is
+//                     and, when the transport says, how much was acknowledged.
+//   RateController  - once per window, turns the meter's counters into a step
+//                     on a ladder of encoder settings (bitrate, and lower down
+//                     the ladder, size and frame rate):
+//                       blocked    share of the window spent inside blocking writes
+//                       queue      time the queued data takes to drain at the current bitrate
+//                       delivered  bytes acknowledged (or written) over bytes offered
+//                     A window is congested when any signal passes its high mark
+//                     and clear when all are under their low marks; a window in
+//                     between neither counts nor resets a run. Stepping down takes downWindows congested
+//                     windows in a row and goes to the highest rung under
+//                     headroom x estimated capacity (always at least one rung).
+//                     Stepping up takes upWindows clear windows and goes one
+//                     rung. If that rung congests within probeTicks the probe
+//                     failed and the wait before probing that rung again
+//                     doubles, up to maxUpWindows. Every window's decision is logged.
+#pragma once
+
+#include "MediaTypes.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+// One set of encoder settings; a ladder lists them from the highest bitrate down
+struct RateRung {
+    uint32_t bitrate; // Bits per second
+    uint32_t width;
+    uint32_t height;
+    uint32_t fps;
+};
+
+// What the output path saw over one window
+struct OutputWindow {
+    int64_t ticks = 0;
+    uint64_t offeredBytes = 0;
+    uint64_t writtenBytes = 0;
+    uint64_t ackedBytes = 0;  // Only when acksKnown
+    bool acksKnown = false;
+    int64_t blockedTicks = 0;
+    int64_t queueTicks = 0;   // Latest queue depth, as time to drain
+};
+
+// Counters for one output; the producer, the writer and the controller may be different threads
+class OutputMeter {
+public:
+    void Reset(int64_t now) {
+        offered = 0;
+        written = 0;
+        blocked = 0;
+        queue = 0;
+        lastAcked = acked.load();
+        windowStart = now;
+    }
+
+    // Producer: data that should go out (a frame dropped before the write still counts)
+    void Offered(uint64_t bytes) { offered += bytes; }
+
+    // Writer: data the sink accepted and the time the write spent waiting for it
+    void Written(uint64_t bytes, int64_t blockedTicks) {
+        written += bytes;
+        blocked += blockedTicks;
+    }
+
+    // Writer: running total the far end has acknowledged, when the transport reports it
+    void Acknowledged(uint64_t totalBytes) {
+        acked = totalBytes;
+        acksKnown = true;
+    }
+
+    // Writer: how long the data queued for the sink will take to drain
+    void QueueDelay(int64_t ticks) { queue = ticks; }
+
+    // Controller: the counters since the previous Take
+    OutputWindow Take(int64_t now) {
+        OutputWindow window;
+        window.ticks = now - windowStart;
+        window.offeredBytes = offered.exchange(0);
+        window.writtenBytes = written.exchange(0);
+        window.blockedTicks = blocked.exchange(0);
+        window.queueTicks = queue;
+        window.acksKnown = acksKnown;
+        const uint64_t total = acked;
+        window.ackedBytes = total - lastAcked;
+        lastAcked = total;
+        windowStart = now;
+        return window;
+    }
+
+private:
+    std::atomic<uint64_t> offered{ 0 };
+    std::atomic<uint64_t> written{ 0 };
+    std::atomic<uint64_t> acked{ 0 };
+    std::atomic<int64_t> blocked{ 0 };
+    std::atomic<int64_t> queue{ 0 };
+    std::atomic<bool> acksKnown{ false };
+    uint64_t lastAcked = 0;
+    int64_t windowStart = 0;
+};
+
+struct RateControlConfig {
+    int64_t windowTicks = TICKS_PER_SECOND;
+    double congestedBlocked = 0.25;    // Share of the window spent blocked
+    double clearBlocked = 0.05;
+    double congestedQueueSeconds = 1.0;
+    double clearQueueSeconds = 0.3;
+    double congestedDelivery = 0.85;   // Delivered / offered
+    double clearDelivery = 0.97;
+    uint32_t downWindows = 2;          // Congested windows in a row before stepping down
+    uint32_t upWindows = 10;           // Clear windows in a row before probing a rung up
+    uint32_t maxUpWindows = 160;       // Longest wait after failed probes
+    int64_t probeTicks = 10 * TICKS_PER_SECOND;
+    double headroom = 0.85;            // Step down to at most this share of the estimated capacity
+};
+
+enum class RateAction { Hold, Down, Up };
+
+struct RateDecision {
+    RateAction action = RateAction::Hold;
+    uint32_t rung = 0;
+    bool congested = false;
+    double blocked = 0;       // Share of the window
+    double queueSeconds = 0;
+    double delivery = 1;      // Delivered / offered
+    double capacity = 0;      // Estimated bits per second the output carries
+    const char* reason = "";
+};
+
+class RateController {
+public:
+    // ladder runs from the highest bitrate down; log receives one line per window (nullptr for none)
+    bool Init(const std::vector<RateRung>& ladder, int64_t now, uint32_t startRung = 0,
+              const RateControlConfig& settings = RateControlConfig(), FILE* logFile = stdout) {
+        if (ladder.empty() || startRung >= ladder.size()) return false;
+        rungs = ladder;
+        config = settings;
+        log = logFile;
+        rung = startRung;
+        startTicks = lastUpdate = now;
+        congestedRun = clearRun = 0;
+        upWaits.assign(rungs.size(), config.upWindows);
+        probing = false;
+        downs = ups = failedProbes = 0;
+        return true;
+    }
+
+    bool Due(int64_t now) const { return now - lastUpdate >= config.windowTicks; }
+
+    // Start the next window at now, e.g. once the output has finished switching rungs
+    void Resume(int64_t now) { lastUpdate = now; }
+
+    // Decide on one window's counters; a Down or Up means the output should switch to Current()
+    RateDecision Update(int64_t now, const OutputWindow& window) {
+        lastUpdate = now;
+        RateDecision decision;
+        const RateRung& current = rungs[rung];
+        const uint64_t delivered = window.acksKnown ? window.ackedBytes : window.writtenBytes;
+        decision.blocked = std::min(1.0, static_cast<double>(window.blockedTicks) / std::max<int64_t>(window.ticks, 1));
+        decision.queueSeconds = static_cast<double>(window.queueTicks) / TICKS_PER_SECOND;
+        decision.delivery = window.offeredBytes ? std::min(1.0, static_cast<double>(delivered) / window.offeredBytes) : 1.0;
+        decision.capacity = current.bitrate * decision.delivery;
+
+        decision.congested = decision.blocked >= config.congestedBlocked || decision.queueSeconds >= config.congestedQueueSeconds ||
+                             decision.delivery < config.congestedDelivery;
+        const bool clear = decision.blocked < config.clearBlocked && decision.queueSeconds < config.clearQueueSeconds &&
+                           decision.delivery >= config.clearDelivery;
+        congestedRun = decision.congested ? congestedRun + 1 : 0;
+        // A window between the marks holds both runs where they are
+        if (decision.congested) clearRun = 0;
+        else if (clear) ++clearRun;
+        if (probing && now - probeStart >= config.probeTicks) {
+            probing = false; // The probed rung held; probing it again waits the normal time
+            upWaits[rung] = config.upWindows;
+        }
+
+        decision.reason = decision.congested ? "congested" : clear ? "clear" : "between marks";
+        if (congestedRun >= config.downWindows && rung + 1 < rungs.size()) {
+            uint32_t target = rung + 1;
+            while (target + 1 < rungs.size() && rungs[target].bitrate > config.headroom * decision.capacity) ++target;
+            if (probing) {
+                ++failedProbes;
+                upWaits[rung] = std::min(upWaits[rung] * 2, config.maxUpWindows);
+                decision.reason = "probe failed";
+                probing = false;
+            } else {
+                decision.reason = decision.blocked >= config.congestedBlocked ? "writes blocked" :
+                                  decision.queueSeconds >= config.congestedQueueSeconds ? "queue deep" : "delivery short";
+            }
+            Switch(target);
+            ++downs;
+            decision.action = RateAction::Down;
+        } else if (rung > 0 && clearRun >= upWaits[rung - 1]) {
+            Switch(rung - 1);
+            probing = true;
+            probeStart = now;
+            ++ups;
+            decision.action = RateAction::Up;
+            decision.reason = "probing up";
+        }
+        decision.rung = rung;
+        Log(now, current, decision);
+        return decision;
+    }
+
+    const RateRung& Current() const { return rungs[rung]; }
+    uint32_t CurrentIndex() const { return rung; }
+    uint32_t Downs() const { return downs; }
+    uint32_t Ups() const { return ups; }
+    uint32_t FailedProbes() const { return failedProbes; }
+
+private:
+    void Switch(uint32_t target) {
+        rung = target;
+        congestedRun = clearRun = 0;
+    }
+
+    void Log(int64_t now, const RateRung& before, const RateDecision& decision) const {
+        if (!log) return;
+        const RateRung& after = rungs[decision.rung];
+        fprintf(log, "[rate %7.1fs] %ux%u@%u %uk | blocked %3.0f%% queue %.2fs delivered %3.0f%% capacity ~%.0fk | ",
+                static_cast<double>(now - startTicks) / TICKS_PER_SECOND, before.width, before.height, before.fps, before.bitrate / 1000,
+                decision.blocked * 100, decision.queueSeconds, decision.delivery * 100, decision.capacity / 1000);
+        if (decision.action == RateAction::Hold) {
+            fprintf(log, "hold (%s, %u congested, %u clear)\n", decision.reason, congestedRun, clearRun);
+        } else {
+            fprintf(log, "%s to %ux%u@%u %uk (%s)\n", decision.action == RateAction::Down ? "DOWN" : "UP", after.width, after.height,
+                    after.fps, after.bitrate / 1000, decision.reason);
+        }
+        fflush(log);
+    }
+
+    std::vector<RateRung> rungs;
+    RateControlConfig config;
+    FILE* log = nullptr;
+    uint32_t rung = 0;
+    int64_t startTicks = 0;
+    int64_t lastUpdate = 0;
+    uint32_t congestedRun = 0;
+    uint32_t clearRun = 0;
+    std::vector<uint32_t> upWaits; // Clear windows needed before probing each rung
+    bool probing = false;
+    int64_t probeStart = 0;
+    uint32_t downs = 0, ups = 0, failedProbes = 0;
+};
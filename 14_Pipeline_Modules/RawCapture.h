@@ -0,0 +1,483 @@
+// RawCapture.h
+// Lossless raw NV12 recording for calibration captures. Frames live in a
+// FramePool and are written straight from their slots, so the capture thread
+// never copies them again:
+//   UringRawWriter - O_DIRECT writes through an io_uring submission queue with
+//                    the pool registered as fixed buffers; many writes in flight
+//   PlainRawWriter - write() on the capture thread, for comparison and for
+//                    kernels without io_uring
+// Both emit "<file>.idx": a RawIndexHeader followed by one RawIndexEntry per
+// frame, giving the byte offset and timestamp of every frame.
+#pragma once
+
+#include "MediaTypes.h"
+#include "FramePool.h"
+#include "Stats.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
+#pragma pack(push, 1)
+struct RawIndexHeader {
+    char magic[8];       // "RAWIDX1"
+    uint32_t width;
+    uint32_t height;
+    uint32_t format;     // PixelFormat
+    uint32_t reserved;
+    uint64_t entryCount;
+};
+
+struct RawIndexEntry {
+    uint64_t offset;      // Byte offset of the frame in the raw file
+    int64_t pts;          // 100-ns ticks
+    uint32_t length;      // Frame bytes (the slot on disk may be padded to 4 KiB)
+    uint32_t frameNumber;
+};
+#pragma pack(pop)
+
+class RawFrameWriter {
+public:
+    virtual ~RawFrameWriter() {}
+
+    // Queue a filled pool slot; the slot goes back to the pool once it is on disk
+    virtual bool Submit(int slot, size_t length, int64_t pts) = 0;
+    // Wait for outstanding writes, then write the index and close
+    virtual void Close() = 0;
+    virtual const char* Name() const = 0;
+
+    uint64_t BytesWritten() const { return bytesWritten; }
+    uint64_t Errors() const { return errors; }
+    const LatencyHistogram& SubmitLatency() const { return submitLatency; }
+
+protected:
+    bool OpenOutput(const std::string& filePath, FramePool& framePool, uint32_t frameWidth, uint32_t frameHeight,
+                    bool directIo) {
+        path = filePath;
+        pool = &framePool;
+        width = frameWidth;
+        height = frameHeight;
+        direct = directIo;
+        fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | (direct ? O_DIRECT : 0), 0644);
+        if (fd < 0 && direct && errno == EINVAL) {
+            // tmpfs and some network filesystems refuse O_DIRECT
+            printf("%s does not support O_DIRECT; using buffered writes.\n", path.c_str());
+            direct = false;
+            fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        }
+        if (fd < 0) {
+            printf("Failed to open %s for raw capture.\n", path.c_str());
+            return false;
+        }
+        nextOffset = 0;
+        bytesWritten = 0;
+        errors = 0;
+        index.clear();
+        index.reserve(1 << 16);
+        submitLatency.Reset();
+        return true;
+    }
+
+    // Reserve the file range for the next frame and remember it in the index
+    uint64_t AddIndexEntry(size_t length, int64_t pts, size_t& writeLength) {
+        // O_DIRECT needs block-aligned lengths; pool slots are padded for this
+        writeLength = direct ? (length + FramePool::ALIGNMENT - 1) / FramePool::ALIGNMENT * FramePool::ALIGNMENT : length;
+        RawIndexEntry entry;
+        entry.offset = nextOffset;
+        entry.pts = pts;
+        entry.length = static_cast<uint32_t>(length);
+        entry.frameNumber = static_cast<uint32_t>(index.size());
+        index.push_back(entry);
+        nextOffset += writeLength;
+        return entry.offset;
+    }
+
+    // Undo AddIndexEntry for a frame that never reached the file, so the index has no hole
+    void DropLastIndexEntry(size_t writeLength) {
+        index.pop_back();
+        nextOffset -= writeLength;
+    }
+
+    void CloseOutput() {
+        if (fd < 0) return;
+        // Drop the padding after the last frame
+        if (!index.empty() && ftruncate(fd, static_cast<off_t>(index.back().offset + index.back().length)) != 0) {
+            printf("Failed to trim %s.\n", path.c_str());
+        }
+        fdatasync(fd);
+        close(fd);
+        fd = -1;
+
+        FILE* out = fopen((path + ".idx").c_str(), "wb");
+        if (!out) {
+            printf("Failed to write frame index for %s.\n", path.c_str());
+            return;
+        }
+        RawIndexHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "RAWIDX1", 8);
+        header.width = width;
+        header.height = height;
+        header.format = static_cast<uint32_t>(PixelFormat::NV12);
+        header.entryCount = index.size();
+        fwrite(&header, sizeof(header), 1, out);
+        fwrite(index.data(), sizeof(RawIndexEntry), index.size(), out);
+        fclose(out);
+    }
+
+    std::string path;
+    FramePool* pool = nullptr;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    bool direct = false;
+    int fd = -1;
+    uint64_t nextOffset = 0;
+    std::atomic<uint64_t> bytesWritten{ 0 };
+    std::atomic<uint64_t> errors{ 0 };
+    std::vector<RawIndexEntry> index;
+    LatencyHistogram submitLatency;
+};
+
+// write() on the calling thread
+class PlainRawWriter : public RawFrameWriter {
+public:
+    ~PlainRawWriter() { Close(); }
+
+    bool Open(const std::string& filePath, FramePool& framePool, uint32_t frameWidth, uint32_t frameHeight,
+              bool directIo = false) {
+        return OpenOutput(filePath, framePool, frameWidth, frameHeight, directIo);
+    }
+
+    bool Submit(int slot, size_t length, int64_t pts) override {
+        int64_t start = NowTicks();
+        size_t writeLength = 0;
+        uint64_t offset = AddIndexEntry(length, pts, writeLength);
+        const uint8_t* data = pool->Slot(slot);
+        bool ok = true;
+        size_t done = 0;
+        while (done < writeLength) {
+            ssize_t written = pwrite(fd, data + done, writeLength - done, static_cast<off_t>(offset + done));
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) {
+                ++errors;
+                ok = false;
+                break;
+            }
+            done += static_cast<size_t>(written);
+        }
+        // The next frame goes over whatever part of this one was written
+        if (!ok) DropLastIndexEntry(writeLength);
+        bytesWritten += done;
+        pool->Release(slot);
+        submitLatency.Record(static_cast<uint64_t>((NowTicks() - start) / 10));
+        return ok;
+    }
+
+    void Close() override { CloseOutput(); }
+    const char* Name() const override { return direct ? "write() + O_DIRECT" : "write()"; }
+};
+
+#ifdef __linux__
+// io_uring submission with the frame pool registered as fixed buffers. The
+// capture thread only fills SQEs; a reaper thread waits for completions and
+// returns slots to the pool. A write that completes short is resubmitted for
+// the rest by the reaper, and its slot stays out until all of it is on disk.
+class UringRawWriter : public RawFrameWriter {
+public:
+    ~UringRawWriter() { Close(); }
+
+    bool Open(const std::string& filePath, FramePool& framePool, uint32_t frameWidth, uint32_t frameHeight,
+              unsigned queueDepth = 64) {
+        if (!OpenOutput(filePath, framePool, frameWidth, frameHeight, true)) return false;
+        if (!SetupRing(queueDepth)) {
+            close(fd);
+            fd = -1;
+            return false;
+        }
+        inFlight = 0;
+        stopping = false;
+        writes.assign(framePool.SlotCount(), PendingWrite());
+        reaper = std::thread(&UringRawWriter::ReapLoop, this);
+        return true;
+    }
+
+    bool Submit(int slot, size_t length, int64_t pts) override {
+        int64_t start = NowTicks();
+        size_t writeLength = 0;
+        uint64_t offset = AddIndexEntry(length, pts, writeLength);
+
+        PendingWrite& write = writes[slot];
+        write.offset = offset;
+        write.length = static_cast<uint32_t>(writeLength);
+        write.done = 0;
+        ++inFlight;
+        bool ok = false;
+        if (!QueueWrite(slot, ok)) {
+            // Cannot happen while the pool has no more slots than the ring has entries
+            DropLastIndexEntry(writeLength);
+            --inFlight;
+            ++errors;
+            pool->Release(slot);
+            return false;
+        }
+        submitLatency.Record(static_cast<uint64_t>((NowTicks() - start) / 10));
+        return ok;
+    }
+
+    void Close() override {
+        if (ringFd < 0) return;
+        if (reaper.joinable()) {
+            stopping = true;
+            // A NOP wakes the reaper so it can exit once the ring has drained. The SQ is only full
+            // while it holds entries the kernel has not taken yet, so push those and try again.
+            for (;;) {
+                {
+                    std::lock_guard<std::mutex> lock(sqMutex);
+                    if (io_uring_sqe* sqe = NextSqe()) {
+                        sqe->opcode = IORING_OP_NOP;
+                        sqe->user_data = STOP_TOKEN;
+                        PublishSqe();
+                        Enter(1, 0, 0);
+                        break;
+                    }
+                    const unsigned queued = *sqTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+                    if (!Enter(queued, 0, 0) && errno != EAGAIN && errno != EBUSY) break; // Left to the reaper's bounded wait
+                }
+                std::this_thread::yield();
+            }
+            reaper.join();
+        }
+        TeardownRing();
+        CloseOutput();
+    }
+
+    const char* Name() const override { return fixedBuffers ? "io_uring + O_DIRECT (fixed buffers)" : "io_uring + O_DIRECT"; }
+
+private:
+    static const uint64_t STOP_TOKEN = ~0ULL;
+    static const long WAIT_MS = 100; // Longest the reaper sleeps before checking for Close
+
+    // The file range a slot is being written to and how much of it is on disk
+    struct PendingWrite {
+        uint64_t offset = 0;
+        uint32_t length = 0;
+        uint32_t done = 0;
+    };
+
+    static int SysSetup(unsigned entries, io_uring_params* params) {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+    }
+    static int SysRegister(int ring, unsigned opcode, const void* arg, unsigned count) {
+        return static_cast<int>(syscall(__NR_io_uring_register, ring, opcode, arg, count));
+    }
+
+    bool SetupRing(unsigned queueDepth) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        ringFd = SysSetup(queueDepth, &params);
+        if (ringFd < 0) {
+            printf("io_uring_setup failed (%s).\n", strerror(errno));
+            return false;
+        }
+
+        sqRingBytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingBytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        timedWait = (params.features & IORING_FEAT_EXT_ARG) != 0;
+        if (singleMmap && cqRingBytes > sqRingBytes) sqRingBytes = cqRingBytes;
+
+        sqRing = static_cast<uint8_t*>(mmap(nullptr, sqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                            ringFd, IORING_OFF_SQ_RING));
+        cqRing = singleMmap ? sqRing
+                            : static_cast<uint8_t*>(mmap(nullptr, cqRingBytes, PROT_READ | PROT_WRITE,
+                                                         MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING));
+        sqeBytes = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqeBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                               ringFd, IORING_OFF_SQES));
+        if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqes == MAP_FAILED) {
+            printf("Failed to map io_uring rings.\n");
+            sqRing = cqRing = nullptr;
+            sqes = nullptr;
+            close(ringFd);
+            ringFd = -1;
+            return false;
+        }
+
+        sqHead = reinterpret_cast<unsigned*>(sqRing + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sqRing + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(sqRing + params.sq_off.ring_mask);
+        sqEntries = params.sq_entries;
+        sqArray = reinterpret_cast<unsigned*>(sqRing + params.sq_off.array);
+        cqHead = reinterpret_cast<unsigned*>(cqRing + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cqRing + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cqRing + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cqRing + params.cq_off.cqes);
+
+        if (SysRegister(ringFd, IORING_REGISTER_FILES, &fd, 1) < 0) {
+            printf("io_uring file registration failed (%s).\n", strerror(errno));
+            TeardownRing();
+            return false;
+        }
+
+        // Pin the whole pool once; each write then skips the per-I/O page lookup
+        std::vector<iovec> buffers(pool->SlotCount());
+        for (size_t i = 0; i < buffers.size(); ++i) {
+            buffers[i].iov_base = pool->Slot(static_cast<int>(i));
+            buffers[i].iov_len = pool->SlotBytes();
+        }
+        fixedBuffers = SysRegister(ringFd, IORING_REGISTER_BUFFERS, buffers.data(),
+                                   static_cast<unsigned>(buffers.size())) == 0;
+        if (!fixedBuffers) {
+            printf("io_uring buffer registration failed (%s); check RLIMIT_MEMLOCK. Using unregistered writes.\n",
+                   strerror(errno));
+        }
+        return true;
+    }
+
+    void TeardownRing() {
+        if (sqes) munmap(sqes, sqeBytes);
+        if (cqRing && !singleMmap) munmap(cqRing, cqRingBytes);
+        if (sqRing) munmap(sqRing, sqRingBytes);
+        sqes = nullptr;
+        sqRing = cqRing = nullptr;
+        if (ringFd >= 0) close(ringFd);
+        ringFd = -1;
+    }
+
+    // Callers hold sqMutex: the capture thread and the reaper both queue writes
+    io_uring_sqe* NextSqe() {
+        unsigned tail = *sqTail;
+        unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        if (tail - head >= sqEntries) return nullptr;
+        unsigned slot = tail & sqMask;
+        io_uring_sqe* sqe = &sqes[slot];
+        memset(sqe, 0, sizeof(*sqe));
+        sqArray[slot] = slot;
+        return sqe;
+    }
+
+    // Make the SQE filled in after NextSqe visible to the kernel
+    void PublishSqe() {
+        __atomic_store_n(sqTail, *sqTail + 1, __ATOMIC_RELEASE);
+    }
+
+    bool Enter(unsigned toSubmit, unsigned minComplete, unsigned flags) {
+        for (;;) {
+            int result = static_cast<int>(syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, nullptr, 0));
+            if (result >= 0) return true;
+            if (errno == EINTR) continue;
+            if (toSubmit) printf("io_uring_enter failed (%s).\n", strerror(errno));
+            return false;
+        }
+    }
+
+    // Queue the part of slot's write that is not on disk yet; false when the SQ has no room
+    bool QueueWrite(int slot, bool& entered) {
+        const PendingWrite& write = writes[slot];
+        std::lock_guard<std::mutex> lock(sqMutex);
+        io_uring_sqe* sqe = NextSqe();
+        if (!sqe) return false;
+        sqe->opcode = fixedBuffers ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        sqe->flags = IOSQE_FIXED_FILE;
+        sqe->fd = 0; // Index into the registered file table
+        sqe->addr = reinterpret_cast<uint64_t>(pool->Slot(slot) + write.done);
+        sqe->len = write.length - write.done;
+        sqe->off = write.offset + write.done;
+        sqe->buf_index = static_cast<uint16_t>(fixedBuffers ? slot : 0);
+        sqe->user_data = static_cast<uint64_t>(slot);
+        PublishSqe();
+        entered = Enter(1, 0, 0);
+        return true;
+    }
+
+    // Block for a completion; where the kernel allows it, only for WAIT_MS so a Close is never missed
+    void WaitForCompletion() {
+        if (!timedWait) {
+            Enter(0, 1, IORING_ENTER_GETEVENTS);
+            return;
+        }
+        __kernel_timespec timeout = { 0, WAIT_MS * 1000000 };
+        io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        arg.ts = reinterpret_cast<uint64_t>(&timeout);
+        syscall(__NR_io_uring_enter, ringFd, 0, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    }
+
+    void ReapLoop() {
+        while (!stopping || inFlight > 0) {
+            unsigned head = *cqHead;
+            unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+            if (head == tail) {
+                WaitForCompletion();
+                continue;
+            }
+            for (; head != tail; ++head) {
+                const io_uring_cqe& cqe = cqes[head & cqMask];
+                if (cqe.user_data == STOP_TOKEN) continue;
+                const int slot = static_cast<int>(cqe.user_data);
+                PendingWrite& write = writes[slot];
+                if (cqe.res < 0) {
+                    printf("Raw capture write failed (%s).\n", strerror(-cqe.res));
+                    ++errors;
+                } else {
+                    bytesWritten += static_cast<uint64_t>(cqe.res);
+                    write.done += static_cast<uint32_t>(cqe.res);
+                    if (write.done < write.length) {
+                        // A short write leaves a hole in the file: send the rest before the slot goes back.
+                        // O_DIRECT can only continue from a block boundary; anything else would fail with EINVAL.
+                        const bool aligned = !direct || write.done % FramePool::ALIGNMENT == 0;
+                        bool entered = false;
+                        if (cqe.res > 0 && aligned && QueueWrite(slot, entered)) continue;
+                        printf("Raw capture write at offset %llu stopped after %u of %u bytes.\n",
+                               static_cast<unsigned long long>(write.offset), write.done, write.length);
+                        ++errors;
+                    }
+                }
+                pool->Release(slot);
+                --inFlight;
+            }
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        }
+    }
+
+    int ringFd = -1;
+    bool singleMmap = false;
+    bool fixedBuffers = false;
+    bool timedWait = false;
+    uint8_t* sqRing = nullptr;
+    uint8_t* cqRing = nullptr;
+    size_t sqRingBytes = 0;
+    size_t cqRingBytes = 0;
+    size_t sqeBytes = 0;
+    io_uring_sqe* sqes = nullptr;
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqMask = 0;
+    unsigned sqEntries = 0;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+    std::atomic<int> inFlight{ 0 };
+    std::atomic<bool> stopping{ false };
+    std::vector<PendingWrite> writes; // By pool slot
+    std::mutex sqMutex;
+    std::thread reaper;
+};
+#endif
@@ -0,0 +1,108 @@
+// RawCaptureBench.cpp
+// Sustained raw NV12 recording: plain write() vs. io_uring with O_DIRECT.
+// Each mode runs a paced capture loop at the target frame rate (reporting how
+// long the capture thread is blocked and how many frames had no free slot) and
+// then an unpaced loop to find the sustained MB/s ceiling.
+//
+// Usage: RawCaptureBench [output-dir] [seconds] [WIDTHxHEIGHT] [fps]
+#include "RawCapture.h"
+#include "SyntheticMedia.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <memory>
+
+// Constants
+const size_t POOL_SLOTS = 48;        // ~150 MB of 1080p frames; must not exceed the ring depth
+const unsigned RING_DEPTH = 64;
+
+struct RunResult {
+    uint64_t frames = 0;
+    uint64_t dropped = 0; // Capture found no free slot and skipped the frame
+    double seconds = 0;
+};
+
+// Drive the writer with frames copied from the "camera" into pool slots
+RunResult RunLoop(RawFrameWriter& writer, FramePool& pool, const std::vector<uint8_t>& camera, double seconds, uint32_t fps) {
+    RunResult result;
+    const int64_t interval = fps ? TICKS_PER_SECOND / fps : 0;
+    const int64_t start = NowTicks();
+    int64_t nextFrame = start;
+    while (NowTicks() - start < static_cast<int64_t>(seconds * TICKS_PER_SECOND)) {
+        int slot = pool.Acquire();
+        if (slot < 0) {
+            // Paced capture drops the frame; the unpaced run just waits for the disk
+            if (interval) ++result.dropped;
+            else std::this_thread::yield();
+        } else {
+            memcpy(pool.Slot(slot), camera.data(), camera.size()); // Stand-in for IMFMediaBuffer::Lock + copy
+            writer.Submit(slot, camera.size(), static_cast<int64_t>(result.frames) * (interval ? interval : 1));
+            ++result.frames;
+        }
+        if (interval) {
+            nextFrame += interval;
+            int64_t wait = nextFrame - NowTicks();
+            if (wait > 0) std::this_thread::sleep_for(std::chrono::microseconds(wait / 10));
+        }
+    }
+    writer.Close();
+    result.seconds = (NowTicks() - start) / static_cast<double>(TICKS_PER_SECOND);
+    return result;
+}
+
+void Report(const char* phase, RawFrameWriter& writer, const RunResult& result) {
+    printf("  %-8s %6llu frames, %4llu without a free slot, %8.1f MB/s, %llu errors\n", phase,
+           static_cast<unsigned long long>(result.frames), static_cast<unsigned long long>(result.dropped),
+           writer.BytesWritten() / result.seconds / 1e6, static_cast<unsigned long long>(writer.Errors()));
+    writer.SubmitLatency().Print("    capture thread blocked");
+}
+
+int main(int argc, char* argv[]) {
+    std::string directory = argc > 1 ? argv[1] : "/tmp";
+    double seconds = argc > 2 ? atof(argv[2]) : 3.0;
+    unsigned width = 1920, height = 1080;
+    if (argc > 3) sscanf(argv[3], "%ux%u", &width, &height);
+    uint32_t fps = argc > 4 ? static_cast<uint32_t>(atoi(argv[4])) : 60;
+
+    std::vector<uint8_t> camera(Frame420Size(width, height));
+    FillTestPattern(camera.data(), width, height, PixelFormat::NV12, 0);
+    FramePool pool;
+    if (!pool.Allocate(POOL_SLOTS, camera.size())) {
+        printf("Failed to allocate the frame pool.\n");
+        return 1;
+    }
+    printf("Raw NV12 %ux%u at %u fps = %.1f MB/s target, pool of %zu slots.\n\n", width, height, fps,
+           camera.size() * fps / 1e6, POOL_SLOTS);
+
+    const std::string path = directory + "/rawcapture.nv12";
+    for (int mode = 0; mode < 3; ++mode) {
+        for (int phase = 0; phase < 2; ++phase) {
+            std::unique_ptr<RawFrameWriter> writer;
+            if (mode == 0 || mode == 1) {
+                auto plain = std::make_unique<PlainRawWriter>();
+                if (!plain->Open(path, pool, width, height, mode == 1)) return 1;
+                writer = std::move(plain);
+            } else {
+#ifdef __linux__
+                auto uring = std::make_unique<UringRawWriter>();
+                if (!uring->Open(path, pool, width, height, RING_DEPTH)) {
+                    printf("io_uring is unavailable here; skipping.\n");
+                    break;
+                }
+                writer = std::move(uring);
+#else
+                break;
+#endif
+            }
+            if (phase == 0) printf("%s\n", writer->Name());
+            RunResult result = RunLoop(*writer, pool, camera, seconds, phase == 0 ? fps : 0);
+            Report(phase == 0 ? "paced" : "max", *writer, result);
+        }
+        printf("\n");
+    }
+    remove(path.c_str());
+    remove((path + ".idx").c_str());
+    return 0;
+}
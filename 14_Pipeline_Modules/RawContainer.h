@@ -0,0 +1,236 @@
+// RawContainer.h
+// Compact container for raw NV12 video + interleaved PCM audio, for hosts that
+// cannot encode in real time. Layout:
+//
+//   RawContainerHeader
+//   { RawChunkHeader, payload } ...      in capture order
+//   RawIndexRecord[entryCount]           trailing index
+//   RawContainerFooter                   points back at the index
+//
+// Every chunk carries its own small header, so a file whose recorder died
+// before writing the index can still be opened: the reader rebuilds the index
+// by walking the chunks.
+#pragma once
+
+#include "MediaTypes.h"
+#include "MappedFile.h"
+#include "DiskWriter.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#pragma pack(push, 1)
+struct RawContainerHeader {
+    char magic[8];          // "RAWCAP1"
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixelFormat;   // PixelFormat
+    uint32_t fpsNumerator;
+    uint32_t fpsDenominator;
+    uint32_t audioSampleRate; // 0 when there is no audio
+    uint16_t audioChannels;
+    uint16_t audioBitsPerSample;
+    uint8_t reserved[24];
+};
+
+struct RawChunkHeader {
+    char tag[4];            // "VID0" or "AUD0"
+    uint32_t size;          // Payload bytes following this header
+    int64_t pts;            // 100-ns ticks
+};
+
+struct RawIndexRecord {
+    uint64_t offset;        // Payload offset in the file
+    int64_t pts;
+    uint32_t size;
+    uint32_t type;          // RawChunkType
+};
+
+struct RawContainerFooter {
+    uint64_t indexOffset;
+    uint64_t entryCount;
+    char magic[8];          // "RAWCIDX"
+};
+#pragma pack(pop)
+
+enum RawChunkType : uint32_t {
+    RAW_CHUNK_VIDEO = 0,
+    RAW_CHUNK_AUDIO = 1
+};
+
+struct RawContainerFormat {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    PixelFormat pixelFormat = PixelFormat::NV12;
+    uint32_t fpsNumerator = 30;
+    uint32_t fpsDenominator = 1;
+    uint32_t audioSampleRate = 0;
+    uint16_t audioChannels = 0;
+    uint16_t audioBitsPerSample = 0;
+};
+
+// Recording side; output goes through the write-behind DiskWriter
+class RawContainerWriter {
+public:
+    bool Open(const std::string& path, const RawContainerFormat& containerFormat,
+              const DiskWriterOptions& options = DiskWriterOptions()) {
+        format = containerFormat;
+        if (!writer.Open(path, options)) return false;
+        RawContainerHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "RAWCAP1", 8);
+        header.version = 1;
+        header.width = format.width;
+        header.height = format.height;
+        header.pixelFormat = static_cast<uint32_t>(format.pixelFormat);
+        header.fpsNumerator = format.fpsNumerator;
+        header.fpsDenominator = format.fpsDenominator;
+        header.audioSampleRate = format.audioSampleRate;
+        header.audioChannels = format.audioChannels;
+        header.audioBitsPerSample = format.audioBitsPerSample;
+        offset = 0;
+        index.clear();
+        return Append(&header, sizeof(header));
+    }
+
+    bool WriteVideo(const uint8_t* data, size_t size, int64_t pts) { return WriteChunk("VID0", RAW_CHUNK_VIDEO, data, size, pts); }
+    bool WriteAudio(const uint8_t* data, size_t size, int64_t pts) { return WriteChunk("AUD0", RAW_CHUNK_AUDIO, data, size, pts); }
+
+    // Append the index and footer, then close the file
+    bool Close() {
+        if (!writer.IsOpen()) return false;
+        RawContainerFooter footer;
+        footer.indexOffset = offset;
+        footer.entryCount = index.size();
+        memcpy(footer.magic, "RAWCIDX", 8);
+        bool ok = Append(index.data(), index.size() * sizeof(RawIndexRecord)) && Append(&footer, sizeof(footer));
+        writer.Close();
+        return ok && !writer.Failed();
+    }
+
+    uint64_t BytesWritten() const { return offset; }
+    size_t Chunks() const { return index.size(); }
+
+private:
+    bool WriteChunk(const char* tag, RawChunkType type, const uint8_t* data, size_t size, int64_t pts) {
+        RawChunkHeader chunk;
+        memcpy(chunk.tag, tag, 4);
+        chunk.size = static_cast<uint32_t>(size);
+        chunk.pts = pts;
+        if (!Append(&chunk, sizeof(chunk))) return false;
+        index.push_back({ offset, pts, static_cast<uint32_t>(size), type });
+        return Append(data, size);
+    }
+
+    bool Append(const void* data, size_t size) {
+        offset += size;
+        return writer.Write(data, size);
+    }
+
+    DiskWriter writer;
+    RawContainerFormat format;
+    uint64_t offset = 0;
+    std::vector<RawIndexRecord> index;
+};
+
+// Playback side; payloads are served straight from the mapping
+class RawContainerReader {
+public:
+    bool Open(const std::string& path) {
+        if (!file.Open(path, false)) return false;
+        const uint8_t* base = file.Data();
+        const size_t size = file.Size();
+        if (size < sizeof(RawContainerHeader) || memcmp(base, "RAWCAP1", 8) != 0) {
+            printf("%s is not a raw capture container.\n", path.c_str());
+            return false;
+        }
+        const RawContainerHeader* header = reinterpret_cast<const RawContainerHeader*>(base);
+        format.width = header->width;
+        format.height = header->height;
+        format.pixelFormat = static_cast<PixelFormat>(header->pixelFormat);
+        format.fpsNumerator = header->fpsNumerator;
+        format.fpsDenominator = header->fpsDenominator;
+        format.audioSampleRate = header->audioSampleRate;
+        format.audioChannels = header->audioChannels;
+        format.audioBitsPerSample = header->audioBitsPerSample;
+
+        if (!LoadIndex()) {
+            printf("%s has no valid index (recording interrupted?); rebuilding it from the chunks.\n", path.c_str());
+            RebuildIndex();
+        }
+        video.clear();
+        audio.clear();
+        for (const RawIndexRecord& record : records) {
+            (record.type == RAW_CHUNK_VIDEO ? video : audio).push_back(record);
+        }
+        return !video.empty();
+    }
+
+    const RawContainerFormat& Format() const { return format; }
+    const std::vector<RawIndexRecord>& VideoChunks() const { return video; }
+    const std::vector<RawIndexRecord>& AudioChunks() const { return audio; }
+    const uint8_t* Payload(const RawIndexRecord& record) const { return file.Data() + record.offset; }
+
+private:
+    bool LoadIndex() {
+        const size_t size = file.Size();
+        if (size < sizeof(RawContainerHeader) + sizeof(RawContainerFooter)) return false;
+        RawContainerFooter footer;
+        memcpy(&footer, file.Data() + size - sizeof(footer), sizeof(footer));
+        if (memcmp(footer.magic, "RAWCIDX", 8) != 0) return false;
+        // Bound the count first so the size arithmetic below cannot wrap
+        const uint64_t space = size - sizeof(RawContainerHeader) - sizeof(footer);
+        if (footer.entryCount > space / sizeof(RawIndexRecord)) return false;
+        if (footer.indexOffset < sizeof(RawContainerHeader) ||
+            footer.indexOffset + footer.entryCount * sizeof(RawIndexRecord) + sizeof(footer) != size) {
+            return false;
+        }
+        records.resize(static_cast<size_t>(footer.entryCount));
+        memcpy(records.data(), file.Data() + footer.indexOffset, records.size() * sizeof(RawIndexRecord));
+        // Every record must point at a matching chunk before the index, as RebuildIndex would find it
+        for (const RawIndexRecord& record : records) {
+            if (!ValidRecord(record, footer.indexOffset)) {
+                records.clear();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool ValidRecord(const RawIndexRecord& record, uint64_t end) const {
+        if (record.type != RAW_CHUNK_VIDEO && record.type != RAW_CHUNK_AUDIO) return false;
+        if (record.offset < sizeof(RawContainerHeader) + sizeof(RawChunkHeader) || record.offset > end ||
+            record.size > end - record.offset) {
+            return false;
+        }
+        RawChunkHeader chunk;
+        memcpy(&chunk, file.Data() + record.offset - sizeof(chunk), sizeof(chunk));
+        return memcmp(chunk.tag, record.type == RAW_CHUNK_VIDEO ? "VID0" : "AUD0", 4) == 0 && chunk.size == record.size;
+    }
+
+    void RebuildIndex() {
+        records.clear();
+        const uint8_t* base = file.Data();
+        const size_t size = file.Size();
+        size_t offset = sizeof(RawContainerHeader);
+        while (offset + sizeof(RawChunkHeader) <= size) {
+            RawChunkHeader chunk;
+            memcpy(&chunk, base + offset, sizeof(chunk));
+            bool isVideo = memcmp(chunk.tag, "VID0", 4) == 0;
+            bool isAudio = memcmp(chunk.tag, "AUD0", 4) == 0;
+            size_t payload = offset + sizeof(chunk);
+            if ((!isVideo && !isAudio) || payload + chunk.size > size) break; // Torn tail
+            records.push_back({ payload, chunk.pts, chunk.size, isVideo ? RAW_CHUNK_VIDEO : RAW_CHUNK_AUDIO });
+            offset = payload + chunk.size;
+        }
+    }
+
+    MappedFile file;
+    RawContainerFormat format;
+    std::vector<RawIndexRecord> records;
+    std::vector<RawIndexRecord> video;
+    std::vector<RawIndexRecord> audio;
+};
@@ -0,0 +1,332 @@
+// RawTranscode.cpp
+// Offline transcoder for raw capture containers (RawContainer.h). The capture
+// is split at planned GOP boundaries, the segments are encoded concurrently
+// (one single-threaded ffmpeg/libx264 per core, each segment starting with an
+// IDR and closed GOPs), the Annex B segments are concatenated and finally
+// muxed with the audio into one MP4.
+// Raw Annex B carries no timestamps, so the timing comes from the index: each
+// frame is placed on the output's constant frame-rate grid by its pts (held
+// over gaps, skipped when it is a whole frame late), and the audio is offset
+// by the difference between the first audio and first video pts.
+//
+// Usage:
+//   RawTranscode input.rawc output.mp4 [--jobs N] [--gop FRAMES] [--preset NAME] [--compare] [--dry-run]
+//   RawTranscode --make-synthetic clip.rawc [seconds]
+#include "RawContainer.h"
+#include "SyntheticMedia.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+const char* NULL_DEVICE = "NUL";
+#else
+const char* NULL_DEVICE = "/dev/null";
+#endif
+
+// Constants
+const uint32_t SYNTHETIC_WIDTH = 640;
+const uint32_t SYNTHETIC_HEIGHT = 360;
+const uint32_t SYNTHETIC_FPS = 24;
+const uint32_t GOPS_PER_SEGMENT = 4;
+
+struct TranscodeOptions {
+    unsigned jobs = 0;          // 0 = one per core
+    uint32_t gopFrames = 0;     // 0 = two seconds
+    std::string preset = "veryfast";
+    bool dryRun = false;
+};
+
+struct Segment {
+    size_t firstFrame;
+    size_t frameCount;
+    std::string path;
+};
+
+std::mutex printMutex;
+
+// One argument for popen/system, whatever spaces or shell characters it holds
+std::string ShellQuote(const std::string& argument) {
+#ifdef _WIN32
+    return "\"" + argument + "\""; // Windows paths cannot contain a double quote
+#else
+    std::string quoted = "'";
+    for (char c : argument) {
+        if (c == '\'') quoted += "'\\''";
+        else quoted += c;
+    }
+    return quoted + "'";
+#endif
+}
+
+// Cut the capture into whole-GOP segments so every segment starts on an IDR
+std::vector<Segment> PlanSegments(size_t frames, uint32_t gopFrames, size_t segmentFrames, const std::string& stem) {
+    std::vector<Segment> segments;
+    segmentFrames = (segmentFrames + gopFrames - 1) / gopFrames * gopFrames;
+    for (size_t first = 0; first < frames; first += segmentFrames) {
+        size_t count = frames - first < segmentFrames ? frames - first : segmentFrames;
+        segments.push_back({ first, count, stem + ".seg" + std::to_string(segments.size()) + ".h264" });
+    }
+    return segments;
+}
+
+// Position of video frame i on the output's constant frame-rate grid, from its pts
+int64_t GridSlot(const RawContainerReader& reader, size_t i) {
+    const RawContainerFormat& format = reader.Format();
+    const std::vector<RawIndexRecord>& frames = reader.VideoChunks();
+    const int64_t sinceFirst = std::max<int64_t>(frames[i].pts - frames.front().pts, 0);
+    const int64_t unit = static_cast<int64_t>(format.fpsDenominator ? format.fpsDenominator : 1) * TICKS_PER_SECOND;
+    return (sinceFirst * format.fpsNumerator + unit / 2) / unit;
+}
+
+std::string RawPixelFormat(const RawContainerFormat& format) {
+    return format.pixelFormat == PixelFormat::NV12 ? "nv12" : "yuv420p";
+}
+
+// Encode one segment by piping its frames into a single-threaded libx264
+bool EncodeSegment(const RawContainerReader& reader, const Segment& segment, const TranscodeOptions& options) {
+    const RawContainerFormat& format = reader.Format();
+    std::string command = "ffmpeg -hide_banner -loglevel error -y -f rawvideo -pix_fmt " + RawPixelFormat(format) +
+                          " -s " + std::to_string(format.width) + "x" + std::to_string(format.height) +
+                          " -r " + std::to_string(format.fpsNumerator) + "/" + std::to_string(format.fpsDenominator) +
+                          " -i - -c:v libx264 -pix_fmt yuv420p -preset " + ShellQuote(options.preset) +
+                          " -threads 1 -g " + std::to_string(options.gopFrames) +
+                          " -keyint_min " + std::to_string(options.gopFrames) +
+                          " -sc_threshold 0 -x264-params open-gop=0 -f h264 " + ShellQuote(segment.path);
+    if (options.dryRun) {
+        std::lock_guard<std::mutex> lock(printMutex);
+        printf("  %s  < frames %zu..%zu\n", command.c_str(), segment.firstFrame, segment.firstFrame + segment.frameCount - 1);
+        return true;
+    }
+
+    FILE* encoder = popen(command.c_str(), "w");
+    if (!encoder) {
+        printf("Failed to start ffmpeg for %s.\n", segment.path.c_str());
+        return false;
+    }
+    const std::vector<RawIndexRecord>& frames = reader.VideoChunks();
+    bool ok = true;
+    int64_t written = GridSlot(reader, segment.firstFrame);
+    for (size_t i = segment.firstFrame; i < segment.firstFrame + segment.frameCount && ok; ++i) {
+        // Hold the frame until the next one is due; a segment always starts with its first frame
+        const int64_t until = i + 1 < frames.size() ? GridSlot(reader, i + 1) : written + 1;
+        const int64_t copies = std::max<int64_t>(until - written, i == segment.firstFrame ? 1 : 0);
+        for (int64_t c = 0; c < copies && ok; ++c) {
+            ok = fwrite(reader.Payload(frames[i]), 1, frames[i].size, encoder) == frames[i].size;
+        }
+        written += copies;
+    }
+    return pclose(encoder) == 0 && ok;
+}
+
+// Encode all segments with a pool of workers pulling from a shared cursor
+bool EncodeSegments(const RawContainerReader& reader, const std::vector<Segment>& segments,
+                    const TranscodeOptions& options, unsigned jobs) {
+    std::atomic<size_t> nextSegment(0);
+    std::atomic<bool> failed(false);
+    std::vector<std::thread> workers;
+    for (unsigned j = 0; j < jobs; ++j) {
+        workers.emplace_back([&]() {
+            for (size_t s = nextSegment++; s < segments.size() && !failed; s = nextSegment++) {
+                if (!EncodeSegment(reader, segments[s], options)) failed = true;
+            }
+        });
+    }
+    for (std::thread& worker : workers) worker.join();
+    return !failed;
+}
+
+// Annex B streams that each start with SPS/PPS + IDR can simply be concatenated
+bool StitchSegments(const std::vector<Segment>& segments, const std::string& path) {
+    FILE* out = fopen(path.c_str(), "wb");
+    if (!out) return false;
+    std::vector<uint8_t> buffer(1 << 20);
+    bool ok = true;
+    for (const Segment& segment : segments) {
+        FILE* in = fopen(segment.path.c_str(), "rb");
+        if (!in) {
+            printf("Missing encoded segment %s.\n", segment.path.c_str());
+            ok = false;
+            break;
+        }
+        size_t read;
+        while (ok && (read = fread(buffer.data(), 1, buffer.size(), in)) > 0) ok = fwrite(buffer.data(), 1, read, out) == read;
+        ok = ok && !ferror(in);
+        fclose(in);
+        if (!ok) {
+            printf("Failed to copy %s into %s.\n", segment.path.c_str(), path.c_str());
+            break;
+        }
+    }
+    ok = fclose(out) == 0 && ok;
+    return ok;
+}
+
+// Write the captured PCM to a flat file for the final mux
+bool ExtractAudio(const RawContainerReader& reader, const std::string& path) {
+    FILE* out = fopen(path.c_str(), "wb");
+    if (!out) return false;
+    bool ok = true;
+    for (const RawIndexRecord& record : reader.AudioChunks()) {
+        ok = ok && fwrite(reader.Payload(record), 1, record.size, out) == record.size;
+    }
+    ok = fclose(out) == 0 && ok;
+    if (!ok) printf("Failed to write %s.\n", path.c_str());
+    return ok;
+}
+
+bool MuxOutput(const RawContainerReader& reader, const std::string& videoPath, const std::string& audioPath,
+               const std::string& outputPath, const TranscodeOptions& options) {
+    const RawContainerFormat& format = reader.Format();
+    std::string command = "ffmpeg -hide_banner -loglevel error -y -framerate " + std::to_string(format.fpsNumerator) + "/" +
+                          std::to_string(format.fpsDenominator) + " -f h264 -i " + ShellQuote(videoPath);
+    if (!audioPath.empty()) {
+        // The video starts at its first frame's pts; line the audio up with it
+        const int64_t offset = reader.AudioChunks().front().pts - reader.VideoChunks().front().pts;
+        char itsoffset[32];
+        snprintf(itsoffset, sizeof(itsoffset), "%.6f", offset / static_cast<double>(TICKS_PER_SECOND));
+        command += std::string(" -itsoffset ") + itsoffset + " -f s" + std::to_string(format.audioBitsPerSample) + "le -ar " + std::to_string(format.audioSampleRate) +
+                   " -ac " + std::to_string(format.audioChannels) + " -i " + ShellQuote(audioPath) + " -c:a aac -b:a 128k";
+    }
+    command += " -c:v copy -movflags +faststart " + ShellQuote(outputPath);
+    if (options.dryRun) {
+        printf("  %s\n", command.c_str());
+        return true;
+    }
+    return system(command.c_str()) == 0;
+}
+
+// Full transcode with the given parallelism; returns wall-clock seconds for the encode stage, or -1
+double Transcode(const RawContainerReader& reader, const std::string& outputPath, const TranscodeOptions& options,
+                 unsigned jobs, size_t segmentFrames) {
+    const size_t frames = reader.VideoChunks().size();
+    if (frames == 0) {
+        printf("No video frames to transcode.\n");
+        return -1;
+    }
+    std::vector<Segment> segments = PlanSegments(frames, options.gopFrames, segmentFrames, outputPath);
+    printf("%zu frames -> %zu segments of up to %zu frames, %u parallel encoders.\n", frames, segments.size(),
+           segments.front().frameCount, jobs);
+
+    int64_t start = NowTicks();
+    bool ok = EncodeSegments(reader, segments, options, jobs);
+    double encodeSeconds = (NowTicks() - start) / static_cast<double>(TICKS_PER_SECOND);
+
+    const std::string videoPath = outputPath + ".video.h264";
+    const std::string audioPath = reader.AudioChunks().empty() ? "" : outputPath + ".audio.pcm";
+    if (ok && !options.dryRun) ok = StitchSegments(segments, videoPath);
+    if (ok && !audioPath.empty() && !options.dryRun) ok = ExtractAudio(reader, audioPath);
+    if (ok) ok = MuxOutput(reader, videoPath, audioPath, outputPath, options);
+
+    for (const Segment& segment : segments) remove(segment.path.c_str());
+    remove(videoPath.c_str());
+    if (!audioPath.empty()) remove(audioPath.c_str());
+    if (!ok) {
+        printf("Transcode failed.\n");
+        return -1;
+    }
+    if (!options.dryRun) {
+        printf("Encoded %zu frames in %.2f s (%.1f fps) -> %s\n", frames, encodeSeconds, frames / encodeSeconds, outputPath.c_str());
+    }
+    return encodeSeconds;
+}
+
+// Write a synthetic capture (moving pattern + 1 kHz tone) for trying the transcoder
+int MakeSynthetic(const std::string& path, double seconds) {
+    RawContainerFormat format;
+    format.width = SYNTHETIC_WIDTH;
+    format.height = SYNTHETIC_HEIGHT;
+    format.pixelFormat = PixelFormat::NV12;
+    format.fpsNumerator = SYNTHETIC_FPS;
+    format.audioSampleRate = 48000;
+    format.audioChannels = 2;
+    format.audioBitsPerSample = 16;
+
+    RawContainerWriter writer;
+    if (!writer.Open(path, format)) return 1;
+    std::vector<uint8_t> frame(Frame420Size(format.width, format.height));
+    const uint32_t samplesPerFrame = format.audioSampleRate / SYNTHETIC_FPS;
+    std::vector<int16_t> pcm(samplesPerFrame * format.audioChannels);
+    const uint32_t frames = static_cast<uint32_t>(seconds * SYNTHETIC_FPS);
+    for (uint32_t i = 0; i < frames; ++i) {
+        int64_t pts = static_cast<int64_t>(i) * TICKS_PER_SECOND / SYNTHETIC_FPS;
+        FillTestPattern(frame.data(), format.width, format.height, format.pixelFormat, i);
+        writer.WriteVideo(frame.data(), frame.size(), pts);
+        for (uint32_t s = 0; s < samplesPerFrame; ++s) {
+            double t = (static_cast<double>(i) * samplesPerFrame + s) / format.audioSampleRate;
+            int16_t value = static_cast<int16_t>(16000 * sin(2 * SYNTHETIC_PI * 1000 * t));
+            pcm[2 * s] = pcm[2 * s + 1] = value;
+        }
+        writer.WriteAudio(reinterpret_cast<const uint8_t*>(pcm.data()), pcm.size() * sizeof(int16_t), pts);
+    }
+    if (!writer.Close()) return 1;
+    printf("Wrote %u frames (%.1f MB) to %s.\n", frames, writer.BytesWritten() / 1e6, path.c_str());
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc >= 3 && std::string(argv[1]) == "--make-synthetic") {
+        return MakeSynthetic(argv[2], argc > 3 ? atof(argv[3]) : 60.0);
+    }
+    if (argc < 3) {
+        printf("Usage: RawTranscode input.rawc output.mp4 [--jobs N] [--gop FRAMES] [--preset NAME] [--compare] [--dry-run]\n");
+        printf("       RawTranscode --make-synthetic clip.rawc [seconds]\n");
+        return 1;
+    }
+
+    const std::string inputPath = argv[1];
+    const std::string outputPath = argv[2];
+    TranscodeOptions options;
+    bool compare = false;
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--jobs" && i + 1 < argc) options.jobs = static_cast<unsigned>(atoi(argv[++i]));
+        else if (arg == "--gop" && i + 1 < argc) options.gopFrames = static_cast<uint32_t>(atoi(argv[++i]));
+        else if (arg == "--preset" && i + 1 < argc) options.preset = argv[++i];
+        else if (arg == "--compare") compare = true;
+        else if (arg == "--dry-run") options.dryRun = true;
+    }
+
+    RawContainerReader reader;
+    if (!reader.Open(inputPath)) return 1;
+    const RawContainerFormat& format = reader.Format();
+    if (options.jobs == 0) options.jobs = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+    if (options.gopFrames == 0) options.gopFrames = 2 * format.fpsNumerator / (format.fpsDenominator ? format.fpsDenominator : 1);
+    if (options.gopFrames == 0) options.gopFrames = 1;
+
+    std::string probe = std::string("ffmpeg -hide_banner -version > ") + NULL_DEVICE + " 2>&1";
+    if (!options.dryRun && system(probe.c_str()) != 0) {
+        printf("ffmpeg was not found on PATH; rerun with --dry-run to see the plan.\n");
+        return 1;
+    }
+
+    const size_t frames = reader.VideoChunks().size();
+    if (frames == 0) {
+        printf("%s has no video frames.\n", inputPath.c_str());
+        return 1;
+    }
+    // Several segments per worker keeps all cores busy until the end
+    size_t segmentFrames = frames / (options.jobs * 2) + 1;
+    if (segmentFrames < options.gopFrames * GOPS_PER_SEGMENT) segmentFrames = options.gopFrames * GOPS_PER_SEGMENT;
+
+    double parallelSeconds = Transcode(reader, outputPath, options, options.jobs, segmentFrames);
+    if (parallelSeconds < 0) return 1;
+
+    if (compare && !options.dryRun) {
+        printf("\nSingle-threaded reference:\n");
+        double serialSeconds = Transcode(reader, outputPath + ".serial.mp4", options, 1, frames);
+        remove((outputPath + ".serial.mp4").c_str());
+        if (serialSeconds > 0) {
+            printf("\nSpeedup with %u jobs: %.2fx\n", options.jobs, serialSeconds / parallelSeconds);
+        }
+    }
+    return 0;
+}
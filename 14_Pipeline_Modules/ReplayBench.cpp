@@ -0,0 +1,138 @@
+// ReplayBench.cpp
+// Replays a clip through the memory-mapped replay source and reports throughput
+// plus a checksum over pixels and timestamps. Two runs of the same clip must
+// print the same checksum.
+//
+// Usage: ReplayBench [clip.y4m | clip.nv12 WIDTHxHEIGHT FPS] [audio.wav] [--paced]
+#include "ReplaySource.h"
+#include "SyntheticMedia.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+// Constants
+const uint32_t FRAME_WIDTH = 640;
+const uint32_t FRAME_HEIGHT = 360;
+const uint32_t FRAME_RATE_NUMERATOR = 24;
+const uint32_t SYNTHETIC_FRAMES = 240;
+const uint32_t AUDIO_BLOCK_FRAMES = 1024;
+
+// FNV-1a over a byte range
+uint64_t Fnv1a(uint64_t hash, const void* data, size_t length) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+bool EndsWith(const std::string& value, const char* suffix) {
+    size_t length = strlen(suffix);
+    return value.size() >= length && value.compare(value.size() - length, length, suffix) == 0;
+}
+
+// Replay every frame and audio block once, returning the combined checksum
+uint64_t ReplayOnce(VideoReplaySource& video, AudioReplaySource* audio, ReplayPacing pacing) {
+    ReplayClock clock(pacing);
+    video.Rewind();
+    video.SetClock(&clock);
+    if (audio) {
+        audio->Rewind();
+        audio->SetClock(&clock);
+    }
+
+    uint64_t hash = 14695981039346656037ULL;
+    uint64_t bytes = 0;
+    int64_t maxLateness = 0;
+    int64_t start = NowTicks();
+    VideoFrame frame;
+    AudioBlock block;
+    int64_t nextAudioPts = 0;
+    while (video.ReadFrame(frame)) {
+        int64_t lateness = NowTicks() - start - frame.pts;
+        if (lateness > maxLateness) maxLateness = lateness;
+
+        const uint32_t chromaHeight = (frame.height + 1) / 2;
+        const int planeCount = frame.format == PixelFormat::NV12 ? 2 : 3;
+        for (int p = 0; p < planeCount; ++p) {
+            uint32_t rows = p == 0 ? frame.height : chromaHeight;
+            size_t planeBytes = static_cast<size_t>(frame.strides[p]) * rows;
+            hash = Fnv1a(hash, frame.planes[p], planeBytes);
+            bytes += planeBytes;
+        }
+        hash = Fnv1a(hash, &frame.pts, sizeof(frame.pts));
+
+        // Interleave audio up to the video position, as a capture loop would
+        while (audio && nextAudioPts <= frame.pts && audio->ReadBlock(block, AUDIO_BLOCK_FRAMES)) {
+            size_t blockBytes = static_cast<size_t>(block.frames) * block.channels * (block.bitsPerSample / 8);
+            hash = Fnv1a(hash, block.data, blockBytes);
+            hash = Fnv1a(hash, &block.pts, sizeof(block.pts));
+            nextAudioPts = block.pts + static_cast<int64_t>(block.frames) * TICKS_PER_SECOND / block.sampleRate;
+        }
+    }
+    double seconds = (NowTicks() - start) / static_cast<double>(TICKS_PER_SECOND);
+
+    printf("  %s: %zu frames in %.3f s (%.1f fps, %.1f MB/s), checksum %016llx",
+           pacing == ReplayPacing::Recorded ? "recorded cadence" : "unthrottled",
+           video.FrameCount(), seconds, video.FrameCount() / seconds, bytes / seconds / 1e6,
+           static_cast<unsigned long long>(hash));
+    if (pacing == ReplayPacing::Recorded) printf(", max lateness %.2f ms", maxLateness / 1e4);
+    printf("\n");
+    return hash;
+}
+
+int main(int argc, char* argv[]) {
+    std::string videoPath, audioPath, geometry;
+    uint32_t fps = FRAME_RATE_NUMERATOR;
+    bool paced = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--paced") paced = true;
+        else if (EndsWith(arg, ".wav")) audioPath = arg;
+        else if (videoPath.empty()) videoPath = arg;
+        else if (geometry.empty()) geometry = arg;
+        else fps = static_cast<uint32_t>(atoi(arg.c_str()));
+    }
+
+    if (videoPath.empty()) {
+        videoPath = "/tmp/replay_synthetic.y4m";
+        audioPath = "/tmp/replay_synthetic.wav";
+        printf("No clip given, generating %s and %s.\n", videoPath.c_str(), audioPath.c_str());
+        if (!WriteSyntheticY4M(videoPath, FRAME_WIDTH, FRAME_HEIGHT, FRAME_RATE_NUMERATOR, 1, SYNTHETIC_FRAMES)) return 1;
+        if (!WriteSineWav(audioPath, 48000, 2, SYNTHETIC_FRAMES / double(FRAME_RATE_NUMERATOR), 1000.0)) return 1;
+    }
+
+    VideoReplaySource video;
+    bool opened = false;
+    if (EndsWith(videoPath, ".y4m")) {
+        opened = video.OpenY4M(videoPath);
+    } else {
+        unsigned width = 0, height = 0;
+        if (sscanf(geometry.c_str(), "%ux%u", &width, &height) != 2) {
+            printf("Raw NV12 input needs WIDTHxHEIGHT.\n");
+            return 1;
+        }
+        opened = video.OpenNV12(videoPath, width, height, fps);
+    }
+    if (!opened) return 1;
+
+    AudioReplaySource audioSource;
+    AudioReplaySource* audio = nullptr;
+    if (!audioPath.empty()) {
+        if (!audioSource.OpenWav(audioPath)) return 1;
+        audio = &audioSource;
+    }
+
+    uint64_t first = ReplayOnce(video, audio, ReplayPacing::Unthrottled);
+    uint64_t second = ReplayOnce(video, audio, ReplayPacing::Unthrottled);
+    printf("Reproducible: %s\n", first == second ? "yes" : "NO");
+
+    if (paced) {
+        uint64_t pacedHash = ReplayOnce(video, audio, ReplayPacing::Recorded);
+        printf("Paced replay matches: %s\n", pacedHash == first ? "yes" : "NO");
+    }
+    return first == second ? 0 : 1;
+}
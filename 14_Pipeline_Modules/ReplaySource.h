@@ -0,0 +1,352 @@
+// ReplaySource.h
+// Deterministic replay of recorded media in place of MFEnumDeviceSources(...)[0].
+// Files are memory-mapped and frames are served by pointer, so no read copies
+// are made. Timestamps come from the file, which makes capture loops,
+// timestamping and muxing reproducible bit for bit.
+//
+// Supported inputs:
+//   *.y4m  - YUV4MPEG2 with C420* (served as I420). Frames may carry the
+//            extension parameter "XPTS=<ticks>"; otherwise PTS = index * F.
+//   *.nv12 - Raw NV12 frames of a given size. An optional "<file>.pts" sidecar
+//            holds one PTS (100-ns ticks) per line.
+//   *.wav  - PCM (16/24/32-bit) or IEEE float, served in blocks.
+#pragma once
+
+#include "MediaTypes.h"
+#include "MappedFile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+
+enum class ReplayPacing {
+    Recorded,   // Deliver at the cadence given by the file timestamps
+    Unthrottled // Deliver as fast as the consumer asks
+};
+
+// Wall-clock anchor shared by the audio and video sources of one replay, so
+// both streams are paced against the same start time.
+class ReplayClock {
+public:
+    explicit ReplayClock(ReplayPacing pacing = ReplayPacing::Recorded) : pacing(pacing) {}
+
+    // Block until media time pts is due; the first call anchors the clock
+    void WaitUntil(int64_t pts) {
+        if (pacing == ReplayPacing::Unthrottled) return;
+        int64_t target;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!started) {
+                started = true;
+                startWall = NowTicks();
+                startPts = pts;
+            }
+            target = startWall + (pts - startPts);
+        }
+        int64_t wait = target - NowTicks();
+        if (wait > 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(wait / 10));
+        }
+    }
+
+    ReplayPacing Pacing() const { return pacing; }
+
+private:
+    ReplayPacing pacing;
+    std::mutex mutex;
+    bool started = false;
+    int64_t startWall = 0;
+    int64_t startPts = 0;
+};
+
+class VideoReplaySource {
+public:
+    // Open a YUV4MPEG2 file
+    bool OpenY4M(const std::string& path) {
+        if (!file.Open(path)) return false;
+        const char* base = reinterpret_cast<const char*>(file.Data());
+        const size_t size = file.Size();
+
+        const char* headerEnd = static_cast<const char*>(memchr(base, '\n', size));
+        if (size < 10 || memcmp(base, "YUV4MPEG2 ", 10) != 0 || !headerEnd) {
+            printf("%s is not a YUV4MPEG2 file.\n", path.c_str());
+            return false;
+        }
+
+        uint32_t fpsNum = 25, fpsDen = 1;
+        width = height = 0;
+        std::string header(base + 10, headerEnd);
+        size_t pos = 0;
+        while (pos < header.size()) {
+            size_t end = header.find(' ', pos);
+            if (end == std::string::npos) end = header.size();
+            std::string token = header.substr(pos, end - pos);
+            pos = end + 1;
+            if (token.empty()) continue;
+            switch (token[0]) {
+                case 'W': width = static_cast<uint32_t>(atoi(token.c_str() + 1)); break;
+                case 'H': height = static_cast<uint32_t>(atoi(token.c_str() + 1)); break;
+                case 'F': sscanf(token.c_str() + 1, "%u:%u", &fpsNum, &fpsDen); break;
+                case 'C':
+                    // 8-bit 4:2:0 only; the chroma siting variants share the layout, C420p10 and the like do not
+                    if (token != "C420" && token != "C420jpeg" && token != "C420paldv" && token != "C420mpeg2") {
+                        printf("Unsupported Y4M colourspace %s (only 8-bit 4:2:0 is supported).\n", token.c_str());
+                        return false;
+                    }
+                    break;
+                default: break;
+            }
+        }
+        if (width == 0 || height == 0 || fpsNum == 0 || fpsDen == 0) {
+            printf("Invalid Y4M header in %s.\n", path.c_str());
+            return false;
+        }
+        format = PixelFormat::I420;
+        frameDuration = TICKS_PER_SECOND * fpsDen / fpsNum;
+
+        // Index the frames once so looping and random access stay O(1)
+        const size_t frameSize = Frame420Size(width, height);
+        size_t offset = static_cast<size_t>(headerEnd - base) + 1;
+        entries.clear();
+        while (offset + 6 <= size && memcmp(base + offset, "FRAME", 5) == 0) {
+            const char* paramsEnd = static_cast<const char*>(memchr(base + offset, '\n', size - offset));
+            if (!paramsEnd) break;
+            int64_t pts = static_cast<int64_t>(entries.size()) * frameDuration;
+            const char* xpts = FindParam(base + offset + 5, paramsEnd, "XPTS=");
+            if (xpts) pts = strtoll(xpts, nullptr, 10);
+
+            size_t dataOffset = static_cast<size_t>(paramsEnd - base) + 1;
+            if (dataOffset + frameSize > size) {
+                printf("Ignoring truncated frame %zu in %s.\n", entries.size(), path.c_str());
+                break;
+            }
+            entries.push_back({ dataOffset, pts });
+            offset = dataOffset + frameSize;
+        }
+        return FinishOpen(path);
+    }
+
+    // Open a headerless NV12 file with a known geometry
+    bool OpenNV12(const std::string& path, uint32_t frameWidth, uint32_t frameHeight,
+                  uint32_t fpsNum, uint32_t fpsDen = 1) {
+        if (frameWidth == 0 || frameHeight == 0 || fpsNum == 0 || fpsDen == 0) {
+            printf("Invalid NV12 geometry for %s: %ux%u at %u/%u fps.\n", path.c_str(), frameWidth, frameHeight, fpsNum, fpsDen);
+            return false;
+        }
+        if (!file.Open(path)) return false;
+        width = frameWidth;
+        height = frameHeight;
+        format = PixelFormat::NV12;
+        frameDuration = TICKS_PER_SECOND * fpsDen / fpsNum;
+
+        const size_t frameSize = Frame420Size(width, height);
+        const size_t frameCount = file.Size() / frameSize;
+        if (file.Size() % frameSize != 0) {
+            printf("Ignoring %zu trailing bytes in %s.\n", file.Size() % frameSize, path.c_str());
+        }
+
+        std::vector<int64_t> sidecar;
+        if (FILE* pts = fopen((path + ".pts").c_str(), "r")) {
+            long long value;
+            while (fscanf(pts, "%lld", &value) == 1) sidecar.push_back(value);
+            fclose(pts);
+            if (sidecar.size() < frameCount) {
+                printf("Timestamp sidecar has %zu entries for %zu frames; using frame cadence for the rest.\n",
+                       sidecar.size(), frameCount);
+            }
+        }
+
+        entries.clear();
+        entries.reserve(frameCount);
+        for (size_t i = 0; i < frameCount; ++i) {
+            int64_t pts = i < sidecar.size() ? sidecar[i] : static_cast<int64_t>(i) * frameDuration;
+            entries.push_back({ i * frameSize, pts });
+        }
+        return FinishOpen(path);
+    }
+
+    void SetClock(ReplayClock* replayClock) { clock = replayClock; }
+    void SetLoop(bool enable) { loop = enable; }
+
+    // Point frame at the next frame; returns false at end of file (unless looping)
+    bool ReadFrame(VideoFrame& frame) {
+        if (entries.empty()) return false;
+        if (next >= entries.size()) {
+            if (!loop) return false;
+            loopOffset += entries.back().pts + frameDuration - entries.front().pts;
+            next = 0;
+        }
+
+        const FrameEntry& entry = entries[next];
+        Describe420Frame(frame, file.Data() + entry.offset, width, height, format);
+        frame.pts = entry.pts + loopOffset;
+        frame.duration = next + 1 < entries.size() ? entries[next + 1].pts - entry.pts : frameDuration;
+        frame.index = served++;
+        ++next;
+
+        if (clock) clock->WaitUntil(frame.pts);
+        return true;
+    }
+
+    void Rewind() {
+        next = 0;
+        loopOffset = 0;
+        served = 0;
+    }
+
+    size_t FrameCount() const { return entries.size(); }
+    uint32_t Width() const { return width; }
+    uint32_t Height() const { return height; }
+    PixelFormat Format() const { return format; }
+    int64_t FrameDuration() const { return frameDuration; }
+
+private:
+    struct FrameEntry {
+        size_t offset;
+        int64_t pts;
+    };
+
+    static const char* FindParam(const char* begin, const char* end, const char* name) {
+        const size_t length = strlen(name);
+        for (const char* p = begin; p + length <= end; ++p) {
+            if ((p == begin || p[-1] == ' ') && memcmp(p, name, length) == 0) return p + length;
+        }
+        return nullptr;
+    }
+
+    bool FinishOpen(const std::string& path) {
+        if (entries.empty()) {
+            printf("No frames found in %s.\n", path.c_str());
+            return false;
+        }
+        Rewind();
+        printf("Replaying %s: %ux%u, %zu frames.\n", path.c_str(), width, height, entries.size());
+        return true;
+    }
+
+    MappedFile file;
+    std::vector<FrameEntry> entries;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    PixelFormat format = PixelFormat::NV12;
+    int64_t frameDuration = 0;
+    ReplayClock* clock = nullptr;
+    bool loop = false;
+    size_t next = 0;
+    int64_t loopOffset = 0;
+    uint64_t served = 0;
+};
+
+class AudioReplaySource {
+public:
+    // Open a RIFF/WAVE file
+    bool OpenWav(const std::string& path) {
+        if (!file.Open(path)) return false;
+        const uint8_t* base = file.Data();
+        const size_t size = file.Size();
+        if (size < 12 || memcmp(base, "RIFF", 4) != 0 || memcmp(base + 8, "WAVE", 4) != 0) {
+            printf("%s is not a WAVE file.\n", path.c_str());
+            return false;
+        }
+
+        bool haveFormat = false;
+        size_t offset = 12;
+        dataOffset = dataSize = 0;
+        while (offset + 8 <= size) {
+            const uint8_t* chunk = base + offset;
+            uint32_t chunkSize = ReadLE32(chunk + 4);
+            if (memcmp(chunk, "fmt ", 4) == 0 && chunkSize >= 16 && offset + 8 + 16 <= size) {
+                uint16_t formatTag = ReadLE16(chunk + 8);
+                channels = ReadLE16(chunk + 10);
+                sampleRate = ReadLE32(chunk + 12);
+                bitsPerSample = ReadLE16(chunk + 22);
+                isFloat = formatTag == 3;
+                if (formatTag == 0xFFFE && chunkSize >= 40 && offset + 8 + 40 <= size) {
+                    isFloat = ReadLE16(chunk + 8 + 24) == 3; // SubFormat GUID starts with the format tag
+                }
+                haveFormat = true;
+            } else if (memcmp(chunk, "data", 4) == 0) {
+                dataOffset = offset + 8;
+                // Recorders that were killed leave 0 or 0xFFFFFFFF here; trust the file size instead
+                dataSize = chunkSize == 0 || dataOffset + chunkSize > size ? size - dataOffset : chunkSize;
+                break;
+            }
+            offset += 8 + chunkSize + (chunkSize & 1);
+        }
+
+        if (!haveFormat || dataOffset == 0 || channels == 0 || sampleRate == 0 || bitsPerSample == 0 ||
+            bitsPerSample > 32 || bitsPerSample % 8 != 0) {
+            printf("Unsupported or malformed WAVE file %s.\n", path.c_str());
+            return false;
+        }
+        blockAlign = channels * (bitsPerSample / 8);
+        totalFrames = dataSize / blockAlign;
+        Rewind();
+        printf("Replaying %s: %u Hz, %u channels, %u-bit%s, %llu frames.\n", path.c_str(), sampleRate, channels,
+               bitsPerSample, isFloat ? " float" : "", static_cast<unsigned long long>(totalFrames));
+        return totalFrames > 0;
+    }
+
+    void SetClock(ReplayClock* replayClock) { clock = replayClock; }
+    void SetLoop(bool enable) { loop = enable; }
+
+    // Point block at up to maxFrames sample frames; returns false at end of file
+    bool ReadBlock(AudioBlock& block, uint32_t maxFrames) {
+        if (totalFrames == 0) return false;
+        if (position >= totalFrames) {
+            if (!loop) return false;
+            loopFrames += totalFrames;
+            position = 0;
+        }
+
+        uint64_t count = totalFrames - position;
+        if (count > maxFrames) count = maxFrames;
+        block.data = file.Data() + dataOffset + position * blockAlign;
+        block.frames = static_cast<uint32_t>(count);
+        block.channels = channels;
+        block.sampleRate = sampleRate;
+        block.bitsPerSample = bitsPerSample;
+        // Exact sample-count timestamps, so long replays never drift
+        block.pts = static_cast<int64_t>((loopFrames + position) * TICKS_PER_SECOND / sampleRate);
+        position += count;
+
+        if (clock) clock->WaitUntil(block.pts);
+        return true;
+    }
+
+    void Rewind() {
+        position = 0;
+        loopFrames = 0;
+    }
+
+    uint32_t SampleRate() const { return sampleRate; }
+    uint32_t Channels() const { return channels; }
+    uint32_t BitsPerSample() const { return bitsPerSample; }
+    bool IsFloat() const { return isFloat; }
+    uint64_t TotalFrames() const { return totalFrames; }
+
+private:
+    static uint16_t ReadLE16(const uint8_t* p) { return static_cast<uint16_t>(p[0] | (p[1] << 8)); }
+    static uint32_t ReadLE32(const uint8_t* p) {
+        return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+               (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    MappedFile file;
+    size_t dataOffset = 0;
+    size_t dataSize = 0;
+    uint32_t channels = 0;
+    uint32_t sampleRate = 0;
+    uint32_t bitsPerSample = 0;
+    uint32_t blockAlign = 0;
+    bool isFloat = false;
+    uint64_t totalFrames = 0;
+    uint64_t position = 0;
+    uint64_t loopFrames = 0;
+    ReplayClock* clock = nullptr;
+    bool loop = false;
+};
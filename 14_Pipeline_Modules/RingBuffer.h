@@ -0,0 +1,106 @@
+// RingBuffer.h
+// Single-producer/single-consumer byte ring. The producer never blocks: when
+// the consumer falls behind, Write refuses data and counts the overflow, so a
+// capture thread can hand off samples without waiting on an output thread.
+// WriteTimeline keeps untimestamped PCM honest: what it refuses is paid back
+// as zeros once the consumer makes room, so byte counts stay a clock.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+#include <vector>
+
+class SpscRingBuffer {
+public:
+    // Capacity is rounded up to a power of two
+    explicit SpscRingBuffer(size_t minCapacity = 1 << 20) {
+        size_t capacity = 1;
+        while (capacity < minCapacity) capacity <<= 1;
+        buffer.resize(capacity);
+        mask = capacity - 1;
+    }
+
+    SpscRingBuffer(const SpscRingBuffer&) = delete;
+    SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+    // Producer: all-or-nothing write; returns false (and counts it) if there is no room
+    bool Write(const void* data, size_t length) {
+        if (length > Writable()) {
+            overflowBytes.fetch_add(length, std::memory_order_relaxed);
+            return false;
+        }
+        Put(data, length);
+        return true;
+    }
+
+    // Producer: like Write, but refused bytes are owed and go out as zeros ahead of
+    // anything newer, so the consumer's byte count never runs ahead of the producer's
+    bool WriteTimeline(const void* data, size_t length) {
+        if (silenceOwed) {
+            const size_t room = Writable();
+            const size_t fill = silenceOwed < room ? silenceOwed : room;
+            Put(nullptr, fill);
+            silenceOwed -= fill;
+        }
+        if (silenceOwed || !Write(data, length)) {
+            if (silenceOwed) overflowBytes.fetch_add(length, std::memory_order_relaxed);
+            silenceOwed += length;
+            return false;
+        }
+        return true;
+    }
+
+    // Consumer: copy out up to maxLength bytes; returns the number copied
+    size_t Read(void* data, size_t maxLength) {
+        const size_t tail = readPos.load(std::memory_order_relaxed);
+        const size_t head = writePos.load(std::memory_order_acquire);
+        size_t length = head - tail;
+        if (length > maxLength) length = maxLength;
+        const size_t offset = tail & mask;
+        const size_t first = length < buffer.size() - offset ? length : buffer.size() - offset;
+        memcpy(data, buffer.data() + offset, first);
+        memcpy(static_cast<uint8_t*>(data) + first, buffer.data(), length - first);
+        readPos.store(tail + length, std::memory_order_release);
+        return length;
+    }
+
+    size_t Readable() const {
+        return writePos.load(std::memory_order_acquire) - readPos.load(std::memory_order_acquire);
+    }
+
+    size_t Capacity() const { return buffer.size(); }
+    size_t HighWater() const { return highWater.load(std::memory_order_relaxed); }
+    uint64_t OverflowBytes() const { return overflowBytes.load(std::memory_order_relaxed); }
+
+private:
+    size_t Writable() const {
+        return buffer.size() - (writePos.load(std::memory_order_relaxed) - readPos.load(std::memory_order_acquire));
+    }
+
+    // Producer: append length bytes (zeros when data is null); the caller checked the room
+    void Put(const void* data, size_t length) {
+        const size_t head = writePos.load(std::memory_order_relaxed);
+        const size_t offset = head & mask;
+        const size_t first = length < buffer.size() - offset ? length : buffer.size() - offset;
+        if (data) {
+            memcpy(buffer.data() + offset, data, first);
+            memcpy(buffer.data(), static_cast<const uint8_t*>(data) + first, length - first);
+        } else {
+            memset(buffer.data() + offset, 0, first);
+            memset(buffer.data(), 0, length - first);
+        }
+        writePos.store(head + length, std::memory_order_release);
+        const size_t used = head + length - readPos.load(std::memory_order_relaxed);
+        if (used > highWater.load(std::memory_order_relaxed)) highWater.store(used, std::memory_order_relaxed);
+    }
+
+    std::vector<uint8_t> buffer;
+    size_t mask = 0;
+    alignas(64) std::atomic<size_t> writePos{ 0 };
+    alignas(64) std::atomic<size_t> readPos{ 0 };
+    std::atomic<size_t> highWater{ 0 };
+    std::atomic<uint64_t> overflowBytes{ 0 };
+    uint64_t silenceOwed = 0; // Producer only
+};
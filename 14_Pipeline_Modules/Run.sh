@@ -0,0 +1,33 @@
+#!/bin/sh
+# Build and run one of the Linux tools in this directory, e.g. ./Run.sh ReplayBench --paced
+TOOL=$1
+shift
+LIBS=""
+case $TOOL in
+    AudioEncoderBench|KeyframeControlBench|IntraRefreshBench)
+        # AAC throughput and the libx264 encodes need libavcodec; without it the benches run the rest
+        if pkg-config --exists libavcodec libavutil 2>/dev/null; then
+            LIBS="-DHAVE_LIBAVCODEC $(pkg-config --cflags --libs libavcodec libavutil)"
+        fi
+        ;;
+    TemporalLayerBench)
+        # OpenH264 encodes and decodes real layered streams; without it the bench runs on tagged stand-in frames
+        if pkg-config --exists openh264 2>/dev/null; then
+            LIBS="-DHAVE_OPENH264 $(pkg-config --cflags --libs openh264)"
+        fi
+        ;;
+    SrtOutputBench)
+        # The runs over a lossy link need libsrt; without it the bench checks URL handling only
+        if pkg-config --exists srt 2>/dev/null; then
+            LIBS="-DHAVE_SRT $(pkg-config --cflags --libs srt)"
+        fi
+        ;;
+    FrameChangeBench|ThumbnailBench|GlassToGlassBench)
+        # libjpeg: stand-in encoder for FrameChangeBench, sprite sheets and the post-hoc decode for ThumbnailBench,
+        # the in-process pipelines for GlassToGlassBench
+        if [ -f /usr/include/jpeglib.h ]; then
+            LIBS="-DHAVE_LIBJPEG -ljpeg"
+        fi
+        ;;
+esac
+g++ -std=c++17 -O2 -march=native -pthread -o $TOOL $TOOL.cpp $LIBS && ./$TOOL "$@"
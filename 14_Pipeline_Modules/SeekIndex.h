@@ -0,0 +1,481 @@
+// SeekIndex.h
+// Keyframe seek index written next to a recording, so review tools can jump
+// into an hours-long MP4 without parsing its sample table. One file per
+// recording, <media>.seek:
+//
+//   SeekIndexHeader   64 bytes: counts, duration, size of the indexed media file
+//   SeekKeyframe[]    32 bytes each, sorted by PTS: where the keyframe sample is
+//                     in the media file, and the size of the GOP it starts
+//   SeekAnchor[]      16 bytes each, sorted by PTS: wall-clock time of a PTS
+//
+// Every field has a fixed width (little-endian, as on x86 and ARM), so
+// SeekIndexReader maps the file and binary-searches the arrays where they lie.
+// A lookup parses and allocates nothing.
+//
+// The Media Foundation sink writer does not report where it puts samples, so
+// the keyframe table comes from the finished file. After Finalize,
+// ReadMp4VideoTrack reads the video track's sample table once (stts, ctts,
+// stss, stsz, stsc, stco/co64). It touches the box headers and the moov box
+// only, never the media data. The wall-clock anchors are collected while
+// recording by SeekIndexRecorder, one per anchor interval.
+//
+// PTS values are 100-ns ticks on the track's presentation timeline. An initial
+// empty edit and the media start time of the first edit are applied, which
+// covers what recorders write; other edit lists are ignored.
+#pragma once
+
+#include "MappedFile.h"
+#include "MediaTypes.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+// Constants
+const char SEEK_INDEX_MAGIC[8] = { 'S', 'E', 'E', 'K', 'I', 'D', 'X', '1' };
+const uint32_t SEEK_INDEX_VERSION = 1;
+
+#pragma pack(push, 1)
+struct SeekIndexHeader {
+    char magic[8];          // SEEK_INDEX_MAGIC
+    uint32_t version;       // SEEK_INDEX_VERSION
+    uint32_t headerSize;    // sizeof(SeekIndexHeader); the keyframes start here
+    uint32_t keyframeSize;  // sizeof(SeekKeyframe)
+    uint32_t anchorSize;    // sizeof(SeekAnchor)
+    uint64_t keyframeCount;
+    uint64_t anchorCount;   // The anchors follow the keyframes
+    uint64_t sampleCount;   // Video samples in the track
+    int64_t duration;       // End of the last video sample
+    uint64_t mediaSize;     // Size of the media file when indexed; a mismatch means the index is stale
+};
+
+struct SeekKeyframe {
+    int64_t pts;
+    uint64_t offset;        // Byte offset of the keyframe sample in the media file
+    uint32_t size;          // Bytes in the keyframe sample
+    uint32_t sample;        // Sample number in decode order, from 0
+    uint32_t gopFrames;     // Samples from this keyframe up to the next one
+    uint32_t gopBytes;      // Their total size, saturated at 4 GB
+};
+
+struct SeekAnchor {
+    int64_t pts;
+    int64_t wallClock;      // UnixTimeTicks when the frame with this PTS was captured
+};
+#pragma pack(pop)
+
+static_assert(sizeof(SeekIndexHeader) == 64, "SeekIndexHeader is part of the file format");
+static_assert(sizeof(SeekKeyframe) == 32, "SeekKeyframe is part of the file format");
+static_assert(sizeof(SeekAnchor) == 16, "SeekAnchor is part of the file format");
+
+inline uint32_t ReadBe32(const uint8_t* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+inline uint64_t ReadBe64(const uint8_t* p) {
+    return (static_cast<uint64_t>(ReadBe32(p)) << 32) | ReadBe32(p + 4);
+}
+
+constexpr uint32_t Mp4Type(const char (&type)[5]) {
+    return (static_cast<uint32_t>(static_cast<uint8_t>(type[0])) << 24) | (static_cast<uint32_t>(static_cast<uint8_t>(type[1])) << 16) |
+           (static_cast<uint32_t>(static_cast<uint8_t>(type[2])) << 8) | static_cast<uint8_t>(type[3]);
+}
+
+// Payload of a box, after its size/type header
+struct Mp4Box {
+    const uint8_t* body = nullptr;
+    uint64_t size = 0;
+};
+
+// First box of the given type in [begin, end); next is set to the box after it, so a caller can keep scanning
+inline bool FindMp4Box(const uint8_t* begin, const uint8_t* end, uint32_t type, Mp4Box& box, const uint8_t** next = nullptr) {
+    const uint8_t* p = begin;
+    while (end - p >= 8) {
+        uint64_t size = ReadBe32(p);
+        uint64_t header = 8;
+        if (size == 1) {
+            if (end - p < 16) return false;
+            size = ReadBe64(p + 8);
+            header = 16;
+        } else if (size == 0) {
+            size = static_cast<uint64_t>(end - p); // Runs to the end of its parent
+        }
+        if (size < header || size > static_cast<uint64_t>(end - p)) return false;
+        if (ReadBe32(p + 4) == type) {
+            box.body = p + header;
+            box.size = size - header;
+            if (next) *next = p + size;
+            return true;
+        }
+        p += size;
+    }
+    return false;
+}
+
+// Nested lookup, e.g. FindMp4Path(moov, { "mdia", "minf", "stbl" })
+inline bool FindMp4Path(Mp4Box box, std::initializer_list<uint32_t> path, Mp4Box& out) {
+    for (uint32_t type : path) {
+        if (!FindMp4Box(box.body, box.body + box.size, type, box)) return false;
+    }
+    out = box;
+    return true;
+}
+
+// Entry table of a full box (version/flags, entry count, entries); fixed is the bytes between the flags and the count
+inline bool Mp4Table(const Mp4Box& box, size_t entrySize, const uint8_t*& entries, uint32_t& count, size_t fixed = 0) {
+    if (box.size < 8 + fixed) return false;
+    count = ReadBe32(box.body + 4 + fixed);
+    entries = box.body + 8 + fixed;
+    return static_cast<uint64_t>(count) * entrySize <= box.size - 8 - fixed;
+}
+
+// Track timescale units to 100-ns ticks, without overflowing on long recordings
+inline int64_t Mp4ToTicks(int64_t value, uint32_t timescale) {
+    return value / timescale * TICKS_PER_SECOND + value % timescale * TICKS_PER_SECOND / timescale;
+}
+
+// The video track's sample table, one entry per sample in decode order
+struct Mp4VideoTrack {
+    uint32_t timescale = 0;
+    std::vector<int64_t> pts;            // Presentation time, track timescale, edit applied
+    std::vector<uint64_t> offsets;       // Byte offset in the file
+    std::vector<uint32_t> sizes;
+    std::vector<uint32_t> syncSamples;   // Keyframe sample numbers from 0; every sample when the track has no stss
+    int64_t duration = 0;                // End of the last sample, track timescale
+    uint64_t fileSize = 0;
+};
+
+// Presentation times from stts and ctts, shifted by the first edit
+inline bool ReadMp4Times(const Mp4Box& trak, const Mp4Box& stbl, uint32_t movieTimescale, Mp4VideoTrack& track) {
+    const uint8_t* entries = nullptr;
+    uint32_t count = 0;
+    Mp4Box box;
+    const size_t samples = track.sizes.size();
+    track.pts.resize(samples);
+    if (!FindMp4Box(stbl.body, stbl.body + stbl.size, Mp4Type("stts"), box) || !Mp4Table(box, 8, entries, count)) return false;
+    int64_t dts = 0;
+    size_t sample = 0;
+    std::vector<uint32_t> deltas(samples);
+    for (uint32_t i = 0; i < count; ++i) {
+        const uint32_t run = ReadBe32(entries + i * 8);
+        const uint32_t delta = ReadBe32(entries + i * 8 + 4);
+        if (run > samples - sample) return false;
+        for (uint32_t k = 0; k < run; ++k, ++sample) {
+            track.pts[sample] = dts;
+            deltas[sample] = delta;
+            dts += delta;
+        }
+    }
+    if (sample != samples) return false;
+
+    if (FindMp4Box(stbl.body, stbl.body + stbl.size, Mp4Type("ctts"), box)) {
+        if (!Mp4Table(box, 8, entries, count)) return false;
+        sample = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+            const uint32_t run = ReadBe32(entries + i * 8);
+            const int32_t offset = static_cast<int32_t>(ReadBe32(entries + i * 8 + 4)); // Signed in version 1, small in version 0
+            if (run > samples - sample) return false;
+            for (uint32_t k = 0; k < run; ++k) track.pts[sample++] += offset;
+        }
+    }
+
+    int64_t shift = 0;
+    if (FindMp4Path(trak, { Mp4Type("edts"), Mp4Type("elst") }, box) && box.size >= 8) {
+        const bool wide = box.body[0] == 1;
+        const size_t entrySize = wide ? 20 : 12;
+        if (!Mp4Table(box, entrySize, entries, count)) return false;
+        for (uint32_t i = 0; i < count; ++i) {
+            const uint8_t* entry = entries + i * entrySize;
+            const uint64_t segment = wide ? ReadBe64(entry) : ReadBe32(entry);
+            const int64_t mediaTime = wide ? static_cast<int64_t>(ReadBe64(entry + 8)) : static_cast<int32_t>(ReadBe32(entry + 4));
+            if (mediaTime != -1) {
+                shift -= mediaTime;
+                break;
+            }
+            if (movieTimescale) shift += static_cast<int64_t>(segment * track.timescale / movieTimescale); // Empty edit: a delay
+        }
+    }
+    for (size_t i = 0; i < samples; ++i) {
+        track.pts[i] += shift;
+        track.duration = std::max<int64_t>(track.duration, track.pts[i] + deltas[i]);
+    }
+    return true;
+}
+
+// Sample sizes (stsz) and their offsets from the chunk table (stsc, stco or co64)
+inline bool ReadMp4Offsets(const Mp4Box& stbl, Mp4VideoTrack& track) {
+    const uint8_t* entries = nullptr;
+    uint32_t count = 0;
+    Mp4Box box;
+    if (!FindMp4Box(stbl.body, stbl.body + stbl.size, Mp4Type("stsz"), box) || box.size < 12) return false;
+    const uint32_t fixedSize = ReadBe32(box.body + 4);
+    if (!Mp4Table(box, fixedSize ? 0 : 4, entries, count, 4)) return false;
+    track.sizes.resize(count);
+    for (uint32_t i = 0; i < count; ++i) track.sizes[i] = fixedSize ? fixedSize : ReadBe32(entries + i * 4);
+
+    const uint8_t* chunks = nullptr;
+    uint32_t chunkCount = 0;
+    const bool wide = FindMp4Box(stbl.body, stbl.body + stbl.size, Mp4Type("co64"), box);
+    if (!wide && !FindMp4Box(stbl.body, stbl.body + stbl.size, Mp4Type("stco"), box)) return false;
+    if (!Mp4Table(box, wide ? 8 : 4, chunks, chunkCount)) return false;
+    if (!FindMp4Box(stbl.body, stbl.body + stbl.size, Mp4Type("stsc"), box) || !Mp4Table(box, 12, entries, count)) return false;
+
+    track.offsets.resize(track.sizes.size());
+    size_t sample = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        const uint32_t firstChunk = ReadBe32(entries + i * 12);
+        const uint32_t lastChunk = i + 1 < count ? ReadBe32(entries + (i + 1) * 12) - 1 : chunkCount;
+        const uint32_t perChunk = ReadBe32(entries + i * 12 + 4);
+        if (firstChunk == 0 || lastChunk > chunkCount) return false;
+        for (uint32_t chunk = firstChunk; chunk <= lastChunk; ++chunk) {
+            uint64_t offset = wide ? ReadBe64(chunks + (chunk - 1) * 8) : ReadBe32(chunks + (chunk - 1) * 4);
+            for (uint32_t k = 0; k < perChunk && sample < track.sizes.size(); ++k, ++sample) {
+                track.offsets[sample] = offset;
+                offset += track.sizes[sample];
+            }
+        }
+    }
+    return sample == track.sizes.size();
+}
+
+// Parse the sample table of the first video track in an MP4 file
+inline bool ReadMp4VideoTrack(const std::string& path, Mp4VideoTrack& track) {
+    track = Mp4VideoTrack();
+    MappedFile file;
+    if (!file.Open(path, false)) return false;
+    track.fileSize = file.Size();
+    Mp4Box moov, box;
+    if (!FindMp4Box(file.Data(), file.Data() + file.Size(), Mp4Type("moov"), moov)) {
+        printf("%s has no moov box (not finalized?).\n", path.c_str());
+        return false;
+    }
+    uint32_t movieTimescale = 0;
+    if (FindMp4Box(moov.body, moov.body + moov.size, Mp4Type("mvhd"), box) && box.size >= 24) {
+        movieTimescale = ReadBe32(box.body + (box.body[0] == 1 ? 20 : 12));
+    }
+    const uint8_t* next = moov.body;
+    Mp4Box trak;
+    while (FindMp4Box(next, moov.body + moov.size, Mp4Type("trak"), trak, &next)) {
+        Mp4Box hdlr, mdhd, stbl;
+        if (!FindMp4Path(trak, { Mp4Type("mdia"), Mp4Type("hdlr") }, hdlr) || hdlr.size < 12 ||
+            ReadBe32(hdlr.body + 8) != Mp4Type("vide")) {
+            continue;
+        }
+        if (!FindMp4Path(trak, { Mp4Type("mdia"), Mp4Type("mdhd") }, mdhd) || mdhd.size < 24 ||
+            !FindMp4Path(trak, { Mp4Type("mdia"), Mp4Type("minf"), Mp4Type("stbl") }, stbl)) {
+            break;
+        }
+        track.timescale = ReadBe32(mdhd.body + (mdhd.body[0] == 1 ? 20 : 12));
+        if (track.timescale == 0 || !ReadMp4Offsets(stbl, track) || !ReadMp4Times(trak, stbl, movieTimescale, track)) break;
+
+        const uint8_t* entries = nullptr;
+        uint32_t count = 0;
+        if (FindMp4Box(stbl.body, stbl.body + stbl.size, Mp4Type("stss"), box)) {
+            if (!Mp4Table(box, 4, entries, count)) break;
+            track.syncSamples.reserve(count);
+            for (uint32_t i = 0; i < count; ++i) {
+                const uint32_t sample = ReadBe32(entries + i * 4);
+                if (sample == 0 || sample > track.sizes.size()) break;
+                track.syncSamples.push_back(sample - 1);
+            }
+            if (track.syncSamples.size() != count) break;
+        } else {
+            track.syncSamples.resize(track.sizes.size());
+            for (uint32_t i = 0; i < track.syncSamples.size(); ++i) track.syncSamples[i] = i;
+        }
+        return true;
+    }
+    printf("No readable video track in %s.\n", path.c_str());
+    return false;
+}
+
+// Keyframe entries for a parsed track, sorted by PTS
+inline std::vector<SeekKeyframe> SeekKeyframes(const Mp4VideoTrack& track) {
+    std::vector<SeekKeyframe> keyframes(track.syncSamples.size());
+    for (size_t i = 0; i < keyframes.size(); ++i) {
+        const uint32_t sample = track.syncSamples[i];
+        const uint32_t end = i + 1 < keyframes.size() ? track.syncSamples[i + 1] : static_cast<uint32_t>(track.sizes.size());
+        uint64_t gopBytes = 0;
+        for (uint32_t k = sample; k < end; ++k) gopBytes += track.sizes[k];
+        SeekKeyframe& keyframe = keyframes[i];
+        keyframe.pts = Mp4ToTicks(track.pts[sample], track.timescale);
+        keyframe.offset = track.offsets[sample];
+        keyframe.size = track.sizes[sample];
+        keyframe.sample = sample;
+        keyframe.gopFrames = end - sample;
+        keyframe.gopBytes = static_cast<uint32_t>(std::min<uint64_t>(gopBytes, UINT32_MAX));
+    }
+    std::stable_sort(keyframes.begin(), keyframes.end(), [](const SeekKeyframe& a, const SeekKeyframe& b) { return a.pts < b.pts; });
+    return keyframes;
+}
+
+// Write the index for a parsed track to a temporary file, then rename it over indexPath
+inline bool WriteSeekIndex(const std::string& indexPath, const Mp4VideoTrack& track, const std::vector<SeekAnchor>& anchors) {
+    const std::vector<SeekKeyframe> keyframes = SeekKeyframes(track);
+    SeekIndexHeader header = {};
+    memcpy(header.magic, SEEK_INDEX_MAGIC, sizeof(header.magic));
+    header.version = SEEK_INDEX_VERSION;
+    header.headerSize = sizeof(SeekIndexHeader);
+    header.keyframeSize = sizeof(SeekKeyframe);
+    header.anchorSize = sizeof(SeekAnchor);
+    header.keyframeCount = keyframes.size();
+    header.anchorCount = anchors.size();
+    header.sampleCount = track.sizes.size();
+    header.duration = Mp4ToTicks(track.duration, track.timescale);
+    header.mediaSize = track.fileSize;
+
+    const std::string temporary = indexPath + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (!file) {
+        printf("Failed to create %s.\n", temporary.c_str());
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    if (ok && !keyframes.empty()) ok = fwrite(keyframes.data(), sizeof(SeekKeyframe), keyframes.size(), file) == keyframes.size();
+    if (ok && !anchors.empty()) ok = fwrite(anchors.data(), sizeof(SeekAnchor), anchors.size(), file) == anchors.size();
+    ok = fclose(file) == 0 && ok;
+#ifdef _WIN32
+    ok = ok && MoveFileExA(temporary.c_str(), indexPath.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    ok = ok && rename(temporary.c_str(), indexPath.c_str()) == 0;
+#endif
+    if (!ok) {
+        printf("Failed to write %s.\n", indexPath.c_str());
+        remove(temporary.c_str());
+    }
+    return ok;
+}
+
+// Index an existing recording; it has no wall-clock anchors
+inline bool BuildSeekIndex(const std::string& mediaPath, const std::string& indexPath) {
+    Mp4VideoTrack track;
+    return ReadMp4VideoTrack(mediaPath, track) && WriteSeekIndex(indexPath, track, {});
+}
+
+// Collects wall-clock anchors while recording and writes the index once the file is finalized
+class SeekIndexRecorder {
+public:
+    void Start(int64_t anchorInterval = TICKS_PER_SECOND) {
+        interval = anchorInterval;
+        anchors.clear();
+    }
+
+    // Once per video frame handed to the sink writer, with its sample time; reads the clock once per interval
+    void AddFrame(int64_t pts) {
+        if (anchors.empty() || pts - anchors.back().pts >= interval) anchors.push_back({ pts, UnixTimeTicks() });
+    }
+
+    void AddFrame(int64_t pts, int64_t wallClock) {
+        if (anchors.empty() || pts - anchors.back().pts >= interval) anchors.push_back({ pts, wallClock });
+    }
+
+    // After the sink writer finalized mediaPath. The first frame added is the track's first sample,
+    // which lines up the anchors' sample times with the file's own timeline.
+    bool Finish(const std::string& mediaPath, const std::string& indexPath) {
+        Mp4VideoTrack track;
+        if (!ReadMp4VideoTrack(mediaPath, track)) return false;
+        if (!anchors.empty() && !track.pts.empty()) {
+            const int64_t shift = Mp4ToTicks(track.pts[0], track.timescale) - anchors[0].pts;
+            for (SeekAnchor& anchor : anchors) anchor.pts += shift;
+        }
+        return WriteSeekIndex(indexPath, track, anchors);
+    }
+
+    size_t Anchors() const { return anchors.size(); }
+
+private:
+    int64_t interval = TICKS_PER_SECOND;
+    std::vector<SeekAnchor> anchors;
+};
+
+// Size of a file on disk without opening it; false if it cannot be read
+inline bool MediaFileSize(const std::string& path, uint64_t& size) {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &data)) return false;
+    size = (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+#else
+    struct stat status;
+    if (stat(path.c_str(), &status) != 0) return false;
+    size = static_cast<uint64_t>(status.st_size);
+#endif
+    return true;
+}
+
+// Maps a .seek file and answers lookups in place
+class SeekIndexReader {
+public:
+    // mediaPath defaults to path without ".seek". An index whose mediaSize no longer matches the media
+    // file is stale (the file was rewritten or appended to) and is rebuilt from it, without anchors.
+    bool Open(const std::string& path, std::string mediaPath = std::string()) {
+        if (mediaPath.empty() && path.size() > 5 && path.compare(path.size() - 5, 5, ".seek") == 0) {
+            mediaPath = path.substr(0, path.size() - 5);
+        }
+        if (!Map(path)) return false;
+        uint64_t mediaSize = 0;
+        if (mediaPath.empty() || (MediaFileSize(mediaPath, mediaSize) && mediaSize == Header().mediaSize)) return true;
+        file.Close();
+        printf("%s does not match %s any more; rebuilding it.\n", path.c_str(), mediaPath.c_str());
+        return BuildSeekIndex(mediaPath, path) && Map(path);
+    }
+
+    void Close() { file.Close(); }
+
+    // Last keyframe at or before pts; the first keyframe when pts is earlier, nullptr when there are none
+    const SeekKeyframe* KeyframeBefore(int64_t pts) const {
+        const SeekKeyframe* begin = Keyframes();
+        const SeekKeyframe* end = begin + KeyframeCount();
+        if (begin == end) return nullptr;
+        const SeekKeyframe* after = std::upper_bound(begin, end, pts, [](int64_t t, const SeekKeyframe& k) { return t < k.pts; });
+        return after == begin ? begin : after - 1;
+    }
+
+    // PTS captured at a wall-clock time: the last anchor at or before it plus the time since. -1 without anchors.
+    int64_t PtsAtWallClock(int64_t wallClock) const {
+        const SeekAnchor* begin = Anchors();
+        const SeekAnchor* end = begin + AnchorCount();
+        if (begin == end) return -1;
+        const SeekAnchor* after = std::upper_bound(begin, end, wallClock, [](int64_t t, const SeekAnchor& a) { return t < a.wallClock; });
+        const SeekAnchor& anchor = after == begin ? *begin : after[-1];
+        return anchor.pts + (wallClock - anchor.wallClock);
+    }
+
+    const SeekKeyframe* KeyframeBeforeWallClock(int64_t wallClock) const {
+        return AnchorCount() ? KeyframeBefore(PtsAtWallClock(wallClock)) : nullptr;
+    }
+
+    const SeekIndexHeader& Header() const { return *reinterpret_cast<const SeekIndexHeader*>(file.Data()); }
+    const SeekKeyframe* Keyframes() const { return reinterpret_cast<const SeekKeyframe*>(file.Data() + sizeof(SeekIndexHeader)); }
+    const SeekAnchor* Anchors() const { return reinterpret_cast<const SeekAnchor*>(Keyframes() + KeyframeCount()); }
+    uint64_t KeyframeCount() const { return Header().keyframeCount; }
+    uint64_t AnchorCount() const { return Header().anchorCount; }
+
+private:
+    bool Map(const std::string& path) {
+        if (!file.Open(path, false)) return false;
+        if (file.Size() < sizeof(SeekIndexHeader)) {
+            printf("%s is too short to be a seek index.\n", path.c_str());
+            file.Close();
+            return false;
+        }
+        const SeekIndexHeader& header = Header();
+        const bool valid = memcmp(header.magic, SEEK_INDEX_MAGIC, sizeof(header.magic)) == 0 &&
+                           header.version == SEEK_INDEX_VERSION && header.headerSize == sizeof(SeekIndexHeader) &&
+                           header.keyframeSize == sizeof(SeekKeyframe) && header.anchorSize == sizeof(SeekAnchor) &&
+                           header.keyframeCount <= file.Size() / sizeof(SeekKeyframe) && header.anchorCount <= file.Size() / sizeof(SeekAnchor) &&
+                           file.Size() == sizeof(SeekIndexHeader) + header.keyframeCount * sizeof(SeekKeyframe) +
+                                              header.anchorCount * sizeof(SeekAnchor);
+        if (!valid) {
+            printf("%s is not a seek index.\n", path.c_str());
+            file.Close();
+        }
+        return valid;
+    }
+
+    MappedFile file;
+};
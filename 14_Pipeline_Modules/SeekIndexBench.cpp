@@ -0,0 +1,421 @@
+// SeekIndexBench.cpp
+// Checks and measures SeekIndex.h on a synthetic 60 fps, 4 Mbit/s recording
+// of several hours. The MP4 is written sparse: real box layout (co64 offsets,
+// a 64-bit mdat, B-frames with ctts and an edit list, audio gaps between video
+// chunks, an audio track ahead of the video one), with a marker at each
+// keyframe offset and no other media data. GOPs are 2 s, with random scene
+// cuts making shorter ones.
+//   1. The index against the ground truth: every keyframe's PTS, offset (the
+//      marker must be there), size and GOP; random "nearest keyframe before T"
+//      lookups by PTS and by wall clock against a linear scan; edge cases.
+//   2. Seek cost today: open the MP4 and parse the whole video sample table,
+//      then find the keyframe.
+//   3. Seek cost with the index: building it after Finalize, its size, and
+//      lookups with the file already mapped and with an open/map/close each.
+//   4. An index opened after the media file grew is rebuilt.
+// Usage: ./Run.sh SeekIndexBench [hours] [directory]
+//        ./Run.sh SeekIndexBench --index recording.mp4   (writes recording.mp4.seek)
+#include "SeekIndex.h"
+#include "MediaTypes.h"
+#include "Stats.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Constants
+const uint32_t FPS = 60;
+const uint32_t TIMESCALE = 90000;
+const uint32_t FRAME_DELTA = TIMESCALE / FPS;
+const uint32_t GOP_FRAMES = 2 * FPS;
+const uint32_t CHUNK_FRAMES = FPS / 2;    // Samples per video chunk after the first
+const uint32_t AUDIO_GAP = 8000;          // Bytes of (unwritten) audio between video chunks
+const uint64_t MDAT_START = 20 + 16;      // After ftyp and the 64-bit mdat header
+const int64_t FIRST_SAMPLE_TIME = 12345678; // Sample time of the first captured frame, as a recorder sets it
+const int64_t WALL_CLOCK_START = 1700000000LL * TICKS_PER_SECOND;
+const uint32_t TABLE_PARSES = 10;
+const uint32_t MAPPED_LOOKUPS = 1000000;
+const uint32_t OPEN_LOOKUPS = 5000;
+const uint32_t CHECKED_LOOKUPS = 20000;
+
+uint64_t rngState = 0x9E3779B97F4A7C15ull;
+
+uint32_t Random(uint32_t range) {
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 7;
+    rngState ^= rngState << 17;
+    return static_cast<uint32_t>(rngState % range);
+}
+
+// Big-endian box builder; sizes are patched when a box ends
+class BoxWriter {
+public:
+    void U32(uint32_t v) {
+        for (int shift = 24; shift >= 0; shift -= 8) data.push_back(static_cast<uint8_t>(v >> shift));
+    }
+    void U64(uint64_t v) {
+        U32(static_cast<uint32_t>(v >> 32));
+        U32(static_cast<uint32_t>(v));
+    }
+    void Zeros(size_t count) { data.insert(data.end(), count, 0); }
+    void Begin(const char (&type)[5]) {
+        starts.push_back(data.size());
+        U32(0);
+        U32(Mp4Type(type));
+    }
+    void BeginFull(const char (&type)[5], uint32_t version = 0) {
+        Begin(type);
+        U32(version << 24);
+    }
+    void End() {
+        const size_t start = starts.back();
+        starts.pop_back();
+        const uint32_t size = static_cast<uint32_t>(data.size() - start);
+        for (int i = 0; i < 4; ++i) data[start + i] = static_cast<uint8_t>(size >> (24 - 8 * i));
+    }
+
+    std::vector<uint8_t> data;
+
+private:
+    std::vector<size_t> starts;
+};
+
+struct Recording {
+    std::vector<SeekKeyframe> keyframes; // Ground truth
+    std::vector<uint32_t> display;       // Display frame of each sample, decode order
+    uint64_t samples = 0;
+    uint64_t fileSize = 0;
+    size_t moovBytes = 0;
+};
+
+// GOPs in display order, each coded I P B P B ... (P before the B it follows), so decode order differs
+bool WriteRecording(const std::string& path, uint64_t frames, Recording& recording) {
+    std::vector<uint32_t> gopStarts;
+    for (uint64_t frame = 0; frame < frames;) {
+        gopStarts.push_back(static_cast<uint32_t>(frame));
+        frame += Random(8) == 0 ? 10 + Random(GOP_FRAMES - 10) : GOP_FRAMES;
+    }
+    gopStarts.push_back(static_cast<uint32_t>(frames));
+
+    std::vector<uint32_t> sizes, ctts, sync;
+    std::vector<uint64_t> chunkOffsets;
+    recording.display.clear();
+    for (size_t g = 0; g + 1 < gopStarts.size(); ++g) {
+        const uint32_t start = gopStarts[g], end = gopStarts[g + 1];
+        sync.push_back(static_cast<uint32_t>(sizes.size()) + 1);
+        recording.display.push_back(start);
+        sizes.push_back(40000 + Random(8000));
+        for (uint32_t d = start + 1; d < end; d += 2) {
+            if (d + 1 < end) {
+                recording.display.push_back(d + 1);
+                sizes.push_back(9000 + Random(3000));
+                recording.display.push_back(d);
+                sizes.push_back(4000 + Random(2000));
+            } else {
+                recording.display.push_back(d);
+                sizes.push_back(9000 + Random(3000));
+            }
+        }
+    }
+    recording.samples = sizes.size();
+    for (size_t i = 0; i < sizes.size(); ++i) ctts.push_back((recording.display[i] + 1 - static_cast<uint32_t>(i)) * FRAME_DELTA);
+
+    // Chunks: the first holds one sample, the rest CHUNK_FRAMES, with audio in between
+    std::vector<uint64_t> offsets(sizes.size());
+    uint64_t position = MDAT_START;
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        if (i == 0 || (i - 1) % CHUNK_FRAMES == 0) {
+            if (i > 0) position += AUDIO_GAP;
+            chunkOffsets.push_back(position);
+        }
+        offsets[i] = position;
+        position += sizes[i];
+    }
+    const uint64_t mdatEnd = position + AUDIO_GAP;
+
+    for (size_t k = 0; k < sync.size(); ++k) {
+        const uint32_t sample = sync[k] - 1;
+        const uint32_t next = k + 1 < sync.size() ? sync[k + 1] - 1 : static_cast<uint32_t>(sizes.size());
+        uint64_t gopBytes = 0;
+        for (uint32_t i = sample; i < next; ++i) gopBytes += sizes[i];
+        recording.keyframes.push_back({ Mp4ToTicks(static_cast<int64_t>(recording.display[sample]) * FRAME_DELTA, TIMESCALE),
+                                        offsets[sample], sizes[sample], sample, next - sample, static_cast<uint32_t>(gopBytes) });
+    }
+
+    BoxWriter head;
+    head.Begin("ftyp");
+    head.U32(Mp4Type("isom"));
+    head.U32(512);
+    head.U32(Mp4Type("isom"));
+    head.End();
+    head.U32(1);
+    head.U32(Mp4Type("mdat"));
+    head.U64(mdatEnd - 20);
+
+    const uint64_t duration = frames * FRAME_DELTA;
+    BoxWriter moov;
+    moov.Begin("moov");
+    moov.BeginFull("mvhd");
+    moov.U32(0);
+    moov.U32(0);
+    moov.U32(1000);
+    moov.U32(static_cast<uint32_t>(duration / (TIMESCALE / 1000)));
+    moov.Zeros(80);
+    moov.End();
+    for (const char* handler : { "soun", "vide" }) {
+        const bool video = handler[0] == 'v';
+        moov.Begin("trak");
+        moov.BeginFull("tkhd");
+        moov.Zeros(80);
+        moov.End();
+        if (video) {
+            moov.Begin("edts");
+            moov.BeginFull("elst");
+            moov.U32(1);
+            moov.U32(static_cast<uint32_t>(duration / (TIMESCALE / 1000)));
+            moov.U32(FRAME_DELTA); // Cancels the one-frame ctts shift
+            moov.U32(0x00010000);
+            moov.End();
+            moov.End();
+        }
+        moov.Begin("mdia");
+        moov.BeginFull("mdhd");
+        moov.U32(0);
+        moov.U32(0);
+        moov.U32(video ? TIMESCALE : 48000);
+        moov.U32(video ? static_cast<uint32_t>(duration) : 0);
+        moov.U32(0);
+        moov.End();
+        moov.BeginFull("hdlr");
+        moov.U32(0);
+        moov.U32(Mp4Type(video ? "vide" : "soun"));
+        moov.Zeros(13);
+        moov.End();
+        moov.Begin("minf");
+        moov.Begin("stbl");
+        moov.BeginFull("stsd");
+        moov.U32(0);
+        moov.End();
+        if (video) {
+            moov.BeginFull("stts");
+            moov.U32(1);
+            moov.U32(static_cast<uint32_t>(sizes.size()));
+            moov.U32(FRAME_DELTA);
+            moov.End();
+            std::vector<std::pair<uint32_t, uint32_t>> runs;
+            for (uint32_t offset : ctts) {
+                if (!runs.empty() && runs.back().second == offset) ++runs.back().first;
+                else runs.push_back({ 1, offset });
+            }
+            moov.BeginFull("ctts");
+            moov.U32(static_cast<uint32_t>(runs.size()));
+            for (const auto& run : runs) {
+                moov.U32(run.first);
+                moov.U32(run.second);
+            }
+            moov.End();
+            moov.BeginFull("stss");
+            moov.U32(static_cast<uint32_t>(sync.size()));
+            for (uint32_t sample : sync) moov.U32(sample);
+            moov.End();
+            moov.BeginFull("stsz");
+            moov.U32(0);
+            moov.U32(static_cast<uint32_t>(sizes.size()));
+            for (uint32_t size : sizes) moov.U32(size);
+            moov.End();
+            moov.BeginFull("stsc");
+            moov.U32(2);
+            for (uint32_t value : { 1u, 1u, 1u, 2u, CHUNK_FRAMES, 1u }) moov.U32(value);
+            moov.End();
+            moov.BeginFull("co64");
+            moov.U32(static_cast<uint32_t>(chunkOffsets.size()));
+            for (uint64_t offset : chunkOffsets) moov.U64(offset);
+            moov.End();
+        }
+        moov.End();
+        moov.End();
+        moov.End();
+        moov.End();
+    }
+    moov.End();
+    recording.moovBytes = moov.data.size();
+
+    const int fd = open(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd < 0) {
+        printf("Failed to create %s.\n", path.c_str());
+        return false;
+    }
+    bool ok = pwrite(fd, head.data.data(), head.data.size(), 0) == static_cast<ssize_t>(head.data.size());
+    for (const SeekKeyframe& keyframe : recording.keyframes) {
+        const uint64_t marker = 0x4B45590000000000ull | keyframe.sample;
+        ok = ok && pwrite(fd, &marker, sizeof(marker), static_cast<off_t>(keyframe.offset)) == sizeof(marker);
+    }
+    ok = ok && pwrite(fd, moov.data.data(), moov.data.size(), static_cast<off_t>(mdatEnd)) == static_cast<ssize_t>(moov.data.size());
+    close(fd);
+    recording.fileSize = mdatEnd + moov.data.size();
+    return ok;
+}
+
+// Reference "nearest keyframe before T" by linear scan over the ground truth
+const SeekKeyframe* ScanKeyframeBefore(const std::vector<SeekKeyframe>& keyframes, int64_t pts) {
+    const SeekKeyframe* best = &keyframes[0];
+    for (const SeekKeyframe& keyframe : keyframes) {
+        if (keyframe.pts <= pts) best = &keyframe;
+    }
+    return best;
+}
+
+// Seek the way the review tooling does today: parse the whole sample table, then find the keyframe
+uint32_t SeekByTable(const std::string& path, int64_t pts) {
+    Mp4VideoTrack track;
+    if (!ReadMp4VideoTrack(path, track)) return UINT32_MAX;
+    uint32_t best = track.syncSamples[0];
+    for (uint32_t sample : track.syncSamples) {
+        if (Mp4ToTicks(track.pts[sample], track.timescale) <= pts) best = sample;
+    }
+    return best;
+}
+
+bool CheckIndex(const std::string& mediaPath, const std::string& indexPath, const Recording& recording, int64_t duration) {
+    SeekIndexReader reader;
+    if (!reader.Open(indexPath)) return false;
+    bool table = reader.KeyframeCount() == recording.keyframes.size() && reader.Header().sampleCount == recording.samples &&
+                 reader.Header().mediaSize == recording.fileSize && reader.Header().duration == duration;
+    const int fd = open(mediaPath.c_str(), O_RDONLY);
+    for (size_t i = 0; table && i < recording.keyframes.size(); ++i) {
+        const SeekKeyframe& got = reader.Keyframes()[i];
+        const SeekKeyframe& want = recording.keyframes[i];
+        uint64_t marker = 0;
+        table = got.pts == want.pts && got.offset == want.offset && got.size == want.size && got.sample == want.sample &&
+                got.gopFrames == want.gopFrames && got.gopBytes == want.gopBytes &&
+                pread(fd, &marker, sizeof(marker), static_cast<off_t>(got.offset)) == sizeof(marker) &&
+                marker == (0x4B45590000000000ull | want.sample);
+    }
+    close(fd);
+
+    bool lookups = true, wallClock = true;
+    for (uint32_t i = 0; i < CHECKED_LOOKUPS; ++i) {
+        const int64_t pts = static_cast<int64_t>(Random(static_cast<uint32_t>(duration / 1000))) * 1000;
+        const SeekKeyframe* want = ScanKeyframeBefore(recording.keyframes, pts);
+        lookups = lookups && reader.KeyframeBefore(pts) == reader.Keyframes() + (want - recording.keyframes.data());
+        wallClock = wallClock && reader.KeyframeBeforeWallClock(WALL_CLOCK_START + FIRST_SAMPLE_TIME + pts) == reader.KeyframeBefore(pts);
+    }
+    const bool edges = reader.KeyframeBefore(-TICKS_PER_SECOND) == reader.Keyframes() &&
+                       reader.KeyframeBefore(duration * 2) == reader.Keyframes() + reader.KeyframeCount() - 1 &&
+                       reader.KeyframeBefore(reader.Keyframes()[5].pts) == reader.Keyframes() + 5 &&
+                       reader.KeyframeBefore(reader.Keyframes()[5].pts - 1) == reader.Keyframes() + 4;
+    printf("Keyframe table (PTS, offset with marker, size, GOP): %s; %u lookups by PTS: %s; by wall clock: %s; edges: %s\n",
+           table ? "ok" : "FAILED", CHECKED_LOOKUPS, lookups ? "ok" : "FAILED", wallClock ? "ok" : "FAILED", edges ? "ok" : "FAILED");
+    return table && lookups && wallClock && edges;
+}
+
+bool IndexFile(const std::string& mediaPath) {
+    const std::string indexPath = mediaPath + ".seek";
+    const int64_t start = NowTicks();
+    SeekIndexReader reader;
+    if (!BuildSeekIndex(mediaPath, indexPath) || !reader.Open(indexPath)) return false;
+    const SeekIndexHeader& header = reader.Header();
+    printf("%s: %llu samples, %llu keyframes, %.1f s, average GOP %.1f frames; indexed in %.1f ms\n", indexPath.c_str(),
+           static_cast<unsigned long long>(header.sampleCount), static_cast<unsigned long long>(header.keyframeCount),
+           header.duration / static_cast<double>(TICKS_PER_SECOND),
+           header.keyframeCount ? header.sampleCount / static_cast<double>(header.keyframeCount) : 0.0, (NowTicks() - start) / 1e4);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 2 && strcmp(argv[1], "--index") == 0) return IndexFile(argv[2]) ? 0 : 1;
+    const double hours = argc > 1 ? atof(argv[1]) : 3.0;
+    const std::string directory = argc > 2 ? argv[2] : "/tmp";
+    const std::string mediaPath = directory + "/SeekIndexBench.mp4";
+    const std::string indexPath = mediaPath + ".seek";
+    const uint64_t frames = static_cast<uint64_t>(hours * 3600 * FPS);
+
+    Recording recording;
+    if (!WriteRecording(mediaPath, frames, recording)) return 1;
+    const int64_t duration = Mp4ToTicks(static_cast<int64_t>(frames) * FRAME_DELTA, TIMESCALE);
+    printf("%.1f h recording: %.2f GB (sparse), %llu samples, %zu keyframes, moov %.1f MB\n", hours, recording.fileSize / 1e9,
+           static_cast<unsigned long long>(recording.samples), recording.keyframes.size(), recording.moovBytes / 1048576.0);
+
+    // The recorder sees frames in capture (display) order with its own sample times
+    SeekIndexRecorder recorder;
+    recorder.Start();
+    for (uint64_t frame = 0; frame < frames; ++frame) {
+        const int64_t sampleTime = FIRST_SAMPLE_TIME + Mp4ToTicks(static_cast<int64_t>(frame) * FRAME_DELTA, TIMESCALE);
+        recorder.AddFrame(sampleTime, WALL_CLOCK_START + sampleTime);
+    }
+    int64_t start = NowTicks();
+    bool ok = recorder.Finish(mediaPath, indexPath);
+    const double buildMs = (NowTicks() - start) / 1e4;
+    ok = ok && CheckIndex(mediaPath, indexPath, recording, duration);
+
+    SeekIndexReader reader;
+    ok = reader.Open(indexPath) && ok;
+    const uint64_t indexBytes = sizeof(SeekIndexHeader) + reader.KeyframeCount() * sizeof(SeekKeyframe) + reader.AnchorCount() * sizeof(SeekAnchor);
+    reader.Close();
+    ok = BuildSeekIndex(mediaPath, indexPath + ".plain") && reader.Open(indexPath + ".plain") && reader.AnchorCount() == 0 &&
+         reader.KeyframeCount() == recording.keyframes.size() && !reader.KeyframeBeforeWallClock(WALL_CLOCK_START) && ok;
+    reader.Close();
+    remove((indexPath + ".plain").c_str());
+    FILE* garbage = fopen((indexPath + ".bad").c_str(), "wb");
+    if (garbage) {
+        fwrite(recording.keyframes.data(), sizeof(SeekKeyframe), 8, garbage);
+        fclose(garbage);
+    }
+    ok = !reader.Open(indexPath + ".bad") && ok;
+    remove((indexPath + ".bad").c_str());
+
+    printf("\nSeek cost, page cache warm:\n");
+    start = NowTicks();
+    for (uint32_t i = 0; i < TABLE_PARSES; ++i) ok = SeekByTable(mediaPath, Random(static_cast<uint32_t>(duration / 1000)) * 1000LL) != UINT32_MAX && ok;
+    const double tableMs = (NowTicks() - start) / 1e4 / TABLE_PARSES;
+    printf("  parse the sample table per seek:      %9.2f ms\n", tableMs);
+
+    LatencyHistogram openLatency;
+    ok = SeekIndexReader().Open(indexPath) && ok; // First open pages the file in
+    start = NowTicks();
+    for (uint32_t i = 0; i < OPEN_LOOKUPS; ++i) {
+        const int64_t t = NowTicks();
+        SeekIndexReader once;
+        ok = once.Open(indexPath) && once.KeyframeBefore(Random(static_cast<uint32_t>(duration / 1000)) * 1000LL) && ok;
+        openLatency.Record(static_cast<uint64_t>(NowTicks() - t) / 10);
+    }
+    const double openUs = (NowTicks() - start) / 10.0 / OPEN_LOOKUPS;
+    printf("  index: open, map, look up, close:    %9.2f us (p99 %.0f us), %.0fx faster\n", openUs,
+           static_cast<double>(openLatency.Percentile(99)), tableMs * 1000 / openUs);
+
+    ok = reader.Open(indexPath) && ok;
+    std::vector<int64_t> targets(4096);
+    for (int64_t& target : targets) target = Random(static_cast<uint32_t>(duration / 1000)) * 1000LL;
+    uint64_t checksum = 0;
+    start = NowTicks();
+    for (uint32_t i = 0; i < MAPPED_LOOKUPS; ++i) checksum += reader.KeyframeBefore(targets[i & 4095])->offset;
+    const double mappedNs = (NowTicks() - start) * 100.0 / MAPPED_LOOKUPS;
+    start = NowTicks();
+    for (uint32_t i = 0; i < MAPPED_LOOKUPS; ++i) checksum += reader.KeyframeBeforeWallClock(WALL_CLOCK_START + targets[i & 4095])->offset;
+    const double wallNs = (NowTicks() - start) * 100.0 / MAPPED_LOOKUPS;
+    printf("  index already mapped, by PTS:         %9.0f ns\n", mappedNs);
+    printf("  index already mapped, by wall clock:  %9.0f ns  (checksum %llu)\n", wallNs, static_cast<unsigned long long>(checksum % 1000));
+    printf("\nIndex: %.0f KB (%.0f KB per hour, %llu keyframes + %llu anchors), built after Finalize in %.1f ms\n", indexBytes / 1024.0,
+           indexBytes / 1024.0 / hours, static_cast<unsigned long long>(reader.KeyframeCount()),
+           static_cast<unsigned long long>(reader.AnchorCount()), buildMs);
+    reader.Close();
+
+    // Appending to the media (a free box here) leaves the index stale; opening it rebuilds it
+    FILE* media = fopen(mediaPath.c_str(), "ab");
+    const uint8_t freeBox[8] = { 0, 0, 0, 8, 'f', 'r', 'e', 'e' };
+    const bool grown = media && fwrite(freeBox, 1, sizeof(freeBox), media) == sizeof(freeBox);
+    if (media) fclose(media);
+    const bool rebuilt = grown && reader.Open(indexPath) && reader.Header().mediaSize == recording.fileSize + sizeof(freeBox) &&
+                         reader.KeyframeCount() == recording.keyframes.size() && reader.AnchorCount() == 0;
+    reader.Close();
+    printf("Stale index after the media grew: %s\n", rebuilt ? "rebuilt, ok" : "FAILED");
+    ok = rebuilt && ok;
+
+    remove(mediaPath.c_str());
+    remove(indexPath.c_str());
+    return ok ? 0 : 1;
+}
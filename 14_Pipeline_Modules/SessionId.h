@@ -0,0 +1,312 @@
+// SessionId.h
+// Session and segment IDs without COM: UUIDv4 (random) and UUIDv7 (Unix
+// milliseconds first, so IDs sort by creation time), formatted the way
+// StringFromGUID2 does ("{8-4-4-4-12}", upper case) or as canonical lower case.
+// Random bytes come from a per-thread ChaCha20 generator seeded from the OS
+// (BCryptGenRandom / getrandom). It refills a buffer of blocks at a time and
+// takes its next key from the start of each refill, so a later memory leak
+// cannot recover IDs already handed out. A forked child reseeds before its
+// next ID. Nothing is allocated per ID.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <bcrypt.h>
+#pragma comment(lib, "bcrypt.lib")
+#else
+#include <errno.h>
+#include <pthread.h>
+#include <sys/random.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Bytes in RFC 9562 order (the order of the text form)
+struct Uuid {
+    uint8_t bytes[16];
+
+    bool operator==(const Uuid& other) const { return memcmp(bytes, other.bytes, 16) == 0; }
+    bool operator<(const Uuid& other) const { return memcmp(bytes, other.bytes, 16) < 0; }
+    int Version() const { return bytes[6] >> 4; }
+};
+
+const size_t UUID_REGISTRY_LENGTH = 38;  // {XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX}
+const size_t UUID_CANONICAL_LENGTH = 36; // xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx
+
+// Operating system entropy; false only if the OS call fails
+inline bool OsRandomBytes(void* out, size_t size) {
+#ifdef _WIN32
+    return BCRYPT_SUCCESS(BCryptGenRandom(NULL, static_cast<PUCHAR>(out), static_cast<ULONG>(size), BCRYPT_USE_SYSTEM_PREFERRED_RNG));
+#else
+    uint8_t* p = static_cast<uint8_t*>(out);
+    while (size > 0) {
+        ssize_t got = getrandom(p, size, 0);
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += got;
+        size -= static_cast<size_t>(got);
+    }
+    return true;
+#endif
+}
+
+// One ChaCha20 block (RFC 8439): key, 32-bit block counter and 96-bit nonce in, 64 bytes out
+inline void ChaCha20Block(const uint32_t key[8], uint32_t counter, const uint32_t nonce[3], uint8_t out[64]) {
+    uint32_t state[16] = { 0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,
+                           key[0], key[1], key[2], key[3], key[4], key[5], key[6], key[7],
+                           counter, nonce[0], nonce[1], nonce[2] };
+    uint32_t x[16];
+    memcpy(x, state, sizeof(x));
+#define CHACHA_ROTATE(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define CHACHA_QUARTER(a, b, c, d)                                   \
+    x[a] += x[b]; x[d] ^= x[a]; x[d] = CHACHA_ROTATE(x[d], 16);     \
+    x[c] += x[d]; x[b] ^= x[c]; x[b] = CHACHA_ROTATE(x[b], 12);     \
+    x[a] += x[b]; x[d] ^= x[a]; x[d] = CHACHA_ROTATE(x[d], 8);      \
+    x[c] += x[d]; x[b] ^= x[c]; x[b] = CHACHA_ROTATE(x[b], 7);
+    for (int round = 0; round < 10; ++round) {
+        CHACHA_QUARTER(0, 4, 8, 12) CHACHA_QUARTER(1, 5, 9, 13) CHACHA_QUARTER(2, 6, 10, 14) CHACHA_QUARTER(3, 7, 11, 15)
+        CHACHA_QUARTER(0, 5, 10, 15) CHACHA_QUARTER(1, 6, 11, 12) CHACHA_QUARTER(2, 7, 8, 13) CHACHA_QUARTER(3, 4, 9, 14)
+    }
+#undef CHACHA_QUARTER
+#undef CHACHA_ROTATE
+    for (int i = 0; i < 16; ++i) {
+        const uint32_t v = x[i] + state[i]; // Serialised little-endian
+        out[4 * i] = static_cast<uint8_t>(v);
+        out[4 * i + 1] = static_cast<uint8_t>(v >> 8);
+        out[4 * i + 2] = static_cast<uint8_t>(v >> 16);
+        out[4 * i + 3] = static_cast<uint8_t>(v >> 24);
+    }
+}
+
+#ifndef _WIN32
+// Bumped in a forked child so every thread's generator reseeds
+inline std::atomic<uint32_t>& ForkGeneration() {
+    static std::atomic<uint32_t> generation(0);
+    static const int registered = pthread_atfork(nullptr, nullptr, [] { ForkGeneration().fetch_add(1); });
+    (void)registered;
+    return generation;
+}
+#endif
+
+class IdGenerator {
+public:
+    IdGenerator() = default;
+    IdGenerator(const IdGenerator&) = delete;
+    IdGenerator& operator=(const IdGenerator&) = delete;
+    ~IdGenerator() {
+        // Do not leave key or unused output behind
+        volatile uint8_t* p = buffer;
+        for (size_t i = 0; i < sizeof(buffer); ++i) p[i] = 0;
+        volatile uint32_t* k = key;
+        for (size_t i = 0; i < 8; ++i) k[i] = 0;
+    }
+
+    // Fill out with CSPRNG bytes; throws std::runtime_error if the OS has no entropy to give
+    void RandomBytes(void* out, size_t size) {
+        uint8_t* p = static_cast<uint8_t*>(out);
+        while (size > 0) {
+            if (available == 0 || Forked()) Refill();
+            const size_t n = size < available ? size : available;
+            uint8_t* source = buffer + sizeof(buffer) - available;
+            memcpy(p, source, n);
+            memset(source, 0, n); // Each byte is handed out once
+            available -= n;
+            p += n;
+            size -= n;
+        }
+    }
+
+    Uuid NewV4() {
+        Uuid id;
+        RandomBytes(id.bytes, 16);
+        id.bytes[6] = static_cast<uint8_t>((id.bytes[6] & 0x0F) | 0x40);
+        id.bytes[8] = static_cast<uint8_t>((id.bytes[8] & 0x3F) | 0x80);
+        return id;
+    }
+
+    // 48-bit Unix milliseconds, then a 12-bit counter (RFC 9562 method 1) so IDs
+    // from this thread sort in creation order even within one millisecond, then 62 random bits
+    Uuid NewV7() {
+        Uuid id;
+        RandomBytes(id.bytes + 6, 10);
+        uint64_t now = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                           std::chrono::system_clock::now().time_since_epoch()).count());
+        if (now > lastMillis) {
+            lastMillis = now;
+            counter = ((id.bytes[6] << 8) | id.bytes[7]) & 0x07FF; // Random start, leaving room to count up
+        } else if (++counter > 0x0FFF) {
+            ++lastMillis; // Counter spent: borrow the next millisecond
+            counter = 0;
+        }
+        for (int i = 0; i < 6; ++i) id.bytes[i] = static_cast<uint8_t>(lastMillis >> (40 - 8 * i));
+        id.bytes[6] = static_cast<uint8_t>(0x70 | (counter >> 8));
+        id.bytes[7] = static_cast<uint8_t>(counter);
+        id.bytes[8] = static_cast<uint8_t>((id.bytes[8] & 0x3F) | 0x80);
+        return id;
+    }
+
+    void NewV4(Uuid* out, size_t count) {
+        RandomBytes(out, count * sizeof(Uuid));
+        for (size_t i = 0; i < count; ++i) {
+            out[i].bytes[6] = static_cast<uint8_t>((out[i].bytes[6] & 0x0F) | 0x40);
+            out[i].bytes[8] = static_cast<uint8_t>((out[i].bytes[8] & 0x3F) | 0x80);
+        }
+    }
+
+    void NewV7(Uuid* out, size_t count) {
+        for (size_t i = 0; i < count; ++i) out[i] = NewV7();
+    }
+
+private:
+    static const size_t BUFFER_BLOCKS = 16;
+
+    bool Forked() const {
+#ifdef _WIN32
+        return false;
+#else
+        return ForkGeneration().load(std::memory_order_relaxed) != generation;
+#endif
+    }
+
+    void Refill() {
+        if (!seeded || Forked()) {
+            uint32_t seed[11];
+            if (!OsRandomBytes(seed, sizeof(seed))) throw std::runtime_error("Failed to read entropy from the operating system.");
+            memcpy(key, seed, sizeof(key));
+            memcpy(nonce, seed + 8, sizeof(nonce));
+            memset(seed, 0, sizeof(seed));
+            blockCounter = 0;
+#ifndef _WIN32
+            generation = ForkGeneration().load();
+#endif
+            seeded = true;
+        }
+        for (size_t b = 0; b < BUFFER_BLOCKS; ++b) ChaCha20Block(key, blockCounter++, nonce, buffer + 64 * b);
+        if (blockCounter == 0) ++nonce[0]; // 2^32 blocks under one nonce; move on
+        // Fast key erasure: the first 32 bytes become the next key and are never handed out
+        memcpy(key, buffer, sizeof(key));
+        memset(buffer, 0, sizeof(key));
+        available = sizeof(buffer) - sizeof(key);
+    }
+
+    uint32_t key[8] = {};
+    uint32_t nonce[3] = {};
+    uint32_t blockCounter = 0;
+    uint8_t buffer[64 * BUFFER_BLOCKS];
+    size_t available = 0;
+    bool seeded = false;
+    uint32_t generation = 0;
+    uint64_t lastMillis = 0;
+    uint32_t counter = 0;
+};
+
+// The calling thread's generator
+inline IdGenerator& ThreadIdGenerator() {
+    thread_local IdGenerator generator;
+    return generator;
+}
+
+// 16 bytes to 32 hex digits
+inline void HexEncode16(const uint8_t* bytes, char* out, bool upper) {
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes));
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    const __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask), lo = _mm_and_si128(v, mask);
+    // Interleave so each byte's high nibble comes first, then map 0-9 and 10-15 to characters
+    __m128i first = _mm_unpacklo_epi8(hi, lo), second = _mm_unpackhi_epi8(hi, lo);
+    const __m128i nine = _mm_set1_epi8(9), zero = _mm_set1_epi8('0'), letterGap = _mm_set1_epi8(upper ? 'A' - '0' - 10 : 'a' - '0' - 10);
+    first = _mm_add_epi8(_mm_add_epi8(first, zero), _mm_and_si128(_mm_cmpgt_epi8(first, nine), letterGap));
+    second = _mm_add_epi8(_mm_add_epi8(second, zero), _mm_and_si128(_mm_cmpgt_epi8(second, nine), letterGap));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), first);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16), second);
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint8x16_t table = vld1q_u8(reinterpret_cast<const uint8_t*>(upper ? "0123456789ABCDEF" : "0123456789abcdef"));
+    const uint8x16_t v = vld1q_u8(bytes);
+    uint8x16x2_t digits;
+    digits.val[0] = vqtbl1q_u8(table, vshrq_n_u8(v, 4));
+    digits.val[1] = vqtbl1q_u8(table, vandq_u8(v, vdupq_n_u8(0x0F)));
+    vst2q_u8(reinterpret_cast<uint8_t*>(out), digits); // Interleaves high and low digits
+#else
+    const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    for (int i = 0; i < 16; ++i) {
+        out[2 * i] = digits[bytes[i] >> 4];
+        out[2 * i + 1] = digits[bytes[i] & 0x0F];
+    }
+#endif
+}
+
+// xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx into out (36 chars, no terminator)
+inline void FormatUuidGroups(const Uuid& id, char* out, bool upper) {
+    char hex[32];
+    HexEncode16(id.bytes, hex, upper);
+    memcpy(out, hex, 8);
+    out[8] = '-';
+    memcpy(out + 9, hex + 8, 4);
+    out[13] = '-';
+    memcpy(out + 14, hex + 12, 4);
+    out[18] = '-';
+    memcpy(out + 19, hex + 16, 4);
+    out[23] = '-';
+    memcpy(out + 24, hex + 20, 12);
+}
+
+// Registry format, as StringFromGUID2 writes it; out holds UUID_REGISTRY_LENGTH + 1 chars
+inline void FormatRegistry(const Uuid& id, char* out) {
+    out[0] = '{';
+    FormatUuidGroups(id, out + 1, true);
+    out[37] = '}';
+    out[38] = '\0';
+}
+
+// Canonical lower case; out holds UUID_CANONICAL_LENGTH + 1 chars
+inline void FormatCanonical(const Uuid& id, char* out) {
+    FormatUuidGroups(id, out, false);
+    out[36] = '\0';
+}
+
+// Accepts canonical or registry form, either case
+inline bool ParseUuid(const char* text, size_t length, Uuid& id) {
+    if (length == UUID_REGISTRY_LENGTH) {
+        if (text[0] != '{' || text[37] != '}') return false;
+        ++text;
+        length -= 2;
+    }
+    if (length != UUID_CANONICAL_LENGTH) return false;
+    int nibble = 0;
+    for (size_t i = 0; i < length; ++i) {
+        const char c = text[i];
+        if (i == 8 || i == 13 || i == 18 || i == 23) {
+            if (c != '-') return false;
+            continue;
+        }
+        int v;
+        if (c >= '0' && c <= '9') v = c - '0';
+        else if (c >= 'a' && c <= 'f') v = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') v = c - 'A' + 10;
+        else return false;
+        if (nibble % 2 == 0) id.bytes[nibble / 2] = static_cast<uint8_t>(v << 4);
+        else id.bytes[nibble / 2] |= static_cast<uint8_t>(v);
+        ++nibble;
+    }
+    return true;
+}
+
+// Unix milliseconds of a UUIDv7
+inline uint64_t UuidV7Millis(const Uuid& id) {
+    uint64_t ms = 0;
+    for (int i = 0; i < 6; ++i) ms = (ms << 8) | id.bytes[i];
+    return ms;
+}
@@ -0,0 +1,217 @@
+// SessionIdBench.cpp
+// Checks and measures SessionId.h.
+//   1. ChaCha20 against the RFC 8439 block test vector.
+//   2. Version and variant bits, uniqueness over a million IDs, UUIDv7 order
+//      within a thread, registry formatting against snprintf, parse round trip.
+//   3. Forked child gets different IDs from its parent.
+//   4. IDs per second per thread: v4, v7, batched, and formatted to a registry
+//      string, on 1..N threads, plus heap allocations per ID (should be 0).
+//      The old per-call path (OS entropy call + wide string + conversion for
+//      every ID) is timed for comparison as getrandom + snprintf + std::string.
+// Usage: ./Run.sh SessionIdBench [millions of IDs per run]
+#include "SessionId.h"
+#include "MediaTypes.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Counts heap allocations so the per-ID paths can show they make none.
+// GCC flags malloc/free inside replaced operators once they are inlined into std::vector.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+std::atomic<uint64_t> heapAllocations(0);
+void* operator new(size_t size) {
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+bool CheckChaCha() {
+    // RFC 8439 section 2.3.2
+    uint32_t key[8], nonce[3] = { 0x09000000, 0x4a000000, 0x00000000 };
+    for (uint32_t i = 0; i < 8; ++i) key[i] = (4 * i) | ((4 * i + 1) << 8) | ((4 * i + 2) << 16) | ((4 * i + 3) << 24);
+    const uint8_t expected[64] = { 0x10, 0xf1, 0xe7, 0xe4, 0xd1, 0x3b, 0x59, 0x15, 0x50, 0x0f, 0xdd, 0x1f, 0xa3, 0x20, 0x71, 0xc4,
+                                   0xc7, 0xd1, 0xf4, 0xc7, 0x33, 0xc0, 0x68, 0x03, 0x04, 0x22, 0xaa, 0x9a, 0xc3, 0xd4, 0x6c, 0x4e,
+                                   0xd2, 0x82, 0x64, 0x46, 0x07, 0x9f, 0xaa, 0x09, 0x14, 0xc2, 0xd7, 0x05, 0xd9, 0x8b, 0x02, 0xa2,
+                                   0xb5, 0x12, 0x9c, 0xd1, 0xde, 0x16, 0x4e, 0xb9, 0xcb, 0xd0, 0x83, 0xe8, 0xa2, 0x50, 0x3c, 0x4e };
+    uint8_t out[64];
+    ChaCha20Block(key, 1, nonce, out);
+    const bool ok = memcmp(out, expected, 64) == 0;
+    printf("ChaCha20 RFC 8439 block vector: %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+bool CheckIds() {
+    IdGenerator& generator = ThreadIdGenerator();
+    const size_t count = 1000000;
+    std::vector<Uuid> v4(count), v7(count);
+    generator.NewV4(v4.data(), count / 2);
+    for (size_t i = count / 2; i < count; ++i) v4[i] = generator.NewV4();
+    generator.NewV7(v7.data(), count);
+
+    bool bits = true, ordered = true;
+    for (size_t i = 0; i < count; ++i) {
+        bits = bits && v4[i].Version() == 4 && (v4[i].bytes[8] & 0xC0) == 0x80 && v7[i].Version() == 7 && (v7[i].bytes[8] & 0xC0) == 0x80;
+        if (i > 0 && !(v7[i - 1] < v7[i])) ordered = false;
+    }
+    std::vector<Uuid> all(v4);
+    all.insert(all.end(), v7.begin(), v7.end());
+    std::sort(all.begin(), all.end());
+    const bool unique = std::adjacent_find(all.begin(), all.end()) == all.end();
+    const int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    const bool clock = llabs(static_cast<int64_t>(UuidV7Millis(v7.back())) - nowMs) < 5000;
+
+    bool format = true, parse = true;
+    for (size_t i = 0; i < 1000; ++i) {
+        const Uuid& id = i % 2 ? v4[i] : v7[i];
+        char registry[UUID_REGISTRY_LENGTH + 1], canonical[UUID_CANONICAL_LENGTH + 1], reference[64];
+        FormatRegistry(id, registry);
+        FormatCanonical(id, canonical);
+        const uint8_t* b = id.bytes;
+        snprintf(reference, sizeof(reference), "{%02X%02X%02X%02X-%02X%02X-%02X%02X-%02X%02X-%02X%02X%02X%02X%02X%02X}",
+                 b[0], b[1], b[2], b[3], b[4], b[5], b[6], b[7], b[8], b[9], b[10], b[11], b[12], b[13], b[14], b[15]);
+        format = format && strcmp(registry, reference) == 0 && strlen(registry) == UUID_REGISTRY_LENGTH;
+        for (char& c : reference) c = static_cast<char>(tolower(c));
+        format = format && memcmp(canonical, reference + 1, UUID_CANONICAL_LENGTH) == 0 && canonical[36] == '\0';
+        Uuid fromRegistry, fromCanonical;
+        parse = parse && ParseUuid(registry, strlen(registry), fromRegistry) && fromRegistry == id &&
+                ParseUuid(canonical, strlen(canonical), fromCanonical) && fromCanonical == id;
+    }
+    Uuid ignored;
+    parse = parse && !ParseUuid("{00000000-0000-0000-0000-00000000000G}", 38, ignored) && !ParseUuid("0000", 4, ignored);
+
+    printf("Version/variant bits: %s; %zu IDs unique: %s; v7 in creation order: %s, clock %s\n", bits ? "ok" : "FAILED",
+           all.size(), unique ? "ok" : "FAILED", ordered ? "ok" : "FAILED", clock ? "ok" : "FAILED");
+    printf("Registry/canonical format matches snprintf: %s; parse round trip: %s\n", format ? "ok" : "FAILED", parse ? "ok" : "FAILED");
+    return bits && unique && ordered && clock && format && parse;
+}
+
+// Parent and child draw right after fork; a shared buffer would give equal IDs
+bool CheckFork() {
+    ThreadIdGenerator().NewV4(); // Parent buffer now holds unused bytes the child inherits
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    pid_t pid = fork();
+    if (pid == 0) {
+        Uuid id = ThreadIdGenerator().NewV4();
+        ssize_t written = write(fds[1], id.bytes, 16);
+        _exit(written == 16 ? 0 : 1);
+    }
+    Uuid parent = ThreadIdGenerator().NewV4(), child;
+    ssize_t got = read(fds[0], child.bytes, 16);
+    waitpid(pid, nullptr, 0);
+    close(fds[0]);
+    close(fds[1]);
+    const bool ok = got == 16 && !(parent == child);
+    printf("Forked child draws different IDs: %s\n\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+enum class Mode { V4, V7, V4Batch, V4Registry, V7Registry, PerCall };
+
+// Returns IDs per second for one thread; checksum keeps the work from being optimised away
+double RunThread(Mode mode, size_t count, uint64_t& checksum) {
+    IdGenerator& generator = ThreadIdGenerator();
+    generator.NewV4(); // Seed outside the timing
+    Uuid batch[64];
+    char text[UUID_REGISTRY_LENGTH + 1];
+    uint64_t sum = 0;
+    const int64_t start = NowTicks();
+    switch (mode) {
+        case Mode::V4:
+            for (size_t i = 0; i < count; ++i) sum += generator.NewV4().bytes[15];
+            break;
+        case Mode::V7:
+            for (size_t i = 0; i < count; ++i) sum += generator.NewV7().bytes[15];
+            break;
+        case Mode::V4Batch:
+            for (size_t i = 0; i < count; i += 64) {
+                generator.NewV4(batch, 64);
+                sum += batch[63].bytes[15];
+            }
+            break;
+        case Mode::V4Registry:
+            for (size_t i = 0; i < count; ++i) {
+                FormatRegistry(generator.NewV4(), text);
+                sum += static_cast<uint8_t>(text[36]);
+            }
+            break;
+        case Mode::V7Registry:
+            for (size_t i = 0; i < count; ++i) {
+                FormatRegistry(generator.NewV7(), text);
+                sum += static_cast<uint8_t>(text[36]);
+            }
+            break;
+        case Mode::PerCall:
+            // What the old code did per ID, in Linux terms: an OS call for the GUID, then formatting
+            // through a temporary wide string into a new std::string
+            for (size_t i = 0; i < count; ++i) {
+                uint8_t b[16];
+                if (!OsRandomBytes(b, 16)) break;
+                wchar_t wide[39];
+                swprintf(wide, 39, L"{%02X%02X%02X%02X-%02X%02X-%02X%02X-%02X%02X-%02X%02X%02X%02X%02X%02X}",
+                         b[0], b[1], b[2], b[3], b[4], b[5], b[6], b[7], b[8], b[9], b[10], b[11], b[12], b[13], b[14], b[15]);
+                char narrow[39];
+                wcstombs(narrow, wide, 39);
+                std::string result = narrow;
+                sum += static_cast<uint8_t>(result[36]);
+            }
+            break;
+    }
+    const double seconds = (NowTicks() - start) / static_cast<double>(TICKS_PER_SECOND);
+    checksum += sum;
+    return count / seconds;
+}
+
+int main(int argc, char** argv) {
+    const double millions = argc > 1 ? atof(argv[1]) : 4.0;
+    const size_t count = static_cast<size_t>(millions * 1e6) / 64 * 64;
+    bool ok = CheckChaCha();
+    ok = CheckIds() && ok;
+    ok = CheckFork() && ok;
+
+    struct Case { const char* name; Mode mode; };
+    const Case cases[] = { { "v4", Mode::V4 }, { "v7", Mode::V7 }, { "v4 batch of 64", Mode::V4Batch },
+                           { "v4 + registry string", Mode::V4Registry }, { "v7 + registry string", Mode::V7Registry },
+                           { "per-call (old path)", Mode::PerCall } };
+    const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned> threadCounts = { 1 };
+    for (unsigned t = 2; t <= cores && t <= 8; t *= 2) threadCounts.push_back(t);
+    printf("Millions of IDs per second per thread (%u hardware threads):\n", cores);
+    printf("  %-22s", "");
+    for (unsigned t : threadCounts) printf("  %u thread%s", t, t > 1 ? "s" : " ");
+    printf("  allocations/ID\n");
+    uint64_t checksum = 0;
+    for (const Case& c : cases) {
+        printf("  %-22s", c.name);
+        const size_t perThread = c.mode == Mode::PerCall ? count / 16 : count;
+        uint64_t allocations = 0;
+        for (unsigned t : threadCounts) {
+            std::vector<double> rates(t);
+            std::vector<uint64_t> sums(t, 0);
+            std::vector<std::thread> threads;
+            threads.reserve(t);
+            const uint64_t before = heapAllocations.load();
+            for (unsigned i = 0; i < t; ++i) threads.emplace_back([&, i] { rates[i] = RunThread(c.mode, perThread, sums[i]); });
+            for (std::thread& thread : threads) thread.join();
+            if (t == 1) allocations = heapAllocations.load() - before;
+            double mean = 0;
+            for (double r : rates) mean += r / t;
+            for (uint64_t s : sums) checksum += s;
+            printf("  %8.1f", mean / 1e6);
+        }
+        // The thread itself allocates a little; per ID that rounds to zero unless the path allocates
+        printf("  %14.2f\n", static_cast<double>(allocations) / perThread);
+    }
+    printf("(checksum %llu)\n", static_cast<unsigned long long>(checksum));
+    return ok ? 0 : 1;
+}
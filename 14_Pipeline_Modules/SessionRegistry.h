@@ -0,0 +1,794 @@
+// SessionRegistry.h
+// Links session IDs to the recordings made during the session: file paths,
+// time ranges and devices. Two files per registry:
+//
+//   <base>.log   append-only records, each carrying a CRC32C. Records are never
+//                rewritten in place; this file is the source of truth.
+//   <base>.idx   memory-mapped open-addressing hash table from session ID to the
+//                session's newest record plus a summary (recording count, first
+//                start, last end).
+//
+// Every record points back at the previous record of the same session. A
+// lookup is one hash probe, then a walk over that session's own records only,
+// so its cost does not depend on how many sessions the registry holds.
+//
+// Crash safety: each record goes to the end of the log in one write. A torn or
+// corrupt tail fails its CRC and is cut off on the next open. The index is only
+// a cache of the log. It stores the log's generation ID and a clean flag, and
+// the flag is cleared while the registry is open. So after a crash, or when the
+// log does not match, the index is rebuilt from the log.
+//
+// Compact() writes the live records (no removed sessions, recording entries
+// merged with their end times) to new files. It then renames them into place,
+// log first. A crash between the two renames leaves an index whose generation
+// does not match the log, and that index is rebuilt.
+//
+// Recorders call AddRecording when a file is opened and FinishRecording when it
+// is closed. All times are 100-ns ticks since the Unix epoch (UnixTimeTicks).
+#pragma once
+
+#include "MediaTypes.h"
+#include "SessionId.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <array>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+// Constants
+const uint32_t REGISTRY_VERSION = 1;
+const uint32_t REGISTRY_MAX_DEVICE = 1024;      // Bytes of device name or session label
+const uint32_t REGISTRY_MAX_PATH = 32768;       // Bytes of recording path
+
+#pragma pack(push, 1)
+struct RegistryLogHeader {
+    char magic[8];          // "SESSLOG"
+    uint32_t version;
+    uint32_t reserved;
+    Uuid generation;        // New for every log file written; the index must carry the same one
+};
+
+struct RegistryRecordHeader {
+    uint32_t crc;           // CRC32C of the rest of the record, device and path included
+    uint16_t type;          // RegistryRecordType
+    uint16_t deviceLength;  // Bytes of device name (session label for REGISTRY_SESSION)
+    uint32_t pathLength;    // Bytes of recording path, after the device name
+    uint32_t reserved;
+    Uuid session;
+    uint64_t previous;      // Log offset of this session's previous record, 0 for none
+    int64_t start;          // Recording start, or session creation time
+    int64_t end;            // Recording end, 0 while the recording is open
+};
+
+struct RegistryIndexHeader {
+    char magic[8];          // "SESSIDX"
+    uint32_t version;
+    uint32_t clean;         // 1 only after Close synced log and index
+    Uuid generation;        // Of the log this index was built from
+    uint64_t capacity;      // Slots, a power of two
+    uint64_t count;         // Occupied slots, removed sessions included
+    uint64_t removed;
+    uint64_t indexedBytes;  // Log bytes the index covers
+};
+
+struct RegistryIndexSlot {
+    Uuid session;
+    uint64_t newest;        // Log offset of the newest record; 0 = empty slot
+    int64_t firstStart;
+    int64_t lastEnd;
+    uint32_t recordings;
+    uint32_t flags;         // REGISTRY_SLOT_REMOVED
+};
+#pragma pack(pop)
+
+enum RegistryRecordType : uint16_t {
+    REGISTRY_SESSION = 1,        // Session created: start = creation time, device = label
+    REGISTRY_RECORDING = 2,      // Recording file opened (or written whole, with end set)
+    REGISTRY_RECORDING_END = 3,  // Sets the end time of an earlier REGISTRY_RECORDING with this path
+    REGISTRY_REMOVED = 4,        // Session and everything before this record is gone
+};
+
+const uint32_t REGISTRY_SLOT_REMOVED = 1;
+
+// CRC32C (Castagnoli); SSE4.2 has an instruction for it, otherwise a byte table
+inline uint32_t Crc32c(const void* data, size_t size, uint32_t crc = 0) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+#if defined(__SSE4_2__)
+    for (; size >= 8; size -= 8, p += 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        crc = static_cast<uint32_t>(_mm_crc32_u64(crc, v));
+    }
+    for (; size > 0; --size) crc = _mm_crc32_u8(crc, *p++);
+#else
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t;
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = c & 1 ? (c >> 1) ^ 0x82F63B78u : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    for (; size > 0; --size) crc = table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+#endif
+    return ~crc;
+}
+
+// Slot hash; mixes both halves so UUIDv7's timestamp prefix does not cluster
+inline uint64_t SessionHash(const Uuid& id) {
+    uint64_t a, b;
+    memcpy(&a, id.bytes, 8);
+    memcpy(&b, id.bytes + 8, 8);
+    uint64_t h = a ^ (b * 0x9E3779B97F4A7C15ull);
+    h ^= h >> 32;
+    h *= 0xBF58476D1CE4E5B9ull;
+    return h ^ (h >> 29);
+}
+
+// Positioned reads and writes, resize, sync and a read/write mapping of one file
+class RegistryFile {
+public:
+    RegistryFile() = default;
+    RegistryFile(const RegistryFile&) = delete;
+    RegistryFile& operator=(const RegistryFile&) = delete;
+    ~RegistryFile() { Close(); }
+
+    // Open read/write, creating the file if it does not exist
+    bool Open(const std::string& path) {
+        Close();
+#ifdef _WIN32
+        handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (handle == INVALID_HANDLE_VALUE) {
+#else
+        fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+#endif
+            printf("Failed to open %s.\n", path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    void Close() {
+        Unmap();
+#ifdef _WIN32
+        if (handle != INVALID_HANDLE_VALUE) CloseHandle(handle);
+        handle = INVALID_HANDLE_VALUE;
+#else
+        if (fd >= 0) close(fd);
+        fd = -1;
+#endif
+    }
+
+    uint64_t Size() const {
+#ifdef _WIN32
+        LARGE_INTEGER size;
+        return GetFileSizeEx(handle, &size) ? static_cast<uint64_t>(size.QuadPart) : 0;
+#else
+        struct stat st;
+        return fstat(fd, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+#endif
+    }
+
+    bool ReadAt(uint64_t offset, void* out, size_t size) const {
+        uint8_t* p = static_cast<uint8_t*>(out);
+        while (size > 0) {
+#ifdef _WIN32
+            OVERLAPPED overlapped = {};
+            overlapped.Offset = static_cast<DWORD>(offset);
+            overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+            DWORD got = 0;
+            const DWORD request = static_cast<DWORD>(std::min<size_t>(size, 1u << 30));
+            if (!ReadFile(handle, p, request, &got, &overlapped) || got == 0) return false;
+#else
+            const ssize_t got = pread(fd, p, size, static_cast<off_t>(offset));
+            if (got <= 0) return false;
+#endif
+            p += got;
+            offset += static_cast<uint64_t>(got);
+            size -= static_cast<size_t>(got);
+        }
+        return true;
+    }
+
+    bool WriteAt(uint64_t offset, const void* data, size_t size) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        while (size > 0) {
+#ifdef _WIN32
+            OVERLAPPED overlapped = {};
+            overlapped.Offset = static_cast<DWORD>(offset);
+            overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+            DWORD written = 0;
+            const DWORD request = static_cast<DWORD>(std::min<size_t>(size, 1u << 30));
+            if (!WriteFile(handle, p, request, &written, &overlapped) || written == 0) return false;
+#else
+            const ssize_t written = pwrite(fd, p, size, static_cast<off_t>(offset));
+            if (written <= 0) return false;
+#endif
+            p += written;
+            offset += static_cast<uint64_t>(written);
+            size -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+
+    // Set the file length; the file must not be mapped
+    bool Resize(uint64_t size) {
+#ifdef _WIN32
+        LARGE_INTEGER position;
+        position.QuadPart = static_cast<LONGLONG>(size);
+        return SetFilePointerEx(handle, position, NULL, FILE_BEGIN) && SetEndOfFile(handle);
+#else
+        return ftruncate(fd, static_cast<off_t>(size)) == 0;
+#endif
+    }
+
+    // Flush file data to the device
+    bool Sync() {
+#ifdef _WIN32
+        return FlushFileBuffers(handle) != 0;
+#else
+        return fdatasync(fd) == 0;
+#endif
+    }
+
+    // Resize the file to size bytes and map all of it read/write
+    uint8_t* Map(uint64_t size) {
+        Unmap();
+        if (Size() != size && !Resize(size)) return nullptr;
+#ifdef _WIN32
+        mappingHandle = CreateFileMappingA(handle, NULL, PAGE_READWRITE, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), NULL);
+        if (mappingHandle) view = static_cast<uint8_t*>(MapViewOfFile(mappingHandle, FILE_MAP_ALL_ACCESS, 0, 0, static_cast<SIZE_T>(size)));
+#else
+        void* mapping = mmap(nullptr, static_cast<size_t>(size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping != MAP_FAILED) {
+            view = static_cast<uint8_t*>(mapping);
+            madvise(mapping, static_cast<size_t>(size), MADV_RANDOM);
+        }
+#endif
+        if (!view) {
+            Unmap();
+            return nullptr;
+        }
+        viewSize = size;
+        return view;
+    }
+
+    // Write dirty mapped pages back and flush them to the device
+    bool SyncMapping() {
+        if (!view) return false;
+#ifdef _WIN32
+        return FlushViewOfFile(view, 0) && FlushFileBuffers(handle);
+#else
+        return msync(view, static_cast<size_t>(viewSize), MS_SYNC) == 0;
+#endif
+    }
+
+    void Unmap() {
+#ifdef _WIN32
+        if (view) UnmapViewOfFile(view);
+        if (mappingHandle) CloseHandle(mappingHandle);
+        mappingHandle = NULL;
+#else
+        if (view) munmap(view, static_cast<size_t>(viewSize));
+#endif
+        view = nullptr;
+        viewSize = 0;
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE handle = INVALID_HANDLE_VALUE;
+    HANDLE mappingHandle = NULL;
+#else
+    int fd = -1;
+#endif
+    uint8_t* view = nullptr;
+    uint64_t viewSize = 0;
+};
+
+// Atomically replace to with from, and make the rename itself durable
+inline bool RenameOver(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    if (rename(from.c_str(), to.c_str()) != 0) return false;
+    const size_t slash = to.find_last_of('/');
+    const std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : to.substr(0, slash);
+    const int dirFd = open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+    if (dirFd >= 0) {
+        fsync(dirFd);
+        close(dirFd);
+    }
+    return true;
+#endif
+}
+
+struct RegistryConfig {
+    uint64_t initialCapacity = 1 << 16;  // Index slots; doubles whenever more than 5/8 are used
+    bool syncEachRecord = false;         // Flush the log after every record instead of at Sync/Close
+};
+
+struct RecordingEntry {
+    std::string path;
+    std::string device;
+    int64_t start = 0;
+    int64_t end = 0;        // 0 = still open, or the recorder died before finishing it
+};
+
+// What the index alone knows about a session
+struct SessionSummary {
+    int64_t firstStart = 0;
+    int64_t lastEnd = 0;
+    uint32_t recordings = 0; // REGISTRY_RECORDING records, before merging repeated paths
+};
+
+struct SessionRecord {
+    std::string label;
+    int64_t created = 0;                    // 0 when only recordings were registered
+    std::vector<RecordingEntry> recordings; // In start order
+};
+
+class SessionRegistry {
+public:
+    SessionRegistry() = default;
+    SessionRegistry(const SessionRegistry&) = delete;
+    SessionRegistry& operator=(const SessionRegistry&) = delete;
+    ~SessionRegistry() { Close(); }
+
+    // Open or create <basePath>.log and <basePath>.idx; recovers from a crash if needed
+    bool Open(const std::string& basePath, const RegistryConfig& registryConfig = RegistryConfig()) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return OpenLocked(basePath, registryConfig);
+    }
+
+    // Sync everything and mark the index clean so the next Open can trust it
+    void Close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        CloseLocked();
+    }
+
+    bool AddSession(const Uuid& id, int64_t created, const std::string& label) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return Append(REGISTRY_SESSION, id, created, 0, label, std::string());
+    }
+
+    // end = 0 while the file is still being written; FinishRecording sets it later
+    bool AddRecording(const Uuid& id, const std::string& path, const std::string& device, int64_t start, int64_t end = 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return Append(REGISTRY_RECORDING, id, start, end, device, path);
+    }
+
+    bool FinishRecording(const Uuid& id, const std::string& path, int64_t end) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return Append(REGISTRY_RECORDING_END, id, 0, end, std::string(), path);
+    }
+
+    bool RemoveSession(const Uuid& id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        const RegistryIndexSlot* slot = index ? Probe(id) : nullptr;
+        if (!slot || slot->newest == 0 || (slot->flags & REGISTRY_SLOT_REMOVED)) return false;
+        return Append(REGISTRY_REMOVED, id, 0, 0, std::string(), std::string());
+    }
+
+    // Index only: one probe, no file reads
+    bool Find(const Uuid& id, SessionSummary& summary) {
+        std::lock_guard<std::mutex> lock(mutex);
+        const RegistryIndexSlot* slot = index ? Probe(id) : nullptr;
+        if (!slot || slot->newest == 0 || (slot->flags & REGISTRY_SLOT_REMOVED)) return false;
+        summary.firstStart = slot->firstStart;
+        summary.lastEnd = slot->lastEnd;
+        summary.recordings = slot->recordings;
+        return true;
+    }
+
+    // Label, creation time and recordings of a session; reads only that session's records
+    bool Lookup(const Uuid& id, SessionRecord& record) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return LookupLocked(id, record);
+    }
+
+    // Make everything appended so far durable
+    bool Sync() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return index && log.Sync() && indexFile.SyncMapping();
+    }
+
+    // Rewrite the log without removed sessions and with recording ends merged in
+    bool Compact() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!index) return false;
+        const std::string compactBase = basePath + ".compact";
+        remove((compactBase + ".log").c_str());
+        remove((compactBase + ".idx").c_str());
+
+        RegistryConfig compactConfig = config;
+        compactConfig.syncEachRecord = false;
+        compactConfig.initialCapacity = std::max<uint64_t>(config.initialCapacity, CapacityFor(Header()->count - Header()->removed));
+        const uint64_t before = logSize;
+        {
+            SessionRegistry compacted;
+            if (!compacted.Open(compactBase, compactConfig)) return false;
+            const uint64_t capacity = Header()->capacity;
+            SessionRecord record;
+            for (uint64_t i = 0; i < capacity; ++i) {
+                const RegistryIndexSlot& slot = Slots()[i];
+                if (slot.newest == 0 || (slot.flags & REGISTRY_SLOT_REMOVED)) continue;
+                const Uuid id = slot.session;
+                if (!LookupLocked(id, record)) return false;
+                if ((record.created != 0 || !record.label.empty()) && !compacted.AddSession(id, record.created, record.label)) return false;
+                for (const RecordingEntry& entry : record.recordings) {
+                    if (!compacted.AddRecording(id, entry.path, entry.device, entry.start, entry.end)) return false;
+                }
+            }
+            compacted.Close();
+        }
+
+        // Log first: if the index rename is lost, its generation no longer matches and it is rebuilt
+        const std::string path = basePath;
+        const RegistryConfig reopenConfig = config;
+        CloseLocked();
+        const bool replaced = RenameOver(compactBase + ".log", path + ".log") && RenameOver(compactBase + ".idx", path + ".idx");
+        // Reopen either way so the registry stays usable on whichever log is in place
+        if (!OpenLocked(path, reopenConfig)) return false;
+        if (!replaced) {
+            printf("Failed to replace %s.log with its compacted copy.\n", path.c_str());
+            return false;
+        }
+        printf("Compacted %s.log: %llu -> %llu bytes.\n", path.c_str(), static_cast<unsigned long long>(before),
+               static_cast<unsigned long long>(logSize));
+        return true;
+    }
+
+    uint64_t Sessions() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return index ? Header()->count - Header()->removed : 0;
+    }
+
+    uint64_t LogBytes() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return logSize;
+    }
+
+    // True if Open had to rebuild the index from the log
+    bool Rebuilt() const { return rebuilt; }
+
+    bool IsOpen() const { return index != nullptr; }
+
+private:
+    bool OpenLocked(const std::string& path, const RegistryConfig& registryConfig) {
+        CloseLocked();
+        basePath = path;
+        config = registryConfig;
+        if (!log.Open(basePath + ".log")) return false;
+        logSize = log.Size();
+        RegistryLogHeader header = {};
+        // A log shorter than its header cannot hold a record; start it over
+        if (logSize < sizeof(header)) {
+            memcpy(header.magic, "SESSLOG", 8);
+            header.version = REGISTRY_VERSION;
+            header.generation = ThreadIdGenerator().NewV4();
+            if (!log.Resize(0) || !log.WriteAt(0, &header, sizeof(header)) || !log.Sync()) {
+                printf("Failed to create %s.log.\n", basePath.c_str());
+                log.Close();
+                return false;
+            }
+            logSize = sizeof(header);
+        } else if (!log.ReadAt(0, &header, sizeof(header)) || memcmp(header.magic, "SESSLOG", 8) != 0 || header.version != REGISTRY_VERSION) {
+            printf("%s.log is not a session log.\n", basePath.c_str());
+            log.Close();
+            return false;
+        }
+        generation = header.generation;
+        if (!OpenIndex()) {
+            index = nullptr; // A half-built index must not be marked clean
+            CloseLocked();
+            return false;
+        }
+        return true;
+    }
+
+    void CloseLocked() {
+        if (index) {
+            const bool logSynced = log.Sync();
+            Header()->indexedBytes = logSize;
+            // Only after everything it describes is on disk; otherwise the next Open rebuilds
+            if (indexFile.SyncMapping() && logSynced) {
+                Header()->clean = 1;
+                indexFile.SyncMapping();
+            } else {
+                printf("Failed to sync %s; its index will be rebuilt on the next open.\n", basePath.c_str());
+            }
+        }
+        index = nullptr;
+        indexFile.Close();
+        log.Close();
+        logSize = 0;
+    }
+
+    bool OpenIndex() {
+        if (!indexFile.Open(basePath + ".idx")) return false;
+        const uint64_t size = indexFile.Size();
+        rebuilt = true;
+        if (size >= sizeof(RegistryIndexHeader) && (index = indexFile.Map(size)) != nullptr) {
+            const RegistryIndexHeader* header = Header();
+            const bool valid = memcmp(header->magic, "SESSIDX", 8) == 0 && header->version == REGISTRY_VERSION &&
+                               header->generation == generation && header->capacity != 0 &&
+                               (header->capacity & (header->capacity - 1)) == 0 && size == IndexSize(header->capacity) &&
+                               header->indexedBytes >= sizeof(RegistryLogHeader) && header->indexedBytes <= logSize;
+            rebuilt = !valid || !header->clean;
+        }
+        if (rebuilt) {
+            if (size > 0) printf("Rebuilding %s.idx from the log.\n", basePath.c_str());
+            if (!CreateIndex(CapacityFor(0)) || !ScanLog(sizeof(RegistryLogHeader))) return false;
+        } else if (Header()->indexedBytes < logSize && !ScanLog(Header()->indexedBytes)) {
+            return false;
+        }
+        // From here until Close a crash leaves the index untrusted
+        Header()->clean = 0;
+        return indexFile.SyncMapping();
+    }
+
+    bool CreateIndex(uint64_t capacity) {
+        index = indexFile.Map(IndexSize(capacity));
+        if (!index) {
+            printf("Failed to map %s.idx.\n", basePath.c_str());
+            return false;
+        }
+        memset(index, 0, static_cast<size_t>(IndexSize(capacity)));
+        RegistryIndexHeader* header = Header();
+        memcpy(header->magic, "SESSIDX", 8);
+        header->version = REGISTRY_VERSION;
+        header->generation = generation;
+        header->capacity = capacity;
+        header->indexedBytes = sizeof(RegistryLogHeader);
+        return true;
+    }
+
+    // Index every valid record from offset on; cut the log at the first torn or corrupt one. A read
+    // error fails the open instead, so a transient fault never truncates good records.
+    bool ScanLog(uint64_t offset) {
+        std::vector<uint8_t> buffer;
+        uint64_t bufferStart = 0;
+        const size_t chunk = 1 << 20;
+        while (offset < logSize) {
+            RegistryRecordHeader header;
+            if (logSize - offset < sizeof(header)) break;
+            // Keep a window of the log in memory so small records do not cost a read each
+            if (offset < bufferStart || offset + sizeof(header) > bufferStart + buffer.size()) {
+                buffer.resize(static_cast<size_t>(std::min<uint64_t>(chunk, logSize - offset)));
+                if (!log.ReadAt(offset, buffer.data(), buffer.size())) return ReadFailed(offset);
+                bufferStart = offset;
+            }
+            memcpy(&header, buffer.data() + (offset - bufferStart), sizeof(header));
+            if (header.type < REGISTRY_SESSION || header.type > REGISTRY_REMOVED || header.deviceLength > REGISTRY_MAX_DEVICE ||
+                header.pathLength > REGISTRY_MAX_PATH || header.previous >= offset) {
+                break;
+            }
+            const uint64_t total = sizeof(header) + header.deviceLength + header.pathLength;
+            if (logSize - offset < total) break;
+            if (offset + total > bufferStart + buffer.size()) {
+                buffer.resize(static_cast<size_t>(std::max<uint64_t>(total, std::min<uint64_t>(chunk, logSize - offset))));
+                if (!log.ReadAt(offset, buffer.data(), buffer.size())) return ReadFailed(offset);
+                bufferStart = offset;
+            }
+            const uint8_t* record = buffer.data() + (offset - bufferStart);
+            if (Crc32c(record + 4, static_cast<size_t>(total - 4)) != header.crc) break;
+            if (!Reserve(Header()->count + 1)) return false;
+            Apply(*Probe(header.session), header, offset);
+            offset += total;
+        }
+        if (offset < logSize) {
+            printf("Dropping %llu bytes of torn or corrupt records at the end of %s.log.\n",
+                   static_cast<unsigned long long>(logSize - offset), basePath.c_str());
+            if (!log.Resize(offset)) return false;
+            logSize = offset;
+        }
+        Header()->indexedBytes = logSize;
+        return true;
+    }
+
+    bool ReadFailed(uint64_t offset) {
+        printf("Failed to read %s.log at offset %llu.\n", basePath.c_str(), static_cast<unsigned long long>(offset));
+        return false;
+    }
+
+    bool Append(uint16_t type, const Uuid& id, int64_t start, int64_t end, const std::string& device, const std::string& path) {
+        if (!index) return false;
+        static const Uuid nil = {};
+        if (id == nil || device.size() > REGISTRY_MAX_DEVICE || path.size() > REGISTRY_MAX_PATH) {
+            printf("Rejected session registry record: nil ID or name too long.\n");
+            return false;
+        }
+        if (!Reserve(Header()->count + 1)) return false;
+        RegistryIndexSlot* slot = Probe(id);
+
+        RegistryRecordHeader header = {};
+        header.type = type;
+        header.deviceLength = static_cast<uint16_t>(device.size());
+        header.pathLength = static_cast<uint32_t>(path.size());
+        header.session = id;
+        header.previous = slot->newest;
+        header.start = start;
+        header.end = end;
+        record.resize(sizeof(header) + device.size() + path.size());
+        memcpy(record.data() + sizeof(header), device.data(), device.size());
+        memcpy(record.data() + sizeof(header) + device.size(), path.data(), path.size());
+        memcpy(record.data(), &header, sizeof(header));
+        header.crc = Crc32c(record.data() + 4, record.size() - 4);
+        memcpy(record.data(), &header.crc, 4);
+
+        if (!log.WriteAt(logSize, record.data(), record.size()) || (config.syncEachRecord && !log.Sync())) {
+            printf("Failed to append to %s.log.\n", basePath.c_str());
+            log.Resize(logSize); // Do not leave a partial record for the next append to follow
+            return false;
+        }
+        Apply(*slot, header, logSize);
+        logSize += record.size();
+        Header()->indexedBytes = logSize;
+        return true;
+    }
+
+    // Fold one record into its session's slot
+    void Apply(RegistryIndexSlot& slot, const RegistryRecordHeader& header, uint64_t offset) {
+        RegistryIndexHeader* indexHeader = Header();
+        if (slot.newest == 0) {
+            slot.session = header.session;
+            ++indexHeader->count;
+        }
+        if (header.type == REGISTRY_REMOVED) {
+            if (!(slot.flags & REGISTRY_SLOT_REMOVED)) ++indexHeader->removed;
+            slot.flags |= REGISTRY_SLOT_REMOVED;
+            slot.firstStart = slot.lastEnd = 0;
+            slot.recordings = 0;
+        } else if (slot.flags & REGISTRY_SLOT_REMOVED) {
+            // Same ID used again: a new session from here on
+            slot.flags &= ~REGISTRY_SLOT_REMOVED;
+            --indexHeader->removed;
+        }
+        if (header.type == REGISTRY_RECORDING) {
+            if (slot.recordings == 0 || header.start < slot.firstStart) slot.firstStart = header.start;
+            ++slot.recordings;
+        }
+        if (header.type == REGISTRY_RECORDING || header.type == REGISTRY_RECORDING_END) slot.lastEnd = std::max<int64_t>(slot.lastEnd, header.end);
+        slot.newest = offset;
+    }
+
+    bool LookupLocked(const Uuid& id, SessionRecord& result) {
+        result.label.clear();
+        result.created = 0;
+        result.recordings.clear();
+        const RegistryIndexSlot* slot = index ? Probe(id) : nullptr;
+        if (!slot || slot->newest == 0 || (slot->flags & REGISTRY_SLOT_REMOVED)) return false;
+
+        // Newest first: the first record seen for a path wins, and end records fill in open recordings
+        ends.clear();
+        bool haveSession = false;
+        for (uint64_t offset = slot->newest; offset != 0;) {
+            RegistryRecordHeader header;
+            if (!ReadRecord(offset, header) || !(header.session == id)) {
+                printf("Session registry record at %llu is damaged.\n", static_cast<unsigned long long>(offset));
+                return false;
+            }
+            if (header.type == REGISTRY_REMOVED) break;
+            const std::string device(reinterpret_cast<const char*>(record.data() + sizeof(header)), header.deviceLength);
+            const std::string path(reinterpret_cast<const char*>(record.data() + sizeof(header) + header.deviceLength), header.pathLength);
+            if (header.type == REGISTRY_SESSION && !haveSession) {
+                result.label = device;
+                result.created = header.start;
+                haveSession = true;
+            } else if (header.type == REGISTRY_RECORDING_END) {
+                if (std::find_if(ends.begin(), ends.end(), [&](const RecordingEntry& e) { return e.path == path; }) == ends.end()) {
+                    RecordingEntry end;
+                    end.path = path;
+                    end.end = header.end;
+                    ends.push_back(end);
+                }
+            } else if (header.type == REGISTRY_RECORDING) {
+                auto seen = [&](const RecordingEntry& e) { return e.path == path; };
+                if (std::find_if(result.recordings.begin(), result.recordings.end(), seen) == result.recordings.end()) {
+                    RecordingEntry entry;
+                    entry.path = path;
+                    entry.device = device;
+                    entry.start = header.start;
+                    entry.end = header.end;
+                    auto finished = std::find_if(ends.begin(), ends.end(), seen);
+                    if (entry.end == 0 && finished != ends.end()) entry.end = finished->end;
+                    result.recordings.push_back(entry);
+                }
+            }
+            offset = header.previous;
+        }
+        std::stable_sort(result.recordings.begin(), result.recordings.end(),
+                         [](const RecordingEntry& a, const RecordingEntry& b) { return a.start < b.start; });
+        return true;
+    }
+
+    // Read and check one record into `record`; most take a single read
+    bool ReadRecord(uint64_t offset, RegistryRecordHeader& header) {
+        if (offset < sizeof(RegistryLogHeader) || logSize - offset < sizeof(header)) return false;
+        record.resize(sizeof(header) + 192);
+        size_t have = static_cast<size_t>(std::min<uint64_t>(record.size(), logSize - offset));
+        if (!log.ReadAt(offset, record.data(), have)) return false;
+        memcpy(&header, record.data(), sizeof(header));
+        const uint64_t total = sizeof(header) + header.deviceLength + header.pathLength;
+        if (header.deviceLength > REGISTRY_MAX_DEVICE || header.pathLength > REGISTRY_MAX_PATH || logSize - offset < total ||
+            header.previous >= offset) {
+            return false;
+        }
+        if (total > have) {
+            record.resize(static_cast<size_t>(total));
+            if (!log.ReadAt(offset + have, record.data() + have, static_cast<size_t>(total) - have)) return false;
+        }
+        return Crc32c(record.data() + 4, static_cast<size_t>(total - 4)) == header.crc;
+    }
+
+    // Slot holding id, or the empty slot where it would go (linear probing)
+    RegistryIndexSlot* Probe(const Uuid& id) const {
+        const uint64_t mask = Header()->capacity - 1;
+        RegistryIndexSlot* slots = Slots();
+        for (uint64_t i = SessionHash(id) & mask;; i = (i + 1) & mask) {
+            if (slots[i].newest == 0 || slots[i].session == id) return &slots[i];
+        }
+    }
+
+    // Grow the table so `count` sessions stay under 5/8 full
+    bool Reserve(uint64_t count) {
+        const uint64_t capacity = Header()->capacity;
+        if (count * 8 <= capacity * 5) return true;
+        const uint64_t newCapacity = CapacityFor(count);
+        const RegistryIndexHeader header = *Header();
+        std::vector<RegistryIndexSlot> used;
+        used.reserve(static_cast<size_t>(header.count));
+        for (uint64_t i = 0; i < capacity; ++i) {
+            if (Slots()[i].newest != 0) used.push_back(Slots()[i]);
+        }
+        if (!CreateIndex(newCapacity)) return false;
+        *Header() = header;
+        Header()->capacity = newCapacity;
+        for (const RegistryIndexSlot& slot : used) *Probe(slot.session) = slot;
+        return true;
+    }
+
+    uint64_t CapacityFor(uint64_t count) const {
+        uint64_t capacity = 64;
+        while (capacity < config.initialCapacity || count * 8 > capacity * 5) capacity *= 2;
+        return capacity;
+    }
+
+    static uint64_t IndexSize(uint64_t capacity) { return sizeof(RegistryIndexHeader) + capacity * sizeof(RegistryIndexSlot); }
+    RegistryIndexHeader* Header() const { return reinterpret_cast<RegistryIndexHeader*>(index); }
+    RegistryIndexSlot* Slots() const { return reinterpret_cast<RegistryIndexSlot*>(index + sizeof(RegistryIndexHeader)); }
+
+    std::mutex mutex;
+    std::string basePath;
+    RegistryConfig config;
+    RegistryFile log;
+    RegistryFile indexFile;
+    uint8_t* index = nullptr;
+    uint64_t logSize = 0;
+    Uuid generation = {};
+    bool rebuilt = false;
+    std::vector<uint8_t> record;       // Scratch for one record
+    std::vector<RecordingEntry> ends;  // Scratch for Lookup
+};
@@ -0,0 +1,289 @@
+// SrtOutput.h
+// Sends the livestream's MPEG-TS over SRT, for lossy links where RTMP's TCP
+// connection stalls for seconds after each loss. SRT resends lost packets
+// within a fixed latency window. It drops what would still arrive later than
+// that, so the delay stays bounded and a loss shows as a brief glitch rather
+// than a stall.
+//   SrtConfig     - the listener to connect to, the latency window, and how far
+//                   resends may go over the stream's bitrate (the overhead
+//                   budget)
+//   ParseSrtUrl   - srt://host:port?latency=<ms>&oheadbw=<percent>&streamid=<id>;
+//                   latency is in milliseconds, as srt-live-transmit takes it.
+//                   An IPv6 host goes in brackets; the stream id may be
+//                   percent-encoded
+//   FfmpegSrtUrl  - the same settings as ffmpeg's srt:// options (latency in
+//                   microseconds), for an ffmpeg relay when libsrt is not built in
+//   SrtStats      - RTT, send rate, loss, resends and late drops, summed over
+//                   connections
+//   SrtSink       - StreamSink on a libsrt caller socket; needs HAVE_SRT.
+//                   Each chunk goes out at once, in messages of up to seven TS
+//                   packets (1316 bytes, what every SRT receiver takes). A
+//                   short message is sent as it is, never held back to fill.
+#pragma once
+
+#include "MediaTypes.h"
+#include "StreamFanout.h"
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#ifdef HAVE_SRT
+#include <srt/srt.h>
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <netdb.h>
+#include <sys/socket.h>
+#endif
+#endif
+
+const size_t SRT_MESSAGE_BYTES = 7 * 188;
+
+struct SrtConfig {
+    std::string host;
+    int port = 0;
+    int latencyMs = 120;       // Receiver buffer: how long a lost packet has to be resent
+    int overheadPercent = 25;  // Bandwidth for resends, over the stream's own bitrate
+    int connectTimeoutMs = 3000;
+    std::string streamId;      // For ingest servers that take the stream key this way
+};
+
+// %XX escapes back to bytes; anything else is kept as it is
+inline std::string PercentDecode(const std::string& text) {
+    std::string decoded;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '%' && i + 2 < text.size() && isxdigit(static_cast<unsigned char>(text[i + 1])) &&
+            isxdigit(static_cast<unsigned char>(text[i + 2]))) {
+            decoded += static_cast<char>(strtol(text.substr(i + 1, 2).c_str(), nullptr, 16));
+            i += 2;
+        } else {
+            decoded += text[i];
+        }
+    }
+    return decoded;
+}
+
+// Escape everything but RFC 3986's unreserved characters, so a value cannot end its query field
+inline std::string PercentEncode(const std::string& text) {
+    static const char HEX[] = "0123456789ABCDEF";
+    std::string encoded;
+    for (char c : text) {
+        const unsigned char byte = static_cast<unsigned char>(c);
+        if (isalnum(byte) || c == '-' || c == '.' || c == '_' || c == '~') {
+            encoded += c;
+        } else {
+            encoded += '%';
+            encoded += HEX[byte >> 4];
+            encoded += HEX[byte & 15];
+        }
+    }
+    return encoded;
+}
+
+// srt://host:port with optional latency, oheadbw, streamid and conntimeo; false if it is not one
+inline bool ParseSrtUrl(const std::string& url, SrtConfig& config) {
+    const std::string scheme = "srt://";
+    if (url.compare(0, scheme.size(), scheme) != 0) return false;
+    const size_t query = url.find('?', scheme.size());
+    const std::string address = url.substr(scheme.size(), query == std::string::npos ? std::string::npos : query - scheme.size());
+    size_t colon;
+    if (!address.empty() && address[0] == '[') {
+        // [IPv6]:port
+        const size_t close = address.find(']');
+        if (close == std::string::npos || close == 1) return false;
+        colon = close + 1;
+        if (colon >= address.size() || address[colon] != ':') return false;
+        config.host = address.substr(1, close - 1);
+    } else {
+        colon = address.find(':');
+        if (colon == std::string::npos || colon == 0 || address.find(':', colon + 1) != std::string::npos) return false;
+        config.host = address.substr(0, colon);
+    }
+    char* end = nullptr;
+    const long port = strtol(address.c_str() + colon + 1, &end, 10);
+    if (*end != 0 || port <= 0 || port > 65535) return false;
+    config.port = static_cast<int>(port);
+
+    for (size_t at = query; at != std::string::npos && at < url.size();) {
+        const size_t next = url.find('&', at + 1);
+        const std::string pair = url.substr(at + 1, next == std::string::npos ? std::string::npos : next - at - 1);
+        const size_t equals = pair.find('=');
+        if (equals != std::string::npos) {
+            const std::string key = pair.substr(0, equals), value = pair.substr(equals + 1);
+            if (key == "latency") config.latencyMs = atoi(value.c_str());
+            else if (key == "oheadbw") config.overheadPercent = atoi(value.c_str());
+            else if (key == "conntimeo") config.connectTimeoutMs = atoi(value.c_str());
+            else if (key == "streamid") config.streamId = PercentDecode(value);
+        }
+        at = next;
+    }
+    // SRT takes 5 to 100 percent of overhead
+    return config.latencyMs >= 0 && config.overheadPercent >= 5 && config.overheadPercent <= 100;
+}
+
+// The URL ffmpeg's own srt:// output takes for the same settings
+inline std::string FfmpegSrtUrl(const SrtConfig& config) {
+    const std::string host = config.host.find(':') != std::string::npos ? "[" + config.host + "]" : config.host;
+    std::string url = "srt://" + host + ":" + std::to_string(config.port) + "?mode=caller&transtype=live" +
+                      "&latency=" + std::to_string(static_cast<int64_t>(config.latencyMs) * 1000) +
+                      "&oheadbw=" + std::to_string(config.overheadPercent) + "&pkt_size=" + std::to_string(SRT_MESSAGE_BYTES) +
+                      "&connect_timeout=" + std::to_string(config.connectTimeoutMs);
+    if (!config.streamId.empty()) url += "&streamid=" + PercentEncode(config.streamId);
+    return url;
+}
+
+struct SrtStats {
+    uint32_t connections = 0;
+    double rttMs = 0;            // Latest, on the current or last connection
+    double sendMbps = 0;
+    double bandwidthMbps = 0;    // The link's capacity as SRT estimates it
+    int64_t packetsSent = 0;
+    int64_t packetsLost = 0;     // Reported lost by the receiver
+    int64_t packetsResent = 0;
+    int64_t packetsDropped = 0;  // Not resent in time: the viewer sees these as glitches
+    int64_t sendBufferMs = 0;
+};
+
+inline void PrintSrtStats(FILE* out, const char* label, const SrtStats& s) {
+    fprintf(out, "%s rtt %.1f ms, send %.2f Mbps of %.1f estimated, %lld packets: %lld lost (%.2f%%), %lld resent, %lld dropped late; "
+                 "%lld ms in the send buffer; %u connections\n",
+            label, s.rttMs, s.sendMbps, s.bandwidthMbps, static_cast<long long>(s.packetsSent), static_cast<long long>(s.packetsLost),
+            s.packetsSent ? 100.0 * s.packetsLost / s.packetsSent : 0.0, static_cast<long long>(s.packetsResent),
+            static_cast<long long>(s.packetsDropped), static_cast<long long>(s.sendBufferMs), s.connections);
+}
+
+#ifdef HAVE_SRT
+
+class SrtSink : public StreamSink {
+public:
+    // log, if given, gets the connection's stats every statsTicks, tagged with name
+    SrtSink(const SrtConfig& settings, FILE* logFile = nullptr, const std::string& logName = "srt",
+            int64_t statsTicks = 5 * TICKS_PER_SECOND)
+        : config(settings), log(logFile), name(logName), statsInterval(statsTicks) {
+        srt_startup();
+    }
+    SrtSink(const SrtSink&) = delete;
+    SrtSink& operator=(const SrtSink&) = delete;
+    ~SrtSink() override {
+        Close();
+        srt_cleanup();
+    }
+
+    bool Open() override {
+        Close();
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_DGRAM;
+        addrinfo* address = nullptr;
+        if (getaddrinfo(config.host.c_str(), std::to_string(config.port).c_str(), &hints, &address) != 0 || !address) {
+            Log("cannot resolve %s\n", config.host.c_str());
+            return false;
+        }
+        sock = srt_create_socket();
+        // Live mode first: it resets the other options to its defaults
+        const int live = SRTT_LIVE;
+        const int latency = config.latencyMs, overhead = config.overheadPercent, timeout = config.connectTimeoutMs;
+        const int payload = static_cast<int>(SRT_MESSAGE_BYTES);
+        const int64_t relativeBandwidth = 0, estimateInput = 0; // Overhead on top of the measured input rate
+        const bool yes = true;
+        bool ok = sock != SRT_INVALID_SOCK && srt_setsockflag(sock, SRTO_TRANSTYPE, &live, sizeof(live)) != SRT_ERROR &&
+                  srt_setsockflag(sock, SRTO_LATENCY, &latency, sizeof(latency)) != SRT_ERROR &&
+                  srt_setsockflag(sock, SRTO_PAYLOADSIZE, &payload, sizeof(payload)) != SRT_ERROR &&
+                  srt_setsockflag(sock, SRTO_MAXBW, &relativeBandwidth, sizeof(relativeBandwidth)) != SRT_ERROR &&
+                  srt_setsockflag(sock, SRTO_INPUTBW, &estimateInput, sizeof(estimateInput)) != SRT_ERROR &&
+                  srt_setsockflag(sock, SRTO_OHEADBW, &overhead, sizeof(overhead)) != SRT_ERROR &&
+                  srt_setsockflag(sock, SRTO_TLPKTDROP, &yes, sizeof(yes)) != SRT_ERROR &&
+                  srt_setsockflag(sock, SRTO_SNDSYN, &yes, sizeof(yes)) != SRT_ERROR &&
+                  srt_setsockflag(sock, SRTO_CONNTIMEO, &timeout, sizeof(timeout)) != SRT_ERROR;
+        if (ok && !config.streamId.empty()) {
+            ok = srt_setsockflag(sock, SRTO_STREAMID, config.streamId.c_str(), static_cast<int>(config.streamId.size())) != SRT_ERROR;
+        }
+        ok = ok && srt_connect(sock, address->ai_addr, static_cast<int>(address->ai_addrlen)) != SRT_ERROR;
+        freeaddrinfo(address);
+        if (!ok) {
+            Log("connect to %s:%d failed: %s\n", config.host.c_str(), config.port, srt_getlasterror_str());
+            if (sock != SRT_INVALID_SOCK) srt_close(sock);
+            sock = SRT_INVALID_SOCK;
+            return false;
+        }
+        ++totals.connections;
+        lastStats = NowTicks();
+        return true;
+    }
+
+    bool Write(const uint8_t* data, size_t bytes) override {
+        if (sock == SRT_INVALID_SOCK) return false;
+        for (size_t at = 0; at < bytes; at += SRT_MESSAGE_BYTES) {
+            const size_t length = bytes - at < SRT_MESSAGE_BYTES ? bytes - at : SRT_MESSAGE_BYTES;
+            if (srt_sendmsg2(sock, reinterpret_cast<const char*>(data + at), static_cast<int>(length), nullptr) == SRT_ERROR) {
+                Log("send failed: %s\n", srt_getlasterror_str());
+                return false;
+            }
+        }
+        const int64_t now = NowTicks();
+        if (log && now - lastStats >= statsInterval) {
+            lastStats = now;
+            PrintSrtStats(log, ("[" + name + "]").c_str(), Stats());
+            fflush(log);
+        }
+        return true;
+    }
+
+    void Close() override {
+        if (sock == SRT_INVALID_SOCK) return;
+        totals = Stats(); // Keep this connection's counters
+        srt_close(sock);
+        sock = SRT_INVALID_SOCK;
+    }
+
+    // The send buffer: sent but not yet acknowledged, or waiting for bandwidth
+    int64_t QueuedTicks() override {
+        SRT_TRACEBSTATS perf;
+        if (sock == SRT_INVALID_SOCK || srt_bstats(sock, &perf, 0) == SRT_ERROR) return 0;
+        return static_cast<int64_t>(perf.msSndBuf) * TICKS_PER_SECOND / 1000;
+    }
+
+    void PrintStats(FILE* out) const override { PrintSrtStats(out, "    srt", Stats()); }
+
+    // Counters over every connection so far, the current one included
+    SrtStats Stats() const {
+        SrtStats stats = totals;
+        SRT_TRACEBSTATS perf;
+        if (sock == SRT_INVALID_SOCK || srt_bstats(sock, &perf, 0) == SRT_ERROR) return stats;
+        stats.rttMs = perf.msRTT;
+        stats.sendMbps = perf.mbpsSendRate;
+        stats.bandwidthMbps = perf.mbpsBandwidth;
+        stats.packetsSent += perf.pktSentTotal;
+        stats.packetsLost += perf.pktSndLossTotal;
+        stats.packetsResent += perf.pktRetransTotal;
+        stats.packetsDropped += perf.pktSndDropTotal;
+        stats.sendBufferMs = perf.msSndBuf;
+        return stats;
+    }
+
+private:
+    void Log(const char* format, ...) const {
+        if (!log) return;
+        fprintf(log, "[%s] ", name.c_str());
+        va_list args;
+        va_start(args, format);
+        vfprintf(log, format, args);
+        va_end(args);
+        fflush(log);
+    }
+
+    SrtConfig config;
+    FILE* log = nullptr;
+    std::string name;
+    int64_t statsInterval = 0;
+    int64_t lastStats = 0;
+    SRTSOCKET sock = SRT_INVALID_SOCK;
+    SrtStats totals;
+};
+
+#endif // HAVE_SRT
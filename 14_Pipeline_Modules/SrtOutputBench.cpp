@@ -0,0 +1,335 @@
+// SrtOutputBench.cpp
+// Checks and measures the SRT output.
+//   1. URLs: ParseSrtUrl reads host, port and options, refuses what is not an
+//      srt:// listener, and FfmpegSrtUrl gives ffmpeg the same settings.
+//   2. Loss (needs libsrt): SrtSink sends a 30 fps MPEG-TS stream
+//      (SyntheticTsStream) to a libsrt listener over loopback. The path goes
+//      through LossyLink, a UDP forwarder that drops and delays packets both
+//      ways, as `tc qdisc add dev lo root netem delay 10ms loss 5%` would
+//      without root. The bench runs each loss rate at two latency settings.
+//      It reports frames that arrived whole, frames damaged by late drops,
+//      frames missing, each frame's latency, and SRT's own loss, resend and
+//      RTT counters. With --direct the bench skips LossyLink, for a run under
+//      real tc netem.
+// Usage: ./Run.sh SrtOutputBench [--direct]
+#include "MediaTypes.h"
+#include "SrtOutput.h"
+#include "Stats.h"
+#include "SyntheticMedia.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#ifdef HAVE_SRT
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <random>
+#include <thread>
+#endif
+
+int failures = 0;
+
+void Check(bool ok, const char* what) {
+    printf("  %-58s %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok) ++failures;
+}
+
+void CheckUrls() {
+    printf("URLs:\n");
+    SrtConfig config;
+    Check(ParseSrtUrl("srt://ingest.example.com:9000", config) && config.host == "ingest.example.com" && config.port == 9000 &&
+              config.latencyMs == 120 && config.overheadPercent == 25,
+          "host and port, defaults kept");
+    config = SrtConfig();
+    Check(ParseSrtUrl("srt://10.0.0.5:7001?latency=250&oheadbw=40&streamid=live/key&conntimeo=1500", config) &&
+              config.latencyMs == 250 && config.overheadPercent == 40 && config.streamId == "live/key" &&
+              config.connectTimeoutMs == 1500,
+          "latency, overhead, stream id and timeout");
+    config = SrtConfig();
+    Check(ParseSrtUrl("srt://[::1]:9000", config) && config.host == "::1" && config.port == 9000 &&
+              FfmpegSrtUrl(config).compare(0, 17, "srt://[::1]:9000?") == 0,
+          "bracketed IPv6 host, bracketed again for ffmpeg");
+    Check(!ParseSrtUrl("srt://::1:9000", config), "unbracketed IPv6 host refused");
+    config = SrtConfig();
+    Check(ParseSrtUrl("srt://host:9000?streamid=%23!::r=live/key,m=publish", config) &&
+              config.streamId == "#!::r=live/key,m=publish" &&
+              FfmpegSrtUrl(config).find("&streamid=%23%21%3A%3Ar%3Dlive%2Fkey%2Cm%3Dpublish") != std::string::npos,
+          "stream id decoded, then escaped for ffmpeg");
+    config = SrtConfig();
+    Check(!ParseSrtUrl("rtmp://a.rtmp.youtube.com/live2", config), "other schemes refused");
+    Check(!ParseSrtUrl("srt://host-without-port", config), "missing port refused");
+    Check(!ParseSrtUrl("srt://host:70000", config), "port out of range refused");
+    config = SrtConfig();
+    Check(!ParseSrtUrl("srt://host:9000?oheadbw=200", config), "overhead over 100% refused");
+    config = SrtConfig();
+    ParseSrtUrl("srt://host:9000?latency=200&oheadbw=30", config);
+    const std::string ffmpeg = FfmpegSrtUrl(config);
+    Check(ffmpeg.find("latency=200000") != std::string::npos && ffmpeg.find("oheadbw=30") != std::string::npos &&
+              ffmpeg.find("pkt_size=1316") != std::string::npos,
+          "ffmpeg URL: latency in us, overhead, 1316-byte packets");
+    printf("  %s\n", ffmpeg.c_str());
+}
+
+#ifdef HAVE_SRT
+
+// Constants
+const uint32_t FPS = 30;
+const uint32_t GOP = 30;
+const size_t KEYFRAME_BYTES = 30000;
+const size_t DELTA_BYTES = 5000; // About 1.4 Mbps with audio
+const double SECONDS = 6.0;
+const int ONE_WAY_DELAY_MS = 10;
+const double LOSS_PERCENT[] = { 0, 2, 5, 10 };
+const int LATENCY_MS[] = { 80, 250 };
+
+int64_t ElapsedMs(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+int PickUdpPort() {
+    const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length);
+    close(fd);
+    return ntohs(address.sin_port);
+}
+
+sockaddr_in Loopback(int port) {
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    return address;
+}
+
+// Stand-in for tc netem on loopback: forwards UDP between a caller and a server,
+// dropping a share of the packets and delaying the rest, in both directions
+class LossyLink {
+public:
+    ~LossyLink() { Stop(); }
+
+    bool Start(int listenPort, int serverPort, double lossPercent, int delayMs) {
+        callerSide = socket(AF_INET, SOCK_DGRAM, 0);
+        serverSide = socket(AF_INET, SOCK_DGRAM, 0);
+        const sockaddr_in local = Loopback(listenPort), server = Loopback(serverPort);
+        if (bind(callerSide, reinterpret_cast<const sockaddr*>(&local), sizeof(local)) != 0 ||
+            connect(serverSide, reinterpret_cast<const sockaddr*>(&server), sizeof(server)) != 0) {
+            return false;
+        }
+        loss = lossPercent / 100;
+        delay = std::chrono::milliseconds(delayMs);
+        running = true;
+        worker = std::thread(&LossyLink::Run, this);
+        return true;
+    }
+
+    void Stop() {
+        running = false;
+        if (worker.joinable()) worker.join();
+        if (callerSide >= 0) close(callerSide);
+        if (serverSide >= 0) close(serverSide);
+        callerSide = serverSide = -1;
+    }
+
+    uint64_t Forwarded() const { return forwarded; }
+    uint64_t Dropped() const { return dropped; }
+
+private:
+    struct Datagram {
+        std::chrono::steady_clock::time_point due;
+        bool toServer;
+        std::vector<uint8_t> data;
+    };
+
+    void Run() {
+        std::mt19937 random(7);
+        std::uniform_real_distribution<double> chance(0, 1);
+        std::deque<Datagram> inFlight; // Same delay for all: due times stay in order
+        sockaddr_in caller = {};
+        bool haveCaller = false;
+        uint8_t buffer[2048];
+        while (running) {
+            pollfd fds[2] = { { callerSide, POLLIN, 0 }, { serverSide, POLLIN, 0 } };
+            poll(fds, 2, 1);
+            for (int side = 0; side < 2; ++side) {
+                if (!(fds[side].revents & POLLIN)) continue;
+                sockaddr_in from = {};
+                socklen_t fromLength = sizeof(from);
+                const ssize_t n = recvfrom(fds[side].fd, buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr*>(&from), &fromLength);
+                if (n <= 0) continue;
+                if (side == 0) {
+                    caller = from;
+                    haveCaller = true;
+                }
+                if (chance(random) < loss) {
+                    ++dropped;
+                    continue;
+                }
+                inFlight.push_back({ std::chrono::steady_clock::now() + delay, side == 0, std::vector<uint8_t>(buffer, buffer + n) });
+            }
+            const auto now = std::chrono::steady_clock::now();
+            while (!inFlight.empty() && inFlight.front().due <= now) {
+                const Datagram& d = inFlight.front();
+                if (d.toServer) {
+                    send(serverSide, d.data.data(), d.data.size(), 0);
+                } else if (haveCaller) {
+                    sendto(callerSide, d.data.data(), d.data.size(), 0, reinterpret_cast<const sockaddr*>(&caller), sizeof(caller));
+                }
+                ++forwarded;
+                inFlight.pop_front();
+            }
+        }
+    }
+
+    int callerSide = -1, serverSide = -1;
+    double loss = 0;
+    std::chrono::milliseconds delay{ 0 };
+    std::atomic<bool> running{ false };
+    std::thread worker;
+    std::atomic<uint64_t> forwarded{ 0 }, dropped{ 0 };
+};
+
+struct Received {
+    uint64_t frames = 0;  // Frames whose first packet arrived
+    uint64_t intact = 0;  // ... and every other packet up to the next frame
+    LatencyHistogram latency; // First packet, us after the frame was produced
+};
+
+// The listener: receives until the caller closes, checking video continuity counters
+void Receive(int port, int latencyMs, std::atomic<bool>& listening, Received& result) {
+    SRTSOCKET listener = srt_create_socket();
+    const int live = SRTT_LIVE, payload = static_cast<int>(SRT_MESSAGE_BYTES);
+    const bool yes = true;
+    srt_setsockflag(listener, SRTO_TRANSTYPE, &live, sizeof(live));
+    srt_setsockflag(listener, SRTO_LATENCY, &latencyMs, sizeof(latencyMs));
+    srt_setsockflag(listener, SRTO_PAYLOADSIZE, &payload, sizeof(payload));
+    srt_setsockflag(listener, SRTO_RCVSYN, &yes, sizeof(yes));
+    const sockaddr_in address = Loopback(port);
+    if (srt_bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == SRT_ERROR ||
+        srt_listen(listener, 1) == SRT_ERROR) {
+        printf("Listener failed: %s\n", srt_getlasterror_str());
+        listening = true;
+        return;
+    }
+    listening = true;
+    sockaddr_storage peerAddress;
+    int peerLength = sizeof(peerAddress);
+    const SRTSOCKET peer = srt_accept(listener, reinterpret_cast<sockaddr*>(&peerAddress), &peerLength);
+    char message[1500];
+    int continuity = -1;
+    bool frameOpen = false, frameWhole = false;
+    int length;
+    while (peer != SRT_INVALID_SOCK && (length = srt_recvmsg(peer, message, sizeof(message))) > 0) {
+        for (int at = 0; at + 188 <= length; at += 188) {
+            const uint8_t* packet = reinterpret_cast<const uint8_t*>(message + at);
+            const int pid = ((packet[1] & 0x1F) << 8) | packet[2];
+            if (pid != SYNTHETIC_TS_VIDEO_PID) continue;
+            const int counter = packet[3] & 0x0F;
+            const bool gap = continuity >= 0 && counter != ((continuity + 1) & 0x0F);
+            continuity = counter;
+            SyntheticTsStamp stamp;
+            if (ReadSyntheticTsStamp(packet, stamp)) {
+                if (frameOpen && frameWhole && !gap) ++result.intact; // The previous frame's tail arrived
+                ++result.frames;
+                result.latency.Record(static_cast<uint64_t>(std::max<int64_t>(SyntheticSteadyNs() - stamp.generatedNs, 0) / 1000));
+                frameOpen = frameWhole = true;
+            } else if (gap) {
+                frameWhole = false;
+            }
+        }
+    }
+    if (frameOpen && frameWhole) ++result.intact;
+    if (peer != SRT_INVALID_SOCK) srt_close(peer);
+    srt_close(listener);
+}
+
+void RunLoss(bool direct) {
+    printf("\nLoss: %u fps for %.0f s, %d ms each way, keyframe every %u frames\n", FPS, SECONDS, direct ? 0 : ONE_WAY_DELAY_MS, GOP);
+    printf("%6s %8s | %7s %7s %7s %7s | %7s %7s %7s | %7s %6s %6s %7s %6s\n", "loss", "latency", "frames", "whole", "damaged",
+           "missing", "p50 ms", "p99 ms", "max ms", "rtt ms", "lost", "resent", "dropped", "link");
+    for (const double loss : LOSS_PERCENT) {
+        if (direct && loss > 0) break; // Loss comes from tc
+        for (const int latency : LATENCY_MS) {
+            const int serverPort = PickUdpPort(), linkPort = PickUdpPort();
+            std::atomic<bool> listening(false);
+            Received received;
+            std::thread listener(Receive, serverPort, latency, std::ref(listening), std::ref(received));
+            while (!listening) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            LossyLink link;
+            if (!direct && !link.Start(linkPort, serverPort, loss, ONE_WAY_DELAY_MS)) {
+                printf("Cannot start the lossy link.\n");
+                listener.detach();
+                return;
+            }
+
+            SrtConfig config;
+            config.host = "127.0.0.1";
+            config.port = direct ? serverPort : linkPort;
+            config.latencyMs = latency;
+            SrtSink sink(config, stdout, "srt");
+            uint64_t produced = 0;
+            if (sink.Open()) {
+                SyntheticTsStream stream(FPS, KEYFRAME_BYTES, DELTA_BYTES);
+                std::vector<uint8_t> frame;
+                const auto start = std::chrono::steady_clock::now();
+                for (uint32_t n = 0; n < SECONDS * FPS; ++n) {
+                    std::this_thread::sleep_until(start + std::chrono::microseconds(static_cast<int64_t>(n) * 1000000 / FPS));
+                    frame.clear();
+                    stream.Frame(n, n % GOP == 0, frame);
+                    if (!sink.Write(frame.data(), frame.size())) break;
+                    ++produced;
+                }
+                // Let the last frames through the receiver's latency window before closing
+                const auto drain = std::chrono::steady_clock::now();
+                while (ElapsedMs(drain) < latency + 4 * ONE_WAY_DELAY_MS + 200) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                }
+            }
+            const SrtStats stats = sink.Stats();
+            sink.Close();
+            listener.join();
+            link.Stop();
+
+            const double linkLoss = link.Forwarded() + link.Dropped() ? 100.0 * link.Dropped() / (link.Forwarded() + link.Dropped()) : 0;
+            printf("%5.0f%% %6d ms | %7llu %7llu %7llu %7llu | %7.0f %7.0f %7.0f | %7.1f %6lld %6lld %7lld %5.1f%%\n", loss, latency,
+                   static_cast<unsigned long long>(received.frames), static_cast<unsigned long long>(received.intact),
+                   static_cast<unsigned long long>(received.frames - received.intact),
+                   static_cast<unsigned long long>(produced - std::min(produced, received.frames)),
+                   received.latency.Percentile(50) / 1000.0, received.latency.Percentile(99) / 1000.0,
+                   received.latency.Percentile(100) / 1000.0, stats.rttMs, static_cast<long long>(stats.packetsLost),
+                   static_cast<long long>(stats.packetsResent), static_cast<long long>(stats.packetsDropped), linkLoss);
+        }
+    }
+    printf("\nwhole: every packet arrived; damaged: a late drop took part of it; latency: capture to first packet out of\n"
+           "the receiver, which SRT holds back until the latency window has passed; link: share of datagrams LossyLink dropped\n");
+}
+
+#endif // HAVE_SRT
+
+int main(int argc, char** argv) {
+    CheckUrls();
+#ifdef HAVE_SRT
+    const bool direct = argc > 1 && strcmp(argv[1], "--direct") == 0;
+    srt_startup();
+    RunLoss(direct);
+    srt_cleanup();
+#else
+    (void)argc;
+    (void)argv;
+    printf("\nBuilt without libsrt (define HAVE_SRT and link libsrt for the runs over a lossy link).\n");
+#endif
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,91 @@
+// Stats.h
+// Fixed-size latency histogram (log-linear buckets, ~3% resolution) for reporting
+// percentiles without storing every sample.
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+class LatencyHistogram {
+public:
+    LatencyHistogram() { Reset(); }
+
+    void Reset() {
+        memset(buckets, 0, sizeof(buckets));
+        count = 0;
+        sum = 0;
+        maxValue = 0;
+    }
+
+    // Record one value in microseconds
+    void Record(uint64_t micros) {
+        ++buckets[BucketIndex(micros)];
+        ++count;
+        sum += micros;
+        if (micros > maxValue) maxValue = micros;
+    }
+
+    void Merge(const LatencyHistogram& other) {
+        for (int i = 0; i < BUCKET_COUNT; ++i) buckets[i] += other.buckets[i];
+        count += other.count;
+        sum += other.sum;
+        if (other.maxValue > maxValue) maxValue = other.maxValue;
+    }
+
+    // Value at percentile p (0-100), in microseconds
+    uint64_t Percentile(double p) const {
+        if (count == 0) return 0;
+        uint64_t target = static_cast<uint64_t>(p / 100.0 * count + 0.5);
+        if (target == 0) target = 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKET_COUNT; ++i) {
+            seen += buckets[i];
+            if (seen >= target) {
+                uint64_t value = BucketValue(i);
+                return value < maxValue ? value : maxValue;
+            }
+        }
+        return maxValue;
+    }
+
+    uint64_t Count() const { return count; }
+    uint64_t Max() const { return maxValue; }
+    double Mean() const { return count ? static_cast<double>(sum) / count : 0.0; }
+
+    void Print(const char* label) const {
+        printf("%-28s n=%-8llu mean=%9.1f us  p50=%8llu  p90=%8llu  p99=%8llu  p99.9=%8llu  max=%8llu us\n",
+               label, static_cast<unsigned long long>(count), Mean(),
+               static_cast<unsigned long long>(Percentile(50)), static_cast<unsigned long long>(Percentile(90)),
+               static_cast<unsigned long long>(Percentile(99)), static_cast<unsigned long long>(Percentile(99.9)),
+               static_cast<unsigned long long>(maxValue));
+    }
+
+private:
+    static const int LINEAR_LIMIT = 64; // Values below this are counted exactly
+    static const int SUB_BUCKETS = 32;
+    static const int BUCKET_COUNT = LINEAR_LIMIT + 58 * SUB_BUCKETS;
+
+    static int BucketIndex(uint64_t value) {
+        if (value < LINEAR_LIMIT) return static_cast<int>(value);
+        int msb = 63;
+        while (!(value >> msb)) --msb;
+        int shift = msb - 5;
+        int sub = static_cast<int>(value >> shift) - SUB_BUCKETS;
+        return LINEAR_LIMIT + (msb - 6) * SUB_BUCKETS + sub;
+    }
+
+    static uint64_t BucketValue(int index) {
+        if (index < LINEAR_LIMIT) return static_cast<uint64_t>(index);
+        int msb = (index - LINEAR_LIMIT) / SUB_BUCKETS + 6;
+        int sub = (index - LINEAR_LIMIT) % SUB_BUCKETS;
+        int shift = msb - 5;
+        // Upper edge of the bucket, so percentiles never under-report
+        return ((static_cast<uint64_t>(SUB_BUCKETS + sub + 1)) << shift) - 1;
+    }
+
+    uint64_t buckets[BUCKET_COUNT];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t maxValue;
+};
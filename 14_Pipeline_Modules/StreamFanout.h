@@ -0,0 +1,278 @@
+// StreamFanout.h
+// One encoded stream to several destinations (the ingest server and an
+// archive, say) without encoding twice. The producer publishes each chunk
+// once; every destination has its own queue, send thread, backlog, reconnect
+// state and counters, so a destination that is slow or down holds up only
+// itself:
+//   StreamSink         - interface to one destination: Open, Write, Close
+//   FileSink           - appends to a local file
+//   FanoutDestination  - a BoundedFrameQueue with keep-keyframes, so the
+//                        producer never waits and a destination that falls
+//                        behind loses whole GOP tails, never a reference. Also
+//                        a send thread, plus CatchUpBuffer and
+//                        ReconnectSupervisor from OutputSupervisor.h.
+//   StreamFanout       - the destinations. Publish copies a chunk into every
+//                        queue. Restart marks where a new stream begins (the
+//                        encoder restarted); each destination reopens its sink
+//                        there, so the new stream gets a fresh connection.
+// A chunk's pts is its publish time, so backlog caps and latency are wall time.
+#pragma once
+
+#include "FrameQueue.h"
+#include "MediaTypes.h"
+#include "OutputSupervisor.h"
+#include "RateController.h"
+#include "Stats.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+struct FanoutConfig {
+    size_t queueChunks = 64;
+    size_t maxChunkBytes = 64 * 1024; // Larger chunks are dropped and counted
+    int64_t backlogTicks = 5 * TICKS_PER_SECOND;
+    size_t backlogBytes = 8 * 1024 * 1024;
+    ReconnectConfig reconnect;
+    std::function<void()> connected; // On the send thread, when a destination comes up (e.g. to ask for a keyframe)
+};
+
+class StreamSink {
+public:
+    virtual ~StreamSink() = default;
+    virtual bool Open() = 0;
+    // Everything or fail; may block while the destination is slow
+    virtual bool Write(const uint8_t* data, size_t bytes) = 0;
+    virtual void Close() = 0;
+    // Written but not yet delivered, for a sink that can tell (a transport's send buffer)
+    virtual int64_t QueuedTicks() { return 0; }
+    // Transport counters, printed under the destination's stats line
+    virtual void PrintStats(FILE*) const {}
+};
+
+class FileSink : public StreamSink {
+public:
+    explicit FileSink(const std::string& filePath) : path(filePath) {}
+    ~FileSink() override { Close(); }
+
+    bool Open() override {
+        Close();
+        file = fopen(path.c_str(), "ab");
+        return file != nullptr;
+    }
+
+    bool Write(const uint8_t* data, size_t bytes) override {
+        return file && fwrite(data, 1, bytes, file) == bytes && fflush(file) == 0;
+    }
+
+    void Close() override {
+        if (file) fclose(file);
+        file = nullptr;
+    }
+
+private:
+    std::string path;
+    FILE* file = nullptr;
+};
+
+class FanoutDestination {
+public:
+    FanoutDestination(const std::string& destinationName, std::unique_ptr<StreamSink> destinationSink)
+        : name(destinationName), sink(std::move(destinationSink)) {}
+    FanoutDestination(const FanoutDestination&) = delete;
+    FanoutDestination& operator=(const FanoutDestination&) = delete;
+    ~FanoutDestination() { Stop(); }
+
+    // log gets this destination's reconnects and drops; meter, if given, follows its output
+    bool Init(const FanoutConfig& settings, FILE* logFile, OutputMeter* outputMeter) {
+        config = settings;
+        log = logFile;
+        meter = outputMeter;
+        if (!sink || !queue.Init(config.queueChunks, config.maxChunkBytes, DropPolicy::KeepKeyframes)) return false;
+        backlog.Init(config.backlogTicks, config.backlogBytes);
+        supervisor.Init(NowTicks(), config.reconnect, log, name.c_str());
+        return true;
+    }
+
+    void Start() { sender = std::thread(&FanoutDestination::Run, this); }
+
+    // Producer: queue a chunk (bytes == 0 marks a stream restart); never waits
+    void Offer(const uint8_t* data, size_t bytes, int64_t pts, bool keyframe) {
+        if (bytes > config.maxChunkBytes) {
+            ++oversize;
+            queue.Refuse(pts, keyframe); // What follows up to the next keyframe cannot be decoded without it
+            return;
+        }
+        if (meter) meter->Offered(bytes);
+        uint8_t* slot = queue.Begin(pts, keyframe);
+        if (!slot) return;
+        if (bytes) memcpy(slot, data, bytes);
+        queue.Commit(bytes);
+    }
+
+    // Send what is queued (if the sink is up), then close it
+    void Stop() {
+        queue.Close();
+        if (sender.joinable()) sender.join();
+    }
+
+    // Counters; read them after Stop
+    const std::string& Name() const { return name; }
+    uint64_t SentBytes() const { return sentBytes; }
+    uint64_t SentChunks() const { return sentChunks; }
+    const LatencyHistogram& Latency() const { return latency; } // Publish to written, us
+    const BoundedFrameQueue& Queue() const { return queue; }
+    const CatchUpBuffer& Backlog() const { return backlog; }
+    const ReconnectSupervisor& Supervisor() const { return supervisor; }
+    uint64_t Oversize() const { return oversize; }
+    uint32_t Restarts() const { return restarts; }
+    const StreamSink& Sink() const { return *sink; }
+
+private:
+    void Run() {
+        QueuedFrame chunk;
+        while (queue.Pop(chunk)) {
+            backlog.Push(chunk.pts, chunk.keyframe, queue.Data(chunk), chunk.bytes);
+            queue.Release(chunk);
+            queue.LogDrops(log, name.c_str());
+            Send();
+        }
+        queue.LogDrops(log, name.c_str());
+        if (supervisor.Up()) sink->Close();
+    }
+
+    // Open the sink if an attempt is due, then write what it has not had yet,
+    // stopping early when another chunk is queued so it joins the backlog first
+    void Send() {
+        if (!supervisor.Up()) {
+            const int64_t now = NowTicks();
+            if (!supervisor.AttemptDue(now)) return;
+            if (!sink->Open()) {
+                supervisor.Failed(now, "open failed");
+                return;
+            }
+            supervisor.Connected(now);
+            fresh = true;
+            if (config.connected) config.connected();
+        }
+        while (const BacklogChunk* next = backlog.Next()) {
+            if (next->bytes == 0) {
+                // A new stream starts here: it gets a connection of its own
+                if (!fresh) {
+                    sink->Close();
+                    if (!sink->Open()) {
+                        Fail("reopen failed");
+                        return;
+                    }
+                    ++restarts;
+                    fresh = true;
+                }
+            } else {
+                const int64_t writeStart = NowTicks();
+                if (!sink->Write(next->data.data(), next->bytes)) {
+                    Fail("write failed");
+                    return;
+                }
+                const int64_t now = NowTicks();
+                if (meter) meter->Written(next->bytes, now - writeStart);
+                latency.Record(static_cast<uint64_t>(std::max<int64_t>(now - next->pts, 0) / 10));
+                sentBytes += next->bytes;
+                ++sentChunks;
+                fresh = false;
+            }
+            backlog.Sent();
+            if (queue.Depth() > 0) break;
+        }
+        backlog.Acknowledged(backlog.SentBytes());
+        if (meter) meter->QueueDelay(backlog.PendingTicks() + sink->QueuedTicks());
+    }
+
+    void Fail(const char* why) {
+        sink->Close();
+        backlog.Rewind();
+        supervisor.Failed(NowTicks(), why);
+        fresh = false;
+    }
+
+    std::string name;
+    std::unique_ptr<StreamSink> sink;
+    FanoutConfig config;
+    FILE* log = nullptr;
+    OutputMeter* meter = nullptr;
+    BoundedFrameQueue queue;
+    CatchUpBuffer backlog;
+    ReconnectSupervisor supervisor;
+    std::thread sender;
+    bool fresh = false; // Sink opened, nothing written yet
+    uint64_t sentBytes = 0, sentChunks = 0, oversize = 0;
+    uint32_t restarts = 0;
+    LatencyHistogram latency;
+};
+
+class StreamFanout {
+public:
+    ~StreamFanout() { Stop(); }
+
+    // Before Start. meter, if given, follows this destination (the one rate control should track).
+    bool Add(const std::string& name, std::unique_ptr<StreamSink> sink, const FanoutConfig& config = FanoutConfig(),
+             FILE* log = stdout, OutputMeter* meter = nullptr) {
+        std::unique_ptr<FanoutDestination> destination(new FanoutDestination(name, std::move(sink)));
+        if (!destination->Init(config, log, meter)) {
+            printf("Cannot set up stream destination %s.\n", name.c_str());
+            return false;
+        }
+        destinations.push_back(std::move(destination));
+        return true;
+    }
+
+    void Start() {
+        for (auto& destination : destinations) destination->Start();
+    }
+
+    // Producer: one chunk to every destination; never waits
+    void Publish(const uint8_t* data, size_t bytes, bool keyframe) {
+        if (bytes == 0) return;
+        const int64_t pts = NowTicks();
+        for (auto& destination : destinations) destination->Offer(data, bytes, pts, keyframe);
+        ++published;
+    }
+
+    // Producer: a new stream follows (the encoder restarted)
+    void Restart() {
+        const int64_t pts = NowTicks();
+        for (auto& destination : destinations) destination->Offer(nullptr, 0, pts, true);
+    }
+
+    // Destinations send what they have queued, then close
+    void Stop() {
+        for (auto& destination : destinations) destination->Stop();
+    }
+
+    size_t Count() const { return destinations.size(); }
+    const FanoutDestination& Destination(size_t index) const { return *destinations[index]; }
+    uint64_t Published() const { return published; }
+
+    // One line per destination; after Stop
+    void PrintStats(FILE* out) const {
+        for (const auto& d : destinations) {
+            fprintf(out, "  %-10s %7.1f MB in %llu chunks, latency p50 %.0f ms p99 %.0f ms | queue dropped %llu (high water %zu) | "
+                         "backlog trimmed %llu | %u failures, %u reconnects, %.1f s down | %u stream restarts\n",
+                    d->Name().c_str(), d->SentBytes() / 1e6, static_cast<unsigned long long>(d->SentChunks()),
+                    static_cast<double>(d->Latency().Percentile(50)) / 1000, static_cast<double>(d->Latency().Percentile(99)) / 1000,
+                    static_cast<unsigned long long>(d->Queue().Dropped() + d->Oversize()), d->Queue().HighWater(),
+                    static_cast<unsigned long long>(d->Backlog().Dropped()), d->Supervisor().Losses(), d->Supervisor().Reconnects(),
+                    static_cast<double>(d->Supervisor().DownTicks(NowTicks())) / TICKS_PER_SECOND, d->Restarts());
+            d->Sink().PrintStats(out);
+        }
+    }
+
+private:
+    std::vector<std::unique_ptr<FanoutDestination>> destinations;
+    uint64_t published = 0;
+};
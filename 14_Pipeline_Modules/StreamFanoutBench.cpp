@@ -0,0 +1,399 @@
+// StreamFanoutBench.cpp
+// One encoded stream to four destinations, the way the livestream sends its
+// single encode to the ingest server and an archive. A producer stands in for
+// ffmpeg: it writes an MPEG-TS stream into a FIFO at 30 fps. The stream has
+// PAT and PMT before each keyframe, a keyframe every second, and AAC-sized
+// audio (SyntheticTsStream). NamedPipeReader and TsChunker read it. The destinations:
+//   ingest   local TCP server that keeps up
+//   slow     local TCP server that reads at half the stream's bitrate
+//   flaky    local TCP server killed at 3 s and restarted at 6 s
+//   archive  FileSink
+// The servers are this program run with --server, as separate processes.
+// Each one logs every video frame it receives with its latency from the
+// producer.
+// Two runs:
+//   serial   one thread writes every chunk to each destination in turn, and
+//            reopens a failed one at its next keyframe
+//   fan-out  StreamFanout: a queue, send thread, backlog and reconnect state
+//            per destination
+// Reported per destination: frames delivered, frames missing, frames delivered
+// after a reference was lost, and latency. Also the longest time the producer
+// (the encoder) was kept waiting on its output, and whether the PAT and PMT
+// packets in the archive keep their continuity counters in sequence.
+// Usage: ./Run.sh StreamFanoutBench
+#include "MediaTypes.h"
+#include "NamedPipe.h"
+#include "Stats.h"
+#include "StreamFanout.h"
+#include "SyntheticMedia.h"
+#include "TsChunker.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Constants
+const uint32_t FPS = 30;
+const uint32_t GOP = 30;
+const size_t KEYFRAME_BYTES = 40000;
+const size_t DELTA_BYTES = 6000;
+const double SECONDS = 10.0;
+const double SLOW_KBPS = 1000;        // The stream is about 1.9 Mbps
+const double FLAKY_DOWN = 3.0;
+const double FLAKY_UP = 6.0;
+const int SOCKET_BUFFER = 32 * 1024;
+const char* PIPE_NAME = "StreamFanoutBench.ts";
+const char* LOG_PATH = "/tmp/StreamFanoutBench.log";
+const char* ARCHIVE_PATH = "/tmp/StreamFanoutBench.archive.ts";
+
+struct DestinationResult {
+    std::string name;
+    uint64_t frames = 0, missing = 0, broken = 0;
+    LatencyHistogram latency; // Producer to arrival, us
+};
+
+struct RunResult {
+    uint64_t produced = 0;
+    int64_t worstStallUs = 0; // Longest producer write into the pipe
+    std::vector<DestinationResult> destinations;
+    uint64_t tableCounterBreaks = 0; // PAT/PMT packets in the archive whose continuity_counter is not the last one + 1
+};
+
+char selfPath[4096];
+
+// --server: log "pid connection index keyframe latency-us" for each video frame received; kbps > 0 throttles reading
+int RunServer(int port, const char* path, double kbps) {
+    FILE* out = fopen(path, "a");
+    const int listener = socket(AF_INET, SOCK_STREAM, 0);
+    const int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(listener, SOL_SOCKET, SO_RCVBUF, &SOCKET_BUFFER, sizeof(SOCKET_BUFFER));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    if (!out || listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listener, 1) != 0) {
+        return 1;
+    }
+    setvbuf(out, NULL, _IOLBF, 0);
+    uint8_t packet[TsChunker::PACKET];
+    for (uint32_t connection = 1;; ++connection) {
+        const int fd = accept(listener, NULL, NULL);
+        if (fd < 0) continue;
+        const auto start = std::chrono::steady_clock::now();
+        uint64_t received = 0;
+        while (recv(fd, packet, sizeof(packet), MSG_WAITALL) == static_cast<ssize_t>(sizeof(packet))) {
+            received += sizeof(packet);
+            SyntheticTsStamp stamp;
+            if (ReadSyntheticTsStamp(packet, stamp)) {
+                fprintf(out, "%d %u %u %u %lld\n", static_cast<int>(getpid()), connection, stamp.index, stamp.keyframe,
+                        static_cast<long long>((SyntheticSteadyNs() - stamp.generatedNs) / 1000));
+            }
+            if (kbps > 0) {
+                std::this_thread::sleep_until(start + std::chrono::microseconds(static_cast<int64_t>(received * 8 * 1000 / kbps)));
+            }
+        }
+        close(fd);
+    }
+}
+
+struct Server {
+    std::string name;
+    int port = 0;
+    double kbps = 0;
+    std::string log;
+    pid_t pid = -1;
+};
+
+void StartServer(Server& server) {
+    const std::string port = std::to_string(server.port), kbps = std::to_string(server.kbps);
+    server.pid = fork();
+    if (server.pid == 0) {
+        execl(selfPath, selfPath, "--server", port.c_str(), server.log.c_str(), kbps.c_str(), static_cast<char*>(nullptr));
+        _exit(127);
+    }
+}
+
+void KillServer(Server& server) {
+    if (server.pid <= 0) return;
+    kill(server.pid, SIGKILL);
+    waitpid(server.pid, NULL, 0);
+    server.pid = -1;
+}
+
+int PickPort() {
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length);
+    close(fd);
+    return ntohs(address.sin_port);
+}
+
+// Stand-in for the relay to an RTMP server: a TCP connection
+class TcpSink : public StreamSink {
+public:
+    explicit TcpSink(int serverPort) : port(serverPort) {}
+    ~TcpSink() override { Close(); }
+
+    bool Open() override {
+        Close();
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &SOCKET_BUFFER, sizeof(SOCKET_BUFFER));
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(static_cast<uint16_t>(port));
+        if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    bool Write(const uint8_t* data, size_t bytes) override {
+        while (bytes > 0) {
+            const ssize_t n = send(fd, data, bytes, MSG_NOSIGNAL);
+            if (n <= 0) return false;
+            data += n;
+            bytes -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    void Close() override {
+        if (fd >= 0) close(fd);
+        fd = -1;
+    }
+
+private:
+    int port;
+    int fd = -1;
+};
+
+// Frames, gaps and broken references in one destination's log, in arrival order
+DestinationResult Analyse(const std::string& name, const std::string& path, uint64_t produced) {
+    DestinationResult result;
+    result.name = name;
+    FILE* in = fopen(path.c_str(), "r");
+    if (!in) return result;
+    std::set<uint32_t> seen;
+    std::map<std::pair<int, uint32_t>, uint32_t> last; // Per connection: last frame with its references
+    int pid = 0;
+    unsigned connection = 0, index = 0, keyframe = 0;
+    long long latency = 0;
+    while (fscanf(in, "%d %u %u %u %lld", &pid, &connection, &index, &keyframe, &latency) == 5) {
+        seen.insert(index);
+        result.latency.Record(static_cast<uint64_t>(std::max(latency, 0LL)));
+        const std::pair<int, uint32_t> key(pid, connection);
+        const auto previous = last.find(key);
+        if (keyframe || (previous != last.end() && previous->second + 1 == index)) {
+            last[key] = index;
+        } else {
+            ++result.broken;
+            last.erase(key);
+        }
+    }
+    fclose(in);
+    result.frames = seen.size();
+    for (uint32_t n = 0; n < produced; ++n) {
+        if (!seen.count(n)) ++result.missing;
+    }
+    return result;
+}
+
+// PAT and PMT packets in the archive that do not continue their PID's continuity_counter
+uint64_t TableCounterBreaks() {
+    FILE* in = fopen(ARCHIVE_PATH, "rb");
+    if (!in) return 0;
+    uint8_t packet[TsChunker::PACKET];
+    int last[2] = { -1, -1 };
+    uint64_t breaks = 0;
+    while (fread(packet, 1, sizeof(packet), in) == sizeof(packet)) {
+        const int pid = ((packet[1] & 0x1F) << 8) | packet[2];
+        if (pid != 0 && pid != SYNTHETIC_TS_PMT_PID) continue;
+        int& previous = last[pid == 0 ? 0 : 1];
+        const int counter = packet[3] & 0x0F;
+        if (previous >= 0 && counter != ((previous + 1) & 0x0F)) ++breaks;
+        previous = counter;
+    }
+    fclose(in);
+    return breaks;
+}
+
+// The archive is the stream itself; log its frames as a server would (latency unknown)
+void LogArchive(const std::string& path) {
+    FILE* in = fopen(ARCHIVE_PATH, "rb");
+    FILE* out = fopen(path.c_str(), "w");
+    if (!in || !out) return;
+    uint8_t packet[TsChunker::PACKET];
+    while (fread(packet, 1, sizeof(packet), in) == sizeof(packet)) {
+        SyntheticTsStamp stamp;
+        if (ReadSyntheticTsStamp(packet, stamp)) fprintf(out, "0 1 %u %u 0\n", stamp.index, stamp.keyframe);
+    }
+    fclose(in);
+    fclose(out);
+}
+
+RunResult Run(bool fanout, FILE* log) {
+    RunResult result;
+    std::vector<Server> servers = { { "ingest", PickPort(), 0, "/tmp/StreamFanoutBench.ingest.log" },
+                                    { "slow", PickPort(), SLOW_KBPS, "/tmp/StreamFanoutBench.slow.log" },
+                                    { "flaky", PickPort(), 0, "/tmp/StreamFanoutBench.flaky.log" } };
+    for (Server& server : servers) {
+        fclose(fopen(server.log.c_str(), "w"));
+        StartServer(server);
+    }
+    fclose(fopen(ARCHIVE_PATH, "wb"));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    if (log) fprintf(log, "--- %s\n", fanout ? "fan-out" : "serial");
+
+    // Sinks in server order, then the archive
+    std::vector<std::unique_ptr<StreamSink>> sinks;
+    for (const Server& server : servers) sinks.emplace_back(new TcpSink(server.port));
+    sinks.emplace_back(new FileSink(ARCHIVE_PATH));
+    const char* names[] = { "ingest", "slow", "flaky", "archive" };
+
+    StreamFanout streamFanout;
+    TsChunker chunker;
+    chunker.Init(FanoutConfig().maxChunkBytes);
+    TsChunkSink publish;
+    std::vector<bool> sinkOpen(sinks.size(), false);
+    if (fanout) {
+        FanoutConfig config;
+        config.backlogTicks = 5 * TICKS_PER_SECOND;
+        config.reconnect.firstWaitTicks = TICKS_PER_SECOND / 4;
+        config.reconnect.maxWaitTicks = TICKS_PER_SECOND;
+        for (size_t i = 0; i < sinks.size(); ++i) streamFanout.Add(names[i], std::move(sinks[i]), config, log);
+        streamFanout.Start();
+        publish = [&](const uint8_t* data, size_t bytes, bool keyframe) { streamFanout.Publish(data, bytes, keyframe); };
+    } else {
+        // Each destination in turn; one that failed is reopened at the next keyframe
+        publish = [&](const uint8_t* data, size_t bytes, bool keyframe) {
+            for (size_t i = 0; i < sinks.size(); ++i) {
+                if (!sinkOpen[i] && keyframe) sinkOpen[i] = sinks[i]->Open();
+                if (sinkOpen[i] && !sinks[i]->Write(data, bytes)) {
+                    sinks[i]->Close();
+                    sinkOpen[i] = false;
+                }
+            }
+        };
+    }
+
+    NamedPipeReader pipe;
+    if (!pipe.Create(PIPE_NAME)) return result;
+    const std::string pipePath = pipe.Path();
+    std::thread reader([&] {
+        std::vector<uint8_t> buffer(64 * 1024);
+        if (!pipe.Connect()) return;
+        size_t length;
+        while ((length = pipe.Read(buffer.data(), buffer.size())) > 0) chunker.Push(buffer.data(), length, publish);
+        pipe.Close();
+    });
+
+    // The producer stands in for ffmpeg writing its output file
+    const int out = open(pipePath.c_str(), O_WRONLY | O_CLOEXEC);
+    SyntheticTsStream stream(FPS, KEYFRAME_BYTES, DELTA_BYTES);
+    std::vector<uint8_t> frame;
+    const int64_t start = NowTicks();
+    const uint64_t frames = static_cast<uint64_t>(SECONDS * FPS);
+    bool flakyUp = true;
+    for (uint64_t n = 0; n < frames && out >= 0; ++n) {
+        const int64_t due = start + static_cast<int64_t>(n) * TICKS_PER_SECOND / FPS;
+        const int64_t now = NowTicks();
+        if (due > now) std::this_thread::sleep_for(std::chrono::nanoseconds((due - now) * 100));
+        const double t = static_cast<double>(NowTicks() - start) / TICKS_PER_SECOND;
+        if (flakyUp && t >= FLAKY_DOWN && t < FLAKY_UP) {
+            KillServer(servers[2]);
+            flakyUp = false;
+        } else if (!flakyUp && t >= FLAKY_UP) {
+            StartServer(servers[2]);
+            flakyUp = true;
+        }
+
+        frame.clear();
+        stream.Frame(static_cast<uint32_t>(n), n % GOP == 0, frame);
+        const int64_t writeStart = NowTicks();
+        for (size_t at = 0; at < frame.size();) {
+            const ssize_t written = write(out, frame.data() + at, frame.size() - at);
+            if (written <= 0) break;
+            at += static_cast<size_t>(written);
+        }
+        result.worstStallUs = std::max(result.worstStallUs, (NowTicks() - writeStart) / 10);
+        ++result.produced;
+    }
+    if (out >= 0) close(out);
+    reader.join();
+    if (fanout) {
+        streamFanout.Stop();
+        printf("fan-out, as the destinations saw it:\n");
+        streamFanout.PrintStats(stdout);
+    } else {
+        for (auto& sink : sinks) sink->Close();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(300)); // Let the servers log the last frames
+    for (Server& server : servers) KillServer(server);
+
+    for (const Server& server : servers) result.destinations.push_back(Analyse(server.name, server.log, result.produced));
+    LogArchive("/tmp/StreamFanoutBench.archive.log");
+    result.tableCounterBreaks = TableCounterBreaks();
+    result.destinations.push_back(Analyse("archive", "/tmp/StreamFanoutBench.archive.log", result.produced));
+    return result;
+}
+
+void Report(const char* mode, const RunResult& r) {
+    printf("%-8s producer waited up to %.0f ms on its output\n", mode, r.worstStallUs / 1000.0);
+    for (const DestinationResult& d : r.destinations) {
+        printf("  %-10s %8llu %8llu %8llu", d.name.c_str(), static_cast<unsigned long long>(d.frames),
+               static_cast<unsigned long long>(d.missing), static_cast<unsigned long long>(d.broken));
+        if (d.name == "archive") {
+            printf("  PAT/PMT continuity breaks: %llu\n", static_cast<unsigned long long>(r.tableCounterBreaks));
+        } else {
+            printf(" %9.0f %9.0f %9.0f\n", d.latency.Percentile(50) / 1000.0, d.latency.Percentile(99) / 1000.0,
+                   d.latency.Percentile(100) / 1000.0);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc == 5 && strcmp(argv[1], "--server") == 0) return RunServer(atoi(argv[2]), argv[3], atof(argv[4]));
+    const ssize_t length = readlink("/proc/self/exe", selfPath, sizeof(selfPath) - 1);
+    if (length <= 0) return 1;
+    selfPath[length] = 0;
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("%u fps for %.0f s, keyframe every %u frames; slow reads %.0f kbps; flaky is down %.0f-%.0f s\n\n", FPS, SECONDS, GOP,
+           SLOW_KBPS, FLAKY_DOWN, FLAKY_UP);
+    FILE* log = fopen(LOG_PATH, "w");
+    const RunResult serial = Run(false, log);
+    const RunResult fanout = Run(true, log);
+    if (log) fclose(log);
+
+    printf("\n%-12s %8s %8s %8s %9s %9s %9s\n", "", "frames", "missing", "broken", "p50 ms", "p99 ms", "max ms");
+    Report("serial", serial);
+    Report("fan-out", fanout);
+    printf("\nbroken: arrived after one of its references was lost; every reconnect and drop: %s\n", LOG_PATH);
+    return 0;
+}
@@ -0,0 +1,224 @@
+// SyntheticMedia.h
+// Generators for test clips, so the Linux tools run without a camera or microphone.
+#pragma once
+
+#include "MediaTypes.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+const double SYNTHETIC_PI = 3.14159265358979323846;
+
+// Draw a moving gradient with a bouncing box into a tightly packed 4:2:0 buffer
+inline void FillTestPattern(uint8_t* data, uint32_t width, uint32_t height, PixelFormat format, uint64_t frameIndex) {
+    uint8_t* luma = data;
+    const uint32_t shift = static_cast<uint32_t>(frameIndex * 2);
+    for (uint32_t y = 0; y < height; ++y) {
+        uint8_t* row = luma + static_cast<size_t>(y) * width;
+        for (uint32_t x = 0; x < width; ++x) {
+            row[x] = static_cast<uint8_t>(16 + ((x + y + shift) & 0x7F));
+        }
+    }
+
+    const uint32_t box = height / 4;
+    const uint32_t travelX = width > box ? width - box : 1;
+    const uint32_t travelY = height > box ? height - box : 1;
+    uint32_t boxX = static_cast<uint32_t>((frameIndex * 7) % (2 * travelX));
+    uint32_t boxY = static_cast<uint32_t>((frameIndex * 5) % (2 * travelY));
+    if (boxX >= travelX) boxX = 2 * travelX - boxX - 1;
+    if (boxY >= travelY) boxY = 2 * travelY - boxY - 1;
+    for (uint32_t y = boxY; y < boxY + box && y < height; ++y) {
+        memset(luma + static_cast<size_t>(y) * width + boxX, 235, box < width - boxX ? box : width - boxX);
+    }
+
+    const uint32_t chromaWidth = (width + 1) / 2;
+    const uint32_t chromaHeight = (height + 1) / 2;
+    const uint8_t u = static_cast<uint8_t>(128 + 40 * sin(frameIndex * 0.05));
+    const uint8_t v = static_cast<uint8_t>(128 - 40 * sin(frameIndex * 0.05));
+    uint8_t* chroma = data + static_cast<size_t>(width) * height;
+    if (format == PixelFormat::NV12) {
+        for (size_t i = 0; i < static_cast<size_t>(chromaWidth) * chromaHeight; ++i) {
+            chroma[2 * i] = u;
+            chroma[2 * i + 1] = v;
+        }
+    } else {
+        memset(chroma, u, static_cast<size_t>(chromaWidth) * chromaHeight);
+        memset(chroma + static_cast<size_t>(chromaWidth) * chromaHeight, v, static_cast<size_t>(chromaWidth) * chromaHeight);
+    }
+}
+
+// Write a Y4M clip; frame timestamps are stored as XPTS so replays see exact PTS
+inline bool WriteSyntheticY4M(const std::string& path, uint32_t width, uint32_t height,
+                              uint32_t fpsNum, uint32_t fpsDen, uint32_t frames) {
+    FILE* out = fopen(path.c_str(), "wb");
+    if (!out) {
+        printf("Failed to create %s.\n", path.c_str());
+        return false;
+    }
+    fprintf(out, "YUV4MPEG2 W%u H%u F%u:%u Ip A1:1 C420jpeg\n", width, height, fpsNum, fpsDen);
+    std::vector<uint8_t> frame(Frame420Size(width, height));
+    for (uint32_t i = 0; i < frames; ++i) {
+        FillTestPattern(frame.data(), width, height, PixelFormat::I420, i);
+        long long pts = static_cast<long long>(i) * TICKS_PER_SECOND * fpsDen / fpsNum;
+        fprintf(out, "FRAME XPTS=%lld\n", pts);
+        fwrite(frame.data(), 1, frame.size(), out);
+    }
+    fclose(out);
+    return true;
+}
+
+// Write the 44-byte canonical header for 16-bit PCM
+inline void WriteWavHeader(FILE* out, uint32_t sampleRate, uint16_t channels, uint32_t dataBytes) {
+    auto put32 = [out](uint32_t v) { uint8_t b[4] = { uint8_t(v), uint8_t(v >> 8), uint8_t(v >> 16), uint8_t(v >> 24) }; fwrite(b, 1, 4, out); };
+    auto put16 = [out](uint16_t v) { uint8_t b[2] = { uint8_t(v), uint8_t(v >> 8) }; fwrite(b, 1, 2, out); };
+    fwrite("RIFF", 1, 4, out);
+    put32(36 + dataBytes);
+    fwrite("WAVEfmt ", 1, 8, out);
+    put32(16);
+    put16(1); // PCM
+    put16(channels);
+    put32(sampleRate);
+    put32(sampleRate * channels * 2);
+    put16(static_cast<uint16_t>(channels * 2));
+    put16(16);
+    fwrite("data", 1, 4, out);
+    put32(dataBytes);
+}
+
+// Write a 16-bit sine tone
+inline bool WriteSineWav(const std::string& path, uint32_t sampleRate, uint16_t channels,
+                         double seconds, double frequency, double amplitude = 0.5) {
+    FILE* out = fopen(path.c_str(), "wb");
+    if (!out) {
+        printf("Failed to create %s.\n", path.c_str());
+        return false;
+    }
+    const uint32_t frames = static_cast<uint32_t>(seconds * sampleRate);
+    WriteWavHeader(out, sampleRate, channels, frames * channels * 2);
+    std::vector<int16_t> samples(static_cast<size_t>(frames) * channels);
+    for (uint32_t i = 0; i < frames; ++i) {
+        int16_t s = static_cast<int16_t>(32767.0 * amplitude * sin(2.0 * SYNTHETIC_PI * frequency * i / sampleRate));
+        for (uint16_t c = 0; c < channels; ++c) samples[static_cast<size_t>(i) * channels + c] = s;
+    }
+    fwrite(samples.data(), sizeof(int16_t), samples.size(), out);
+    fclose(out);
+    return true;
+}
+
+// PIDs of the synthetic transport stream
+const int SYNTHETIC_TS_VIDEO_PID = 0x100;
+const int SYNTHETIC_TS_AUDIO_PID = 0x101;
+const int SYNTHETIC_TS_PMT_PID = 0x1000;
+
+// What each synthetic video PES carries after its 6-byte header
+struct SyntheticTsStamp {
+    uint32_t index;
+    uint32_t keyframe;
+    int64_t generatedNs; // SyntheticSteadyNs: the same clock in every process on the machine
+};
+
+inline int64_t SyntheticSteadyNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// MPEG-TS shaped like ffmpeg's mpegts output, for the stream output tools. PAT
+// and PMT come before each keyframe, and a keyframe's first packet carries the
+// random access indicator. AAC-sized audio is interleaved at 47 frames a second.
+class SyntheticTsStream {
+public:
+    SyntheticTsStream(uint32_t framesPerSecond, size_t keyframeSize, size_t deltaSize)
+        : fps(framesPerSecond), keyframeBytes(keyframeSize), deltaBytes(deltaSize) {}
+
+    // Append frame index, stamped now, and the audio due by its end
+    void Frame(uint32_t index, bool keyframe, std::vector<uint8_t>& out) {
+        if (keyframe) {
+            Section(0, Pat(), out);
+            Section(SYNTHETIC_TS_PMT_PID, Pmt(), out);
+        }
+        std::vector<uint8_t> pes = { 0, 0, 1, 0xE0, 0, 0 };
+        const SyntheticTsStamp stamp = { index, keyframe ? 1u : 0u, SyntheticSteadyNs() };
+        pes.insert(pes.end(), reinterpret_cast<const uint8_t*>(&stamp), reinterpret_cast<const uint8_t*>(&stamp) + sizeof(stamp));
+        pes.resize(keyframe ? keyframeBytes : deltaBytes, static_cast<uint8_t>(index));
+        Packetize(SYNTHETIC_TS_VIDEO_PID, pes, keyframe, out);
+        const uint64_t audioDue = static_cast<uint64_t>(index + 1) * AUDIO_PER_SECOND / fps;
+        for (; audioSent < audioDue; ++audioSent) {
+            std::vector<uint8_t> audio(AUDIO_BYTES, 0xA5);
+            audio[0] = audio[1] = 0;
+            audio[2] = 1;
+            audio[3] = 0xC0;
+            Packetize(SYNTHETIC_TS_AUDIO_PID, audio, false, out);
+        }
+    }
+
+private:
+    static const size_t AUDIO_BYTES = 400;       // One AAC frame at 128 kbps
+    static const uint32_t AUDIO_PER_SECOND = 47; // 48 kHz / 1024
+
+    static std::vector<uint8_t> Pat() {
+        return { 0x00, 0xB0, 13, 0, 1, 0xC1, 0, 0, 0, 1, static_cast<uint8_t>(0xE0 | (SYNTHETIC_TS_PMT_PID >> 8)),
+                 SYNTHETIC_TS_PMT_PID & 0xFF, 0, 0, 0, 0 };
+    }
+
+    static std::vector<uint8_t> Pmt() {
+        const uint8_t videoHigh = static_cast<uint8_t>(0xE0 | (SYNTHETIC_TS_VIDEO_PID >> 8));
+        const uint8_t audioHigh = static_cast<uint8_t>(0xE0 | (SYNTHETIC_TS_AUDIO_PID >> 8));
+        return { 0x02, 0xB0, 23, 0, 1, 0xC1, 0, 0, videoHigh, SYNTHETIC_TS_VIDEO_PID & 0xFF, 0xF0, 0,
+                 0x1B, videoHigh, SYNTHETIC_TS_VIDEO_PID & 0xFF, 0xF0, 0,  // H.264
+                 0x0F, audioHigh, SYNTHETIC_TS_AUDIO_PID & 0xFF, 0xF0, 0,  // AAC
+                 0, 0, 0, 0 };                                             // CRC, not checked by the tools
+    }
+
+    void Section(int pid, const std::vector<uint8_t>& section, std::vector<uint8_t>& out) {
+        std::vector<uint8_t> payload(1, 0); // Pointer field
+        payload.insert(payload.end(), section.begin(), section.end());
+        payload.resize(184, 0xFF);
+        Packetize(pid, payload, false, out);
+    }
+
+    // PES or section into 188-byte packets, stuffing the last one through its adaptation field
+    void Packetize(int pid, const std::vector<uint8_t>& payload, bool randomAccess, std::vector<uint8_t>& out) {
+        for (size_t at = 0; at < payload.size();) {
+            const bool first = at == 0;
+            const size_t remaining = payload.size() - at;
+            size_t adaptation = first && randomAccess ? 2 : 0; // Length byte and flags
+            if (remaining < 184 - adaptation) adaptation = 184 - remaining;
+            uint8_t packet[188];
+            packet[0] = 0x47;
+            packet[1] = static_cast<uint8_t>((first ? 0x40 : 0) | (pid >> 8));
+            packet[2] = static_cast<uint8_t>(pid & 0xFF);
+            packet[3] = static_cast<uint8_t>((adaptation ? 0x30 : 0x10) | (continuity[pid]++ & 0x0F));
+            if (adaptation) {
+                packet[4] = static_cast<uint8_t>(adaptation - 1);
+                if (adaptation > 1) {
+                    packet[5] = first && randomAccess ? 0x40 : 0;
+                    memset(packet + 6, 0xFF, adaptation - 2);
+                }
+            }
+            const size_t take = 184 - adaptation;
+            memcpy(packet + 4 + adaptation, payload.data() + at, take);
+            out.insert(out.end(), packet, packet + sizeof(packet));
+            at += take;
+        }
+    }
+
+    uint32_t fps;
+    size_t keyframeBytes, deltaBytes;
+    std::map<int, uint8_t> continuity;
+    uint64_t audioSent = 0;
+};
+
+// The stamp of the video frame a packet starts, if it starts one
+inline bool ReadSyntheticTsStamp(const uint8_t* packet, SyntheticTsStamp& stamp) {
+    const int pid = ((packet[1] & 0x1F) << 8) | packet[2];
+    if (packet[0] != 0x47 || pid != SYNTHETIC_TS_VIDEO_PID || !(packet[1] & 0x40)) return false;
+    const size_t payload = 4 + ((packet[3] & 0x20) ? 1 + packet[4] : 0);
+    if (payload + 6 + sizeof(stamp) > 188) return false;
+    memcpy(&stamp, packet + payload + 6, sizeof(stamp));
+    return true;
+}
@@ -0,0 +1,292 @@
+// TemporalLayerBench.cpp
+// Temporal layers under backpressure. A 30 fps stream with a keyframe every
+// 2 s goes through a keep-keyframes BoundedFrameQueue (FrameQueue.h) to a
+// consumer that slows down: 5 ms a frame, 55 ms (a link at 60% of the frame
+// rate) from 1.5 s, 90 ms (37%) from 3 s, then 5 ms again from 4.5 s. The run
+// is repeated with 1, 2 and 3 temporal layers.
+// Reported per run: frames written; the frame rate written and the longest
+// gap between written frames while the consumer is slow; drops by layer; and
+// written frames whose reference had been dropped.
+//   Always: frames tagged with the 0 2 1 2 layer pattern, each checked against
+//   the frame it references. Also checks which frames a full queue sheds.
+//   With OpenH264: the moving test pattern encoded by OpenH264Encoder, and the
+//   consumer decodes what it writes with OpenH264's decoder; decode errors are
+//   counted too.
+// Usage: ./Run.sh TemporalLayerBench
+#include "FrameQueue.h"
+#include "MediaTypes.h"
+#include "Stats.h"
+#include "SyntheticMedia.h"
+#include "VideoEncoder.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Constants
+const uint32_t FPS = 30;
+const uint32_t GOP = 2 * FPS;
+const double SECONDS = 6.0;
+const double SLOW_FROM = 1.5;
+const double SLOWER_FROM = 3.0;
+const double SLOW_UNTIL = 4.5;
+const size_t QUEUE_FRAMES = 8;
+const size_t SLOT_BYTES = 256 * 1024;
+const size_t TAGGED_FRAME_BYTES = 4096; // Stands in for an encoded frame
+const uint32_t WIDTH = 640;
+const uint32_t HEIGHT = 360;
+const uint32_t BITRATE = 1000000;
+const char* LOG_PATH = "/tmp/TemporalLayerBench.log";
+
+int failures = 0;
+
+void Check(bool ok, const char* what) {
+    printf("  %-56s %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok) ++failures;
+}
+
+// In front of each frame in its slot
+struct FrameTag {
+    uint64_t index;
+    int64_t reference; // Index of the frame it references; -1: a keyframe
+};
+
+struct RunResult {
+    uint64_t written = 0, writtenWhileSlow = 0, undecodable = 0, decodeErrors = 0;
+    int64_t longestGap = 0; // Between written frames' pts while slow, ticks
+    uint64_t dropped[3] = {};
+    LatencyHistogram latency; // Capture to written, ms
+};
+
+// Time one write takes at t seconds into the run
+std::chrono::milliseconds WriteCost(double t) {
+    if (t >= SLOWER_FROM && t < SLOW_UNTIL) return std::chrono::milliseconds(90);
+    return std::chrono::milliseconds(t >= SLOW_FROM && t < SLOW_UNTIL ? 55 : 5);
+}
+
+// Frame n's layer in the dyadic pattern: with 3 layers 0 2 1 2, with 2 layers 0 1
+uint32_t LayerOf(uint64_t n, uint32_t layers) {
+    uint64_t position = n % (1ull << (layers - 1));
+    if (position == 0) return 0;
+    uint32_t layer = layers - 1;
+    for (; !(position & 1); position >>= 1) --layer;
+    return layer;
+}
+
+// Producer side: which frame each one references. Layer 0 references the last layer 0 frame,
+// a higher layer the latest frame below it.
+struct ReferenceTracker {
+    int64_t lastAt[BoundedFrameQueue::MAX_LAYERS] = { -1, -1, -1, -1 };
+
+    int64_t Next(uint64_t index, bool keyframe, uint32_t layer) {
+        int64_t reference = -1;
+        if (!keyframe) {
+            for (uint32_t below = 0; below < std::max<uint32_t>(layer, 1); ++below) reference = std::max(reference, lastAt[below]);
+        }
+        lastAt[layer] = static_cast<int64_t>(index);
+        return reference;
+    }
+};
+
+#ifdef HAVE_OPENH264
+
+// The consumer's decoder: any error state means the written stream is not valid H.264 as sent
+class StreamChecker {
+public:
+    StreamChecker() {
+        if (WelsCreateDecoder(&decoder) != 0 || !decoder) {
+            decoder = nullptr;
+            return;
+        }
+        SDecodingParam param;
+        memset(&param, 0, sizeof(param));
+        param.sVideoProperty.eVideoBsType = VIDEO_BITSTREAM_AVC;
+        decoder->Initialize(&param);
+    }
+
+    ~StreamChecker() {
+        if (!decoder) return;
+        decoder->Uninitialize();
+        WelsDestroyDecoder(decoder);
+    }
+
+    bool Decode(const uint8_t* data, size_t size) {
+        if (!decoder) return false;
+        unsigned char* planes[3] = {};
+        SBufferInfo info;
+        memset(&info, 0, sizeof(info));
+        const DECODING_STATE state = decoder->DecodeFrameNoDelay(data, static_cast<int>(size), planes, &info);
+        return (state & ~dsFramePending) == 0;
+    }
+
+private:
+    ISVCDecoder* decoder = nullptr;
+};
+
+#endif // HAVE_OPENH264
+
+// encoded: OpenH264 frames instead of tagged stand-ins
+RunResult Run(uint32_t layers, bool encoded, FILE* log) {
+    RunResult result;
+    BoundedFrameQueue queue;
+    if (!queue.Init(QUEUE_FRAMES, SLOT_BYTES, DropPolicy::KeepKeyframes)) return result;
+    const uint64_t frames = static_cast<uint64_t>(SECONDS * FPS);
+    if (log) fprintf(log, "--- %u temporal layer(s)%s\n", layers, encoded ? ", OpenH264" : "");
+
+#ifdef HAVE_OPENH264
+    OpenH264Encoder encoder;
+    if (encoded) {
+        VideoEncoderConfig config;
+        config.width = WIDTH;
+        config.height = HEIGHT;
+        config.fps = FPS;
+        config.bitrate = BITRATE;
+        config.temporalLayers = layers;
+        if (!encoder.Open(config)) return result;
+    }
+    std::vector<uint8_t> pixels(Frame420Size(WIDTH, HEIGHT));
+#endif
+
+    const int64_t start = NowTicks();
+    std::thread consumer([&] {
+        std::vector<bool> decodable(frames, false);
+        int64_t lastPts = -1;
+#ifdef HAVE_OPENH264
+        StreamChecker checker;
+#endif
+        QueuedFrame frame;
+        while (queue.Pop(frame)) {
+            FrameTag tag;
+            memcpy(&tag, queue.Data(frame), sizeof(tag));
+            std::this_thread::sleep_for(WriteCost(static_cast<double>(NowTicks() - start) / TICKS_PER_SECOND));
+#ifdef HAVE_OPENH264
+            if (encoded && !checker.Decode(queue.Data(frame) + sizeof(tag), frame.bytes - sizeof(tag))) ++result.decodeErrors;
+#endif
+            const bool ok = tag.reference < 0 || decodable[static_cast<size_t>(tag.reference)];
+            decodable[static_cast<size_t>(tag.index)] = ok;
+            if (!ok) ++result.undecodable;
+            ++result.written;
+            const double t = static_cast<double>(frame.pts) / TICKS_PER_SECOND;
+            if (t >= SLOW_FROM && t < SLOW_UNTIL) {
+                ++result.writtenWhileSlow;
+                if (lastPts >= 0) result.longestGap = std::max(result.longestGap, frame.pts - lastPts);
+            }
+            lastPts = frame.pts;
+            result.latency.Record(static_cast<uint64_t>((NowTicks() - start - frame.pts) / 10000));
+            queue.Release(frame);
+            queue.LogDrops(log);
+        }
+        queue.LogDrops(log);
+    });
+
+    ReferenceTracker references;
+    std::vector<uint8_t> payload(TAGGED_FRAME_BYTES, 0);
+    for (uint64_t n = 0; n < frames; ++n) {
+        const int64_t pts = static_cast<int64_t>(n) * TICKS_PER_SECOND / FPS;
+        const int64_t now = NowTicks();
+        if (start + pts > now) std::this_thread::sleep_for(std::chrono::nanoseconds((start + pts - now) * 100));
+        bool keyframe = n % GOP == 0;
+        uint32_t layer = keyframe ? 0 : LayerOf(n, layers);
+#ifdef HAVE_OPENH264
+        if (encoded) {
+            FillTestPattern(pixels.data(), WIDTH, HEIGHT, PixelFormat::NV12, n);
+            VideoFrame video;
+            Describe420Frame(video, pixels.data(), WIDTH, HEIGHT, PixelFormat::NV12);
+            video.pts = pts;
+            payload.clear();
+            const bool ok = encoder.Encode(video, keyframe, [&](const EncodedVideoPacket& packet) {
+                payload.assign(packet.data, packet.data + packet.size);
+                keyframe = packet.keyframe;
+                layer = packet.temporalLayer;
+            });
+            if (!ok || payload.empty() || payload.size() + sizeof(FrameTag) > SLOT_BYTES) continue;
+        }
+#endif
+        const FrameTag tag = { n, references.Next(n, keyframe, layer) };
+        uint8_t* slot = queue.Begin(pts, keyframe, layer);
+        if (slot) {
+            memcpy(slot, &tag, sizeof(tag));
+            memcpy(slot + sizeof(tag), payload.data(), payload.size());
+            queue.Commit(sizeof(tag) + payload.size());
+        }
+    }
+    queue.Close();
+    consumer.join();
+    for (uint32_t layer = 0; layer < 3; ++layer) result.dropped[layer] = queue.DroppedAtLayer(layer);
+    return result;
+}
+
+void Report(const char* name, const RunResult& r, bool encoded) {
+    const double slowSeconds = SLOW_UNTIL - SLOW_FROM;
+    printf("%-22s %7llu %7.1f %7.0f %5llu %5llu %5llu %7llu %7s %7.0f\n", name, static_cast<unsigned long long>(r.written),
+           r.writtenWhileSlow / slowSeconds, static_cast<double>(r.longestGap) / 10000, static_cast<unsigned long long>(r.dropped[0]),
+           static_cast<unsigned long long>(r.dropped[1]), static_cast<unsigned long long>(r.dropped[2]),
+           static_cast<unsigned long long>(r.undecodable), encoded ? std::to_string(r.decodeErrors).c_str() : "-",
+           static_cast<double>(r.latency.Percentile(99)));
+}
+
+// A full queue of a 3-layer stream, nothing popped: the top layer goes first, then the middle one
+void CheckShedding() {
+    BoundedFrameQueue queue;
+    queue.Init(4, 64, DropPolicy::KeepKeyframes);
+    for (uint64_t n = 0; n < 9; ++n) {
+        const bool keyframe = n == 0;
+        uint8_t* slot = queue.Begin(static_cast<int64_t>(n), keyframe, keyframe ? 0 : LayerOf(n, 3));
+        if (slot) queue.Commit(1);
+    }
+    queue.Close();
+    std::vector<int64_t> kept;
+    QueuedFrame frame;
+    while (queue.Pop(frame)) {
+        kept.push_back(frame.pts);
+        queue.Release(frame);
+    }
+    Check(kept == std::vector<int64_t>({ 0, 4, 6, 8 }), "frames 0-8 into 4 slots keep 0, 4, 6 and 8");
+    Check(queue.DroppedAtLayer(2) == 4 && queue.DroppedAtLayer(1) == 1 && queue.DroppedAtLayer(0) == 0,
+          "drops counted by layer: four at 2, one at 1");
+}
+
+int main() {
+    printf("Queue shedding:\n");
+    CheckShedding();
+
+    printf("\n%u fps for %.0f s, keyframe every %u frames, %zu frames queued; consumer 5 ms/frame, 55 ms from %.1f s, 90 ms from %.1f s, 5 ms from %.1f s\n\n",
+           FPS, SECONDS, GOP, QUEUE_FRAMES, SLOW_FROM, SLOWER_FROM, SLOW_UNTIL);
+    printf("%-22s %7s %15s %17s %7s %7s %7s\n", "", "written", "while slow", "dropped at layer", "broken", "decode", "latency");
+    printf("%-22s %7s %7s %7s %5s %5s %5s %7s %7s %7s\n", "", "", "fps", "gap ms", "0", "1", "2", "refs", "errors", "p99 ms");
+    FILE* log = fopen(LOG_PATH, "w");
+    RunResult tagged[3];
+    const char* names[3] = { "1 layer", "2 layers", "3 layers" };
+    for (uint32_t layers = 1; layers <= 3; ++layers) {
+        tagged[layers - 1] = Run(layers, false, log);
+        Report(names[layers - 1], tagged[layers - 1], false);
+    }
+#ifdef HAVE_OPENH264
+    RunResult encoded[3];
+    const char* encodedNames[3] = { "OpenH264, 1 layer", "OpenH264, 2 layers", "OpenH264, 3 layers" };
+    for (uint32_t layers = 1; layers <= 3; ++layers) {
+        encoded[layers - 1] = Run(layers, true, log);
+        Report(encodedNames[layers - 1], encoded[layers - 1], true);
+    }
+#endif
+    if (log) fclose(log);
+
+    printf("\nbroken refs: written after the frame they reference was dropped\n");
+    printf("Every drop, with its time and layer: %s\n\n", LOG_PATH);
+    bool intact = true;
+    for (const RunResult& r : tagged) intact = intact && r.undecodable == 0;
+    Check(intact, "no frame written without its reference");
+    Check(tagged[2].longestGap < tagged[0].longestGap, "3 layers: shorter freezes than 1 layer");
+    Check(tagged[2].writtenWhileSlow > tagged[0].writtenWhileSlow, "3 layers: more frames through the slow link");
+#ifdef HAVE_OPENH264
+    Check(encoded[1].decodeErrors == 0 && encoded[2].decodeErrors == 0, "OpenH264 layered streams decode without errors");
+    Check(encoded[2].dropped[2] > 0 && encoded[2].dropped[0] == 0, "OpenH264, 3 layers: drops from the top layer, none at 0");
+#else
+    printf("\nBuilt without OpenH264 (define HAVE_OPENH264 and link openh264 to encode and decode real streams).\n");
+#endif
+    return failures ? 1 : 0;
+}
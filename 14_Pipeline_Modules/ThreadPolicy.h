@@ -0,0 +1,437 @@
+// ThreadPolicy.h
+// Priority, CPU affinity and a name for each pipeline thread, by the role it
+// plays. At default priority on whatever core the OS picks, a capture loop
+// under background load wakes late and the device overwrites its frames:
+//   ThreadRole          - capture, audio, encode, io, telemetry
+//   ThreadPolicy        - a priority class, the SCHED_FIFO priority (Linux) or
+//                         MMCSS task (Windows) for the real-time class, and the
+//                         CPUs the thread may run on
+//   ThreadPolicyTable   - a policy per role: capture and audio real-time,
+//                         telemetry low, the rest normal, all on any CPU.
+//                         LoadThreadPolicies reads a deployment's overrides.
+//   ScopedThreadPolicy  - applies a role's policy to the calling thread and
+//                         names it; Finish (or scope exit) gives the thread back
+//                         the scheduling, priority and CPUs it had before (pool
+//                         threads go on to other work) and puts its CPU time
+//                         and context switches into a ThreadUsageLog
+//   ThreadUsageLog      - a line per thread, printed at the end of a run
+// Linux: low is nice 10, normal nice 0, high nice -10, all SCHED_OTHER, and
+// real-time SCHED_FIFO. Windows: below normal, normal, highest, and for
+// real-time the MMCSS task if one is set, else time critical. Every class is
+// set explicitly, and "any CPU" too, so nothing is inherited from a thread's
+// earlier role. Raising a priority needs rights (CAP_SYS_NICE or an rtprio
+// limit on Linux), and so does raising it back after a low role; a refused
+// step is reported and the thread runs on as it was.
+// Involuntary context switches (the thread preempted) are counted on Linux
+// only; Windows reports CPU time.
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <avrt.h>
+#pragma comment(lib, "avrt.lib")
+#else
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+enum class ThreadRole { Capture, Audio, Encode, Io, Telemetry, Count };
+
+inline const char* ThreadRoleName(ThreadRole role) {
+    switch (role) {
+    case ThreadRole::Capture: return "capture";
+    case ThreadRole::Audio: return "audio";
+    case ThreadRole::Encode: return "encode";
+    case ThreadRole::Io: return "io";
+    default: return "telemetry";
+    }
+}
+
+enum class ThreadPriority { Low, Normal, High, RealTime };
+
+inline const char* ThreadPriorityName(ThreadPriority priority) {
+    switch (priority) {
+    case ThreadPriority::Low: return "low";
+    case ThreadPriority::High: return "high";
+    case ThreadPriority::RealTime: return "realtime";
+    default: return "normal";
+    }
+}
+
+struct ThreadPolicy {
+    ThreadPriority priority = ThreadPriority::Normal;
+    int fifoPriority = 10;  // Linux, real-time: SCHED_FIFO 1-99
+    std::string mmcssTask;  // Windows, real-time: "Capture", "Audio", "Pro Audio"...; empty: time critical instead
+    uint64_t cpus = 0;      // Affinity, one bit per CPU; 0: any
+};
+
+// "0,2-3" to a mask; false for anything else or a CPU past 63
+inline bool ParseCpuList(const std::string& text, uint64_t& cpus) {
+    cpus = 0;
+    const char* at = text.c_str();
+    while (*at) {
+        char* end = nullptr;
+        const long first = strtol(at, &end, 10);
+        long last = first;
+        if (end == at) return false;
+        if (*end == '-') {
+            at = end + 1;
+            last = strtol(at, &end, 10);
+            if (end == at) return false;
+        }
+        if (first < 0 || last < first || last > 63) return false;
+        for (long cpu = first; cpu <= last; ++cpu) cpus |= 1ull << cpu;
+        if (*end == ',') ++end;
+        else if (*end) return false;
+        at = end;
+    }
+    return cpus != 0;
+}
+
+inline std::string CpuListText(uint64_t cpus) {
+    if (!cpus) return "any";
+    std::string text;
+    for (int cpu = 0; cpu < 64; ++cpu) {
+        if (!(cpus >> cpu & 1)) continue;
+        int last = cpu;
+        while (last < 63 && (cpus >> (last + 1) & 1)) ++last;
+        text += (text.empty() ? "" : ",") + std::to_string(cpu) + (last > cpu ? "-" + std::to_string(last) : "");
+        cpu = last;
+    }
+    return text;
+}
+
+class ThreadPolicyTable {
+public:
+    ThreadPolicyTable() {
+        ThreadPolicy& capture = policies[static_cast<size_t>(ThreadRole::Capture)];
+        capture.priority = ThreadPriority::RealTime;
+        capture.fifoPriority = 10;
+        capture.mmcssTask = "Capture";
+        ThreadPolicy& audio = policies[static_cast<size_t>(ThreadRole::Audio)];
+        audio.priority = ThreadPriority::RealTime;
+        audio.fifoPriority = 20; // Above video: a late audio period is an audible gap
+        audio.mmcssTask = "Audio";
+        policies[static_cast<size_t>(ThreadRole::Telemetry)].priority = ThreadPriority::Low;
+    }
+
+    const ThreadPolicy& Policy(ThreadRole role) const { return policies[static_cast<size_t>(role)]; }
+    void SetPolicy(ThreadRole role, const ThreadPolicy& policy) { policies[static_cast<size_t>(role)] = policy; }
+
+    // "<role> <low|normal|high|realtime> [fifo=<1-99>] [mmcss=<task>] [cpus=<list>]"; an underscore in the
+    // task stands for a space (mmcss=Pro_Audio). Blank lines and # comments are fine. False if it does not parse.
+    bool ParseLine(const std::string& line) {
+        std::vector<std::string> words;
+        for (size_t at = 0; at < line.size();) {
+            const size_t start = line.find_first_not_of(" \t\r\n", at);
+            if (start == std::string::npos || line[start] == '#') break;
+            const size_t end = line.find_first_of(" \t\r\n", start);
+            words.push_back(line.substr(start, end == std::string::npos ? std::string::npos : end - start));
+            at = end == std::string::npos ? line.size() : end;
+        }
+        if (words.empty()) return true;
+        if (words.size() < 2) return false;
+        size_t role = 0;
+        while (role < static_cast<size_t>(ThreadRole::Count) && words[0] != ThreadRoleName(static_cast<ThreadRole>(role))) ++role;
+        if (role == static_cast<size_t>(ThreadRole::Count)) return false;
+        ThreadPolicy policy;
+        policy.fifoPriority = policies[role].fifoPriority;
+        policy.mmcssTask = policies[role].mmcssTask;
+        if (words[1] == "low") policy.priority = ThreadPriority::Low;
+        else if (words[1] == "normal") policy.priority = ThreadPriority::Normal;
+        else if (words[1] == "high") policy.priority = ThreadPriority::High;
+        else if (words[1] == "realtime") policy.priority = ThreadPriority::RealTime;
+        else return false;
+        for (size_t i = 2; i < words.size(); ++i) {
+            const size_t equals = words[i].find('=');
+            if (equals == std::string::npos) return false;
+            const std::string key = words[i].substr(0, equals), value = words[i].substr(equals + 1);
+            if (key == "fifo") {
+                policy.fifoPriority = atoi(value.c_str());
+                if (policy.fifoPriority < 1 || policy.fifoPriority > 99) return false;
+            } else if (key == "mmcss") {
+                policy.mmcssTask = value;
+                for (char& c : policy.mmcssTask) c = c == '_' ? ' ' : c;
+            } else if (key == "cpus") {
+                if (!ParseCpuList(value, policy.cpus)) return false;
+            } else {
+                return false;
+            }
+        }
+        policies[role] = policy;
+        return true;
+    }
+
+private:
+    ThreadPolicy policies[static_cast<size_t>(ThreadRole::Count)];
+};
+
+// A deployment's table over the defaults, one ParseLine line per role. A missing file leaves
+// the defaults and returns true; a line that does not parse is printed and skipped, and makes it false.
+inline bool LoadThreadPolicies(const char* path, ThreadPolicyTable& table) {
+    FILE* file = fopen(path, "r");
+    if (!file) return true;
+    bool ok = true;
+    char line[256];
+    for (int number = 1; fgets(line, sizeof(line), file); ++number) {
+        if (!table.ParseLine(line)) {
+            printf("%s:%d: not a thread policy: %s", path, number, line);
+            ok = false;
+        }
+    }
+    fclose(file);
+    return ok;
+}
+
+inline std::string DescribeThreadPolicy(const ThreadPolicy& policy) {
+    std::string text = ThreadPriorityName(policy.priority);
+    if (policy.priority == ThreadPriority::RealTime) {
+#ifdef _WIN32
+        text += policy.mmcssTask.empty() ? " (time critical)" : " (MMCSS " + policy.mmcssTask + ")";
+#else
+        text += " (fifo " + std::to_string(policy.fifoPriority) + ")";
+#endif
+    }
+    return text + ", cpus " + CpuListText(policy.cpus);
+}
+
+struct ThreadUsage {
+    double cpuSeconds = 0;             // User and kernel
+    int64_t voluntarySwitches = -1;    // Waits; -1: not known (Windows)
+    int64_t involuntarySwitches = -1;  // Preemptions; -1: not known (Windows)
+};
+
+// The calling thread's usage since it started
+inline ThreadUsage CallingThreadUsage() {
+    ThreadUsage usage;
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user)) {
+        const uint64_t ticks = (static_cast<uint64_t>(kernel.dwHighDateTime) << 32 | kernel.dwLowDateTime) +
+                               (static_cast<uint64_t>(user.dwHighDateTime) << 32 | user.dwLowDateTime);
+        usage.cpuSeconds = ticks / 1e7;
+    }
+#else
+    rusage self;
+    if (getrusage(RUSAGE_THREAD, &self) == 0) {
+        usage.cpuSeconds = self.ru_utime.tv_sec + self.ru_stime.tv_sec + (self.ru_utime.tv_usec + self.ru_stime.tv_usec) / 1e6;
+        usage.voluntarySwitches = self.ru_nvcsw;
+        usage.involuntarySwitches = self.ru_nivcsw;
+    }
+#endif
+    return usage;
+}
+
+struct ThreadUsageEntry {
+    std::string name;
+    ThreadRole role = ThreadRole::Io;
+    ThreadPolicy policy;
+    std::string refused; // Steps of the policy that did not take hold
+    ThreadUsage usage;
+    double seconds = 0;  // Wall time under the policy
+};
+
+class ThreadUsageLog {
+public:
+    void Add(const ThreadUsageEntry& entry) {
+        std::lock_guard<std::mutex> hold(lock);
+        entries.push_back(entry);
+    }
+
+    std::vector<ThreadUsageEntry> Entries() const {
+        std::lock_guard<std::mutex> hold(lock);
+        return entries;
+    }
+
+    void Print(FILE* out) const {
+        std::lock_guard<std::mutex> hold(lock);
+        for (const ThreadUsageEntry& e : entries) {
+            fprintf(out, "  %-16s %-9s %-28s cpu %7.2f s (%5.1f%% of %.1f s)", e.name.c_str(), ThreadRoleName(e.role),
+                    DescribeThreadPolicy(e.policy).c_str(), e.usage.cpuSeconds, e.seconds > 0 ? 100 * e.usage.cpuSeconds / e.seconds : 0.0,
+                    e.seconds);
+            if (e.usage.involuntarySwitches >= 0) {
+                fprintf(out, ", %lld involuntary / %lld voluntary switches", static_cast<long long>(e.usage.involuntarySwitches),
+                        static_cast<long long>(e.usage.voluntarySwitches));
+            }
+            fprintf(out, "%s%s\n", e.refused.empty() ? "" : "; refused: ", e.refused.c_str());
+        }
+    }
+
+private:
+    mutable std::mutex lock;
+    std::vector<ThreadUsageEntry> entries;
+};
+
+class ScopedThreadPolicy {
+public:
+    // On the thread the policy is for; name is cut to 15 characters on Linux
+    ScopedThreadPolicy(ThreadRole role, const ThreadPolicyTable& table, const char* name, ThreadUsageLog* usageLog = nullptr)
+        : log(usageLog) {
+        entry.name = name;
+        entry.role = role;
+        entry.policy = table.Policy(role);
+        start = std::chrono::steady_clock::now();
+        startUsage = CallingThreadUsage();
+        Save();
+        Apply();
+    }
+
+    ScopedThreadPolicy(const ScopedThreadPolicy&) = delete;
+    ScopedThreadPolicy& operator=(const ScopedThreadPolicy&) = delete;
+    ~ScopedThreadPolicy() { Finish(); }
+
+    // Steps of the policy that did not take hold, e.g. "SCHED_FIFO (Operation not permitted)"; empty if all did
+    const std::string& Refused() const { return entry.refused; }
+
+    // Leave the MMCSS task, restore what the thread had before and log the usage;
+    // once, on the same thread, before it ends or takes another policy
+    void Finish() {
+        if (finished) return;
+        finished = true;
+#ifdef _WIN32
+        if (mmcss) AvRevertMmThreadCharacteristics(mmcss);
+        mmcss = nullptr;
+#endif
+        Restore();
+        const ThreadUsage now = CallingThreadUsage();
+        entry.usage.cpuSeconds = now.cpuSeconds - startUsage.cpuSeconds;
+        if (now.involuntarySwitches >= 0) {
+            entry.usage.voluntarySwitches = now.voluntarySwitches - startUsage.voluntarySwitches;
+            entry.usage.involuntarySwitches = now.involuntarySwitches - startUsage.involuntarySwitches;
+        }
+        entry.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (log) log->Add(entry);
+    }
+
+    ThreadUsage Usage() const { return entry.usage; } // After Finish
+
+private:
+    void Refuse(const std::string& step) { entry.refused += (entry.refused.empty() ? "" : ", ") + step; }
+
+    // What Restore puts back
+    void Save() {
+#ifdef _WIN32
+        savedPriority = GetThreadPriority(GetCurrentThread());
+#else
+        errno = 0;
+        savedNice = getpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)));
+        CPU_ZERO(&savedCpus);
+        saved = errno == 0 && pthread_getschedparam(pthread_self(), &savedScheduler, &savedParam) == 0 &&
+                pthread_getaffinity_np(pthread_self(), sizeof(savedCpus), &savedCpus) == 0;
+#endif
+    }
+
+    void Restore() {
+#ifdef _WIN32
+        if (savedPriority != THREAD_PRIORITY_ERROR_RETURN && !SetThreadPriority(GetCurrentThread(), savedPriority)) {
+            Refuse("restore priority " + std::to_string(savedPriority));
+        }
+        if (savedAffinity && !SetThreadAffinityMask(GetCurrentThread(), savedAffinity)) Refuse("restore cpus");
+#else
+        if (!saved) return;
+        int result = pthread_setschedparam(pthread_self(), savedScheduler, &savedParam);
+        if (result != 0) Refuse(std::string("restore scheduler (") + strerror(result) + ")");
+        SetNice(savedNice, "restore nice ");
+        result = pthread_setaffinity_np(pthread_self(), sizeof(savedCpus), &savedCpus);
+        if (result != 0) Refuse(std::string("restore cpus (") + strerror(result) + ")");
+#endif
+    }
+
+#ifndef _WIN32
+    // nice is per thread on Linux, addressed by thread id; left alone if it is already there
+    void SetNice(int nice, const char* step) {
+        const id_t thread = static_cast<id_t>(syscall(SYS_gettid));
+        errno = 0;
+        const int current = getpriority(PRIO_PROCESS, thread);
+        if (errno == 0 && current == nice) return;
+        if (setpriority(PRIO_PROCESS, thread, nice) != 0) Refuse(step + std::to_string(nice) + " (" + strerror(errno) + ")");
+    }
+#endif
+
+    void Apply() {
+        const ThreadPolicy& policy = entry.policy;
+#ifdef _WIN32
+        std::wstring wide(entry.name.begin(), entry.name.end());
+        SetThreadDescription(GetCurrentThread(), wide.c_str());
+        int priority = THREAD_PRIORITY_NORMAL;
+        if (policy.priority == ThreadPriority::Low) priority = THREAD_PRIORITY_BELOW_NORMAL;
+        else if (policy.priority == ThreadPriority::High) priority = THREAD_PRIORITY_HIGHEST;
+        else if (policy.priority == ThreadPriority::RealTime) priority = THREAD_PRIORITY_TIME_CRITICAL;
+        if (policy.priority == ThreadPriority::RealTime && !policy.mmcssTask.empty()) {
+            // MMCSS raises the thread while it runs and still leaves the rest of the system a share
+            DWORD taskIndex = 0;
+            mmcss = AvSetMmThreadCharacteristicsA(policy.mmcssTask.c_str(), &taskIndex);
+            if (mmcss) {
+                AvSetMmThreadPriority(mmcss, AVRT_PRIORITY_HIGH);
+                priority = THREAD_PRIORITY_NORMAL;
+            } else {
+                Refuse("MMCSS " + policy.mmcssTask + " (error " + std::to_string(GetLastError()) + "), time critical instead");
+            }
+        }
+        if (!SetThreadPriority(GetCurrentThread(), priority)) {
+            Refuse(std::string("priority ") + ThreadPriorityName(policy.priority));
+        }
+        // Any CPU is the process's CPUs
+        DWORD_PTR cpus = static_cast<DWORD_PTR>(policy.cpus), processCpus = 0, systemCpus = 0;
+        if (!cpus && GetProcessAffinityMask(GetCurrentProcess(), &processCpus, &systemCpus)) cpus = processCpus;
+        savedAffinity = cpus ? SetThreadAffinityMask(GetCurrentThread(), cpus) : 0;
+        if (cpus && !savedAffinity) Refuse("cpus " + CpuListText(policy.cpus));
+#else
+        pthread_setname_np(pthread_self(), entry.name.substr(0, 15).c_str());
+        if (policy.priority == ThreadPriority::RealTime) {
+            sched_param param;
+            memset(&param, 0, sizeof(param));
+            param.sched_priority = policy.fifoPriority;
+            const int result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+            if (result != 0) Refuse(std::string("SCHED_FIFO (") + strerror(result) + ")");
+        } else {
+            // Out of SCHED_FIFO first if the thread was left in it: nice means nothing there
+            if (saved && savedScheduler != SCHED_OTHER) {
+                sched_param param;
+                memset(&param, 0, sizeof(param));
+                const int result = pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+                if (result != 0) Refuse(std::string("SCHED_OTHER (") + strerror(result) + ")");
+            }
+            SetNice(policy.priority == ThreadPriority::Low ? 10 : policy.priority == ThreadPriority::High ? -10 : 0, "nice ");
+        }
+        // Any CPU is every CPU the system lets the thread have; the kernel narrows it to its cpuset
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu = 0; cpu < (policy.cpus ? 64 : CPU_SETSIZE); ++cpu) {
+            if (!policy.cpus || (policy.cpus >> cpu & 1)) CPU_SET(cpu, &set);
+        }
+        const int result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (result != 0) Refuse("cpus " + CpuListText(policy.cpus) + " (" + strerror(result) + ")");
+#endif
+    }
+
+    ThreadUsageLog* log;
+    ThreadUsageEntry entry;
+    std::chrono::steady_clock::time_point start;
+    ThreadUsage startUsage;
+    bool finished = false;
+#ifdef _WIN32
+    HANDLE mmcss = nullptr;
+    int savedPriority = THREAD_PRIORITY_ERROR_RETURN;
+    DWORD_PTR savedAffinity = 0; // 0: the affinity was not changed
+#else
+    bool saved = false; // The state below was read
+    int savedScheduler = SCHED_OTHER;
+    sched_param savedParam = {};
+    int savedNice = 0;
+    cpu_set_t savedCpus;
+#endif
+};
@@ -0,0 +1,265 @@
+// ThreadPolicyBench.cpp
+// ThreadPolicy.h against a CPU hog. A capture loop takes 30 fps frames from a
+// simulated device that holds two of them, and spends 20 ms of computation on
+// each; a frame it comes back for too late has been overwritten and counts as
+// dropped. The loop runs 4 s idle, then under a hog (two spinning threads per
+// CPU at normal priority) with each policy in turn: the defaults, the hog at
+// low priority, the capture thread high, the capture thread real-time, and the
+// capture thread on a CPU of its own (with two or more CPUs).
+// Reported per run: frames dropped, how late the loop picked frames up
+// (p50/p99/max), and the capture thread's CPU time and context switches as
+// ScopedThreadPolicy logged them. A policy the system refuses (SCHED_FIFO and
+// negative nice need root or CAP_SYS_NICE) is reported and the run goes on.
+// Also checks policy-table parsing, the thread name and the affinity.
+// Usage: ./Run.sh ThreadPolicyBench
+#include "Stats.h"
+#include "ThreadPolicy.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// Constants
+const uint32_t FPS = 30;
+const double SECONDS = 4.0;
+const uint64_t DEVICE_FRAMES = 2;  // Frames the device keeps before overwriting the oldest
+const double WORK_MS = 20.0;       // Per frame: two thirds of the frame interval
+const uint32_t HOGS_PER_CPU = 2;
+
+int failures = 0;
+
+void Check(bool ok, const char* what) {
+    printf("  %-56s %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok) ++failures;
+}
+
+std::atomic<uint64_t> sink(0);
+
+// Fixed computation, so a starved thread takes longer in wall time
+void Work(uint64_t iterations) {
+    uint64_t x = sink.load(std::memory_order_relaxed) | 1;
+    for (uint64_t i = 0; i < iterations; ++i) x = x * 6364136223846793005ull + 1442695040888963407ull;
+    sink.store(x, std::memory_order_relaxed);
+}
+
+// Iterations of Work per millisecond on an idle CPU
+uint64_t CalibrateWork() {
+    const uint64_t probe = 1 << 22;
+    double best = 1e9;
+    for (int i = 0; i < 5; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        Work(probe);
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    return static_cast<uint64_t>(probe / best);
+}
+
+struct RunResult {
+    uint64_t frames = 0, dropped = 0;
+    LatencyHistogram late; // Frame arrival to the loop taking it, us
+    ThreadUsage usage;
+    std::string refused;
+};
+
+// The capture loop on its own thread under table's capture policy
+RunResult Capture(const ThreadPolicyTable& table, uint64_t workIterations, ThreadUsageLog& usageLog) {
+    RunResult result;
+    std::thread capture([&] {
+        ScopedThreadPolicy policy(ThreadRole::Capture, table, "capture", &usageLog);
+        result.refused = policy.Refused();
+        const auto interval = std::chrono::microseconds(1000000 / FPS);
+        const uint64_t total = static_cast<uint64_t>(SECONDS * FPS);
+        const auto start = std::chrono::steady_clock::now();
+        uint64_t next = 0;
+        while (next < total) {
+            const auto now = std::chrono::steady_clock::now();
+            const uint64_t arrived = static_cast<uint64_t>((now - start) / interval) + 1; // Frames 0 to arrived - 1 are in
+            if (next >= arrived) {
+                std::this_thread::sleep_until(start + next * interval);
+                continue;
+            }
+            // The device has overwritten everything but its newest frames
+            const uint64_t oldest = arrived > DEVICE_FRAMES ? arrived - DEVICE_FRAMES : 0;
+            if (next < oldest) {
+                result.dropped += std::min(oldest, total) - next;
+                next = oldest;
+                if (next >= total) break;
+            }
+            result.late.Record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - (start + next * interval)).count()));
+            Work(workIterations);
+            ++result.frames;
+            ++next;
+        }
+        policy.Finish();
+        result.usage = policy.Usage();
+    });
+    capture.join();
+    return result;
+}
+
+// Spinning threads under table's telemetry policy while Capture runs
+RunResult CaptureUnderLoad(const ThreadPolicyTable& table, uint64_t workIterations, ThreadUsageLog& usageLog) {
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> hogs;
+    const uint32_t cpus = static_cast<uint32_t>(std::max(1L, sysconf(_SC_NPROCESSORS_ONLN)));
+    for (uint32_t i = 0; i < HOGS_PER_CPU * cpus; ++i) {
+        hogs.emplace_back([&] {
+            ScopedThreadPolicy policy(ThreadRole::Telemetry, table, "hog");
+            while (!stop.load(std::memory_order_relaxed)) Work(1000);
+        });
+    }
+    const RunResult result = Capture(table, workIterations, usageLog);
+    stop = true;
+    for (std::thread& hog : hogs) hog.join();
+    return result;
+}
+
+void Report(const char* name, const RunResult& r) {
+    printf("%-34s %6llu %7llu %7.1f %7.1f %7.1f %7.2f %7lld %7lld  %s\n", name, static_cast<unsigned long long>(r.frames),
+           static_cast<unsigned long long>(r.dropped), r.late.Percentile(50) / 1000.0, r.late.Percentile(99) / 1000.0, r.late.Max() / 1000.0,
+           r.usage.cpuSeconds, static_cast<long long>(r.usage.involuntarySwitches), static_cast<long long>(r.usage.voluntarySwitches),
+           r.refused.empty() ? "" : ("refused: " + r.refused).c_str());
+}
+
+void CheckTable() {
+    ThreadPolicyTable table;
+    Check(table.Policy(ThreadRole::Capture).priority == ThreadPriority::RealTime &&
+              table.Policy(ThreadRole::Telemetry).priority == ThreadPriority::Low &&
+              table.Policy(ThreadRole::Io).priority == ThreadPriority::Normal,
+          "defaults: capture real-time, telemetry low, io normal");
+    Check(table.ParseLine("encode high cpus=0,2-3  # the encoder's cores"), "parses \"encode high cpus=0,2-3\"");
+    Check(table.Policy(ThreadRole::Encode).priority == ThreadPriority::High && table.Policy(ThreadRole::Encode).cpus == 0xD,
+          "  high on CPUs 0, 2 and 3");
+    Check(table.ParseLine("audio realtime fifo=30 mmcss=Pro_Audio") && table.Policy(ThreadRole::Audio).fifoPriority == 30 &&
+              table.Policy(ThreadRole::Audio).mmcssTask == "Pro Audio",
+          "parses fifo and an MMCSS task with a space");
+    Check(table.ParseLine("") && table.ParseLine("   # comment only"), "blank and comment lines");
+    Check(!table.ParseLine("decode high") && !table.ParseLine("io urgent") && !table.ParseLine("io high fifo=100") &&
+              !table.ParseLine("io high cpus=3-1") && !table.ParseLine("io high colour=red"),
+          "rejects unknown roles, classes, keys and bad values");
+    Check(CpuListText(0xD) == "0,2-3" && CpuListText(0) == "any", "CPU lists print back");
+}
+
+void CheckApply() {
+    ThreadPolicyTable table;
+    ThreadPolicy io;
+    io.priority = ThreadPriority::Low;
+    io.cpus = 1;
+    table.SetPolicy(ThreadRole::Io, io);
+    ThreadUsageLog usageLog;
+    std::string name, refused;
+    bool pinned = false;
+    std::thread worker([&] {
+        ScopedThreadPolicy policy(ThreadRole::Io, table, "policy-check-thread", &usageLog);
+        refused = policy.Refused();
+        char text[32] = {};
+        pthread_getname_np(pthread_self(), text, sizeof(text));
+        name = text;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+        pinned = CPU_COUNT(&set) == 1 && CPU_ISSET(0, &set);
+        Work(1000000);
+    });
+    worker.join();
+    Check(name == "policy-check-th", "thread named, cut to 15 characters");
+    Check(pinned, "pinned to CPU 0");
+    Check(refused.empty(), "nice 10 and the affinity taken without privileges");
+    const std::vector<ThreadUsageEntry> entries = usageLog.Entries();
+    Check(entries.size() == 1 && entries[0].usage.cpuSeconds > 0 && entries[0].usage.involuntarySwitches >= 0,
+          "usage logged with CPU time and switch counts");
+
+    // A pool thread takes one role after another: each gives back what the thread had,
+    // and normal on any CPU undoes a priority and pin the thread was left with
+    bool restored = false, reset = false;
+    std::thread pooled([&] {
+        const id_t thread = static_cast<id_t>(syscall(SYS_gettid));
+        cpu_set_t before, now;
+        pthread_getaffinity_np(pthread_self(), sizeof(before), &before);
+        const int niceBefore = getpriority(PRIO_PROCESS, thread);
+        std::string refusedRestore;
+        {
+            ScopedThreadPolicy first(ThreadRole::Io, table, "pool first");
+            first.Finish();
+            refusedRestore = first.Refused();
+        }
+        pthread_getaffinity_np(pthread_self(), sizeof(now), &now);
+        restored = CPU_EQUAL(&before, &now) &&
+                   (getpriority(PRIO_PROCESS, thread) == niceBefore || refusedRestore.find("restore nice") != std::string::npos);
+
+        cpu_set_t one;
+        CPU_ZERO(&one);
+        CPU_SET(0, &one);
+        pthread_setaffinity_np(pthread_self(), sizeof(one), &one);
+        setpriority(PRIO_PROCESS, thread, 5);
+        ScopedThreadPolicy second(ThreadRole::Io, ThreadPolicyTable(), "pool second");
+        pthread_getaffinity_np(pthread_self(), sizeof(now), &now);
+        reset = CPU_COUNT(&now) >= CPU_COUNT(&before) &&
+                (getpriority(PRIO_PROCESS, thread) == 0 || second.Refused().find("nice 0") != std::string::npos);
+    });
+    pooled.join();
+    Check(restored, "Finish gives back the nice value and the CPUs");
+    Check(reset, "normal on any CPU undoes an inherited nice and pin");
+}
+
+int main() {
+    printf("Policy table:\n");
+    CheckTable();
+    printf("\nApplying a policy:\n");
+    CheckApply();
+
+    const uint64_t workIterations = static_cast<uint64_t>(CalibrateWork() * WORK_MS);
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    printf("\n%u fps capture, %.0f ms of work per frame, device keeps %llu frames; %.0f s per run; %ld CPUs, hog %u threads per CPU\n\n",
+           FPS, WORK_MS, static_cast<unsigned long long>(DEVICE_FRAMES), SECONDS, cpus, HOGS_PER_CPU);
+    printf("%-34s %6s %7s %23s %7s %15s\n", "", "frames", "dropped", "picked up late, ms", "cpu s", "switches");
+    printf("%-34s %6s %7s %7s %7s %7s %7s %7s %7s\n", "", "", "", "p50", "p99", "max", "", "invol", "vol");
+
+    ThreadUsageLog usageLog;
+    ThreadPolicyTable normal; // Every role at normal priority on any CPU: how the pipeline runs today
+    normal.ParseLine("capture normal");
+    normal.ParseLine("telemetry normal");
+    const RunResult idle = Capture(normal, workIterations, usageLog);
+    Report("idle, default priority", idle);
+    const RunResult loaded = CaptureUnderLoad(normal, workIterations, usageLog);
+    Report("hog, default priority", loaded);
+
+    ThreadPolicyTable lowHog = normal;
+    lowHog.ParseLine("telemetry low");
+    Report("hog at low priority", CaptureUnderLoad(lowHog, workIterations, usageLog));
+
+    ThreadPolicyTable high = normal;
+    high.ParseLine("capture high");
+    Report("hog, capture high", CaptureUnderLoad(high, workIterations, usageLog));
+
+    ThreadPolicyTable realTime = normal;
+    realTime.ParseLine("capture realtime fifo=10");
+    const RunResult fifo = CaptureUnderLoad(realTime, workIterations, usageLog);
+    Report("hog, capture real-time", fifo);
+
+    if (cpus >= 2) {
+        ThreadPolicyTable pinned = normal;
+        pinned.ParseLine("capture normal cpus=0");
+        pinned.ParseLine("telemetry normal cpus=1-" + std::to_string(std::min(cpus, 64L) - 1));
+        Report("hog, capture on a CPU of its own", CaptureUnderLoad(pinned, workIterations, usageLog));
+    } else {
+        printf("%-34s (one CPU: nothing to keep the hog off)\n", "hog, capture on a CPU of its own");
+    }
+
+    printf("\nThread usage as logged:\n");
+    usageLog.Print(stdout);
+    printf("\n");
+    Check(idle.dropped == 0, "idle: no drops");
+    if (fifo.refused.empty()) {
+        Check(fifo.dropped <= loaded.dropped && fifo.dropped * 10 <= idle.frames, "real-time: at most a tenth dropped under the hog");
+    } else {
+        printf("  real-time refused here (%s); run as root to compare\n", fifo.refused.c_str());
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,217 @@
+// ThumbnailBench.cpp
+// CPU cost of making scrubbing thumbnails while recording (ThumbnailStage)
+// against building them afterwards by decoding the whole recording, per hour
+// of 30 fps video, at 640x480 and 1280x720.
+//   Live: capture-thread cost of Offer (copying 1 frame in 30), plus the worker's
+//   thread CPU time for scaling and JPEG sprite sheets. The capture loop sleeps
+//   between frames like a real one waiting on the camera, which gives the
+//   idle-priority worker its time. Skipped thumbnails are reported.
+//   Post-hoc: every frame has to be decoded, because a long-GOP file cannot be
+//   decoded only at every Nth frame. No H.264 decoder is assumed, so libjpeg
+//   decode of the same frames stands in for it (MJPEG-like cost). The thumbnail
+//   work is then the same as the live path.
+// Also checks the sheets: the tiles against an exact area-average reference of
+// the source frame, stretched to full range like the sheets (PSNR), and the cue
+// count in the WebVTT and JSON indexes.
+// Usage: ./Run.sh ThumbnailBench [minutes of video] [output directory]
+#include "Thumbnails.h"
+#include "MediaTypes.h"
+#include "Stats.h"
+#include "SyntheticMedia.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef HAVE_LIBJPEG
+#include <jpeglib.h>
+#endif
+
+// Constants
+const uint32_t FPS = 30;
+const uint32_t SOURCE_FRAMES = 8;     // Distinct frames; frame i shows pattern i % SOURCE_FRAMES
+const uint32_t FRAME_INTERVAL = 30;   // One thumbnail per second
+const auto CAPTURE_IDLE = std::chrono::microseconds(1000); // Time a capture loop spends waiting per frame (sped up)
+
+// PSNR of a sheet tile's luma against the source frame averaged over each thumbnail pixel's area
+double TilePsnr(const uint8_t* tile, size_t tileStride, const uint8_t* source, uint32_t width, uint32_t height,
+                uint32_t thumbWidth, uint32_t thumbHeight) {
+    double squared = 0;
+    for (uint32_t ty = 0; ty < thumbHeight; ++ty) {
+        for (uint32_t tx = 0; tx < thumbWidth; ++tx) {
+            const uint32_t x0 = tx * width / thumbWidth, x1 = (tx + 1) * width / thumbWidth;
+            const uint32_t y0 = ty * height / thumbHeight, y1 = (ty + 1) * height / thumbHeight;
+            double sum = 0;
+            for (uint32_t y = y0; y < y1; ++y) {
+                for (uint32_t x = x0; x < x1; ++x) sum += source[static_cast<size_t>(y) * width + x];
+            }
+            // The sheets are full-range JPEG; the source is studio range
+            const double reference = (sum / ((x1 - x0) * (y1 - y0)) - 16) * 255 / 219;
+            const double difference = tile[ty * tileStride + tx] - std::min(std::max(reference, 0.0), 255.0);
+            squared += difference * difference;
+        }
+    }
+    const double mse = squared / (thumbWidth * thumbHeight);
+    return mse > 0 ? 10 * log10(255.0 * 255.0 / mse) : 99.0;
+}
+
+uint32_t CountLines(const std::string& path, const char* needle) {
+    FILE* file = fopen(path.c_str(), "r");
+    if (!file) return 0;
+    char line[512];
+    uint32_t count = 0;
+    while (fgets(line, sizeof(line), file)) {
+        if (strstr(line, needle)) ++count;
+    }
+    fclose(file);
+    return count;
+}
+
+#ifdef HAVE_LIBJPEG
+// NV12 frame as a 4:2:0 JPEG in memory, the stand-in for one coded frame of the recording
+std::vector<uint8_t> EncodeFrame(const uint8_t* nv12, uint32_t width, uint32_t height) {
+    const std::string path = "/tmp/ThumbnailBench_frame.jpg";
+    std::vector<uint8_t> padded(static_cast<size_t>(width) * ((height + 15) & ~15u) * 3 / 2, 128);
+    memcpy(padded.data(), nv12, static_cast<size_t>(width) * height);
+    memcpy(padded.data() + static_cast<size_t>(width) * ((height + 15) & ~15u), nv12 + static_cast<size_t>(width) * height,
+           static_cast<size_t>(width) * height / 2);
+    WriteJpegNv12(path, padded.data(), padded.data() + static_cast<size_t>(width) * ((height + 15) & ~15u), width, height, width, 85);
+    std::vector<uint8_t> data;
+    if (FILE* file = fopen(path.c_str(), "rb")) {
+        uint8_t chunk[65536];
+        size_t got;
+        while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0) data.insert(data.end(), chunk, chunk + got);
+        fclose(file);
+    }
+    remove(path.c_str());
+    return data;
+}
+
+// Decode to YCbCr without colour conversion, as a video decoder hands out YUV
+bool DecodeJpeg(const uint8_t* data, size_t size, std::vector<uint8_t>& pixels, uint32_t& width, uint32_t& height) {
+    jpeg_decompress_struct decompress;
+    jpeg_error_mgr errors;
+    decompress.err = jpeg_std_error(&errors);
+    jpeg_create_decompress(&decompress);
+    jpeg_mem_src(&decompress, const_cast<uint8_t*>(data), static_cast<unsigned long>(size));
+    if (jpeg_read_header(&decompress, TRUE) != JPEG_HEADER_OK) {
+        jpeg_destroy_decompress(&decompress);
+        return false;
+    }
+    decompress.out_color_space = JCS_YCbCr;
+    jpeg_start_decompress(&decompress);
+    width = decompress.output_width;
+    height = decompress.output_height;
+    pixels.resize(static_cast<size_t>(width) * height * 3);
+    while (decompress.output_scanline < decompress.output_height) {
+        JSAMPROW row = pixels.data() + static_cast<size_t>(decompress.output_scanline) * width * 3;
+        jpeg_read_scanlines(&decompress, &row, 1);
+    }
+    jpeg_finish_decompress(&decompress);
+    jpeg_destroy_decompress(&decompress);
+    return true;
+}
+#endif
+
+bool RunCase(uint32_t width, uint32_t height, double minutes, const std::string& directory) {
+    std::vector<std::vector<uint8_t>> frames(SOURCE_FRAMES, std::vector<uint8_t>(Frame420Size(width, height)));
+    for (uint32_t i = 0; i < SOURCE_FRAMES; ++i) FillTestPattern(frames[i].data(), width, height, PixelFormat::NV12, i * 37);
+    const uint64_t frameCount = static_cast<uint64_t>(minutes * 60 * FPS);
+    const double hours = frameCount / (3600.0 * FPS);
+
+    char name[64];
+    snprintf(name, sizeof(name), "/ThumbnailBench_%ux%u", width, height);
+    const std::string prefix = directory + name;
+    ThumbnailStage stage;
+    ThumbnailConfig config;
+    config.frameInterval = FRAME_INTERVAL;
+    if (!stage.Start(prefix, width, height, config)) return false;
+
+    LatencyHistogram offerCost;
+    int64_t capturedTicks = 0;
+    VideoFrame frame;
+    for (uint64_t i = 0; i < frameCount; ++i) {
+        Describe420Frame(frame, frames[i % SOURCE_FRAMES].data(), width, height, PixelFormat::NV12);
+        frame.pts = static_cast<int64_t>(i) * TICKS_PER_SECOND / FPS;
+        const int64_t start = NowTicks();
+        const bool taken = stage.Offer(frame);
+        const int64_t spent = NowTicks() - start;
+        capturedTicks += spent;
+        if (taken) offerCost.Record(static_cast<uint64_t>(spent) / 10);
+        std::this_thread::sleep_for(CAPTURE_IDLE);
+    }
+    const bool stopped = stage.Stop(static_cast<int64_t>(frameCount) * TICKS_PER_SECOND / FPS);
+    const double liveSeconds = (capturedTicks + stage.WorkerTicks()) / static_cast<double>(TICKS_PER_SECOND);
+
+    printf("%ux%u, %.1f min at %u fps, 1 thumbnail per %u frames (%ux%u, %u per sheet):\n", width, height, minutes, FPS, FRAME_INTERVAL,
+           stage.ThumbWidth(), stage.ThumbHeight(), config.columns * config.rows);
+    printf("  live:     Offer on the capture thread mean %.0f us, p99 %.0f us (copying frames); worker %.2f s CPU; "
+           "%llu/%llu taken, %llu skipped, %u sheets\n",
+           offerCost.Mean(), static_cast<double>(offerCost.Percentile(99)), stage.WorkerTicks() / 1e7,
+           static_cast<unsigned long long>(stage.Taken()), static_cast<unsigned long long>(stage.Offered()),
+           static_cast<unsigned long long>(stage.Skipped()), stage.SheetsWritten());
+    printf("            %.1f CPU seconds per hour of recording\n", liveSeconds / hours);
+
+    bool ok = stopped && stage.Skipped() == 0;
+    const uint32_t cues = CountLines(prefix + "_thumbnails.vtt", "#xywh=");
+    const uint32_t entries = CountLines(prefix + "_thumbnails.json", "\"sheet\":");
+    const bool indexes = cues == stage.Taken() && entries == stage.Taken();
+    ok = ok && indexes;
+#ifdef HAVE_LIBJPEG
+    // Decoding every frame is what the post-hoc path cannot avoid
+    std::vector<std::vector<uint8_t>> coded;
+    for (const std::vector<uint8_t>& f : frames) coded.push_back(EncodeFrame(f.data(), width, height));
+    std::vector<uint8_t> pixels;
+    uint32_t decodedWidth = 0, decodedHeight = 0;
+    const uint64_t sampled = std::min<uint64_t>(frameCount, 20 * FPS);
+    const int64_t start = NowTicks();
+    for (uint64_t i = 0; i < sampled; ++i) {
+        const std::vector<uint8_t>& data = coded[i % SOURCE_FRAMES];
+        ok = DecodeJpeg(data.data(), data.size(), pixels, decodedWidth, decodedHeight) && ok;
+    }
+    const double decodePerFrame = (NowTicks() - start) / static_cast<double>(TICKS_PER_SECOND) / sampled;
+    const double postHoc = decodePerFrame * 3600 * FPS + stage.WorkerTicks() / 1e7 / hours;
+    printf("  post-hoc: decode every frame %.2f ms (libjpeg stand-in) -> %.1f CPU seconds per hour of recording (%.0fx the live path)\n",
+           decodePerFrame * 1e3, postHoc, postHoc / (liveSeconds / hours));
+
+    // Tile k of sheet 0 is frame k * FRAME_INTERVAL
+    std::vector<uint8_t> sheetFile;
+    if (FILE* file = fopen(stage.SheetPath(0).c_str(), "rb")) {
+        uint8_t chunk[65536];
+        size_t got;
+        while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0) sheetFile.insert(sheetFile.end(), chunk, chunk + got);
+        fclose(file);
+    }
+    double worstPsnr = 99;
+    const bool decoded = DecodeJpeg(sheetFile.data(), sheetFile.size(), pixels, decodedWidth, decodedHeight) &&
+                         decodedWidth == config.columns * stage.ThumbWidth();
+    if (decoded) {
+        std::vector<uint8_t> luma(static_cast<size_t>(decodedWidth) * decodedHeight);
+        for (size_t i = 0; i < luma.size(); ++i) luma[i] = pixels[3 * i];
+        const uint32_t tiles = std::min<uint32_t>(static_cast<uint32_t>(stage.Taken()), config.columns * config.rows);
+        for (uint32_t k = 0; k < tiles; ++k) {
+            const uint32_t x = k % config.columns * stage.ThumbWidth(), y = k / config.columns * stage.ThumbHeight();
+            const std::vector<uint8_t>& source = frames[(static_cast<uint64_t>(k) * FRAME_INTERVAL) % SOURCE_FRAMES];
+            worstPsnr = std::min(worstPsnr, TilePsnr(luma.data() + static_cast<size_t>(y) * decodedWidth + x, decodedWidth, source.data(),
+                                                     width, height, stage.ThumbWidth(), stage.ThumbHeight()));
+        }
+    }
+    printf("  check:    sheet 0 decodes: %s, worst tile PSNR vs area average %.1f dB, %u VTT cues / %u JSON entries: %s\n\n",
+           decoded ? "ok" : "FAILED", worstPsnr, cues, entries, indexes ? "ok" : "FAILED");
+    ok = ok && decoded && worstPsnr > 28;
+#else
+    printf("  post-hoc comparison and sheet checks need libjpeg (HAVE_LIBJPEG); indexes %s\n\n", indexes ? "ok" : "FAILED");
+#endif
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    const double minutes = argc > 1 ? atof(argv[1]) : 2.0;
+    const std::string directory = argc > 2 ? argv[2] : "/tmp";
+    bool ok = RunCase(640, 480, minutes, directory);
+    ok = RunCase(1280, 720, minutes, directory) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,485 @@
+// Thumbnails.h
+// Scrubbing thumbnails made while recording, so the review UI does not have to
+// decode the whole file afterwards.
+//   ThumbnailStage  - the capture thread offers every frame; every Nth is copied
+//                     into a small pool and handed to a low-priority worker. If
+//                     the worker is behind, the thumbnail is skipped and the
+//                     capture thread never waits.
+//                     The worker halves the frame with FrameKernels (compiled for
+//                     the recorders' profiles, ProfileKernels.h) until it is within
+//                     2x of the thumbnail size (a box filter, no aliasing).
+//                     Nv12CropScaler then scales it bilinearly straight into its
+//                     tile of an NV12 sprite sheet.
+//                     Full sheets are written as JPEG. Stop writes the last,
+//                     partial sheet and two indexes:
+//                       <prefix>_thumbnails.vtt   WebVTT cues, "sheet.jpg#xywh=x,y,w,h"
+//                       <prefix>_thumbnails.json  the same with sheet geometry
+//   WriteJpegNv12   - JPEG from an NV12 buffer: libjpeg raw 4:2:0 input when built
+//                     with HAVE_LIBJPEG (no colour conversion; the studio range is
+//                     only stretched to JFIF's full range), WIC on Windows
+#pragma once
+
+#include "CropScale.h"
+#include "FramePool.h"
+#include "MediaTypes.h"
+#include "ProfileKernels.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(HAVE_LIBJPEG)
+#include <jpeglib.h>
+#include <setjmp.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#include <wincodec.h>
+#pragma comment(lib, "windowscodecs.lib")
+#pragma comment(lib, "ole32.lib")
+#endif
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#endif
+
+struct ThumbnailConfig {
+    uint32_t frameInterval = 60;  // Take every Nth captured frame
+    uint32_t thumbWidth = 160;    // Even
+    uint32_t thumbHeight = 0;     // 0 = thumbWidth at the source aspect, rounded to even
+    uint32_t columns = 10;        // Thumbnails per sheet row
+    uint32_t rows = 10;           // Thumbnail rows per sheet
+    uint32_t quality = 75;        // JPEG quality 1..100
+    uint32_t poolFrames = 3;      // Frames copied and waiting for the worker
+};
+
+#if defined(HAVE_LIBJPEG)
+// libjpeg's default error_exit calls exit(); this one jumps back into WriteJpegNv12 instead
+struct JpegErrorManager {
+    jpeg_error_mgr pub;
+    jmp_buf jump;
+};
+
+inline void JpegErrorExit(j_common_ptr common) {
+    (*common->err->output_message)(common);
+    longjmp(reinterpret_cast<JpegErrorManager*>(common->err)->jump, 1);
+}
+#endif
+
+// stride is the row pitch of both planes. Rows past height up to the next multiple of 16,
+// and columns up to stride, must be readable: libjpeg's raw input takes whole 16x16 blocks.
+inline bool WriteJpegNv12(const std::string& path, const uint8_t* y, const uint8_t* uv, uint32_t width, uint32_t height, size_t stride,
+                          uint32_t quality) {
+#if defined(HAVE_LIBJPEG)
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        printf("Failed to create %s.\n", path.c_str());
+        return false;
+    }
+    // NV12 from the capture is BT.601 studio range; JFIF YCbCr is full range
+    uint8_t lumaRange[256], chromaRange[256];
+    for (int v = 0; v < 256; ++v) {
+        lumaRange[v] = static_cast<uint8_t>(std::min(std::max(((v - 16) * 255 + 109) / 219, 0), 255));
+        const int chroma = (v - 128) * 255;
+        chromaRange[v] = static_cast<uint8_t>(std::min(std::max(128 + (chroma + (chroma < 0 ? -112 : 112)) / 224, 0), 255));
+    }
+    // 16 luma rows and 8 chroma rows per call; NV12 chroma is split into planes as it goes
+    const size_t chromaWidth = stride / 2;
+    std::vector<uint8_t> luma(stride * 16), cb(chromaWidth * 8), cr(chromaWidth * 8);
+
+    jpeg_compress_struct compress;
+    JpegErrorManager errors;
+    compress.err = jpeg_std_error(&errors.pub);
+    errors.pub.error_exit = JpegErrorExit;
+    if (setjmp(errors.jump)) {
+        jpeg_destroy_compress(&compress);
+        fclose(file);
+        remove(path.c_str());
+        printf("Failed to write %s.\n", path.c_str());
+        return false;
+    }
+    jpeg_create_compress(&compress);
+    jpeg_stdio_dest(&compress, file);
+    compress.image_width = width;
+    compress.image_height = height;
+    compress.input_components = 3;
+    compress.in_color_space = JCS_YCbCr;
+    jpeg_set_defaults(&compress);
+    jpeg_set_quality(&compress, static_cast<int>(quality), TRUE);
+    compress.raw_data_in = TRUE;
+    compress.comp_info[0].h_samp_factor = compress.comp_info[0].v_samp_factor = 2;
+    for (int c = 1; c < 3; ++c) compress.comp_info[c].h_samp_factor = compress.comp_info[c].v_samp_factor = 1;
+    jpeg_start_compress(&compress, TRUE);
+    JSAMPROW yRows[16], cbRows[8], crRows[8];
+    JSAMPARRAY planes[3] = { yRows, cbRows, crRows };
+    while (compress.next_scanline < compress.image_height) {
+        const uint32_t top = compress.next_scanline;
+        for (uint32_t r = 0; r < 16; ++r) {
+            const uint8_t* source = y + (top + r) * stride;
+            yRows[r] = luma.data() + r * stride;
+            for (size_t x = 0; x < stride; ++x) yRows[r][x] = lumaRange[source[x]];
+        }
+        for (uint32_t r = 0; r < 8; ++r) {
+            const uint8_t* source = uv + (top / 2 + r) * stride;
+            for (size_t x = 0; x < chromaWidth; ++x) {
+                cb[r * chromaWidth + x] = chromaRange[source[2 * x]];
+                cr[r * chromaWidth + x] = chromaRange[source[2 * x + 1]];
+            }
+            cbRows[r] = cb.data() + r * chromaWidth;
+            crRows[r] = cr.data() + r * chromaWidth;
+        }
+        jpeg_write_raw_data(&compress, planes, 16);
+    }
+    jpeg_finish_compress(&compress);
+    jpeg_destroy_compress(&compress);
+    fclose(file);
+    return true;
+#elif defined(_WIN32)
+    // WIC takes BGR; convert with BT.601 limited range, the capture format's matrix
+    std::vector<uint8_t> bgr(static_cast<size_t>(width) * height * 3);
+    for (uint32_t row = 0; row < height; ++row) {
+        const uint8_t* luma = y + row * stride;
+        const uint8_t* chroma = uv + (row / 2) * stride;
+        uint8_t* out = bgr.data() + static_cast<size_t>(row) * width * 3;
+        for (uint32_t x = 0; x < width; ++x) {
+            const int c = 298 * (luma[x] - 16), d = chroma[x & ~1u] - 128, e = chroma[x | 1u] - 128;
+            out[3 * x + 0] = static_cast<uint8_t>(std::min<int>(std::max<int>((c + 516 * d + 128) >> 8, 0), 255));
+            out[3 * x + 1] = static_cast<uint8_t>(std::min<int>(std::max<int>((c - 100 * d - 208 * e + 128) >> 8, 0), 255));
+            out[3 * x + 2] = static_cast<uint8_t>(std::min<int>(std::max<int>((c + 409 * e + 128) >> 8, 0), 255));
+        }
+    }
+    IWICImagingFactory* factory = nullptr;
+    IWICStream* stream = nullptr;
+    IWICBitmapEncoder* encoder = nullptr;
+    IWICBitmapFrameEncode* frame = nullptr;
+    IPropertyBag2* properties = nullptr;
+    std::wstring widePath(path.begin(), path.end());
+    HRESULT hr = CoCreateInstance(CLSID_WICImagingFactory, NULL, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory));
+    if (SUCCEEDED(hr)) hr = factory->CreateStream(&stream);
+    if (SUCCEEDED(hr)) hr = stream->InitializeFromFilename(widePath.c_str(), GENERIC_WRITE);
+    if (SUCCEEDED(hr)) hr = factory->CreateEncoder(GUID_ContainerFormatJpeg, NULL, &encoder);
+    if (SUCCEEDED(hr)) hr = encoder->Initialize(stream, WICBitmapEncoderNoCache);
+    if (SUCCEEDED(hr)) hr = encoder->CreateNewFrame(&frame, &properties);
+    if (SUCCEEDED(hr)) {
+        PROPBAG2 option = {};
+        option.pstrName = const_cast<LPOLESTR>(L"ImageQuality");
+        VARIANT value;
+        VariantInit(&value);
+        value.vt = VT_R4;
+        value.fltVal = quality / 100.0f;
+        hr = properties->Write(1, &option, &value);
+    }
+    if (SUCCEEDED(hr)) hr = frame->Initialize(properties);
+    if (SUCCEEDED(hr)) hr = frame->SetSize(width, height);
+    WICPixelFormatGUID format = GUID_WICPixelFormat24bppBGR;
+    if (SUCCEEDED(hr)) hr = frame->SetPixelFormat(&format);
+    if (SUCCEEDED(hr)) hr = frame->WritePixels(height, width * 3, static_cast<UINT>(bgr.size()), bgr.data());
+    if (SUCCEEDED(hr)) hr = frame->Commit();
+    if (SUCCEEDED(hr)) hr = encoder->Commit();
+    if (properties) properties->Release();
+    if (frame) frame->Release();
+    if (encoder) encoder->Release();
+    if (stream) stream->Release();
+    if (factory) factory->Release();
+    if (FAILED(hr)) printf("Failed to write %s HRESULT: 0x%08lx\n", path.c_str(), static_cast<unsigned long>(hr));
+    return SUCCEEDED(hr);
+#else
+    (void)y, (void)uv, (void)width, (void)height, (void)stride, (void)quality;
+    printf("No JPEG encoder built in; %s not written (build with HAVE_LIBJPEG).\n", path.c_str());
+    return false;
+#endif
+}
+
+class ThumbnailStage {
+public:
+    ThumbnailStage() = default;
+    ThumbnailStage(const ThumbnailStage&) = delete;
+    ThumbnailStage& operator=(const ThumbnailStage&) = delete;
+    ~ThumbnailStage() { Stop(0); }
+
+    // prefix: output path without extension, e.g. "output" for output.mp4
+    bool Start(const std::string& outputPrefix, uint32_t frameWidth, uint32_t frameHeight, const ThumbnailConfig& thumbnailConfig = ThumbnailConfig()) {
+        Stop(0);
+        if (frameWidth == 0 || frameHeight == 0) {
+            printf("Invalid frame size %ux%u for thumbnails.\n", frameWidth, frameHeight);
+            return false;
+        }
+        config = thumbnailConfig;
+        if (config.thumbHeight == 0) config.thumbHeight = (config.thumbWidth * frameHeight / frameWidth + 1) & ~1u;
+        if (config.frameInterval == 0 || config.columns == 0 || config.rows == 0 || (config.thumbWidth & 1) || config.thumbHeight < 2) {
+            printf("Invalid thumbnail configuration.\n");
+            return false;
+        }
+        prefix = outputPrefix;
+        width = frameWidth;
+        height = frameHeight;
+        frameBytes = Frame420Size(width, height);
+
+        // Halve while the result is still at least the thumbnail size: the bilinear pass then scales by less than 2
+        halvings = 0;
+        while ((width >> (halvings + 1)) >= config.thumbWidth && (height >> (halvings + 1)) >= config.thumbHeight &&
+               (width >> (halvings + 1)) % 2 == 0 && (height >> (halvings + 1)) % 2 == 0) {
+            ++halvings;
+        }
+        const uint32_t scaledWidth = width >> halvings, scaledHeight = height >> halvings;
+        if (!scaler.Init(scaledWidth, scaledHeight, config.thumbWidth, config.thumbHeight) || !pool.Allocate(config.poolFrames, frameBytes)) {
+            printf("Cannot make %ux%u thumbnails from %ux%u frames.\n", config.thumbWidth, config.thumbHeight, width, height);
+            return false;
+        }
+        halvers.clear();
+        for (uint32_t i = 0; i < halvings; ++i) halvers.emplace_back(width >> i, height >> i, PixelFormat::NV12);
+        halved[0].assign(halvings > 0 ? Frame420Size(width >> 1, height >> 1) : 0, 0);
+        halved[1].assign(halvings > 1 ? Frame420Size(width >> 2, height >> 2) : 0, 0);
+        sheetWidth = config.columns * config.thumbWidth;
+        sheetHeight = config.rows * config.thumbHeight;
+        sheetStride = (sheetWidth + 15) & ~15u;
+        sheet.assign(static_cast<size_t>(sheetStride) * ((sheetHeight + 15) & ~15u) * 3 / 2, 0);
+        ClearSheet();
+        cues.clear();
+        queue.clear();
+        sheetIndex = 0;
+        tile = 0;
+        frameCounter = 0;
+        offered = taken = skipped = 0;
+        sheetsWritten = 0;
+        workerTicks = 0;
+        stopping = false;
+        worker = std::thread(&ThumbnailStage::WorkerLoop, this);
+        return true;
+    }
+
+    // Capture thread, every frame. Copies 1 in frameInterval frames into the pool; never blocks.
+    // Returns true if this frame will become a thumbnail.
+    bool Offer(const VideoFrame& frame) {
+        if (!worker.joinable()) return false;
+        if (frameCounter++ % config.frameInterval != 0) return false;
+        ++offered;
+        const int slot = pool.Acquire();
+        if (slot < 0) {
+            ++skipped; // Worker is behind; losing a thumbnail is better than delaying capture
+            return false;
+        }
+        uint8_t* copy = pool.Slot(slot);
+        for (uint32_t row = 0; row < height; ++row) {
+            memcpy(copy + static_cast<size_t>(row) * width, frame.planes[0] + static_cast<size_t>(row) * frame.strides[0], width);
+        }
+        uint8_t* uv = copy + static_cast<size_t>(width) * height;
+        for (uint32_t row = 0; row < height / 2; ++row) {
+            memcpy(uv + static_cast<size_t>(row) * width, frame.planes[1] + static_cast<size_t>(row) * frame.strides[1], width);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(Pending{ slot, frame.pts });
+        }
+        wake.notify_one();
+        ++taken;
+        return true;
+    }
+
+    // Drain the worker, write the last sheet and the WebVTT/JSON indexes.
+    // endPts closes the last cue (the pts just after the last captured frame).
+    bool Stop(int64_t endPts) {
+        if (!worker.joinable()) return false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+        bool ok = true;
+        if (tile > 0) ok = WriteSheet(tile);
+        return WriteIndexes(endPts) && ok;
+    }
+
+    uint64_t Offered() const { return offered; }
+    uint64_t Taken() const { return taken; }
+    uint64_t Skipped() const { return skipped; }
+    uint32_t SheetsWritten() const { return sheetsWritten; }
+    uint32_t ThumbWidth() const { return config.thumbWidth; }
+    uint32_t ThumbHeight() const { return config.thumbHeight; }
+    // CPU time the worker has used, in 100-ns ticks (wall time where thread CPU time is unavailable)
+    int64_t WorkerTicks() const { return workerTicks; }
+    std::string SheetPath(uint32_t index) const {
+        char name[32];
+        snprintf(name, sizeof(name), "_sprites_%03u.jpg", index);
+        return prefix + name;
+    }
+
+private:
+    struct Pending {
+        int slot;
+        int64_t pts;
+    };
+
+    struct Cue {
+        int64_t pts;
+        uint32_t sheet;
+        uint32_t x, y;
+    };
+
+    static int64_t ThreadCpuTicks() {
+#ifdef _WIN32
+        FILETIME created, exited, kernel, user;
+        if (!GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user)) return NowTicks();
+        return static_cast<int64_t>(((static_cast<uint64_t>(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime) +
+                                    ((static_cast<uint64_t>(user.dwHighDateTime) << 32) | user.dwLowDateTime));
+#else
+        timespec now;
+        if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0) return NowTicks();
+        return static_cast<int64_t>(now.tv_sec) * TICKS_PER_SECOND + now.tv_nsec / 100;
+#endif
+    }
+
+    void WorkerLoop() {
+        // Below the capture and encode threads so thumbnails only use idle CPU
+#ifdef _WIN32
+        SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+        CoInitializeEx(NULL, COINIT_MULTITHREADED); // WIC
+#else
+        sched_param param = {};
+        pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+        const int64_t cpuStart = ThreadCpuTicks();
+        for (;;) {
+            Pending next;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (queue.empty()) break;
+                next = queue.front();
+                queue.pop_front();
+            }
+            AddThumbnail(pool.Slot(next.slot), next.pts);
+            pool.Release(next.slot);
+            workerTicks = ThreadCpuTicks() - cpuStart;
+        }
+        workerTicks = ThreadCpuTicks() - cpuStart;
+#ifdef _WIN32
+        CoUninitialize();
+#endif
+    }
+
+    void AddThumbnail(const uint8_t* frame, int64_t pts) {
+        // Box-filter halvings, then a bilinear pass into the tile
+        const uint8_t* source = frame;
+        uint32_t w = width, h = height;
+        for (uint32_t i = 0; i < halvings; ++i) {
+            uint8_t* out = halved[i % 2].data();
+            halvers[i].Halve(source, out);
+            source = out;
+            w /= 2;
+            h /= 2;
+        }
+        const uint32_t column = tile % config.columns, row = tile / config.columns;
+        const uint32_t x = column * config.thumbWidth, y = row * config.thumbHeight;
+        uint8_t* sheetUv = sheet.data() + static_cast<size_t>(sheetStride) * ((sheetHeight + 15) & ~15u);
+        RoiRect all;
+        all.width = w;
+        all.height = h;
+        scaler.Scale(source, w, source + static_cast<size_t>(w) * h, w, all,
+                     sheet.data() + static_cast<size_t>(y) * sheetStride + x, sheetStride,
+                     sheetUv + static_cast<size_t>(y / 2) * sheetStride + x, sheetStride);
+        cues.push_back(Cue{ pts, sheetIndex, x, y });
+        if (++tile == config.columns * config.rows) WriteSheet(tile);
+    }
+
+    // Write the current sheet; a partial last sheet is cut to the rows in use
+    bool WriteSheet(uint32_t tiles) {
+        const uint32_t usedRows = (tiles + config.columns - 1) / config.columns;
+        const uint32_t paddedHeight = (sheetHeight + 15) & ~15u;
+        const bool ok = WriteJpegNv12(SheetPath(sheetIndex), sheet.data(), sheet.data() + static_cast<size_t>(sheetStride) * paddedHeight,
+                                      sheetWidth, usedRows * config.thumbHeight, sheetStride, config.quality);
+        if (ok) ++sheetsWritten;
+        ++sheetIndex;
+        tile = 0;
+        ClearSheet();
+        return ok;
+    }
+
+    void ClearSheet() {
+        const size_t lumaBytes = static_cast<size_t>(sheetStride) * ((sheetHeight + 15) & ~15u);
+        memset(sheet.data(), 16, lumaBytes);
+        memset(sheet.data() + lumaBytes, 128, sheet.size() - lumaBytes);
+    }
+
+    static std::string VttTime(int64_t ticks) {
+        const int64_t ms = std::max<int64_t>(ticks, 0) / 10000;
+        char text[32];
+        snprintf(text, sizeof(text), "%02lld:%02lld:%02lld.%03lld", static_cast<long long>(ms / 3600000), static_cast<long long>(ms / 60000 % 60),
+                 static_cast<long long>(ms / 1000 % 60), static_cast<long long>(ms % 1000));
+        return text;
+    }
+
+    // Sheet names in the indexes are relative to the index files
+    std::string SheetName(uint32_t index) const {
+        const std::string path = SheetPath(index);
+        const size_t slash = path.find_last_of("/\\");
+        return slash == std::string::npos ? path : path.substr(slash + 1);
+    }
+
+    bool WriteIndexes(int64_t endPts) {
+        FILE* vtt = fopen((prefix + "_thumbnails.vtt").c_str(), "w");
+        FILE* json = fopen((prefix + "_thumbnails.json").c_str(), "w");
+        if (!vtt || !json) {
+            printf("Failed to create the thumbnail index for %s.\n", prefix.c_str());
+            if (vtt) fclose(vtt);
+            if (json) fclose(json);
+            return false;
+        }
+        fprintf(vtt, "WEBVTT\n\n");
+        fprintf(json, "{\n  \"thumbWidth\": %u,\n  \"thumbHeight\": %u,\n  \"columns\": %u,\n  \"rows\": %u,\n  \"sheets\": [",
+                config.thumbWidth, config.thumbHeight, config.columns, config.rows);
+        for (uint32_t i = 0; i < sheetIndex; ++i) fprintf(json, "%s\"%s\"", i ? ", " : "", SheetName(i).c_str());
+        fprintf(json, "],\n  \"thumbnails\": [\n");
+        const int64_t origin = cues.empty() ? 0 : cues.front().pts;
+        for (size_t i = 0; i < cues.size(); ++i) {
+            const Cue& cue = cues[i];
+            const int64_t start = cue.pts - origin;
+            const int64_t end = (i + 1 < cues.size() ? cues[i + 1].pts : std::max<int64_t>(endPts, cue.pts + 1)) - origin;
+            fprintf(vtt, "%s --> %s\n%s#xywh=%u,%u,%u,%u\n\n", VttTime(start).c_str(), VttTime(end).c_str(), SheetName(cue.sheet).c_str(),
+                    cue.x, cue.y, config.thumbWidth, config.thumbHeight);
+            fprintf(json, "    { \"start\": %.3f, \"end\": %.3f, \"sheet\": %u, \"x\": %u, \"y\": %u }%s\n", start / 1e7, end / 1e7, cue.sheet,
+                    cue.x, cue.y, i + 1 < cues.size() ? "," : "");
+        }
+        fprintf(json, "  ]\n}\n");
+        const bool ok = ferror(vtt) == 0 && ferror(json) == 0;
+        fclose(vtt);
+        fclose(json);
+        return ok;
+    }
+
+    ThumbnailConfig config;
+    std::string prefix;
+    uint32_t width = 0, height = 0;
+    size_t frameBytes = 0;
+    uint32_t halvings = 0;
+    std::vector<FrameKernels> halvers; // One per halving, for that level's size
+    std::vector<uint8_t> halved[2];
+    Nv12CropScaler scaler;
+    FramePool pool;
+    std::vector<uint8_t> sheet; // NV12; stride and luma rows padded to multiples of 16 for the JPEG encoder
+    uint32_t sheetWidth = 0, sheetHeight = 0, sheetStride = 0;
+    uint32_t sheetIndex = 0, tile = 0;
+    std::vector<Cue> cues;
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Pending> queue;
+    bool stopping = false;
+
+    uint64_t frameCounter = 0;
+    uint64_t offered = 0, taken = 0, skipped = 0;
+    std::atomic<uint32_t> sheetsWritten{ 0 };
+    std::atomic<int64_t> workerTicks{ 0 };
+};
@@ -0,0 +1,177 @@
+// TsChunker.h
+// Cuts an MPEG-TS byte stream (ffmpeg's -f mpegts output) into chunks that
+// can go to several destinations, each of which may start or restart at any
+// keyframe:
+//   - reassembles 188-byte packets across reads, resyncing on the 0x47 sync byte
+//   - learns the video PID from the PAT and PMT
+//   - starts a keyframe chunk at each video packet with the random access
+//     indicator set, prefixed with the latest PAT and PMT, so a destination
+//     that begins on it can decode at once
+//   - numbers every PAT and PMT packet it sends, the stream's own and the
+//     copies, from one continuity counter per table PID, so the copies do not
+//     repeat counter values
+//   - ends other chunks at maxBytes and at the end of each Push, so data
+//     reaches the destinations as soon as it is read
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <functional>
+#include <vector>
+
+// A chunk: whole packets; keyframe chunks start with PAT, PMT and the keyframe's first packet
+typedef std::function<void(const uint8_t* data, size_t bytes, bool keyframe)> TsChunkSink;
+
+class TsChunker {
+public:
+    static const size_t PACKET = 188;
+    static const uint8_t SYNC = 0x47;
+
+    // maxBytes includes the PAT and PMT in front of a keyframe; at least four packets
+    void Init(size_t maxBytes) {
+        maxChunk = (maxBytes < 4 * PACKET ? 4 * PACKET : maxBytes) / PACKET * PACKET;
+        chunk.reserve(maxChunk);
+        Reset();
+        patCounter = pmtCounter = 0;
+        packets = keyframes = resyncs = 0;
+    }
+
+    // A new stream follows (the encoder restarted): forget its tables. The table counters run on,
+    // as destinations see one stream.
+    void Reset() {
+        partialBytes = 0;
+        chunk.clear();
+        chunkKeyframe = false;
+        pat.clear();
+        pmt.clear();
+        pmtPid = videoPid = -1;
+    }
+
+    void Push(const uint8_t* data, size_t length, const TsChunkSink& sink) {
+        while (length > 0) {
+            if (partialBytes == 0 && data[0] != SYNC) {
+                ++resyncs; // Skip to the next sync byte
+                const uint8_t* sync = static_cast<const uint8_t*>(memchr(data, SYNC, length));
+                const size_t skip = sync ? static_cast<size_t>(sync - data) : length;
+                data += skip;
+                length -= skip;
+                continue;
+            }
+            const size_t take = PACKET - partialBytes < length ? PACKET - partialBytes : length;
+            memcpy(partial + partialBytes, data, take);
+            partialBytes += take;
+            data += take;
+            length -= take;
+            if (partialBytes == PACKET) {
+                partialBytes = 0;
+                Packet(partial, sink);
+            }
+        }
+        Emit(sink);
+    }
+
+    int VideoPid() const { return videoPid; }
+    uint64_t Packets() const { return packets; }
+    uint64_t Keyframes() const { return keyframes; }
+    uint64_t Resyncs() const { return resyncs; }
+
+private:
+    void Packet(const uint8_t* packet, const TsChunkSink& sink) {
+        ++packets;
+        const bool unitStart = (packet[1] & 0x40) != 0;
+        const int pid = ((packet[1] & 0x1F) << 8) | packet[2];
+        const uint8_t adaptation = (packet[3] >> 4) & 3;
+        size_t payload = 4;
+        bool randomAccess = false;
+        if (adaptation & 2) {
+            randomAccess = packet[4] > 0 && (packet[5] & 0x40) != 0;
+            payload += 1 + packet[4];
+        }
+        if (unitStart && (adaptation & 1) && payload < PACKET) {
+            if (pid == 0) ReadPat(packet, payload);
+            else if (pid == pmtPid) ReadPmt(packet, payload);
+        }
+
+        if (pid == videoPid && randomAccess && !pat.empty() && !pmt.empty()) {
+            Emit(sink);
+            ++keyframes;
+            Append(pat.data(), 0);
+            Append(pmt.data(), pmtPid);
+            chunkKeyframe = true;
+        } else if (chunk.size() + PACKET > maxChunk) {
+            Emit(sink);
+        }
+        Append(packet, pid);
+    }
+
+    // Add a packet to the chunk; PAT and PMT packets get the next value of their PID's counter
+    void Append(const uint8_t* packet, int pid) {
+        chunk.insert(chunk.end(), packet, packet + PACKET);
+        uint8_t* counter = pid == 0 ? &patCounter : pid == pmtPid ? &pmtCounter : nullptr;
+        if (!counter || !(packet[3] & 0x10)) return; // Only packets with a payload advance the counter
+        uint8_t& flags = chunk[chunk.size() - PACKET + 3];
+        flags = static_cast<uint8_t>((flags & 0xF0) | *counter);
+        *counter = (*counter + 1) & 0x0F;
+    }
+
+    void Emit(const TsChunkSink& sink) {
+        if (chunk.empty()) return;
+        sink(chunk.data(), chunk.size(), chunkKeyframe);
+        chunk.clear();
+        chunkKeyframe = false;
+    }
+
+    // Start of the section in a packet's payload, past the pointer field; nullptr if it does not fit
+    static const uint8_t* Section(const uint8_t* packet, size_t payload, size_t& available) {
+        const size_t start = payload + 1 + packet[payload];
+        if (start + 3 > PACKET) return nullptr;
+        const uint8_t* section = packet + start;
+        const size_t length = 3 + (((section[1] & 0x0F) << 8) | section[2]);
+        if (start + length > PACKET || length < 12) return nullptr; // Multi-packet tables are not needed here
+        available = length - 4; // Without the CRC
+        return section;
+    }
+
+    void ReadPat(const uint8_t* packet, size_t payload) {
+        size_t length = 0;
+        const uint8_t* section = Section(packet, payload, length);
+        if (!section || section[0] != 0x00) return;
+        for (size_t at = 8; at + 4 <= length; at += 4) {
+            const int program = (section[at] << 8) | section[at + 1];
+            if (program != 0) { // 0 is the network PID
+                pmtPid = ((section[at + 2] & 0x1F) << 8) | section[at + 3];
+                pat.assign(packet, packet + PACKET);
+                return;
+            }
+        }
+    }
+
+    void ReadPmt(const uint8_t* packet, size_t payload) {
+        size_t length = 0;
+        const uint8_t* section = Section(packet, payload, length);
+        if (!section || section[0] != 0x02) return;
+        const size_t infoLength = ((section[10] & 0x0F) << 8) | section[11];
+        for (size_t at = 12 + infoLength; at + 5 <= length;) {
+            const uint8_t type = section[at];
+            const int pid = ((section[at + 1] & 0x1F) << 8) | section[at + 2];
+            // MPEG-1/2 video, MPEG-4 part 2, H.264, HEVC
+            if (type == 0x01 || type == 0x02 || type == 0x10 || type == 0x1B || type == 0x24) {
+                videoPid = pid;
+                pmt.assign(packet, packet + PACKET);
+                return;
+            }
+            at += 5 + (((section[at + 3] & 0x0F) << 8) | section[at + 4]);
+        }
+    }
+
+    size_t maxChunk = 64 * 1024;
+    uint8_t partial[PACKET];
+    size_t partialBytes = 0;
+    std::vector<uint8_t> chunk;
+    bool chunkKeyframe = false;
+    std::vector<uint8_t> pat, pmt;
+    int pmtPid = -1;
+    int videoPid = -1;
+    uint8_t patCounter = 0, pmtCounter = 0; // Next continuity_counter for the PAT and PMT PIDs
+    uint64_t packets = 0, keyframes = 0, resyncs = 0;
+};
@@ -0,0 +1,347 @@
+// VideoEncoder.h
+// In-process H.264 encoding. The caller decides frame by frame which frames
+// are IDRs (see KeyframeControl.h); the ffmpeg command line only takes a fixed
+// GOP length.
+//   VideoEncoder       - interface: NV12 frames in, Annex B access units out,
+//                        each frame optionally forced to an IDR
+//   LibavH264Encoder   - libx264 through libavcodec; needs HAVE_LIBAVCODEC. Its
+//                        own keyint is unlimited and scene cuts are off, so IDRs
+//                        come only from the caller. SPS and PPS are repeated in
+//                        front of every IDR, so a receiver can start at any of them.
+//   OpenH264Encoder    - Cisco's OpenH264; needs HAVE_OPENH264. Codes temporal
+//                        layers (temporalLayers) and tags each packet with its
+//                        layer; no lookahead or B-frames, no intra refresh.
+//   H264NalTypes       - the NAL unit types in an Annex B access unit
+// Intra refresh (intraRefreshFrames) replaces periodic IDRs with a column of
+// intra blocks that sweeps the picture once per period. Every frame then
+// costs about the same, where an IDR is several times an average frame and
+// arrives on the uplink as a burst. A decoder joining mid-stream has a clean
+// picture once a full sweep has passed (the recovery point SEI marks where
+// each sweep starts). Forced IDRs still work in this mode.
+// Temporal layers: with 2, every other frame is at layer 1; with 3, the pattern
+// is 0 2 1 2. A frame references only the latest frame at a lower layer (layer
+// 0 its own chain), so a sender that falls behind can drop the top layer and
+// halve the frame rate without breaking the stream (see FrameQueue.h).
+// Packets carry the pts of the frame they code, in 100-ns ticks.
+#pragma once
+
+#include "MediaTypes.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+
+#ifdef HAVE_OPENH264
+#include <wels/codec_api.h>
+#endif
+
+#ifdef HAVE_LIBAVCODEC
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/error.h>
+#include <libavutil/opt.h>
+}
+#endif
+
+struct VideoEncoderConfig {
+    uint32_t width = 640;
+    uint32_t height = 360;
+    uint32_t fps = 30;
+    uint32_t bitrate = 1000000;    // Bits per second
+    uint32_t bufferMs = 5000;      // VBV buffer, as ffmpeg's -bufsize
+    uint32_t maxBitrate = 0;       // VBV peak rate, as -maxrate; 0: none, and then x264 ignores the buffer
+    uint32_t intraRefreshFrames = 0; // Period of the intra refresh sweep; 0: off
+    uint32_t temporalLayers = 1;   // OpenH264Encoder only, up to 4; libx264 codes one layer
+    std::string preset = "faster";
+    bool zeroLatency = false;      // No lookahead or B-frames: each frame comes out as it goes in
+};
+
+// One encoded access unit. data is only valid during the sink callback.
+struct EncodedVideoPacket {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    int64_t pts = 0; // 100-ns ticks
+    bool keyframe = false;
+    uint32_t temporalLayer = 0;
+};
+
+typedef std::function<void(const EncodedVideoPacket&)> VideoPacketSink;
+
+// NAL unit types in one Annex B access unit, in order (5: IDR slice, 6: SEI, 7: SPS, 8: PPS)
+inline std::vector<int> H264NalTypes(const uint8_t* data, size_t size) {
+    std::vector<int> types;
+    for (size_t i = 0; i + 3 < size; ++i) {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+            types.push_back(data[i + 3] & 0x1F);
+            i += 2;
+        }
+    }
+    return types;
+}
+
+class VideoEncoder {
+public:
+    virtual ~VideoEncoder() = default;
+    virtual bool Open(const VideoEncoderConfig& config) = 0;
+    // Encode one NV12 frame at config's size; idr forces it to be an IDR
+    virtual bool Encode(const VideoFrame& frame, bool idr, const VideoPacketSink& sink) = 0;
+    // Drain delayed output at end of stream
+    virtual bool Flush(const VideoPacketSink& sink) = 0;
+    virtual void Close() = 0;
+    virtual const char* Name() const = 0;
+};
+
+#ifdef HAVE_LIBAVCODEC
+
+class LibavH264Encoder : public VideoEncoder {
+public:
+    ~LibavH264Encoder() override { Close(); }
+
+    bool Open(const VideoEncoderConfig& encoderConfig) override {
+        Close();
+        config = encoderConfig;
+        const AVCodec* codec = avcodec_find_encoder_by_name("libx264");
+        if (!codec) {
+            printf("This libavcodec has no libx264.\n");
+            return false;
+        }
+        context = avcodec_alloc_context3(codec);
+        if (!context) return false;
+        context->width = static_cast<int>(config.width);
+        context->height = static_cast<int>(config.height);
+        context->pix_fmt = AV_PIX_FMT_NV12;
+        context->time_base = AVRational{ 1, static_cast<int>(config.fps) };
+        context->framerate = AVRational{ static_cast<int>(config.fps), 1 };
+        context->bit_rate = config.bitrate;
+        context->rc_max_rate = config.maxBitrate;
+        context->rc_buffer_size = static_cast<int>(static_cast<int64_t>(config.bitrate) * config.bufferMs / 1000);
+        // x264's keyint: "infinite", so the caller places every IDR; with intra refresh, the sweep's period
+        context->gop_size = config.intraRefreshFrames ? static_cast<int>(config.intraRefreshFrames) : 1 << 30;
+        if (config.intraRefreshFrames) av_opt_set_int(context->priv_data, "intra-refresh", 1, 0);
+        av_opt_set(context->priv_data, "preset", config.preset.c_str(), 0);
+        if (config.zeroLatency) av_opt_set(context->priv_data, "tune", "zerolatency", 0);
+        av_opt_set_int(context->priv_data, "forced-idr", 1, 0); // A forced keyframe is an IDR, not an open-GOP I-frame
+        av_opt_set_int(context, "sc_threshold", 0, AV_OPT_SEARCH_CHILDREN); // A codec option or libx264's own, by FFmpeg version
+
+        int result = avcodec_open2(context, codec, nullptr);
+        if (result < 0) {
+            PrintAvError("Failed to open libx264", result);
+            Close();
+            return false;
+        }
+        frame = av_frame_alloc();
+        packet = av_packet_alloc();
+        if (!frame || !packet) {
+            Close();
+            return false;
+        }
+        frame->format = AV_PIX_FMT_NV12;
+        frame->width = context->width;
+        frame->height = context->height;
+        frameCount = 0;
+        name = std::string("libx264 ") + config.preset + (config.zeroLatency ? " zerolatency" : "") +
+               (config.intraRefreshFrames ? " intra-refresh" : "");
+        return true;
+    }
+
+    bool Encode(const VideoFrame& input, bool idr, const VideoPacketSink& sink) override {
+        if (!context || input.width != config.width || input.height != config.height || input.format != PixelFormat::NV12) return false;
+        // The frame is not reference counted, so libavcodec copies the planes in
+        frame->data[0] = const_cast<uint8_t*>(input.planes[0]);
+        frame->data[1] = const_cast<uint8_t*>(input.planes[1]);
+        frame->linesize[0] = static_cast<int>(input.strides[0]);
+        frame->linesize[1] = static_cast<int>(input.strides[1]);
+        frame->pts = static_cast<int64_t>(frameCount++);
+        frame->pict_type = idr ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+        ptsByFrame[frame->pts % PTS_SLOTS] = input.pts;
+        const int result = avcodec_send_frame(context, frame);
+        if (result < 0) {
+            PrintAvError("H.264 encode failed", result);
+            return false;
+        }
+        return Drain(sink);
+    }
+
+    bool Flush(const VideoPacketSink& sink) override {
+        if (!context) return false;
+        avcodec_send_frame(context, nullptr);
+        return Drain(sink);
+    }
+
+    void Close() override {
+        if (packet) av_packet_free(&packet);
+        if (frame) av_frame_free(&frame);
+        if (context) avcodec_free_context(&context);
+    }
+
+    const char* Name() const override { return name.c_str(); }
+
+private:
+    static const int64_t PTS_SLOTS = 256; // More frames than x264 ever holds back
+
+    static void PrintAvError(const char* message, int error) {
+        char text[AV_ERROR_MAX_STRING_SIZE] = {};
+        av_strerror(error, text, sizeof(text));
+        printf("%s: %s\n", message, text);
+    }
+
+    bool Drain(const VideoPacketSink& sink) {
+        for (;;) {
+            const int result = avcodec_receive_packet(context, packet);
+            if (result == AVERROR(EAGAIN) || result == AVERROR_EOF) return true;
+            if (result < 0) {
+                PrintAvError("H.264 encode failed", result);
+                return false;
+            }
+            EncodedVideoPacket out;
+            out.data = packet->data;
+            out.size = static_cast<size_t>(packet->size);
+            out.pts = ptsByFrame[packet->pts % PTS_SLOTS];
+            out.keyframe = (packet->flags & AV_PKT_FLAG_KEY) != 0;
+            sink(out);
+            av_packet_unref(packet);
+        }
+    }
+
+    VideoEncoderConfig config;
+    AVCodecContext* context = nullptr;
+    AVFrame* frame = nullptr;
+    AVPacket* packet = nullptr;
+    uint64_t frameCount = 0;
+    int64_t ptsByFrame[PTS_SLOTS] = {}; // Capture pts of recent frames, by encoder frame number
+    std::string name;
+};
+
+#endif // HAVE_LIBAVCODEC
+
+#ifdef HAVE_OPENH264
+
+class OpenH264Encoder : public VideoEncoder {
+public:
+    ~OpenH264Encoder() override { Close(); }
+
+    bool Open(const VideoEncoderConfig& encoderConfig) override {
+        Close();
+        config = encoderConfig;
+        if (WelsCreateSVCEncoder(&encoder) != 0 || !encoder) {
+            printf("Failed to create the OpenH264 encoder.\n");
+            encoder = nullptr;
+            return false;
+        }
+        SEncParamExt params;
+        encoder->GetDefaultParams(&params);
+        params.iUsageType = CAMERA_VIDEO_REAL_TIME;
+        params.iPicWidth = static_cast<int>(config.width);
+        params.iPicHeight = static_cast<int>(config.height);
+        params.iTargetBitrate = static_cast<int>(config.bitrate);
+        params.iMaxBitrate = config.maxBitrate ? static_cast<int>(config.maxBitrate) : UNSPECIFIED_BIT_RATE;
+        params.iRCMode = RC_BITRATE_MODE;
+        params.fMaxFrameRate = static_cast<float>(config.fps);
+        params.iTemporalLayerNum = static_cast<int>(std::min<uint32_t>(std::max<uint32_t>(config.temporalLayers, 1), 4));
+        params.iSpatialLayerNum = 1;
+        params.uiIntraPeriod = 0;               // IDRs only when the caller forces one
+        params.bEnableFrameSkip = false;        // Every frame comes out, so the layer pattern holds
+        params.bEnableSceneChangeDetect = false;
+        params.eSpsPpsIdStrategy = CONSTANT_ID; // The same SPS and PPS in front of every IDR
+        SSpatialLayerConfig& layer = params.sSpatialLayers[0];
+        layer.iVideoWidth = params.iPicWidth;
+        layer.iVideoHeight = params.iPicHeight;
+        layer.fFrameRate = params.fMaxFrameRate;
+        layer.iSpatialBitrate = params.iTargetBitrate;
+        layer.iMaxSpatialBitrate = params.iMaxBitrate;
+        layer.sSliceArgument.uiSliceMode = SM_SINGLE_SLICE;
+        if (encoder->InitializeExt(&params) != cmResultSuccess) {
+            printf("Failed to open OpenH264 at %ux%u.\n", config.width, config.height);
+            Close();
+            return false;
+        }
+        int format = videoFormatI420;
+        encoder->SetOption(ENCODER_OPTION_DATAFORMAT, &format);
+        planar.resize(Frame420Size(config.width, config.height));
+        name = "OpenH264, " + std::to_string(params.iTemporalLayerNum) + " temporal layer" + (params.iTemporalLayerNum > 1 ? "s" : "");
+        return true;
+    }
+
+    bool Encode(const VideoFrame& input, bool idr, const VideoPacketSink& sink) override {
+        if (!encoder || input.width != config.width || input.height != config.height || input.format != PixelFormat::NV12) return false;
+        // OpenH264 takes I420: split NV12's interleaved chroma into two planes
+        const uint32_t chromaWidth = (config.width + 1) / 2;
+        const uint32_t chromaHeight = (config.height + 1) / 2;
+        uint8_t* y = planar.data();
+        uint8_t* u = y + static_cast<size_t>(config.width) * config.height;
+        uint8_t* v = u + static_cast<size_t>(chromaWidth) * chromaHeight;
+        for (uint32_t row = 0; row < config.height; ++row) {
+            memcpy(y + static_cast<size_t>(row) * config.width, input.planes[0] + static_cast<size_t>(row) * input.strides[0], config.width);
+        }
+        for (uint32_t row = 0; row < chromaHeight; ++row) {
+            const uint8_t* uv = input.planes[1] + static_cast<size_t>(row) * input.strides[1];
+            for (uint32_t x = 0; x < chromaWidth; ++x) {
+                u[static_cast<size_t>(row) * chromaWidth + x] = uv[2 * x];
+                v[static_cast<size_t>(row) * chromaWidth + x] = uv[2 * x + 1];
+            }
+        }
+        SSourcePicture picture;
+        memset(&picture, 0, sizeof(picture));
+        picture.iColorFormat = videoFormatI420;
+        picture.iPicWidth = static_cast<int>(config.width);
+        picture.iPicHeight = static_cast<int>(config.height);
+        picture.iStride[0] = static_cast<int>(config.width);
+        picture.iStride[1] = picture.iStride[2] = static_cast<int>(chromaWidth);
+        picture.pData[0] = y;
+        picture.pData[1] = u;
+        picture.pData[2] = v;
+        picture.uiTimeStamp = input.pts / 10000; // ms
+        if (idr) encoder->ForceIntraFrame(true);
+
+        SFrameBSInfo info;
+        memset(&info, 0, sizeof(info));
+        if (encoder->EncodeFrame(&picture, &info) != cmResultSuccess) {
+            printf("OpenH264 encode failed.\n");
+            return false;
+        }
+        if (info.eFrameType == videoFrameTypeSkip || info.eFrameType == videoFrameTypeInvalid) return true;
+        // One access unit: each layer's NAL units are back to back in its buffer
+        accessUnit.clear();
+        uint32_t temporalLayer = 0;
+        for (int i = 0; i < info.iLayerNum; ++i) {
+            const SLayerBSInfo& layer = info.sLayerInfo[i];
+            size_t bytes = 0;
+            for (int n = 0; n < layer.iNalCount; ++n) bytes += static_cast<size_t>(layer.pNalLengthInByte[n]);
+            accessUnit.insert(accessUnit.end(), layer.pBsBuf, layer.pBsBuf + bytes);
+            if (layer.uiLayerType == VIDEO_CODING_LAYER) temporalLayer = layer.uiTemporalId;
+        }
+        EncodedVideoPacket out;
+        out.data = accessUnit.data();
+        out.size = accessUnit.size();
+        out.pts = input.pts;
+        out.keyframe = info.eFrameType == videoFrameTypeIDR;
+        out.temporalLayer = out.keyframe ? 0 : temporalLayer;
+        sink(out);
+        return true;
+    }
+
+    // Nothing is held back
+    bool Flush(const VideoPacketSink&) override { return encoder != nullptr; }
+
+    void Close() override {
+        if (!encoder) return;
+        encoder->Uninitialize();
+        WelsDestroySVCEncoder(encoder);
+        encoder = nullptr;
+    }
+
+    const char* Name() const override { return name.c_str(); }
+
+private:
+    VideoEncoderConfig config;
+    ISVCEncoder* encoder = nullptr;
+    std::vector<uint8_t> planar;     // The frame as I420
+    std::vector<uint8_t> accessUnit; // The frame's NAL units, for the sink
+    std::string name;
+};
+
+#endif // HAVE_OPENH264
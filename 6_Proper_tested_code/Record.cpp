@@ -2,16 +2,25 @@
 #include <stdio.h>
 #include <conio.h>  // For detecting key press on Windows
 #include <time.h>   // For timestamp
+#include <memory>
+
+#include "../14_Pipeline_Modules/ThreadPolicy.h"
 
 #pragma comment(lib, "C:\\gstreamer\\1.0\\msvc_x86_64\\lib\\gstreamer-1.0.lib")
 #pragma comment(lib, "C:\\gstreamer\\1.0\\msvc_x86_64\\lib\\glib-2.0.lib")
 #pragma comment(lib, "C:\\gstreamer\\1.0\\msvc_x86_64\\lib\\gobject-2.0.lib")
 
-GstElement *pipeline, *source, *filter, *enc, *mux, *filesink;
+GstElement *pipeline, *source, *filter, *encode_queue, *enc, *mux, *filesink;
 GstBus *bus;
 gboolean is_recording = FALSE;
 gboolean eos_received = FALSE;
 
+// Streaming threads take the capture or encode role's priority, CPUs and name (thread_policy.txt
+// overrides the defaults); their CPU time and preemptions are printed at exit
+ThreadPolicyTable thread_policies;
+ThreadUsageLog thread_usage;
+thread_local std::unique_ptr<ScopedThreadPolicy> thread_policy;
+
 void get_timestamped_filename(char *filename) {
     time_t now = time(NULL);
     struct tm *t = localtime(&now);
@@ -49,6 +58,36 @@ gboolean on_message(GstBus *bus, GstMessage *message, gpointer user_data) {
     return TRUE;
 }
 
+// GStreamer posts STREAM_STATUS from inside each streaming thread: ENTER as it starts its
+// loop, LEAVE as it stops. The source's thread captures; the encode queue's thread runs
+// x264enc, qtmux and filesink.
+GstBusSyncReply on_sync_message(GstBus *bus, GstMessage *message, gpointer user_data) {
+    if (GST_MESSAGE_TYPE(message) != GST_MESSAGE_STREAM_STATUS) return GST_BUS_PASS;
+    GstStreamStatusType type;
+    GstElement *owner = NULL;
+    gst_message_parse_stream_status(message, &type, &owner);
+    if (type == GST_STREAM_STATUS_TYPE_ENTER) {
+        ThreadRole role = ThreadRole::Io;
+        const char *name = "gst io";
+        if (owner == source) {
+            role = ThreadRole::Capture;
+            name = "gst capture";
+        } else if (owner == encode_queue) {
+            role = ThreadRole::Encode;
+            name = "gst encode";
+        }
+        // A pooled thread gives back its last role first, so the new one starts from the thread's own state
+        thread_policy.reset();
+        thread_policy.reset(new ScopedThreadPolicy(role, thread_policies, name, &thread_usage));
+        if (!thread_policy->Refused().empty()) {
+            printf("[LOG] %s thread policy refused: %s\n", name, thread_policy->Refused().c_str());
+        }
+    } else if (type == GST_STREAM_STATUS_TYPE_LEAVE) {
+        thread_policy.reset();
+    }
+    return GST_BUS_PASS;
+}
+
 void start_recording() {
     if (!is_recording) {
         gst_element_set_state(pipeline, GST_STATE_NULL);
@@ -115,11 +154,13 @@ void init_gstreamer_pipeline() {
     }
 
     filter = gst_element_factory_make("capsfilter", "filter");
+    // A thread of its own for encoding, so the capture thread never waits on x264enc
+    encode_queue = gst_element_factory_make("queue", "encode-queue");
     enc = gst_element_factory_make("x264enc", "h264-encoder");
     mux = gst_element_factory_make("qtmux", "qt-muxer");
     filesink = gst_element_factory_make("filesink", "file-output");
 
-    if (!pipeline || !source || !filter || !enc || !mux || !filesink) {
+    if (!pipeline || !source || !filter || !encode_queue || !enc || !mux || !filesink) {
         printf("[ERROR] Failed to create elements.\n");
         return;
     }
@@ -128,15 +169,17 @@ void init_gstreamer_pipeline() {
     g_object_set(G_OBJECT(filter), "caps", caps, NULL);
     gst_caps_unref(caps);
 
-    gst_bin_add_many(GST_BIN(pipeline), source, filter, enc, mux, filesink, NULL);
+    gst_bin_add_many(GST_BIN(pipeline), source, filter, encode_queue, enc, mux, filesink, NULL);
 
-    if (!gst_element_link_many(source, filter, enc, mux, filesink, NULL)) {
+    if (!gst_element_link_many(source, filter, encode_queue, enc, mux, filesink, NULL)) {
         g_printerr("[ERROR] Failed to link elements in the pipeline.\n");
         gst_object_unref(pipeline);
         return;
     }
 
+    LoadThreadPolicies("thread_policy.txt", thread_policies);
     bus = gst_element_get_bus(pipeline);
+    gst_bus_set_sync_handler(bus, (GstBusSyncHandler)on_sync_message, NULL, NULL);
     gst_bus_add_watch(bus, (GstBusFunc)on_message, NULL);
 }
 
@@ -173,6 +216,8 @@ int main(int argc, char *argv[]) {
 
     printf("[LOG] Cleaning up...\n");
     gst_element_set_state(pipeline, GST_STATE_NULL);
+    printf("[LOG] Streaming threads:\n");
+    thread_usage.Print(stdout);
     gst_object_unref(pipeline);
     gst_object_unref(bus);
     printf("[LOG] Application terminated.\n");